@@ -0,0 +1,275 @@
+/**
+ * Measures cradle's own overhead on synthetic projects.
+ *
+ * Each benchmark generates a project of static libraries whose sources include a number of the library's
+ * headers, builds cradle for it and times four builds: a full build, a null build, a build after editing
+ * one source and a build after editing one header. The generated builds run with `--trace`, so the time
+ * in which no compiler, archiver or linker was running is reported separately as cradle's overhead.
+ *
+ * Options:
+ *  - `--libs=N`: The number of static libraries. Defaults to one per 100 sources.
+ *  - `--headers=N`: The number of headers in each library. Defaults to 16.
+ *  - `--fan-in=N`: The number of the library's headers each source includes. Defaults to 8.
+ *  - `--jobs=N`: Passed to the generated builds as `-j N`.
+ *
+ * Results are also appended as lines of JSON to `build/bench_results.json`.
+ */
+
+#include <cradle.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace cradle;
+
+struct BenchmarkOptions {
+	int sources;
+	int libs;
+	int headers;
+	int fanIn;
+};
+
+struct BenchmarkResult {
+	double wallSeconds = 0;
+
+	// The time in which at least one command was running.
+	double toolSeconds = 0;
+
+	// CPU time used by cradle itself rather than the commands it ran.
+	double cradleCpuSeconds = 0;
+
+	std::size_t commands = 0;
+};
+
+int intOption(const std::string& name, int defaultValue) {
+	std::string value = options().get(name);
+	return value.empty() ? defaultValue : std::stoi(value);
+}
+
+std::string libName(int lib) {
+	return "lib" + std::to_string(lib);
+}
+
+/**
+ * Writes the sources, headers and build configuration of the project to `dir`.
+ */
+bool generate(const std::string& dir, const BenchmarkOptions& bench) {
+	bool ok = io::write_file(io::path_concat(dir, "common.hpp"), "#pragma once\n\n#define COMMON 1\n");
+
+	for (int lib = 0; lib < bench.libs; lib++) {
+		std::string name = libName(lib);
+		std::string libDir = io::path_concat(dir, name);
+		io::mkdirs(libDir);
+
+		for (int h = 0; h < bench.headers; h++) {
+			std::string function = name + "_h" + std::to_string(h);
+			ok = ok && io::write_file(
+				io::path_concat(libDir, "h" + std::to_string(h) + ".hpp"),
+				"#pragma once\n\n#include \"common.hpp\"\n\ninline int " + function + "(int x) { return x * " + std::to_string(h + 2) + " + COMMON; }\n"
+			);
+		}
+
+		// Sources are spread evenly over the libraries.
+		int count = bench.sources / bench.libs + (lib < bench.sources % bench.libs ? 1 : 0);
+		for (int s = 0; s < count; s++) {
+			std::string contents;
+			std::string body = "x + " + std::to_string(s);
+			for (int i = 0; i < bench.fanIn; i++) {
+				int h = (s + i) % bench.headers;
+				contents += "#include \"" + name + "/h" + std::to_string(h) + ".hpp\"\n";
+				body += " + " + name + "_h" + std::to_string(h) + "(x)";
+			}
+			contents += "\nint " + name + "_src" + std::to_string(s) + "(int x) { return " + body + "; }\n";
+			ok = ok && io::write_file(io::path_concat(libDir, "src" + std::to_string(s) + ".cpp"), contents);
+		}
+	}
+
+	std::string declarations;
+	std::string calls = "0";
+	for (int lib = 0; lib < bench.libs; lib++) {
+		declarations += "int " + libName(lib) + "_src0(int x);\n";
+		calls += " + " + libName(lib) + "_src0(1)";
+	}
+	io::mkdirs(io::path_concat(dir, "main"));
+	ok = ok && io::write_file(
+		io::path_concat(dir, "main/main.cpp"),
+		"#include <cstdio>\n\n" + declarations + "\nint main() {\n\tstd::printf(\"%d\\n\", " + calls + ");\n}\n"
+	);
+
+	std::string config = "#include <cradle.hpp>\n\nusing namespace cradle;\n\nbuild_config {\n";
+	for (int lib = 0; lib < bench.libs; lib++) {
+		config += "\tauto " + libName(lib) + " = cpp::static_lib()\n";
+		config += "\t\t\t.name(\"" + libName(lib) + "\")\n";
+		config += "\t\t\t.sourceFiles(io::FILE_LIST, io::files(\"" + libName(lib) + "\", \".*\\\\.cpp\"))\n";
+		config += "\t\t\t.includeSearchDirs({\".\"})\n";
+		config += "\t\t\t.build();\n\n";
+	}
+	config += "\tcpp::exe()\n";
+	config += "\t\t\t.name(\"app\")\n";
+	config += "\t\t\t.sourceFiles(io::FILE_LIST, io::files(\"main\", \".*\\\\.cpp\"))\n";
+	config += "\t\t\t.includeSearchDirs({\".\"})\n";
+	for (int lib = 0; lib < bench.libs; lib++) {
+		config += "\t\t\t.linkLibrary(cpp::LIBRARY_NAME, " + libName(lib) + ")\n";
+		config += "\t\t\t.linklibrarySearchPath(cpp::LIBRARY_PATH, " + libName(lib) + ")\n";
+	}
+	config += "\t\t\t.build();\n}\n";
+	return ok && io::write_file(io::path_concat(dir, "build.cpp"), config);
+}
+
+/**
+ * Runs `cmd` in `dir` and logs its output if it fails.
+ */
+bool runIn(const std::string& dir, const std::string& cmd, platform::ProcessResult& result) {
+	platform::ProcessOptions processOptions;
+	processOptions.workingDirectory = dir;
+	result = platform::runProcess(platform::commandArgs(cmd), processOptions);
+	if (!result.succeeded()) {
+		log_error("Failed: " + cmd);
+		log(result.output + result.errors);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Reads what the build spent its time on from the trace it wrote.
+ */
+bool readTrace(const std::string& traceFile, BenchmarkResult& bench) {
+	std::string contents;
+	if (!io::read_file(traceFile, contents)) {
+		return false;
+	}
+
+	std::vector<std::pair<double, double>> intervals;
+	double toolCpuSeconds = 0;
+	json::Value trace = json::parse(contents);
+	for (auto& event : trace["traceEvents"].asArray()) {
+		if (event["cat"].asString() != "process") {
+			continue;
+		}
+		double begin = event["ts"].asNumber() / 1e6;
+		intervals.push_back(std::make_pair(begin, begin + event["dur"].asNumber() / 1e6));
+		toolCpuSeconds += event["args"]["userSeconds"].asNumber() + event["args"]["systemSeconds"].asNumber();
+	}
+	bench.commands = intervals.size();
+	bench.cradleCpuSeconds -= toolCpuSeconds;
+
+	// The length of the union of the intervals in which commands ran.
+	std::sort(intervals.begin(), intervals.end());
+	double end = 0;
+	for (auto& interval : intervals) {
+		if (interval.second <= end) {
+			continue;
+		}
+		bench.toolSeconds += interval.second - std::max(interval.first, end);
+		end = interval.second;
+	}
+	return true;
+}
+
+bool measure(const std::string& dir, const std::string& scenario, const BenchmarkOptions& options, BenchmarkResult& bench) {
+	std::string traceFile = io::path_concat(dir, "trace.json");
+	std::string cmd = "\"" + io::path_concat(dir, "cradle") + "\" --trace=\"" + traceFile + "\"";
+	int jobs = intOption("jobs", 0);
+	if (jobs > 0) {
+		cmd += " -j " + std::to_string(jobs);
+	}
+
+	platform::ProcessResult result;
+	if (!runIn(dir, cmd + " app", result)) {
+		return false;
+	}
+
+	// The resource usage of cradle includes the commands it waited for.
+	bench.wallSeconds = result.wallSeconds;
+	bench.cradleCpuSeconds = result.userSeconds + result.systemSeconds;
+	if (!readTrace(traceFile, bench)) {
+		log_error("Unable to read " + traceFile);
+		return false;
+	}
+
+	char line[160];
+	std::snprintf(
+		line, sizeof(line), "%-16s %9.2fs %9.2fs %9.2fs %9.2fs %9zu",
+		scenario.c_str(), bench.wallSeconds, bench.toolSeconds, bench.wallSeconds - bench.toolSeconds,
+		bench.cradleCpuSeconds, bench.commands
+	);
+	log(line);
+
+	std::string record = "{\"sources\": " + std::to_string(options.sources);
+	record += ", \"libs\": " + std::to_string(options.libs);
+	record += ", \"headers\": " + std::to_string(options.headers);
+	record += ", \"fanIn\": " + std::to_string(options.fanIn);
+	record += ", \"scenario\": " + json::quote(scenario);
+	record += ", \"wallSeconds\": " + std::to_string(bench.wallSeconds);
+	record += ", \"toolSeconds\": " + std::to_string(bench.toolSeconds);
+	record += ", \"overheadSeconds\": " + std::to_string(bench.wallSeconds - bench.toolSeconds);
+	record += ", \"cradleCpuSeconds\": " + std::to_string(bench.cradleCpuSeconds);
+	record += ", \"commands\": " + std::to_string(bench.commands) + "}\n";
+	io::append_file(io::path_concat(DEFAULT_BUILD_DIR, "bench_results.json"), record);
+	return true;
+}
+
+ExecutionResult benchmark(int sources) {
+	BenchmarkOptions bench;
+	bench.sources = sources;
+	bench.libs = std::max(1, intOption("libs", sources / 100));
+	bench.headers = std::max(1, intOption("headers", 16));
+	bench.fanIn = std::min(bench.headers, intOption("fan-in", 8));
+
+	// The header the benchmark was built with.
+	std::string includes = io::path_concat(io::path_parent(platform::platform_getcwd()), "build/includes");
+	std::string dir = io::path_concat(platform::platform_getcwd(), io::path_concat(DEFAULT_BUILD_DIR, "bench" + std::to_string(sources)));
+	std::string compiler = std::getenv("CXX") != nullptr ? std::getenv("CXX") : "g++";
+
+	log(
+		"Benchmark: " + std::to_string(bench.sources) + " sources in " + std::to_string(bench.libs) + " libraries with " +
+		std::to_string(bench.headers) + " headers each, including " + std::to_string(bench.fanIn) + " headers per source"
+	);
+
+	platform::ProcessResult result;
+	std::string remove = platform::os::is_windows() ? "cmd /c rmdir /s /q \"" + dir + "\"" : "rm -rf \"" + dir + "\"";
+	if (io::exists(dir) && !runIn(".", remove, result)) {
+		return ExecutionResult::FAILURE;
+	}
+	io::invalidateAllStats();
+
+	io::mkdirs(dir);
+	if (!generate(dir, bench)) {
+		log_error("Unable to generate the project in " + dir);
+		return ExecutionResult::FAILURE;
+	}
+	if (!runIn(dir, compiler + " \"" + io::path_concat(dir, "build.cpp") + "\" -I\"" + includes + "\" -std=c++14 -O2 -pthread -o cradle", result)) {
+		return ExecutionResult::FAILURE;
+	}
+
+	char header[160];
+	std::snprintf(header, sizeof(header), "%-16s %10s %10s %10s %10s %9s", "scenario", "wall", "tools", "overhead", "cradle cpu", "commands");
+	log(header);
+
+	BenchmarkResult full, null, source, headerEdit;
+	bool ok =
+		measure(dir, "full build", bench, full) &&
+		measure(dir, "null build", bench, null) &&
+		io::append_file(io::path_concat(dir, "lib0/src0.cpp"), "// Edited\n") &&
+		measure(dir, "edit .cpp", bench, source) &&
+		io::append_file(io::path_concat(dir, "lib0/h0.hpp"), "// Edited\n") &&
+		measure(dir, "edit header", bench, headerEdit);
+	return ok ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+}
+
+build_config {
+	task("bench", [] (Task*) { return benchmark(1000); });
+	task("bench_10k", [] (Task*) { return benchmark(10000); });
+	task("bench_50k", [] (Task*) { return benchmark(50000); });
+
+	// Benchmarks run one after another so they don't compete for CPUs.
+	task("bench_all", [] (Task*) {
+		for (int sources : {1000, 10000, 50000}) {
+			if (benchmark(sources) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+		}
+		return ExecutionResult::SUCCESS;
+	});
+}
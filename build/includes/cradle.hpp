@@ -0,0 +1,11262 @@
+
+/**
+ * @file
+ */
+
+
+/**
+ * @file cradle_task_arena.hpp
+ *
+ * @brief Storage for the tasks of a build.
+ *
+ * Large builds create hundreds of thousands of small tasks. Tasks created with @ref task are allocated,
+ * along with the reference count of their @ref task_p, from large blocks rather than with one heap
+ * allocation each. Every task in the graph has a dense id, so edges between tasks are stored as arrays of
+ * ids and the executors index flat arrays with them instead of hashing pointers. The keys of task
+ * properties are interned to ids as well.
+ *
+ * The arena owns every task with an id until cradle exits or the task is released. Tasks released from the
+ * arena give their ids to tasks adopted later, which keeps the ids dense for tasks that only live for one
+ * execution, e.g. the stand-ins watch mode creates for each rebuild. Such tasks should be allocated on the
+ * heap rather than in the arena, since memory in the arena is only reclaimed when cradle exits.
+ */
+
+
+/**
+ * @file cradle_string_table.hpp
+ *
+ * @brief A compact table for interning strings such as paths.
+ */
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace detail {
+
+/**
+ * 64-bit FNV-1a.
+ */
+uint64_t hashString(const char* data, std::size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * Interns strings, giving each distinct string a dense id in the order it was first added.
+ *
+ * The strings are stored back to back in a single buffer and found through an open addressing hash table
+ * of ids, so interning many strings costs only a handful of allocations.
+ */
+class StringTable {
+	std::string data_;
+	std::vector<std::pair<std::size_t, uint32_t>> spans_;
+	std::vector<uint64_t> hashes_;
+
+	// Holds `id + 1` for occupied slots and 0 for empty ones. The size is always a power of two.
+	std::vector<uint32_t> slots_;
+
+	bool equals(uint32_t id, const char* s, std::size_t length) const {
+		return spans_[id].second == length && std::memcmp(data_.data() + spans_[id].first, s, length) == 0;
+	}
+
+	/**
+	 * @return The slot holding `s` or the empty slot where it would be inserted.
+	 */
+	std::size_t slotOf(uint64_t hash, const char* s, std::size_t length) const {
+		std::size_t mask = slots_.size() - 1;
+		std::size_t slot = static_cast<std::size_t>(hash) & mask;
+		while (slots_[slot] != 0) {
+			uint32_t id = slots_[slot] - 1;
+			if (hashes_[id] == hash && equals(id, s, length)) {
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	void rehash(std::size_t slotCount) {
+		slots_.assign(slotCount, 0);
+		std::size_t mask = slotCount - 1;
+		for (uint32_t id = 0; id < spans_.size(); id++) {
+			std::size_t slot = static_cast<std::size_t>(hashes_[id]) & mask;
+			while (slots_[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			slots_[slot] = id + 1;
+		}
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	StringTable() : slots_(16, 0) {}
+
+	/**
+	 * Prepare for a total of `count` strings taking up `bytes` bytes.
+	 */
+	void reserve(std::size_t count, std::size_t bytes) {
+		data_.reserve(bytes);
+		spans_.reserve(count);
+		hashes_.reserve(count);
+
+		std::size_t slotCount = slots_.size();
+		while (slotCount < 2 * count) {
+			slotCount *= 2;
+		}
+		if (slotCount != slots_.size()) {
+			rehash(slotCount);
+		}
+	}
+
+	/**
+	 * @return The id of `s`, adding it to the table if necessary.
+	 */
+	uint32_t intern(const char* s, std::size_t length) {
+		uint64_t hash = hashString(s, length);
+		std::size_t slot = slotOf(hash, s, length);
+		if (slots_[slot] != 0) {
+			return slots_[slot] - 1;
+		}
+
+		uint32_t id = static_cast<uint32_t>(spans_.size());
+		spans_.push_back(std::make_pair(data_.size(), static_cast<uint32_t>(length)));
+		hashes_.push_back(hash);
+		data_.append(s, length);
+		slots_[slot] = id + 1;
+
+		// Keep the table at most half full.
+		if (2 * spans_.size() > slots_.size()) {
+			rehash(2 * slots_.size());
+		}
+		return id;
+	}
+
+	uint32_t intern(const std::string& s) {
+		return intern(s.data(), s.size());
+	}
+
+	/**
+	 * @return The id of `s` or `NONE` if it was never interned.
+	 */
+	uint32_t find(const std::string& s) const {
+		std::size_t slot = slotOf(hashString(s.data(), s.size()), s.data(), s.size());
+		return slots_[slot] == 0 ? NONE : slots_[slot] - 1;
+	}
+
+	std::string get(uint32_t id) const {
+		return data_.substr(spans_[id].first, spans_[id].second);
+	}
+
+	std::size_t size() const {
+		return spans_.size();
+	}
+};
+
+const uint32_t StringTable::NONE;
+
+} // namespace detail
+} // namespace cradle
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+class Task;
+typedef std::shared_ptr<Task> task_p;
+
+namespace detail {
+
+/**
+ * Hands out memory from large blocks. Memory is only released when the arena is destroyed.
+ */
+class Arena {
+	static const std::size_t BLOCK_SIZE = 256 * 1024;
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* next = nullptr;
+	std::size_t remaining = 0;
+
+	static std::size_t paddingFor(const char* p, std::size_t alignment) {
+		return (alignment - reinterpret_cast<std::uintptr_t>(p) % alignment) % alignment;
+	}
+
+public:
+	void* allocate(std::size_t size, std::size_t alignment) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::size_t padding = paddingFor(next, alignment);
+		if (next == nullptr || padding + size > remaining) {
+			std::size_t blockSize = std::max(BLOCK_SIZE, size + alignment);
+			blocks.emplace_back(new char[blockSize]);
+			next = blocks.back().get();
+			remaining = blockSize;
+			padding = paddingFor(next, alignment);
+		}
+
+		char* result = next + padding;
+		next += padding + size;
+		remaining -= padding + size;
+		return result;
+	}
+};
+
+const std::size_t Arena::BLOCK_SIZE;
+
+/**
+ * Allocates from an @ref Arena. Deallocating does nothing.
+ */
+template <typename T>
+class ArenaAllocator {
+	template <typename U>
+	friend class ArenaAllocator;
+
+	Arena* arena;
+
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(std::size_t n) {
+		return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, std::size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {
+		return arena == other.arena;
+	}
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const {
+		return arena != other.arena;
+	}
+};
+
+/**
+ * Allocates tasks and maps ids to them.
+ *
+ * Tasks are stored in chunks that never move, so a task can be looked up by id while other threads add
+ * tasks, e.g. from configuring tasks that create their followers.
+ */
+class TaskArena {
+	static const std::size_t CHUNK_BITS = 12;
+	static const std::size_t CHUNK_SIZE = std::size_t(1) << CHUNK_BITS;
+	static const std::size_t MAX_CHUNKS = 4096;
+
+	Arena memory;
+
+	std::mutex mutex;
+	std::atomic<std::size_t> size_{0};
+	std::unique_ptr<std::atomic<task_p*>[]> chunks;
+
+	// Ids of released tasks, which are given to tasks adopted later.
+	std::vector<uint32_t> freeIds;
+
+	task_p& slot(std::size_t index) const {
+		return chunks[index >> CHUNK_BITS].load(std::memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	TaskArena() : chunks(new std::atomic<task_p*>[MAX_CHUNKS]) {
+		for (std::size_t i = 0; i < MAX_CHUNKS; i++) {
+			chunks[i].store(nullptr);
+		}
+	}
+
+	/**
+	 * Creates a task of type `T` in the arena. It doesn't have an id until it is adopted.
+	 */
+	template <typename T, typename... Args>
+	std::shared_ptr<T> create(Args&&... args) {
+		return std::allocate_shared<T>(ArenaAllocator<T>(memory), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Gives `t` an id, storing it in `id`, unless `id` already holds one. The arena keeps `t` alive from then
+	 * on.
+	 *
+	 * @return The id of `t`.
+	 */
+	uint32_t adopt(const task_p& t, std::atomic<uint32_t>& id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (id.load(std::memory_order_relaxed) != NONE) {
+			return id.load(std::memory_order_relaxed);
+		}
+
+		if (!freeIds.empty()) {
+			uint32_t reused = freeIds.back();
+			freeIds.pop_back();
+			slot(reused) = t;
+			id.store(reused, std::memory_order_release);
+			return reused;
+		}
+
+		std::size_t index = size_.load(std::memory_order_relaxed);
+		std::size_t chunk = index >> CHUNK_BITS;
+		if (chunk >= MAX_CHUNKS) {
+			throw std::runtime_error("Too many tasks.");
+		}
+		if (chunks[chunk].load(std::memory_order_relaxed) == nullptr) {
+			chunks[chunk].store(new task_p[CHUNK_SIZE], std::memory_order_release);
+		}
+		chunks[chunk].load(std::memory_order_relaxed)[index & (CHUNK_SIZE - 1)] = t;
+
+		size_.store(index + 1, std::memory_order_release);
+		id.store(static_cast<uint32_t>(index), std::memory_order_release);
+		return static_cast<uint32_t>(index);
+	}
+
+	/**
+	 * Drops the arena's reference to the task whose id is in `id`, if any, and resets `id`. The id is given to
+	 * the next task adopted. Must not be called while tasks execute or while any task or graph still refers
+	 * to the released task by its id.
+	 */
+	void release(std::atomic<uint32_t>& id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		uint32_t released = id.load(std::memory_order_relaxed);
+		if (released == NONE) {
+			return;
+		}
+
+		slot(released).reset();
+		freeIds.push_back(released);
+		id.store(NONE, std::memory_order_release);
+	}
+
+	const task_p& get(uint32_t id) const {
+		return slot(id);
+	}
+
+	/**
+	 * @return One more than the largest id given to a task, including released ones.
+	 */
+	std::size_t size() const {
+		return size_.load(std::memory_order_acquire);
+	}
+};
+
+const std::size_t TaskArena::CHUNK_BITS;
+const std::size_t TaskArena::CHUNK_SIZE;
+const std::size_t TaskArena::MAX_CHUNKS;
+const uint32_t TaskArena::NONE;
+
+/**
+ * The arena is never destroyed, since tasks may be referenced by other objects with static storage
+ * duration until the very end of the program.
+ */
+TaskArena& taskArena() {
+	static TaskArena* instance = new TaskArena();
+	return *instance;
+}
+
+/**
+ * Interns the keys of task properties.
+ *
+ * Every executing task reads properties, so looking up a key doesn't take a lock: keys are only ever
+ * added, and readers probe an index that is replaced rather than modified when it grows. Adding a key is
+ * serialized by a mutex.
+ */
+class PropertyKeys {
+	struct Key {
+		uint64_t hash;
+		uint32_t id;
+		std::string name;
+	};
+
+	// Open addressing over the keys, at most half full. The size is always a power of two.
+	struct Index {
+		std::size_t mask;
+		std::unique_ptr<std::atomic<const Key*>[]> slots;
+
+		explicit Index(std::size_t slotCount) : mask(slotCount - 1), slots(new std::atomic<const Key*>[slotCount]) {
+			for (std::size_t i = 0; i < slotCount; i++) {
+				slots[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		 * @return The key with `name` or the empty slot where it would be inserted.
+		 */
+		std::atomic<const Key*>& slotOf(uint64_t hash, const std::string& name) const {
+			std::size_t slot = static_cast<std::size_t>(hash) & mask;
+			while (true) {
+				const Key* key = slots[slot].load(std::memory_order_acquire);
+				if (key == nullptr || (key->hash == hash && key->name == name)) {
+					return slots[slot];
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	};
+
+	std::mutex mutex;
+
+	// Never moves its elements, so the index may point into it.
+	std::deque<Key> keys;
+
+	// Indexes that were replaced are kept, since readers may still be probing them.
+	std::vector<std::unique_ptr<Index>> indexes;
+	std::atomic<const Index*> index;
+
+	void grow() {
+		indexes.emplace_back(new Index(2 * (index.load(std::memory_order_relaxed)->mask + 1)));
+		for (auto& key : keys) {
+			indexes.back()->slotOf(key.hash, key.name).store(&key, std::memory_order_relaxed);
+		}
+		index.store(indexes.back().get(), std::memory_order_release);
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	PropertyKeys() {
+		indexes.emplace_back(new Index(64));
+		index.store(indexes.back().get(), std::memory_order_release);
+	}
+
+	uint32_t intern(const std::string& name) {
+		uint32_t id = find(name);
+		if (id != NONE) {
+			return id;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		uint64_t hash = hashString(name.data(), name.size());
+		if (2 * (keys.size() + 1) > index.load(std::memory_order_relaxed)->mask + 1) {
+			grow();
+		}
+
+		std::atomic<const Key*>& slot = index.load(std::memory_order_relaxed)->slotOf(hash, name);
+		if (slot.load(std::memory_order_relaxed) != nullptr) {
+			return slot.load(std::memory_order_relaxed)->id;
+		}
+		keys.push_back(Key{hash, static_cast<uint32_t>(keys.size()), name});
+		slot.store(&keys.back(), std::memory_order_release);
+		return keys.back().id;
+	}
+
+	/**
+	 * @return The id of `name` or `NONE` if no task has a property with this key.
+	 */
+	uint32_t find(const std::string& name) const {
+		uint64_t hash = hashString(name.data(), name.size());
+		const Key* key = index.load(std::memory_order_acquire)->slotOf(hash, name).load(std::memory_order_acquire);
+		return key == nullptr ? NONE : key->id;
+	}
+
+	std::string name(uint32_t id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return keys[id].name;
+	}
+};
+
+const uint32_t PropertyKeys::NONE;
+
+PropertyKeys& propertyKeys() {
+	static PropertyKeys instance;
+	return instance;
+}
+
+} // namespace detail
+
+/**
+ * The key of a task property, interned once when it is created so that tasks look it up by id instead of
+ * hashing it. Used for the keys cradle defines; it is a string wherever one is expected.
+ */
+class PropertyKey : public std::string {
+	uint32_t id_;
+
+public:
+	explicit PropertyKey(const char* name) : std::string(name), id_(detail::propertyKeys().intern(*this)) {}
+
+	uint32_t id() const { return id_; }
+};
+
+} // namespace cradle
+/**
+ * @file cradle_trace.hpp
+ *
+ * @brief Records when each task and command ran in the Chrome trace event format.
+ *
+ * The file written by @ref Trace::write can be loaded in Perfetto (ui.perfetto.dev) or `chrome://tracing`.
+ * Every thread that executes tasks gets its own lane. Tasks are drawn as slices on their lane and the
+ * commands they run as slices nested inside them, with the command line, exit status and resource usage
+ * of the command as arguments.
+ */
+
+
+/**
+ * @file cradle_json.hpp
+ *
+ * @brief A minimal JSON reader and writing helpers for the files produced and consumed by tools.
+ */
+
+
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cradle {
+namespace json {
+
+class Value {
+public:
+	enum class Type {
+		NUL,
+		BOOLEAN,
+		NUMBER,
+		STRING,
+		ARRAY,
+		OBJECT
+	};
+
+private:
+	Type type_;
+	bool boolean_;
+	double number_;
+	std::string string_;
+	std::vector<Value> array_;
+	std::map<std::string, Value> object_;
+
+	static const Value& null() {
+		static const Value value;
+		return value;
+	}
+
+public:
+	Value() : type_(Type::NUL), boolean_(false), number_(0) {}
+	explicit Value(bool b) : type_(Type::BOOLEAN), boolean_(b), number_(0) {}
+	explicit Value(double n) : type_(Type::NUMBER), boolean_(false), number_(n) {}
+	explicit Value(std::string s) : type_(Type::STRING), boolean_(false), number_(0), string_(std::move(s)) {}
+	explicit Value(std::vector<Value> a) : type_(Type::ARRAY), boolean_(false), number_(0), array_(std::move(a)) {}
+	explicit Value(std::map<std::string, Value> o) : type_(Type::OBJECT), boolean_(false), number_(0), object_(std::move(o)) {}
+
+	Type type() const { return type_; }
+	bool isNull() const { return type_ == Type::NUL; }
+	bool isString() const { return type_ == Type::STRING; }
+	bool isNumber() const { return type_ == Type::NUMBER; }
+	bool isArray() const { return type_ == Type::ARRAY; }
+	bool isObject() const { return type_ == Type::OBJECT; }
+
+	bool asBool() const { return boolean_; }
+	double asNumber() const { return number_; }
+	const std::string& asString() const { return string_; }
+	const std::vector<Value>& asArray() const { return array_; }
+	const std::map<std::string, Value>& asObject() const { return object_; }
+
+	bool has(const std::string& key) const {
+		return object_.find(key) != object_.end();
+	}
+
+	/**
+	 * @return The member with the given key or a null value if this isn't an object with that key.
+	 */
+	const Value& operator[](const std::string& key) const {
+		auto it = object_.find(key);
+		return it == object_.end() ? null() : it->second;
+	}
+};
+
+namespace detail {
+
+class Parser {
+	const std::string& text;
+	std::size_t pos;
+
+	[[noreturn]] void error(const std::string& msg) {
+		throw std::runtime_error("Error parsing JSON at offset " + std::to_string(pos) + ": " + msg);
+	}
+
+	void skipWhitespace() {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+			pos++;
+		}
+	}
+
+	bool consume(const char* literal) {
+		std::size_t length = std::char_traits<char>::length(literal);
+		if (text.compare(pos, length, literal) == 0) {
+			pos += length;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char c) {
+		skipWhitespace();
+		if (pos >= text.size() || text[pos] != c) {
+			error(std::string("Expected '") + c + "'");
+		}
+		pos++;
+	}
+
+	static void appendUtf8(std::string& out, unsigned long codepoint) {
+		if (codepoint < 0x80) {
+			out += static_cast<char>(codepoint);
+		} else if (codepoint < 0x800) {
+			out += static_cast<char>(0xC0 | (codepoint >> 6));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		} else if (codepoint < 0x10000) {
+			out += static_cast<char>(0xE0 | (codepoint >> 12));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		} else {
+			out += static_cast<char>(0xF0 | (codepoint >> 18));
+			out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		}
+	}
+
+	unsigned long parseHex4() {
+		if (pos + 4 > text.size()) {
+			error("Truncated unicode escape");
+		}
+		unsigned long value = std::strtoul(text.substr(pos, 4).c_str(), nullptr, 16);
+		pos += 4;
+		return value;
+	}
+
+	std::string parseString() {
+		expect('"');
+		std::string out;
+		while (true) {
+			if (pos >= text.size()) {
+				error("Unterminated string");
+			}
+
+			char c = text[pos++];
+			if (c == '"') {
+				return out;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+
+			if (pos >= text.size()) {
+				error("Unterminated escape");
+			}
+			switch (text[pos++]) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				unsigned long codepoint = parseHex4();
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u")) {
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (parseHex4() - 0xDC00);
+				}
+				appendUtf8(out, codepoint);
+				break;
+			}
+			default:
+				error("Invalid escape");
+			}
+		}
+	}
+
+	Value parseNumber() {
+		const char* begin = text.c_str() + pos;
+		char* end = nullptr;
+		double value = std::strtod(begin, &end);
+		if (end == begin) {
+			error("Invalid number");
+		}
+		pos += end - begin;
+		return Value(value);
+	}
+
+public:
+	Parser(const std::string& text) : text(text), pos(0) {}
+
+	Value parseValue() {
+		skipWhitespace();
+		if (pos >= text.size()) {
+			error("Unexpected end of input");
+		}
+
+		switch (text[pos]) {
+		case '{': {
+			pos++;
+			std::map<std::string, Value> members;
+			skipWhitespace();
+			if (pos < text.size() && text[pos] == '}') {
+				pos++;
+				return Value(std::move(members));
+			}
+			while (true) {
+				skipWhitespace();
+				std::string key = parseString();
+				expect(':');
+				members[key] = parseValue();
+				skipWhitespace();
+				if (pos < text.size() && text[pos] == ',') {
+					pos++;
+					continue;
+				}
+				expect('}');
+				return Value(std::move(members));
+			}
+		}
+		case '[': {
+			pos++;
+			std::vector<Value> elements;
+			skipWhitespace();
+			if (pos < text.size() && text[pos] == ']') {
+				pos++;
+				return Value(std::move(elements));
+			}
+			while (true) {
+				elements.push_back(parseValue());
+				skipWhitespace();
+				if (pos < text.size() && text[pos] == ',') {
+					pos++;
+					continue;
+				}
+				expect(']');
+				return Value(std::move(elements));
+			}
+		}
+		case '"':
+			return Value(parseString());
+		default:
+			if (consume("true")) return Value(true);
+			if (consume("false")) return Value(false);
+			if (consume("null")) return Value();
+			return parseNumber();
+		}
+	}
+
+	Value parseDocument() {
+		Value value = parseValue();
+		skipWhitespace();
+		if (pos != text.size()) {
+			error("Trailing characters");
+		}
+		return value;
+	}
+};
+
+} // namespace detail
+
+/**
+ * @throws std::runtime_error if `text` is not a valid JSON document.
+ */
+Value parse(const std::string& text) {
+	return detail::Parser(text).parseDocument();
+}
+
+/**
+ * @return `s` as a quoted JSON string.
+ */
+std::string quote(const std::string& s) {
+	static const char* hex = "0123456789abcdef";
+
+	std::string out;
+	out.reserve(s.size() + 2);
+	out += '"';
+	for (char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				out += "\\u00";
+				out += hex[(c >> 4) & 0xF];
+				out += hex[c & 0xF];
+			} else {
+				out += c;
+			}
+		}
+	}
+	out += '"';
+	return out;
+}
+
+} // namespace json
+} // namespace cradle
+/**
+ * @file cradle_process.hpp
+ *
+ * @brief Runs child processes without going through `system()`.
+ *
+ * On POSIX platforms processes are started with `posix_spawnp`, which avoids copying the page tables of a
+ * large cradle process and doesn't need a shell for simple commands. The working directory is changed in
+ * the child only, so processes with different working directories can run concurrently. Output is
+ * collected through pipes so that the output of concurrent processes isn't interleaved, and the exit
+ * status and resource usage are reported with `wait4`.
+ *
+ * On Windows commands are run through `_popen`, which uses the shell.
+ */
+
+
+/**
+ * @file cradle_platform.hpp
+ *
+ * @brief Macros and functions for getting information about the platform that cradle is running on.
+ *
+ * Currently only supports detection of Linux, Mac, and Windows.
+ */
+
+
+#ifdef __APPLE__
+#define PLATFORM_MAC
+#endif
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define PLATFORM_WINDOWS
+#elif defined(__linux__)
+#define PLATFORM_LINUX
+#else
+#error Unsupported platform.
+#endif
+
+
+namespace cradle {
+namespace platform {
+namespace os {
+
+bool is_windows() {
+#ifdef PLATFORM_WINDOWS
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool is_linux() {
+#ifdef PLATFORM_LINUX
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool is_mac() {
+#ifdef PLATFORM_MAC
+	return true;
+#else
+	return false;
+#endif
+}
+
+}
+}
+}
+
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <spawn.h>
+	#include <sys/resource.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+
+	extern char** environ;
+
+	// posix_spawn_file_actions_addchdir_np was added in glibc 2.29.
+	#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+		#define CRADLE_SPAWN_ADDCHDIR
+	#endif
+#endif
+
+namespace cradle {
+namespace platform {
+
+struct ProcessOptions {
+	// The directory the process runs in. Empty to use the current directory.
+	std::string workingDirectory;
+
+	// Collect standard output and error into the result instead of passing them through.
+	bool captureOutput = true;
+};
+
+struct ProcessResult {
+	// False if the process couldn't be started, in which case `error` says why.
+	bool started = false;
+	std::string error;
+
+	int exitCode = -1;
+
+	// The signal that terminated the process or 0.
+	int signal = 0;
+
+	std::string output;
+	std::string errors;
+
+	double wallSeconds = 0;
+	double userSeconds = 0;
+	double systemSeconds = 0;
+
+	// Peak resident set size in kilobytes. Not available on Windows.
+	long maxResidentKb = 0;
+
+	bool succeeded() const {
+		return started && signal == 0 && exitCode == 0;
+	}
+};
+
+/**
+ * Splits a command line into arguments like a POSIX shell does for simple commands: unquoted whitespace
+ * separates arguments, and single quotes, double quotes and backslashes are removed after grouping and
+ * escaping.
+ *
+ * @param needsShell Set to true if the command uses other shell features, such as pipes, redirection,
+ *                   variables or globs, and must be run by a shell.
+ */
+std::vector<std::string> splitCommandLine(const std::string& cmd, bool& needsShell) {
+	static const char* SHELL_CHARACTERS = "|&;<>()$`*?[]~{}#\n";
+
+	std::vector<std::string> args;
+	std::string word;
+	bool inWord = false;
+	needsShell = false;
+
+	for (std::size_t i = 0; i < cmd.size(); i++) {
+		char c = cmd[i];
+
+		if (c == ' ' || c == '\t') {
+			if (inWord) {
+				args.push_back(word);
+				word.clear();
+				inWord = false;
+			}
+			continue;
+		}
+
+		inWord = true;
+		if (c == '\'') {
+			std::size_t end = cmd.find('\'', i + 1);
+			if (end == std::string::npos) {
+				needsShell = true;
+				end = cmd.size();
+			}
+			word.append(cmd, i + 1, end - i - 1);
+			i = end;
+		} else if (c == '"') {
+			for (i++; i < cmd.size() && cmd[i] != '"'; i++) {
+				if (cmd[i] == '\\' && i + 1 < cmd.size() && std::strchr("\"\\$`", cmd[i + 1]) != nullptr) {
+					word += cmd[++i];
+				} else {
+					if (cmd[i] == '$' || cmd[i] == '`') {
+						needsShell = true;
+					}
+					word += cmd[i];
+				}
+			}
+			if (i == cmd.size()) {
+				needsShell = true;
+			}
+		} else if (c == '\\' && i + 1 < cmd.size()) {
+			word += cmd[++i];
+		} else {
+			if (std::strchr(SHELL_CHARACTERS, c) != nullptr) {
+				needsShell = true;
+			}
+			word += c;
+		}
+	}
+	if (inWord) {
+		args.push_back(word);
+	}
+
+	// Variable assignments before the command.
+	if (!args.empty() && args[0].find('=') != std::string::npos) {
+		needsShell = true;
+	}
+	return args;
+}
+
+/**
+ * @return The arguments to run `cmd` with, using the shell only if it is needed.
+ */
+std::vector<std::string> commandArgs(const std::string& cmd) {
+#ifdef PLATFORM_WINDOWS
+	return {cmd};
+#else
+	bool needsShell;
+	std::vector<std::string> args = splitCommandLine(cmd, needsShell);
+	if (needsShell) {
+		return {"/bin/sh", "-c", cmd};
+	}
+	return args;
+#endif
+}
+
+#ifdef PLATFORM_WINDOWS
+
+ProcessResult runProcess(const std::vector<std::string>& args, const ProcessOptions& options = ProcessOptions()) {
+	ProcessResult result;
+	auto start = std::chrono::steady_clock::now();
+
+	std::string cmd;
+	for (auto& arg : args) {
+		if (!cmd.empty()) {
+			cmd += " ";
+		}
+		cmd += args.size() > 1 && arg.find(' ') != std::string::npos ? "\"" + arg + "\"" : arg;
+	}
+	if (!options.workingDirectory.empty()) {
+		cmd = "cd /d \"" + options.workingDirectory + "\" && " + cmd;
+	}
+
+	if (!options.captureOutput) {
+		result.started = true;
+		result.exitCode = system(cmd.c_str());
+	} else {
+		FILE* pipe = _popen((cmd + " 2>&1").c_str(), "r");
+		if (pipe == nullptr) {
+			result.error = strerror(errno);
+			return result;
+		}
+
+		char buffer[4096];
+		std::size_t count;
+		while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+			result.output.append(buffer, count);
+		}
+		result.started = true;
+		result.exitCode = _pclose(pipe);
+	}
+
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+#else
+
+namespace detail {
+
+/**
+ * Reads from `outFd` and `errFd` until both are closed. Both are read concurrently so that a process
+ * blocked writing to one pipe can't deadlock with cradle waiting on the other.
+ */
+void readPipes(int outFd, int errFd, std::string& output, std::string& errors) {
+	struct pollfd fds[2] = {{outFd, POLLIN, 0}, {errFd, POLLIN, 0}};
+	std::string* buffers[2] = {&output, &errors};
+
+	int open = 2;
+	char buffer[16384];
+	while (open > 0) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].fd < 0 || fds[i].revents == 0) {
+				continue;
+			}
+
+			ssize_t count = read(fds[i].fd, buffer, sizeof(buffer));
+			if (count > 0) {
+				buffers[i]->append(buffer, static_cast<std::size_t>(count));
+			} else if (count == 0 || errno != EINTR) {
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				open--;
+			}
+		}
+	}
+
+	for (auto& fd : fds) {
+		if (fd.fd >= 0) {
+			close(fd.fd);
+		}
+	}
+}
+
+/**
+ * Starts `argv` with its standard output and error redirected to `outFd` and `errFd` if they are not -1.
+ *
+ * @return 0 or the `errno` value describing why the process couldn't be started.
+ */
+int spawn(pid_t& pid, std::vector<char*>& argv, const std::string& workingDirectory, int outFd, int errFd) {
+#if defined(CRADLE_SPAWN_ADDCHDIR)
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (outFd >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, errFd, STDERR_FILENO);
+	}
+	if (!workingDirectory.empty()) {
+		posix_spawn_file_actions_addchdir_np(&actions, workingDirectory.c_str());
+	}
+
+	int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	return error;
+#else
+	// Without a way to change the child's directory through posix_spawn, fork and change it by hand.
+	pid = fork();
+	if (pid < 0) {
+		return errno;
+	}
+	if (pid == 0) {
+		if (outFd >= 0) {
+			dup2(outFd, STDOUT_FILENO);
+			dup2(errFd, STDERR_FILENO);
+		}
+		if (!workingDirectory.empty() && chdir(workingDirectory.c_str()) != 0) {
+			_exit(127);
+		}
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	return 0;
+#endif
+}
+
+} // namespace detail
+
+/**
+ * Runs `args[0]`, searched for in `PATH`, with the arguments `args` and waits for it to finish.
+ */
+ProcessResult runProcess(const std::vector<std::string>& args, const ProcessOptions& options = ProcessOptions()) {
+	ProcessResult result;
+	if (args.empty()) {
+		result.error = "Empty command";
+		return result;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<char*> argv;
+	argv.reserve(args.size() + 1);
+	for (auto& arg : args) {
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	// The pipes are close-on-exec so that processes spawned concurrently by other threads don't inherit
+	// them and keep them open.
+	int outPipe[2] = {-1, -1};
+	int errPipe[2] = {-1, -1};
+	if (options.captureOutput) {
+		if (pipe2(outPipe, O_CLOEXEC) != 0) {
+			result.error = strerror(errno);
+			return result;
+		}
+		if (pipe2(errPipe, O_CLOEXEC) != 0) {
+			result.error = strerror(errno);
+			close(outPipe[0]);
+			close(outPipe[1]);
+			return result;
+		}
+	}
+
+	pid_t pid;
+	int error = detail::spawn(pid, argv, options.workingDirectory, outPipe[1], errPipe[1]);
+	if (options.captureOutput) {
+		close(outPipe[1]);
+		close(errPipe[1]);
+	}
+	if (error != 0) {
+		result.error = strerror(error);
+		if (options.captureOutput) {
+			close(outPipe[0]);
+			close(errPipe[0]);
+		}
+		return result;
+	}
+	result.started = true;
+
+	if (options.captureOutput) {
+		detail::readPipes(outPipe[0], errPipe[0], result.output, result.errors);
+	}
+
+	int status = 0;
+	struct rusage usage;
+	std::memset(&usage, 0, sizeof(usage));
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			result.error = strerror(errno);
+			return result;
+		}
+	}
+
+	if (WIFEXITED(status)) {
+		result.exitCode = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		result.signal = WTERMSIG(status);
+	}
+
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	result.systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	result.maxResidentKb = usage.ru_maxrss;
+	return result;
+}
+
+#endif
+
+} // namespace platform
+} // namespace cradle
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cradle {
+
+static const std::string DEFAULT_TRACE_FILE = "build.json";
+
+class Trace {
+	typedef std::chrono::steady_clock Clock;
+
+	std::mutex mutex_;
+	bool enabled_ = false;
+	std::string path_;
+	Clock::time_point start_;
+
+	std::vector<std::string> events_;
+	std::unordered_map<std::thread::id, int> lanes_;
+
+	// Must be called with the mutex held.
+	int lane() {
+		auto it = lanes_.find(std::this_thread::get_id());
+		if (it != lanes_.end()) {
+			return it->second;
+		}
+
+		int lane = static_cast<int>(lanes_.size());
+		lanes_[std::this_thread::get_id()] = lane;
+		events_.push_back(
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(lane) +
+			",\"args\":{\"name\":\"lane " + std::to_string(lane) + "\"}}"
+		);
+		return lane;
+	}
+
+	void add(const std::string& name, const std::string& category, long long begin, long long end, const std::string& args) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		events_.push_back(
+			"{\"name\":" + json::quote(name) +
+			",\"cat\":\"" + category + "\"" +
+			",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(lane()) +
+			",\"ts\":" + std::to_string(begin) +
+			",\"dur\":" + std::to_string(end - begin) +
+			",\"args\":{" + args + "}}"
+		);
+	}
+
+public:
+	/**
+	 * Starts recording. Events are kept in memory until @ref write is called.
+	 */
+	void enable(const std::string& path) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!enabled_) {
+			start_ = Clock::now();
+		}
+		enabled_ = true;
+		path_ = path;
+	}
+
+	bool isEnabled() const {
+		return enabled_;
+	}
+
+	/**
+	 * @return Microseconds since recording started.
+	 */
+	long long now() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count();
+	}
+
+	/**
+	 * Records that the task `name` executed on the calling thread from `begin` to `end`.
+	 *
+	 * @param result "success", "failure" or "exception".
+	 */
+	void task(const std::string& name, long long begin, long long end, const std::string& result) {
+		add(name, "task", begin, end, "\"result\":" + json::quote(result));
+	}
+
+	/**
+	 * Records that the calling thread ran `cmd` from `begin` to `end`.
+	 */
+	void process(const std::string& cmd, const std::vector<std::string>& args, long long begin, long long end, const platform::ProcessResult& result) {
+		std::string name = args.empty() ? cmd : args[0];
+		std::size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos) {
+			name = name.substr(slash + 1);
+		}
+
+		add(name, "process", begin, end,
+			"\"command\":" + json::quote(cmd) +
+			",\"started\":" + (result.started ? "true" : "false") +
+			",\"exitCode\":" + std::to_string(result.exitCode) +
+			",\"signal\":" + std::to_string(result.signal) +
+			",\"userSeconds\":" + std::to_string(result.userSeconds) +
+			",\"systemSeconds\":" + std::to_string(result.systemSeconds) +
+			",\"maxResidentKb\":" + std::to_string(result.maxResidentKb)
+		);
+	}
+
+	/**
+	 * Writes every event recorded so far, replacing the file from an earlier call.
+	 *
+	 * @return False if the file couldn't be written.
+	 */
+	bool write() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!enabled_) {
+			return true;
+		}
+
+		FILE* file = fopen(path_.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+
+		std::string contents = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		contents += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"cradle\"}}";
+		for (auto& event : events_) {
+			contents += ",\n";
+			contents += event;
+		}
+		contents += "\n]}\n";
+
+		bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+		return fclose(file) == 0 && written;
+	}
+
+	const std::string& path() const {
+		return path_;
+	}
+};
+
+Trace& trace() {
+	static Trace instance;
+	return instance;
+}
+
+} // namespace cradle
+/**
+ * @file cradle_glob.hpp
+ *
+ * @brief Matches paths against sets of glob patterns.
+ *
+ * Patterns support `*` and `?`, which don't match `/`, character classes such as `[a-z]` or `[!0-9]`,
+ * brace sets such as `{cpp,cc}` and `**`, which as a whole path segment matches any number of
+ * directories, so a pattern ending in a `**` segment matches every file below it. A `\` makes the next
+ * character literal.
+ *
+ * All patterns of a @ref Glob are compiled together into one deterministic automaton, so a path is
+ * matched against every pattern in a single pass over its characters.
+ */
+
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace io {
+
+namespace detail {
+
+/**
+ * Appends every pattern `pattern` stands for, e.g. `a.cpp` and `a.hpp` for `a.{cpp,hpp}`, to `expanded`.
+ * Braces without a comma are kept as they are.
+ */
+void expandBraces(const std::string& pattern, std::vector<std::string>& expanded) {
+	for (std::size_t open = 0; open < pattern.size(); open++) {
+		if (pattern[open] == '\\') {
+			open++;
+			continue;
+		}
+		if (pattern[open] != '{') {
+			continue;
+		}
+
+		// Find the matching brace and the commas between them that aren't in nested braces.
+		std::vector<std::size_t> separators{open};
+		int depth = 0;
+		std::size_t close = open + 1;
+		for (; close < pattern.size(); close++) {
+			char c = pattern[close];
+			if (c == '\\') {
+				close++;
+			} else if (c == '{') {
+				depth++;
+			} else if (c == '}' && depth > 0) {
+				depth--;
+			} else if (c == '}') {
+				break;
+			} else if (c == ',' && depth == 0) {
+				separators.push_back(close);
+			}
+		}
+		if (close >= pattern.size() || separators.size() == 1) {
+			continue;
+		}
+		separators.push_back(close);
+
+		std::string prefix = pattern.substr(0, open);
+		std::string suffix = pattern.substr(close + 1);
+		for (std::size_t i = 0; i + 1 < separators.size(); i++) {
+			std::string alternative = pattern.substr(separators[i] + 1, separators[i + 1] - separators[i] - 1);
+			expandBraces(prefix + alternative + suffix, expanded);
+		}
+		return;
+	}
+	expanded.push_back(pattern);
+}
+
+} // namespace detail
+
+class Glob {
+	enum Accepts : uint8_t {
+		INCLUDED = 1,
+		EXCLUDED = 2
+	};
+
+	/**
+	 * A state of the nondeterministic automaton. A state has at most one pattern element's worth of
+	 * transitions: characters in `step` lead to `next`, characters in `stay` lead back to the state and
+	 * `epsilon` is reached without consuming a character.
+	 */
+	struct State {
+		std::bitset<256> step;
+		int next = -1;
+		std::bitset<256> stay;
+		int epsilon = -1;
+		uint8_t accepts = 0;
+	};
+
+	// The deterministic automaton gives up beyond this many states and paths are matched by simulating the
+	// nondeterministic one instead.
+	static const std::size_t MAX_DFA_STATES = 1024;
+
+	// The deterministic state that no path can leave, and the one matching starts in.
+	static const int DEAD = 0;
+	static const int START = 1;
+
+	std::vector<State> states;
+	std::vector<int> starts;
+
+	// Characters that every state treats the same way share a class.
+	uint8_t classOf[256];
+	std::size_t classCount = 0;
+
+	bool deterministic = false;
+	std::vector<int> transitions;
+	std::vector<uint8_t> accepting;
+
+	int addState() {
+		states.emplace_back();
+		return static_cast<int>(states.size()) - 1;
+	}
+
+	static std::bitset<256> notSlash() {
+		std::bitset<256> bytes;
+		bytes.set();
+		bytes.reset('/');
+		return bytes;
+	}
+
+	/**
+	 * Parses the character class at `pattern[begin]` into `bytes`.
+	 *
+	 * @return The position after the class, or `begin` if it isn't a class.
+	 */
+	static std::size_t parseClass(const std::string& pattern, std::size_t begin, std::bitset<256>& bytes) {
+		std::size_t i = begin + 1;
+		bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+		if (negated) {
+			i++;
+		}
+
+		std::size_t first = i;
+		for (; i < pattern.size() && (pattern[i] != ']' || i == first); i++) {
+			unsigned char low = pattern[i];
+			if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+				for (unsigned c = low; c <= static_cast<unsigned char>(pattern[i + 2]); c++) {
+					bytes.set(c);
+				}
+				i += 2;
+			} else {
+				bytes.set(low);
+			}
+		}
+		if (i >= pattern.size()) {
+			return begin;
+		}
+
+		if (negated) {
+			bytes.flip();
+		}
+		bytes &= notSlash();
+		return i + 1;
+	}
+
+	/**
+	 * Adds the states matching `pattern`, which must not contain braces.
+	 */
+	void addPattern(const std::string& pattern, uint8_t accepts) {
+		int current = addState();
+		starts.push_back(current);
+
+		std::size_t i = 0;
+		while (i < pattern.size()) {
+			char c = pattern[i];
+			bool segmentStart = i == 0 || pattern[i - 1] == '/';
+			bool segmentEnd = i + 2 == pattern.size() || (i + 2 < pattern.size() && pattern[i + 2] == '/');
+
+			if (c == '*' && i + 1 < pattern.size() && pattern[i + 1] == '*' && segmentStart && segmentEnd) {
+				if (i + 2 == pattern.size()) {
+					// A trailing `**` matches everything.
+					int next = addState();
+					states[current].stay.set();
+					states[current].epsilon = next;
+					current = next;
+					i += 2;
+				} else {
+					// `**/` matches any number of directories, including none.
+					int inside = addState();
+					int next = addState();
+					states[current].step = notSlash();
+					states[current].next = inside;
+					states[current].epsilon = next;
+					states[inside].stay = notSlash();
+					states[inside].step.set('/');
+					states[inside].next = current;
+					current = next;
+					i += 3;
+				}
+				continue;
+			}
+
+			if (c == '*') {
+				int next = addState();
+				states[current].stay = notSlash();
+				states[current].epsilon = next;
+				current = next;
+				while (i < pattern.size() && pattern[i] == '*') {
+					i++;
+				}
+				continue;
+			}
+
+			std::bitset<256> bytes;
+			std::size_t end = c == '[' ? parseClass(pattern, i, bytes) : i;
+			if (c == '?') {
+				bytes = notSlash();
+				i++;
+			} else if (end != i) {
+				i = end;
+			} else {
+				if (c == '\\' && i + 1 < pattern.size()) {
+					i++;
+				}
+				bytes.reset();
+				bytes.set(static_cast<unsigned char>(pattern[i]));
+				i++;
+			}
+
+			int next = addState();
+			states[current].step = bytes;
+			states[current].next = next;
+			current = next;
+		}
+		states[current].accepts |= accepts;
+	}
+
+	/**
+	 * Adds every state reachable from `set` without consuming a character to it and sorts it.
+	 */
+	void closure(std::vector<int>& set) const {
+		std::vector<char> seen(states.size(), 0);
+		for (int s : set) {
+			seen[s] = 1;
+		}
+		for (std::size_t i = 0; i < set.size(); i++) {
+			int epsilon = states[set[i]].epsilon;
+			if (epsilon >= 0 && !seen[epsilon]) {
+				seen[epsilon] = 1;
+				set.push_back(epsilon);
+			}
+		}
+		std::sort(set.begin(), set.end());
+	}
+
+	void advance(const std::vector<int>& set, unsigned char c, std::vector<int>& next) const {
+		std::vector<char> seen(states.size(), 0);
+		next.clear();
+		for (int s : set) {
+			if (states[s].step[c] && !seen[states[s].next]) {
+				seen[states[s].next] = 1;
+				next.push_back(states[s].next);
+			}
+			if (states[s].stay[c] && !seen[s]) {
+				seen[s] = 1;
+				next.push_back(s);
+			}
+		}
+		closure(next);
+	}
+
+	uint8_t acceptsOf(const std::vector<int>& set) const {
+		uint8_t accepts = 0;
+		for (int s : set) {
+			accepts |= states[s].accepts;
+		}
+		return accepts;
+	}
+
+	void computeClasses() {
+		std::map<std::vector<bool>, uint8_t> classes;
+		for (unsigned c = 0; c < 256; c++) {
+			std::vector<bool> signature;
+			signature.reserve(states.size() * 2);
+			for (auto& state : states) {
+				signature.push_back(state.step[c]);
+				signature.push_back(state.stay[c]);
+			}
+			auto it = classes.insert(std::make_pair(signature, static_cast<uint8_t>(classes.size()))).first;
+			classOf[c] = it->second;
+		}
+		classCount = classes.size();
+	}
+
+	/**
+	 * Builds the deterministic automaton by subset construction, unless it has too many states.
+	 */
+	void determinize() {
+		std::vector<unsigned char> representatives(classCount);
+		for (unsigned c = 256; c-- > 0;) {
+			representatives[classOf[c]] = static_cast<unsigned char>(c);
+		}
+
+		std::vector<int> start = starts;
+		closure(start);
+		std::vector<std::vector<int>> sets{std::vector<int>(), start};
+		std::map<std::vector<int>, int> ids{{sets[0], DEAD}, {sets[1], START}};
+
+		std::vector<int> next;
+		for (std::size_t i = 0; i < sets.size(); i++) {
+			for (std::size_t c = 0; c < classCount; c++) {
+				advance(sets[i], representatives[c], next);
+				auto it = ids.find(next);
+				if (it == ids.end()) {
+					if (sets.size() == MAX_DFA_STATES) {
+						transitions.clear();
+						return;
+					}
+					it = ids.insert(std::make_pair(next, static_cast<int>(sets.size()))).first;
+					sets.push_back(next);
+				}
+				transitions.push_back(it->second);
+			}
+		}
+
+		for (auto& set : sets) {
+			accepting.push_back(acceptsOf(set));
+		}
+		deterministic = true;
+	}
+
+public:
+	/**
+	 * @param include Paths must match one of these patterns.
+	 * @param exclude Paths must not match any of these patterns.
+	 */
+	Glob(const std::vector<std::string>& include, const std::vector<std::string>& exclude = std::vector<std::string>()) {
+		for (auto& patterns : {std::make_pair(&include, INCLUDED), std::make_pair(&exclude, EXCLUDED)}) {
+			for (auto& pattern : *patterns.first) {
+				std::vector<std::string> expanded;
+				detail::expandBraces(pattern, expanded);
+				for (auto& alternative : expanded) {
+					addPattern(alternative, patterns.second);
+				}
+			}
+		}
+		computeClasses();
+		determinize();
+	}
+
+	bool matches(const char* path, std::size_t length) const {
+		if (deterministic) {
+			int state = START;
+			for (std::size_t i = 0; i < length && state != DEAD; i++) {
+				state = transitions[state * classCount + classOf[static_cast<unsigned char>(path[i])]];
+			}
+			return accepting[state] == INCLUDED;
+		}
+
+		std::vector<int> set = starts;
+		std::vector<int> next;
+		closure(set);
+		for (std::size_t i = 0; i < length && !set.empty(); i++) {
+			advance(set, static_cast<unsigned char>(path[i]), next);
+			set.swap(next);
+		}
+		return acceptsOf(set) == INCLUDED;
+	}
+
+	bool matches(const std::string& path) const {
+		return matches(path.data(), path.size());
+	}
+};
+
+const std::size_t Glob::MAX_DFA_STATES;
+const int Glob::DEAD;
+const int Glob::START;
+
+} // namespace io
+} // namespace cradle
+/**
+ * @file cradle_jobserver.hpp
+ *
+ * @brief Shares a pool of job slots with GNU make and other processes that implement its jobserver protocol.
+ *
+ * A jobserver is a pipe or named fifo holding one byte per job slot beyond the first. A process that wants
+ * to run a job reads a byte and writes it back once the job is done. Every process also owns one implicit
+ * slot which needs no byte.
+ *
+ * If `MAKEFLAGS` names a jobserver (`--jobserver-auth=R,W` for pipes, `--jobserver-auth=fifo:PATH` for
+ * fifos, or the older `--jobserver-fds=R,W`) cradle takes a slot for each process it runs. Otherwise, if
+ * the build launches commands through `exec` that may themselves be builds, cradle creates a jobserver with
+ * one slot per worker and exports it in `MAKEFLAGS` so nested cradle, make and ninja processes share its
+ * slots.
+ *
+ * Not supported on Windows, where make uses a named semaphore instead.
+ */
+
+
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifndef PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace platform {
+
+class JobServer {
+public:
+	enum class Style {
+		FIFO,
+		PIPE
+	};
+
+	/**
+	 * A slot taken with @ref acquire.
+	 */
+	struct Token {
+		enum class Kind {
+			NONE,
+			IMPLICIT,
+			BYTE
+		};
+
+		Kind kind;
+		char byte;
+	};
+
+private:
+	// Both are -1 if there is no jobserver.
+	int readFd = -1;
+	int writeFd = -1;
+
+	// The pipe exported to child processes by @ref serve with `Style::PIPE`.
+	int inheritedFds[2] = {-1, -1};
+
+	// Written to when the implicit slot is released to wake threads waiting for a slot.
+	int wakeFds[2] = {-1, -1};
+
+	std::mutex mutex;
+	bool implicitFree = true;
+	bool serverRequested = false;
+	unsigned parentJobs = 0;
+
+	// The fifo and the directory holding it if this process created the jobserver.
+	std::string fifoPath;
+	std::string fifoDir;
+
+	// `MAKEFLAGS` before @ref serve exported the jobserver, if it did.
+	bool served = false;
+	bool hadMakeflags = false;
+	std::string inheritedMakeflags;
+
+#ifndef PLATFORM_WINDOWS
+	static std::string findFlag(const std::string& makeflags, const std::string& flag) {
+		std::size_t pos = makeflags.rfind(flag);
+		if (pos == std::string::npos) {
+			return "";
+		}
+		pos += flag.size();
+		return makeflags.substr(pos, makeflags.find(' ', pos) - pos);
+	}
+
+	/**
+	 * Opens our own non-blocking description of the pipe that `fd` refers to so that setting `O_NONBLOCK`
+	 * doesn't affect the other processes using it.
+	 */
+	static int reopen(int fd, int flags) {
+		if (fcntl(fd, F_GETFD) < 0) {
+			// Make didn't pass the descriptors on, e.g. because the command wasn't marked with `+`.
+			return -1;
+		}
+		std::string path = "/proc/self/fd/" + std::to_string(fd);
+		int reopened = open(path.c_str(), flags | O_NONBLOCK | O_CLOEXEC);
+		return reopened >= 0 ? reopened : -1;
+	}
+
+	bool startWaking() {
+		return pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) == 0;
+	}
+#endif
+
+public:
+	JobServer() {}
+	JobServer(const JobServer&) = delete;
+	JobServer& operator=(const JobServer&) = delete;
+
+	~JobServer() {
+		stop();
+	}
+
+	/**
+	 * Leaves the jobserver. If this process created it, it is removed and `MAKEFLAGS` is restored, e.g.
+	 * before cradle replaces itself with a new process.
+	 */
+	void stop() {
+#ifndef PLATFORM_WINDOWS
+		for (int* fd : {&readFd, &writeFd, &wakeFds[0], &wakeFds[1], &inheritedFds[0], &inheritedFds[1]}) {
+			if (*fd >= 0) {
+				close(*fd);
+				*fd = -1;
+			}
+		}
+		if (!fifoPath.empty()) {
+			unlink(fifoPath.c_str());
+			rmdir(fifoDir.c_str());
+			fifoPath.clear();
+		}
+		if (served) {
+			if (hadMakeflags) {
+				setenv("MAKEFLAGS", inheritedMakeflags.c_str(), 1);
+			} else {
+				unsetenv("MAKEFLAGS");
+			}
+			served = false;
+		}
+#endif
+	}
+
+	bool isActive() const {
+		return readFd >= 0;
+	}
+
+	/**
+	 * @return The `-j` value of the parent make, or 0 if it wasn't given.
+	 */
+	unsigned parentJobCount() const {
+		return parentJobs;
+	}
+
+	/**
+	 * Asks for a jobserver to be created by @ref serve because commands may run nested builds.
+	 */
+	void requestServer() {
+		std::lock_guard<std::mutex> lock(mutex);
+		serverRequested = true;
+	}
+
+	bool isServerRequested() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return serverRequested;
+	}
+
+	/**
+	 * Joins the jobserver described by `makeflags`, the value of `MAKEFLAGS`.
+	 *
+	 * @return False if it doesn't describe one or it can't be opened.
+	 */
+	bool connect(const std::string& makeflags) {
+#ifdef PLATFORM_WINDOWS
+		return false;
+#else
+		std::string jobs = findFlag(makeflags, " -j");
+		if (jobs.empty() && makeflags.compare(0, 2, "-j") == 0) {
+			jobs = findFlag(" " + makeflags, " -j");
+		}
+		parentJobs = static_cast<unsigned>(std::strtoul(jobs.c_str(), nullptr, 10));
+
+		std::string auth = findFlag(makeflags, "--jobserver-auth=");
+		if (auth.empty()) {
+			auth = findFlag(makeflags, "--jobserver-fds=");
+		}
+		if (auth.empty()) {
+			return false;
+		}
+
+		if (auth.compare(0, 5, "fifo:") == 0) {
+			readFd = open(auth.substr(5).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+			writeFd = readFd >= 0 ? fcntl(readFd, F_DUPFD_CLOEXEC, 0) : -1;
+		} else {
+			std::size_t comma = auth.find(',');
+			if (comma == std::string::npos) {
+				return false;
+			}
+			int parentRead = std::atoi(auth.substr(0, comma).c_str());
+			int parentWrite = std::atoi(auth.substr(comma + 1).c_str());
+			readFd = reopen(parentRead, O_RDONLY);
+			writeFd = readFd >= 0 && fcntl(parentWrite, F_GETFD) >= 0 ? parentWrite : -1;
+		}
+
+		if (readFd < 0 || writeFd < 0 || !startWaking()) {
+			if (readFd >= 0) {
+				close(readFd);
+			}
+			readFd = writeFd = -1;
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	/**
+	 * Creates a jobserver with `jobs` slots and exports it to child processes through `MAKEFLAGS`. Must be
+	 * called before any threads are started since it changes the environment.
+	 *
+	 * @param style `Style::FIFO` is understood by make 4.4 and later and by ninja. `Style::PIPE` is also
+	 *              understood by older versions of make but leaves the pipe open in every child process.
+	 * @return False if the jobserver couldn't be created.
+	 */
+	bool serve(unsigned jobs, Style style = Style::FIFO) {
+#ifdef PLATFORM_WINDOWS
+		return false;
+#else
+		std::string auth;
+		if (style == Style::FIFO) {
+			const char* tmp = std::getenv("TMPDIR");
+			std::string pattern = std::string(tmp != nullptr && *tmp != '\0' ? tmp : "/tmp") + "/cradle-jobserver-XXXXXX";
+			if (mkdtemp(&pattern[0]) == nullptr) {
+				return false;
+			}
+			fifoDir = pattern;
+			fifoPath = fifoDir + "/fifo";
+
+			if (mkfifo(fifoPath.c_str(), 0600) != 0) {
+				rmdir(fifoDir.c_str());
+				fifoPath.clear();
+				return false;
+			}
+
+			readFd = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+			writeFd = readFd >= 0 ? fcntl(readFd, F_DUPFD_CLOEXEC, 0) : -1;
+			auth = "fifo:" + fifoPath;
+		} else {
+			// Children inherit these descriptors, so they are not close-on-exec.
+			if (pipe(inheritedFds) != 0) {
+				return false;
+			}
+			readFd = reopen(inheritedFds[0], O_RDONLY);
+			writeFd = fcntl(inheritedFds[1], F_DUPFD_CLOEXEC, 0);
+			auth = std::to_string(inheritedFds[0]) + "," + std::to_string(inheritedFds[1]);
+		}
+
+		std::string tokens(jobs > 1 ? jobs - 1 : 0, '+');
+		if (
+			readFd < 0 || writeFd < 0 || !startWaking() ||
+			(!tokens.empty() && write(writeFd, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+		) {
+			// Run without a jobserver rather than with one nobody else can use.
+			if (readFd >= 0) {
+				close(readFd);
+			}
+			readFd = -1;
+			return false;
+		}
+
+		const char* inherited = std::getenv("MAKEFLAGS");
+		hadMakeflags = inherited != nullptr;
+		inheritedMakeflags = hadMakeflags ? inherited : "";
+		served = true;
+
+		std::string makeflags = hadMakeflags ? inheritedMakeflags + " " : "";
+		makeflags += "-j" + std::to_string(jobs) + " --jobserver-auth=" + auth;
+		setenv("MAKEFLAGS", makeflags.c_str(), 1);
+		return true;
+#endif
+	}
+
+	/**
+	 * Blocks until a job slot is available. Returns immediately if there is no jobserver.
+	 */
+	Token acquire() {
+		Token token = {Token::Kind::NONE, 0};
+#ifndef PLATFORM_WINDOWS
+		if (!isActive()) {
+			return token;
+		}
+
+		while (true) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (implicitFree) {
+					implicitFree = false;
+					token.kind = Token::Kind::IMPLICIT;
+					return token;
+				}
+			}
+
+			ssize_t count = read(readFd, &token.byte, 1);
+			if (count == 1) {
+				token.kind = Token::Kind::BYTE;
+				return token;
+			}
+			if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+				// The jobserver is gone so don't limit jobs at all.
+				return token;
+			}
+
+			struct pollfd fds[2] = {{readFd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+			if (poll(fds, 2, -1) > 0 && fds[1].revents != 0) {
+				char drain[16];
+				while (read(wakeFds[0], drain, sizeof(drain)) > 0) {}
+			}
+		}
+#else
+		return token;
+#endif
+	}
+
+	void release(const Token& token) {
+#ifndef PLATFORM_WINDOWS
+		if (token.kind == Token::Kind::BYTE) {
+			while (write(writeFd, &token.byte, 1) < 0 && errno == EINTR) {}
+		} else if (token.kind == Token::Kind::IMPLICIT) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				implicitFree = true;
+			}
+			char wake = 0;
+			if (write(wakeFds[1], &wake, 1) < 0) {
+				// The pipe is full so waiters will wake anyway.
+			}
+		}
+#endif
+	}
+};
+
+/**
+ * @return The jobserver shared by every task in this run.
+ */
+JobServer& jobServer() {
+	static JobServer instance;
+	return instance;
+}
+
+/**
+ * Holds a job slot for as long as it exists.
+ */
+class JobSlot {
+	JobServer::Token token;
+
+public:
+	JobSlot() : token(jobServer().acquire()) {}
+	JobSlot(const JobSlot&) = delete;
+	JobSlot& operator=(const JobSlot&) = delete;
+
+	~JobSlot() {
+		jobServer().release(token);
+	}
+};
+
+} // namespace platform
+} // namespace cradle
+
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+
+#ifdef PLATFORM_LINUX
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+#ifdef PLATFORM_WINDOWS
+	#include <direct.h>
+	#include <process.h>
+	#include <sys/utime.h>
+	#include <windows.h>
+	#define stat _stat
+#endif
+
+namespace cradle {
+namespace platform {
+
+#ifdef PLATFORM_WINDOWS
+
+#define PATH_SEP ('\\')
+
+int platform_mkdir(const char * const str) {
+	return _mkdir(str);
+}
+
+/**
+ * Atomically replaces `to` with `from`.
+ *
+ * @return 0 on success.
+ */
+int platform_rename(const std::string& from, const std::string& to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
+
+int platform_getpid() {
+	return _getpid();
+}
+
+std::string platform_hostname() {
+	char name[MAX_COMPUTERNAME_LENGTH + 1];
+	DWORD size = sizeof(name);
+	return GetComputerNameA(name, &size) ? std::string(name, size) : std::string("localhost");
+}
+
+/**
+ * Sets the access and modification times of `path` to now.
+ *
+ * @return 0 on success.
+ */
+int platform_touch(const std::string& path) {
+	return _utime(path.c_str(), nullptr);
+}
+
+std::string platform_getcwd() {
+	char dir[MAX_PATH];
+	return _getcwd(dir, sizeof(dir)) != nullptr ? std::string(dir) : std::string(".");
+}
+
+#else
+
+#define PATH_SEP ('/')
+
+int platform_mkdir(const char * const str) {
+	return mkdir(str, 0744);
+}
+
+/**
+ * Atomically replaces `to` with `from`.
+ *
+ * @return 0 on success.
+ */
+int platform_rename(const std::string& from, const std::string& to) {
+	return std::rename(from.c_str(), to.c_str());
+}
+
+int platform_getpid() {
+	return static_cast<int>(getpid());
+}
+
+std::string platform_hostname() {
+	char name[256] = {};
+	return gethostname(name, sizeof(name) - 1) == 0 ? std::string(name) : std::string("localhost");
+}
+
+/**
+ * Sets the access and modification times of `path` to now.
+ *
+ * @return 0 on success.
+ */
+int platform_touch(const std::string& path) {
+	return utime(path.c_str(), nullptr);
+}
+
+std::string platform_getcwd() {
+	char dir[4096];
+	return getcwd(dir, sizeof(dir)) != nullptr ? std::string(dir) : std::string(".");
+}
+
+#endif
+
+int platform_chdir(const std::string& str) {
+	return chdir(str.c_str());
+}
+
+/**
+ * @return The path of the executable `program` found in the directories listed in `PATH`, or an empty string
+ *         if it isn't installed.
+ */
+std::string platform_which(const std::string& program) {
+	const char* path = std::getenv("PATH");
+	if (path == nullptr) {
+		return "";
+	}
+
+#ifdef PLATFORM_WINDOWS
+	const char separator = ';';
+	std::string name = program.size() > 4 && program.compare(program.size() - 4, 4, ".exe") == 0 ? program : program + ".exe";
+#else
+	const char separator = ':';
+	const std::string& name = program;
+#endif
+
+	std::string dirs(path);
+	std::size_t start = 0;
+	while (start <= dirs.size()) {
+		std::size_t end = dirs.find(separator, start);
+		if (end == std::string::npos) {
+			end = dirs.size();
+		}
+
+		std::string candidate = (end > start ? dirs.substr(start, end - start) : std::string(".")) + PATH_SEP + name;
+		struct stat s;
+		bool found = stat(candidate.c_str(), &s) == 0 && (s.st_mode & S_IFMT) == S_IFREG;
+#ifndef PLATFORM_WINDOWS
+		found = found && access(candidate.c_str(), X_OK) == 0;
+#endif
+		if (found) {
+			return candidate;
+		}
+		start = end + 1;
+	}
+	return "";
+}
+
+}
+}
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <forward_list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#define build_config                          \
+	namespace cradle {                        \
+		std::string getBuildConfigFile() {    \
+			return __FILE__;                  \
+		}                                     \
+	}                                         \
+	void configure();                         \
+	int main(int argc, char** argv) {         \
+	  log("Cradle Version v0.4-alpha");       \
+	  cradle::platform::platform_chdir(cradle::io::path_parent(getBuildConfigFile())); \
+	  parseCmdLineArgs(argc, argv);           \
+	  if (isNullBuild()) {                    \
+	    writeTrace();                         \
+	    return 0;                             \
+	  }                                       \
+	  configure();                            \
+	  if (options().has("list")) {            \
+	    listTasks();                          \
+	    return 0;                             \
+	  }                                       \
+	  if (options().has("watch")) {           \
+	    return watchAndRebuild();             \
+	  }                                       \
+	  ExecutionResult result = executor->execute(); \
+	  finishBuild(result);                    \
+	  writeTrace();                           \
+	  return result == ExecutionResult::SUCCESS ? 0 : 1; \
+	}                                         \
+	void configure()
+
+namespace cradle {
+
+static const std::string DEFAULT_BUILD_DIR = "build";
+
+class Executor;
+class ParallelExecutor;
+class SingleThreadedExecutor;
+class Task;
+
+void log(const std::string& msg);
+void log_error(const std::string& msg);
+
+/**
+ * @return The absolute path to build.cpp.
+ */
+std::string getBuildConfigFile();
+
+enum class ExecutionResult {
+	SUCCESS,
+	FAILURE
+};
+
+/**
+ * Options given on the command line as `--name` or `--name=value`.
+ */
+class Options {
+	std::unordered_map<std::string, std::string> values;
+
+public:
+	bool has(const std::string& name) const {
+		return values.find(name) != values.end();
+	}
+
+	std::string get(const std::string& name, const std::string& defaultValue = "") const {
+		auto it = values.find(name);
+		return it == values.end() ? defaultValue : it->second;
+	}
+
+	void set(const std::string& name, const std::string& value = "") {
+		values[name] = value;
+	}
+};
+
+Options& options() {
+	static Options instance;
+	return instance;
+}
+
+/**
+ * @return The arguments cradle was started with, including the program.
+ */
+std::vector<std::string>& commandLine() {
+	static std::vector<std::string> args;
+	return args;
+}
+
+/**
+ * Builds the requested tasks and then rebuilds whatever a change to their sources affects until cradle is
+ * interrupted. Implemented in cradle_watch.hpp.
+ *
+ * @return The exit code of cradle.
+ */
+int watchAndRebuild();
+
+/**
+ * Checks the null build snapshot before the build is configured. Implemented in cradle_snapshot.hpp.
+ *
+ * @return True if every output is up to date and the build can be skipped.
+ */
+bool isNullBuild();
+
+/**
+ * Writes the null build snapshot after a successful build. Implemented in cradle_snapshot.hpp.
+ */
+void finishBuild(ExecutionResult result);
+
+/**
+ * Prevents the null build snapshot from being written in this run. Implemented in cradle_snapshot.hpp.
+ */
+void disableSnapshot();
+
+/**
+ * Writes the trace requested with `--trace`, if any.
+ */
+void writeTrace() {
+	if (!trace().write()) {
+		log_error("Unable to write the trace to " + trace().path());
+	}
+}
+
+
+class Task {
+	std::string name_;
+	std::atomic<uint32_t> id_{detail::TaskArena::NONE};
+	std::vector<uint32_t> dependencies_;
+	std::vector<uint32_t> followingTasks_;
+	std::vector<std::pair<uint32_t, std::string>> properties;
+	bool tracked_ = false;
+
+	// A list rather than a vector so that references returned by getList() stay valid as lists are added.
+	std::forward_list<std::pair<uint32_t, std::vector<std::string>>> lists;
+
+	static std::vector<task_p> tasksOf(const std::vector<uint32_t>& ids) {
+		std::vector<task_p> tasks;
+		tasks.reserve(ids.size());
+		for (uint32_t id : ids) {
+			tasks.push_back(detail::taskArena().get(id));
+		}
+		return tasks;
+	}
+
+	// Properties are stored by the id of their key. Keys that no task has a property with have no id yet.
+
+	std::string* findProperty(uint32_t id) {
+		for (auto& property : properties) {
+			if (property.first == id) {
+				return &property.second;
+			}
+		}
+		return nullptr;
+	}
+
+	const std::string* findProperty(uint32_t id) const {
+		return const_cast<Task*>(this)->findProperty(id);
+	}
+
+	const std::string& get(const std::string& key, uint32_t id) const {
+		const std::string* value = findProperty(id);
+		if (value == nullptr) {
+			throw std::runtime_error("Attempting to get unknown key: " + key);
+		}
+		return *value;
+	}
+
+	void set(uint32_t id, const std::string& value) {
+		std::string* existing = findProperty(id);
+		if (existing != nullptr) {
+			*existing = value;
+			return;
+		}
+		properties.emplace_back(id, value);
+	}
+
+	std::vector<std::string>* findList(uint32_t id) {
+		for (auto& list : lists) {
+			if (list.first == id) {
+				return &list.second;
+			}
+		}
+		return nullptr;
+	}
+
+	const std::vector<std::string>* findList(uint32_t id) const {
+		return const_cast<Task*>(this)->findList(id);
+	}
+
+	const std::vector<std::string>& getList(const std::string& key, uint32_t id) const {
+		const std::vector<std::string>* values = findList(id);
+		if (values == nullptr) {
+			throw std::runtime_error("Attempting to get unknown list: " + key);
+		}
+		return *values;
+	}
+
+	std::vector<std::string>& list(uint32_t id) {
+		std::vector<std::string>* existing = findList(id);
+		if (existing != nullptr) {
+			return *existing;
+		}
+		lists.emplace_front(id, std::vector<std::string>());
+		return lists.front().second;
+	}
+
+	static uint32_t find(const std::string& key) { return detail::propertyKeys().find(key); }
+	static uint32_t intern(const std::string& key) { return detail::propertyKeys().intern(key); }
+
+public:
+	Task(std::string name) : name_(name) {}
+	virtual ~Task() {}
+
+	std::string name() const { return name_; }
+
+	/**
+	 * Declares that everything this task does is covered by the null build snapshot: it only writes outputs
+	 * recorded in the build log, lists directories with io::files or io::glob, or only sets properties.
+	 * Builds that execute any other task don't write a snapshot, since that task would have to run again.
+	 */
+	void markTracked() { tracked_ = true; }
+	bool isTracked() const { return tracked_; }
+
+	std::string addr() const {
+		std::stringstream buffer;
+		buffer << reinterpret_cast<const void*>(this);
+		return buffer.str();
+	}
+
+	/**
+	 * @return The id of `t` in the task arena, giving it one if it doesn't have one yet.
+	 */
+	static uint32_t idOf(const task_p& t) {
+		uint32_t id = t->id_.load(std::memory_order_acquire);
+		return id != detail::TaskArena::NONE ? id : detail::taskArena().adopt(t, t->id_);
+	}
+
+	/**
+	 * Removes `t` from the task arena so that it is freed once nothing else holds it. See
+	 * @ref detail::TaskArena::release.
+	 */
+	static void release(const task_p& t) {
+		detail::taskArena().release(t->id_);
+	}
+
+	void dependsOn(task_p other) { dependencies_.push_back(idOf(other)); }
+	void dependsOn(std::vector<task_p>& others) { for (auto& other : others) dependsOn(other); }
+	void dependsOn(std::initializer_list<task_p> others) { for (auto& other : others) dependsOn(other); }
+	const std::vector<task_p> dependencies() const { return tasksOf(dependencies_); }
+	void followedBy(task_p other) { followingTasks_.push_back(idOf(other)); }
+	void followedBy(std::vector<task_p>& others) { for (auto& other : others) followedBy(other); }
+	void followedBy(std::initializer_list<task_p> others) { for (auto& other : others) followedBy(other); }
+	const std::vector<task_p> followingTasks() const { return tasksOf(followingTasks_); }
+
+	// The ids of the tasks above in the task arena.
+	const std::vector<uint32_t>& dependencyIds() const { return dependencies_; }
+	const std::vector<uint32_t>& followerIds() const { return followingTasks_; }
+
+	//
+	// Single-valued properties. Each also takes a PropertyKey, whose id is known.
+	//
+
+	const std::string get(const std::string& key) const { return get(key, find(key)); }
+	const std::string get(const PropertyKey& key) const { return get(key, key.id()); }
+
+	void set(const std::string& key, const std::string& value) { set(intern(key), value); }
+	void set(const PropertyKey& key, const std::string& value) { set(key.id(), value); }
+
+	bool has(const std::string& key) const { return findProperty(find(key)) != nullptr; }
+	bool has(const PropertyKey& key) const { return findProperty(key.id()) != nullptr; }
+
+	std::vector<std::string> propKeys() {
+		std::vector<std::string> keys;
+		for (auto& property : properties) {
+			keys.push_back(detail::propertyKeys().name(property.first));
+		}
+		return keys;
+	}
+
+	//
+	// Multi-valued properties.
+	//
+
+	const std::vector<std::string>& getList(const std::string& key) const { return getList(key, find(key)); }
+	const std::vector<std::string>& getList(const PropertyKey& key) const { return getList(key, key.id()); }
+
+	void push(const std::string& key, const std::string& value) { list(intern(key)).push_back(value); }
+	void push(const PropertyKey& key, const std::string& value) { list(key.id()).push_back(value); }
+
+	void push(const std::string& key, const std::vector<std::string>& values) {
+		std::vector<std::string>& target = list(intern(key));
+		target.insert(target.end(), values.begin(), values.end());
+	}
+
+	void push(const PropertyKey& key, const std::vector<std::string>& values) {
+		std::vector<std::string>& target = list(key.id());
+		target.insert(target.end(), values.begin(), values.end());
+	}
+
+	void ensureList(const std::string& key) { list(intern(key)); }
+	void ensureList(const PropertyKey& key) { list(key.id()); }
+
+	bool hasList(const std::string& key) const { return findList(find(key)) != nullptr; }
+	bool hasList(const PropertyKey& key) const { return findList(key.id()) != nullptr; }
+
+	std::vector<std::string> listKeys() {
+		std::vector<std::string> keys;
+		for (auto& list : lists) {
+			keys.push_back(detail::propertyKeys().name(list.first));
+		}
+		return keys;
+	}
+
+	// Interface.
+	virtual ExecutionResult execute() = 0;
+};
+
+/**
+ * A flat, index-based representation of the task graph that executors use to decide what may run next.
+ *
+ * Every task known to the graph has an index and two nodes: a "run" node (`2 * index`) that is ready
+ * once all of the task's dependencies are done and a "done" node (`2 * index + 1`) that is reached
+ * once the task has executed and all of its followers are done. Edges are stored as singly linked lists
+ * in flat arrays so that followers discovered while executing can be appended without rebuilding the
+ * whole graph.
+ *
+ * The graph is compiled once per run. Validation uses Kahn's algorithm over the newly added nodes and
+ * every cycle is reported (using Tarjan's algorithm on whatever Kahn's algorithm could not order)
+ * before an error is raised.
+ */
+class TaskGraph {
+	static const std::size_t NONE = static_cast<std::size_t>(-1);
+
+	// The arena ids of the tasks by index, and the reverse.
+	std::vector<uint32_t> ids_;
+	std::vector<std::size_t> indices_;
+	std::vector<std::size_t> followerCounts_;
+
+	std::vector<std::size_t> pending_;
+	std::vector<char> done_;
+	std::vector<std::size_t> head_;
+
+	std::vector<std::size_t> edgeTarget_;
+	std::vector<std::size_t> edgeNext_;
+
+	static std::size_t runNode(std::size_t task) { return 2 * task; }
+	static std::size_t doneNode(std::size_t task) { return 2 * task + 1; }
+
+	std::size_t indexOf(uint32_t id, std::vector<std::size_t>& discovered) {
+		if (id >= indices_.size()) {
+			indices_.resize(std::max<std::size_t>(id + 1, detail::taskArena().size()), NONE);
+		}
+		if (indices_[id] != NONE) {
+			return indices_[id];
+		}
+
+		std::size_t index = ids_.size();
+		indices_[id] = index;
+		ids_.push_back(id);
+		followerCounts_.push_back(0);
+		for (int i = 0; i < 2; i++) {
+			pending_.push_back(0);
+			done_.push_back(0);
+			head_.push_back(NONE);
+		}
+		discovered.push_back(index);
+		return index;
+	}
+
+	void addEdge(std::size_t from, std::size_t to) {
+		if (done_[from]) {
+			return;
+		}
+		edgeTarget_.push_back(to);
+		edgeNext_.push_back(head_[from]);
+		head_[from] = edgeTarget_.size() - 1;
+		pending_[to]++;
+	}
+
+	/**
+	 * Adds every task reachable from `roots` that isn't already in the graph. If `owner` is not `NONE`
+	 * the roots are followers that `owner` added while executing.
+	 *
+	 * @return The indices of the tasks that were added.
+	 */
+	std::vector<std::size_t> add(const std::vector<uint32_t>& roots, std::size_t owner) {
+		std::vector<std::size_t> discovered;
+		std::size_t firstNewNode = 2 * ids_.size();
+
+		std::vector<std::size_t> rootIndices;
+		for (uint32_t r : roots) {
+			rootIndices.push_back(indexOf(r, discovered));
+		}
+
+		for (std::size_t i = 0; i < discovered.size(); i++) {
+			std::size_t index = discovered[i];
+			const Task& t = *task(index);
+
+			addEdge(runNode(index), doneNode(index));
+
+			for (uint32_t dep : t.dependencyIds()) {
+				addEdge(doneNode(indexOf(dep, discovered)), runNode(index));
+			}
+
+			const std::vector<uint32_t>& followers = t.followerIds();
+			for (uint32_t f : followers) {
+				std::size_t follower = indexOf(f, discovered);
+
+				// A follower that was already in the graph has been scheduled on its own account.
+				if (runNode(follower) >= firstNewNode) {
+					addEdge(runNode(index), runNode(follower));
+				}
+				addEdge(doneNode(follower), doneNode(index));
+			}
+			followerCounts_[index] = followers.size();
+		}
+
+		if (owner != NONE) {
+			for (std::size_t follower : rootIndices) {
+				addEdge(doneNode(follower), doneNode(owner));
+			}
+		}
+
+		validate(firstNewNode, owner);
+		return discovered;
+	}
+
+	/**
+	 * Checks that the nodes starting at `firstNewNode` are acyclic and, if they were added as followers of
+	 * `owner`, that none of them waits on `owner`.
+	 */
+	void validate(std::size_t firstNewNode, std::size_t owner) {
+		std::size_t count = head_.size() - firstNewNode;
+
+		// Kahn's algorithm restricted to the new nodes.
+		std::vector<std::size_t> indegree(count, 0);
+		for (std::size_t n = firstNewNode; n < head_.size(); n++) {
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				if (edgeTarget_[e] >= firstNewNode) {
+					indegree[edgeTarget_[e] - firstNewNode]++;
+				}
+			}
+		}
+
+		std::vector<std::size_t> queue;
+		for (std::size_t i = 0; i < count; i++) {
+			if (indegree[i] == 0) {
+				queue.push_back(firstNewNode + i);
+			}
+		}
+
+		std::size_t ordered = 0;
+		while (!queue.empty()) {
+			std::size_t n = queue.back();
+			queue.pop_back();
+			ordered++;
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				if (edgeTarget_[e] >= firstNewNode && --indegree[edgeTarget_[e] - firstNewNode] == 0) {
+					queue.push_back(edgeTarget_[e]);
+				}
+			}
+		}
+
+		std::vector<std::vector<std::size_t>> cycles;
+		if (ordered != count) {
+			cycles = findCycles(firstNewNode, indegree);
+		}
+
+		if (owner != NONE) {
+			findCyclesThroughOwner(firstNewNode, owner, cycles);
+		}
+
+		if (cycles.empty()) {
+			return;
+		}
+
+		for (auto& cycle : cycles) {
+			log("Cycle found:");
+			std::size_t previous = NONE;
+			for (std::size_t n : cycle) {
+				if (n / 2 != previous) {
+					log("\t" + describe(n / 2));
+				}
+				previous = n / 2;
+			}
+		}
+		throw std::runtime_error("Cycle found.");
+	}
+
+	/**
+	 * Tarjan's algorithm over the new nodes that Kahn's algorithm could not order.
+	 *
+	 * @return Every strongly connected component that forms a cycle.
+	 */
+	std::vector<std::vector<std::size_t>> findCycles(std::size_t firstNewNode, const std::vector<std::size_t>& indegree) {
+		std::size_t count = indegree.size();
+		std::vector<std::size_t> order(count, NONE);
+		std::vector<std::size_t> lowlink(count, 0);
+		std::vector<char> onStack(count, 0);
+		std::vector<std::size_t> stack;
+		std::vector<std::vector<std::size_t>> cycles;
+		std::size_t counter = 0;
+
+		// Explicit call stack of (node, next edge to visit) to avoid recursing on deep graphs.
+		std::vector<std::pair<std::size_t, std::size_t>> calls;
+
+		for (std::size_t start = 0; start < count; start++) {
+			if (indegree[start] == 0 || order[start] != NONE) {
+				continue;
+			}
+
+			calls.push_back(std::make_pair(start, head_[firstNewNode + start]));
+			order[start] = lowlink[start] = counter++;
+			stack.push_back(start);
+			onStack[start] = 1;
+
+			while (!calls.empty()) {
+				std::size_t v = calls.back().first;
+				std::size_t& e = calls.back().second;
+
+				if (e != NONE) {
+					std::size_t target = edgeTarget_[e];
+					e = edgeNext_[e];
+
+					if (target < firstNewNode || indegree[target - firstNewNode] == 0) {
+						continue;
+					}
+
+					std::size_t w = target - firstNewNode;
+					if (order[w] == NONE) {
+						order[w] = lowlink[w] = counter++;
+						stack.push_back(w);
+						onStack[w] = 1;
+						calls.push_back(std::make_pair(w, head_[target]));
+					} else if (onStack[w]) {
+						lowlink[v] = std::min(lowlink[v], order[w]);
+					}
+					continue;
+				}
+
+				calls.pop_back();
+				if (!calls.empty()) {
+					std::size_t parent = calls.back().first;
+					lowlink[parent] = std::min(lowlink[parent], lowlink[v]);
+				}
+
+				if (lowlink[v] != order[v]) {
+					continue;
+				}
+
+				std::vector<std::size_t> component;
+				std::size_t w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					onStack[w] = 0;
+					component.push_back(firstNewNode + w);
+				} while (w != v);
+
+				if (component.size() > 1) {
+					std::reverse(component.begin(), component.end());
+					cycles.push_back(component);
+				}
+			}
+		}
+
+		return cycles;
+	}
+
+	/**
+	 * Followers added at runtime make `owner` wait on them. If any of them (transitively) waits on `owner`
+	 * in turn the build can never finish.
+	 */
+	void findCyclesThroughOwner(std::size_t firstNewNode, std::size_t owner, std::vector<std::vector<std::size_t>>& cycles) {
+		std::vector<char> waitsOnOwner(firstNewNode, 0);
+		std::vector<std::size_t> queue{doneNode(owner)};
+		waitsOnOwner[doneNode(owner)] = 1;
+
+		while (!queue.empty()) {
+			std::size_t n = queue.back();
+			queue.pop_back();
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				std::size_t target = edgeTarget_[e];
+				if (target < firstNewNode && !done_[target] && !waitsOnOwner[target]) {
+					waitsOnOwner[target] = 1;
+					queue.push_back(target);
+				}
+
+				if (target >= firstNewNode) {
+					cycles.push_back(std::vector<std::size_t>{doneNode(owner), n, target, doneNode(owner)});
+				}
+			}
+		}
+	}
+
+	std::string describe(std::size_t index) const {
+		const task_p& t = task(index);
+		return t->name().empty() ? "<unnamed task " + t->addr() + ">" : t->name();
+	}
+
+	void complete(std::size_t node, std::vector<std::size_t>& ready) {
+		std::vector<std::size_t> stack{node};
+		while (!stack.empty()) {
+			std::size_t n = stack.back();
+			stack.pop_back();
+			done_[n] = 1;
+
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				std::size_t target = edgeTarget_[e];
+				if (--pending_[target] != 0) {
+					continue;
+				}
+				if (target % 2 == 0) {
+					ready.push_back(target / 2);
+				} else {
+					stack.push_back(target);
+				}
+			}
+		}
+	}
+
+public:
+	/**
+	 * Adds the tasks reachable from `roots` to the graph.
+	 *
+	 * @return The indices of the added tasks that are ready to execute.
+	 */
+	std::vector<std::size_t> compile(const std::vector<task_p>& roots) {
+		std::vector<uint32_t> ids;
+		for (auto& root : roots) {
+			ids.push_back(Task::idOf(root));
+		}
+
+		std::vector<std::size_t> ready;
+		for (std::size_t index : add(ids, NONE)) {
+			if (pending_[runNode(index)] == 0) {
+				ready.push_back(index);
+			}
+		}
+		return ready;
+	}
+
+	/**
+	 * Records that the task at `index` executed successfully. Followers it added while executing are
+	 * compiled into the graph.
+	 *
+	 * @param ready Indices of tasks that became ready to execute are appended to this.
+	 */
+	void executed(std::size_t index, std::vector<std::size_t>& ready) {
+		const std::vector<uint32_t>& followers = task(index)->followerIds();
+		if (followers.size() > followerCounts_[index]) {
+			std::vector<uint32_t> added(followers.begin() + followerCounts_[index], followers.end());
+			followerCounts_[index] = followers.size();
+
+			for (std::size_t i : add(added, index)) {
+				if (pending_[runNode(i)] == 0) {
+					ready.push_back(i);
+				}
+			}
+		}
+
+		complete(runNode(index), ready);
+	}
+
+	bool isDone(const task_p& t) const {
+		uint32_t id = Task::idOf(t);
+		return id < indices_.size() && indices_[id] != NONE && done_[doneNode(indices_[id])];
+	}
+
+	const task_p& task(std::size_t index) const {
+		return detail::taskArena().get(ids_[index]);
+	}
+
+	std::size_t size() const {
+		return ids_.size();
+	}
+};
+
+const std::size_t TaskGraph::NONE;
+
+namespace detail {
+
+/**
+ * Executes `t` on the calling thread and records it in the trace.
+ */
+ExecutionResult executeTask(Task& t) {
+	if (!t.isTracked()) {
+		disableSnapshot();
+	}
+
+	if (t.name().empty()) {
+		return t.execute();
+	}
+
+	log("Executing: " + t.name());
+	if (!trace().isEnabled()) {
+		return t.execute();
+	}
+
+	long long begin = trace().now();
+	ExecutionResult result;
+	try {
+		result = t.execute();
+	} catch (...) {
+		trace().task(t.name(), begin, trace().now(), "exception");
+		throw;
+	}
+	trace().task(t.name(), begin, trace().now(), result == ExecutionResult::SUCCESS ? "success" : "failure");
+	return result;
+}
+
+} // namespace detail
+
+class Executor {
+	std::unordered_map<std::string, task_p> tasks_;
+
+	// The names of the tasks in order, so tasks whose names share a prefix can be found without searching
+	// every name.
+	std::set<std::string> names_;
+
+	std::queue<std::string> taskNamesToExecute_;
+
+	// Named tasks may be created by tasks that are already executing (e.g. configure tasks) so
+	// registration must be safe to call from any worker thread.
+	std::mutex tasksMutex_;
+
+protected:
+	/**
+	 * Creates a jobserver with `jobs` slots if commands may run nested builds and there isn't one to join
+	 * already. Must be called before any worker threads are started.
+	 */
+	void startJobServer(unsigned jobs) {
+		platform::JobServer& server = platform::jobServer();
+		if (server.isActive() || !server.isServerRequested()) {
+			return;
+		}
+
+		platform::JobServer::Style style = options().get("jobserver-style") == "pipe" ?
+			platform::JobServer::Style::PIPE : platform::JobServer::Style::FIFO;
+		if (!server.serve(jobs, style)) {
+			log_error("Unable to create a jobserver; nested builds will not share job slots");
+		}
+	}
+
+public:
+	virtual ~Executor() {}
+
+	/**
+	 * Executes `roots` and everything they depend on. May be called again with other tasks once it
+	 * returns, in which case tasks are executed again even if they were executed before.
+	 */
+	virtual ExecutionResult execute(const std::vector<task_p>& roots) = 0;
+
+	/**
+	 * Executes the tasks queued with @ref queue.
+	 */
+	ExecutionResult execute() {
+		return execute(dequeueTasks());
+	}
+
+	/**
+	 * Empties the queue of task names to execute.
+	 *
+	 * @return The tasks with the queued names.
+	 */
+	std::vector<task_p> dequeueTasks() {
+		std::vector<task_p> roots;
+		while (!taskNamesToExecute().empty()) {
+			auto name = taskNamesToExecute().front();
+			taskNamesToExecute().pop();
+
+			if (isPattern(name)) {
+				std::size_t matched = roots.size();
+				forEachTask(name, [&roots] (const task_p& t) { roots.push_back(t); });
+				if (roots.size() == matched) {
+					throw std::runtime_error("No tasks match: " + name);
+				}
+				continue;
+			}
+
+			task_p t = find(name);
+			if (t == nullptr) {
+				throw std::runtime_error("Unknown task: " + name);
+			}
+			roots.push_back(t);
+		}
+		return roots;
+	}
+
+	/**
+	 * @return True if `name` is a glob pattern selecting tasks rather than the name of a task.
+	 */
+	static bool isPattern(const std::string& name) {
+		return name.find_first_of("*?[{") != std::string::npos;
+	}
+
+	/**
+	 * @return The task with the given name or null if there is none.
+	 */
+	task_p find(const std::string& name) {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		auto it = tasks_.find(name);
+		return it == tasks_.end() ? nullptr : it->second;
+	}
+
+	/**
+	 * Calls `f` with every task that has a name, in order of their names. `f` must not add tasks.
+	 */
+	template <typename F>
+	void forEachTask(F f) {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		for (auto& name : names_) {
+			f(tasks_.find(name)->second);
+		}
+	}
+
+	/**
+	 * Calls `f` with every task whose name matches the glob pattern `pattern` (see cradle_glob.hpp), e.g.
+	 * `lib*`, in order of their names. Only the names starting with the characters before the first
+	 * wildcard are matched against the pattern. `f` must not add tasks.
+	 */
+	template <typename F>
+	void forEachTask(const std::string& pattern, F f) {
+		std::string prefix = pattern.substr(0, pattern.find_first_of("*?[{\\"));
+		io::Glob glob({pattern});
+
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		for (auto it = names_.lower_bound(prefix); it != names_.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+			if (glob.matches(*it)) {
+				f(tasks_.find(*it)->second);
+			}
+		}
+	}
+
+	/**
+	 * @return A copy of every task with a name. Prefer @ref find or @ref forEachTask, which don't copy them.
+	 */
+	std::unordered_map<std::string, task_p> tasks() {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		return tasks_;
+	}
+
+	std::queue<std::string>& taskNamesToExecute() {
+		return taskNamesToExecute_;
+	}
+
+	void add(task_p t) {
+		if (t->name().empty()) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		if (tasks_.find(t->name()) != tasks_.end()) {
+			throw std::runtime_error("Duplicate tasks with name: " + t->name());
+		}
+		tasks_[t->name()] = t;
+		names_.insert(t->name());
+	}
+
+	void queue(std::string name) {
+		taskNamesToExecute_.push(name);
+	}
+
+	/**
+	 * Check that none of the registered tasks are part of a cycle. Every cycle found is logged.
+	 */
+	void checkForCycles() {
+		std::vector<task_p> all;
+		forEachTask([&all] (const task_p& t) { all.push_back(t); });
+		TaskGraph().compile(all);
+	}
+};
+
+class SingleThreadedExecutor : public Executor {
+	TaskGraph graph;
+
+public:
+	using Executor::execute;
+
+	ExecutionResult execute(const std::vector<task_p>& roots) override {
+		graph = TaskGraph();
+		std::vector<std::size_t> ready = graph.compile(roots);
+		startJobServer(1);
+
+		while (!ready.empty()) {
+			std::size_t index = ready.back();
+			ready.pop_back();
+
+			task_p t = graph.task(index);
+			if (detail::executeTask(*t) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+
+			graph.executed(index, ready);
+		}
+		return ExecutionResult::SUCCESS;
+	}
+};
+
+/**
+ * Executes tasks on a pool of worker threads.
+ *
+ * A task becomes ready once all of its dependencies are done and it is done once it has executed and
+ * all of its followers (including followers added while it was executing) are done. Ready tasks are
+ * pushed onto the deque of the worker that made them ready. Workers take work from the back of their
+ * own deque and steal from the front of the other workers' deques when they run out.
+ */
+class ParallelExecutor : public Executor {
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::size_t> ready;
+	};
+
+	unsigned threadCount_;
+
+	// Guards the graph and the failure state below.
+	std::mutex graphMutex;
+	TaskGraph graph;
+	bool failed = false;
+	std::exception_ptr error;
+	std::condition_variable progress;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// The number of tasks in the workers' deques. It changes together with a deque, while holding that
+	// worker's mutex, so idle workers only wake up when there is a task to take. Locked after a worker's
+	// mutex.
+	std::mutex idleMutex;
+	std::condition_variable idle;
+	std::size_t available = 0;
+	bool stopping = false;
+
+	void fail(std::exception_ptr e) {
+		std::lock_guard<std::mutex> lock(graphMutex);
+		failed = true;
+		if (e && !error) {
+			error = e;
+		}
+		progress.notify_all();
+	}
+
+	void push(std::size_t workerIndex, const std::vector<std::size_t>& ready) {
+		if (ready.empty()) {
+			return;
+		}
+
+		{
+			Worker& w = *workers[workerIndex];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			w.ready.insert(w.ready.end(), ready.begin(), ready.end());
+
+			std::lock_guard<std::mutex> idleLock(idleMutex);
+			available += ready.size();
+		}
+		idle.notify_all();
+	}
+
+	bool pop(std::size_t workerIndex, std::size_t& index) {
+		for (std::size_t i = 0; i < workers.size(); i++) {
+			std::size_t victim = (workerIndex + i) % workers.size();
+			Worker& w = *workers[victim];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (w.ready.empty()) {
+				continue;
+			}
+
+			// Take the most recently readied task from our own deque and the oldest from anyone else's.
+			if (victim == workerIndex) {
+				index = w.ready.back();
+				w.ready.pop_back();
+			} else {
+				index = w.ready.front();
+				w.ready.pop_front();
+			}
+
+			std::lock_guard<std::mutex> idleLock(idleMutex);
+			available--;
+			return true;
+		}
+		return false;
+	}
+
+	void work(std::size_t workerIndex) {
+		while (true) {
+			std::size_t index;
+			if (!pop(workerIndex, index)) {
+				std::unique_lock<std::mutex> lock(idleMutex);
+				idle.wait(lock, [this] { return stopping || available > 0; });
+				if (stopping) {
+					return;
+				}
+				continue;
+			}
+
+			task_p t;
+			{
+				std::lock_guard<std::mutex> lock(graphMutex);
+				if (failed) {
+					continue;
+				}
+				t = graph.task(index);
+			}
+
+			std::vector<std::size_t> ready;
+			try {
+				if (detail::executeTask(*t) == ExecutionResult::FAILURE) {
+					fail(nullptr);
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(graphMutex);
+				graph.executed(index, ready);
+				progress.notify_all();
+			} catch (...) {
+				fail(std::current_exception());
+				continue;
+			}
+
+			push(workerIndex, ready);
+		}
+	}
+
+	bool isDone(const std::vector<task_p>& roots) const {
+		for (auto& t : roots) {
+			if (!graph.isDone(t)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	ParallelExecutor(unsigned threadCount = std::thread::hardware_concurrency()) :
+		threadCount_(std::max(1u, threadCount))
+	{}
+
+	unsigned threadCount() const {
+		return threadCount_;
+	}
+
+	void setThreadCount(unsigned threadCount) {
+		threadCount_ = std::max(1u, threadCount);
+	}
+
+	using Executor::execute;
+
+	ExecutionResult execute(const std::vector<task_p>& roots) override {
+		graph = TaskGraph();
+		failed = false;
+		error = nullptr;
+		std::vector<std::size_t> ready = graph.compile(roots);
+		startJobServer(threadCount_);
+
+		workers.clear();
+		for (unsigned i = 0; i < threadCount_; i++) {
+			workers.push_back(std::make_unique<Worker>());
+		}
+		stopping = false;
+		available = 0;
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < threadCount_; i++) {
+			threads.emplace_back([this, i] { work(i); });
+		}
+
+		push(0, ready);
+
+		{
+			std::unique_lock<std::mutex> lock(graphMutex);
+			progress.wait(lock, [&] { return failed || isDone(roots); });
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			stopping = true;
+		}
+		idle.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return failed ? ExecutionResult::FAILURE : ExecutionResult::SUCCESS;
+	}
+};
+
+static std::unique_ptr<Executor> executor = std::make_unique<ParallelExecutor>();
+
+/**
+ * Parses the command line. Arguments are the names of tasks to execute, or glob patterns such as `'lib*'`
+ * selecting every task whose name matches, except for:
+ *
+ *  - `-j N` (or `-jN`): The number of worker threads used by the @ref ParallelExecutor.
+ *    Defaults to the `-j` value of a parent make, otherwise the number of online CPUs.
+ *  - `--name` or `--name=value`: Stored in @ref options(). Recognized options:
+ *     - `--content-hash`: Decide whether inputs changed by their contents rather than their timestamps.
+ *     - `--jobserver-style=fifo|pipe`: How the jobserver shared with nested builds is exported. Use `pipe`
+ *       when nesting versions of make older than 4.4.
+ *     - `--list[=pattern]`: Print the names of the tasks, or of those matching the glob pattern, after
+ *       configuring the build instead of building.
+ *     - `--no-snapshot`: Always configure and check the whole build, rather than skipping it when the
+ *       null build snapshot shows that nothing changed. See cradle_snapshot.hpp.
+ *     - `--trace[=file]`: Record when each task and command ran and write it to `file` (@ref
+ *       DEFAULT_TRACE_FILE by default) in the Chrome trace event format.
+ *     - `--watch`: Keep running after the build and rebuild the tasks as their sources change. See
+ *       @ref watchAndRebuild.
+ */
+void parseCmdLineArgs(int argc, char** argv) {
+	commandLine().assign(argv, argv + argc);
+
+	// Take job slots from the jobserver of a parent make or cradle, if there is one.
+	const char* makeflags = std::getenv("MAKEFLAGS");
+	if (makeflags != nullptr && platform::jobServer().connect(makeflags)) {
+		ParallelExecutor* parallel = dynamic_cast<ParallelExecutor*>(executor.get());
+		if (parallel && platform::jobServer().parentJobCount() > 0) {
+			parallel->setThreadCount(platform::jobServer().parentJobCount());
+		}
+	}
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+
+		if (arg.compare(0, 2, "-j") == 0) {
+			std::string jobs = arg.substr(2);
+			if (jobs.empty() && i + 1 < argc) {
+				jobs = argv[++i];
+			}
+
+			ParallelExecutor* parallel = dynamic_cast<ParallelExecutor*>(executor.get());
+			if (parallel) {
+				parallel->setThreadCount(static_cast<unsigned>(std::stoul(jobs)));
+			}
+			continue;
+		}
+
+		if (arg.compare(0, 2, "--") == 0) {
+			std::size_t equals = arg.find('=');
+			if (equals == std::string::npos) {
+				options().set(arg.substr(2));
+			} else {
+				options().set(arg.substr(2, equals - 2), arg.substr(equals + 1));
+			}
+			continue;
+		}
+
+		executor->queue(arg);
+	}
+
+	if (options().has("trace")) {
+		trace().enable(options().get("trace").empty() ? DEFAULT_TRACE_FILE : options().get("trace"));
+	}
+}
+
+/**
+ * Prints the names of the tasks selected with `--list`.
+ */
+void listTasks() {
+	auto print = [] (const task_p& t) { log(t->name()); };
+	std::string pattern = options().get("list");
+	if (pattern.empty()) {
+		executor->forEachTask(print);
+	} else {
+		executor->forEachTask(pattern, print);
+	}
+}
+
+template <typename F>
+class FunctionTask : public Task {
+	F f;
+
+public:
+	FunctionTask(std::string name, F&& f) : Task(name), f(std::move(f)) {}
+	ExecutionResult execute() override {
+		return f(this);
+	}
+};
+
+/**
+ * Create a task and add it to the executor with the given name.
+ *
+ * @tparam F This is always a function type equivalent to (Task* Self) -> ExecutionResult.
+ *
+ * @param f This is a function of type (Task* self) -> ExecutionResult.
+ *          The function represents the behavior of the task and should return the appropriate
+ *          result representing the results of execution.
+ *          The `self` argument passed to `f` is always a pointer to the created task object.
+ */
+template <typename F>
+task_p task(std::string name, F&& f) {
+	task_p t = detail::taskArena().create<FunctionTask<F>>(name, std::move(f));
+	Task::idOf(t);
+	executor->add(t);
+	return t;
+}
+
+/**
+ * Create a task with no name. It will not be added to the executor.
+ *
+ * @tparam F This is always a function type equivalent to (Task* Self) -> ExecutionResult.
+ *
+ * @param f This is a function of type (Task* self) -> ExecutionResult.
+ *          The function represents the behavior of the task and should return the appropriate
+ *          result representing the results of execution.
+ *          The `self` argument passed to `f` is always a pointer to the created task object.
+ */
+template <typename F>
+task_p task(F f) {
+	task_p t = detail::taskArena().create<FunctionTask<F>>("", std::move(f));
+	Task::idOf(t);
+	return t;
+}
+
+/**
+ * Marks `t` as tracked by the null build snapshot (see @ref Task::markTracked) and returns it.
+ */
+task_p tracked(task_p t) {
+	t->markTracked();
+	return t;
+}
+
+void log(const std::string& msg) {
+	printf("%s\n", msg.c_str());
+}
+
+void log_error(const std::string& msg) {
+	printf("ERROR: %s\n", msg.c_str());
+}
+
+} // namespace cradle
+
+
+
+#include <functional>
+#include <vector>
+
+namespace cradle {
+namespace detail {
+
+class SubsequentTask {
+	std::shared_ptr<std::function<ExecutionResult(Task*,Task*)>> f;
+
+public:
+	SubsequentTask(std::function<ExecutionResult(Task*,Task*)> f) :
+		f(std::make_shared<std::function<ExecutionResult(Task*,Task*)>>(f))
+	{}
+
+	std::function<ExecutionResult(Task*,Task*)>& get() const {
+		return *f;
+	}
+};
+
+} // detail
+
+class TaskBuilder {
+	task_p _first;
+	std::string _name;
+	std::vector<detail::SubsequentTask> followers;
+	bool _tracked = false;
+
+	// Whether `_first` runs a function given to first().
+	bool _firstIsFunction = false;
+
+	static void copyNonconflictingKeys(Task* dst, Task* src) {
+		for (auto& k : src->propKeys()) {
+			if (!dst->has(k)) {
+				dst->set(k, src->get(k));
+			}
+		}
+		for (auto& k : src->listKeys()) {
+			if (!dst->has(k)) {
+				dst->push(k, src->getList(k));
+			}
+		}
+	}
+
+public:
+	TaskBuilder() :
+		_first(tracked(task([] (Task *) { return ExecutionResult::SUCCESS; })))
+	{}
+
+	TaskBuilder& name(std::string _name) {
+		this->_name = _name;
+		return *this;
+	}
+
+	TaskBuilder& first(std::function<ExecutionResult(Task*)> f) {
+		_first = task(std::move(f));
+		_firstIsFunction = true;
+		return *this;
+	}
+
+	TaskBuilder& first(task_p t) {
+		_first = t;
+		_firstIsFunction = false;
+		return *this;
+	}
+
+	/**
+	 * Marks the tasks running the given functions with @ref Task::markTracked, for functions that only set
+	 * properties, so that executing them doesn't prevent a null build snapshot.
+	 */
+	TaskBuilder& markTracked() {
+		_tracked = true;
+		return *this;
+	}
+
+	/**
+	 * Takes a function of type (Task* prev, Task* self) -> ExecutionResult.
+	 * This will be passed the preceding task as `prev` and itself as `self`.
+	 */
+	TaskBuilder& then(std::function<ExecutionResult(Task*,Task*)> t) {
+		followers.push_back(t);
+		return *this;
+	}
+
+	TaskBuilder& then(std::function<ExecutionResult(Task*)> f) {
+		followers.push_back(detail::SubsequentTask([f] (Task*, Task* self) { return f(self); }));
+		return *this;
+	}
+
+	TaskBuilder& then(task_p t) {
+		followers.push_back(detail::SubsequentTask([t] (Task*, Task* self) {
+			auto retVal = t->execute();
+			if (retVal == ExecutionResult::SUCCESS) {
+				TaskBuilder::copyNonconflictingKeys(self, t.get());
+			}
+			return retVal;
+		}));
+		return *this;
+	}
+
+	task_p build() {
+		task_p current = _first;
+		if (_tracked && _firstIsFunction) {
+			_first->markTracked();
+		}
+		std::vector<detail::SubsequentTask> subsequentTasks = followers;
+
+		for (auto nextFunction : subsequentTasks) {
+			task_p prev = current;
+			current = task([prev, nextFunction] (Task *self) {
+				ExecutionResult result = nextFunction.get()(prev.get(), self);
+				TaskBuilder::copyNonconflictingKeys(self, prev.get());
+				return result;
+			});
+			current->dependsOn(prev);
+			if (_tracked) {
+				current->markTracked();
+			}
+		}
+
+		// Create final task with name. Only the tasks running the given functions are untracked, unless marked.
+		task_p retVal = tracked(task(_name, [current] (Task* self) {
+			TaskBuilder::copyNonconflictingKeys(self, current.get());
+			return ExecutionResult::SUCCESS;
+		}));
+		retVal->dependsOn(current);
+
+		return retVal;
+	}
+};
+
+TaskBuilder task() {
+	return TaskBuilder();
+}
+
+}
+/**
+ * @file cradle_cache.hpp
+ *
+ * @brief A size-bounded, content-addressed store of build results that can be shared by concurrent cradle
+ *        processes, including processes on different machines sharing the directory over NFS.
+ *
+ * Every item is a file named by its key, a 32 character hex string, under one of 16 shards selected by the
+ * first character of the key:
+ *
+ *     <root>/<k[0]>/<k[1..2]>/<k[3..]>.<kind>
+ *
+ * No locks are taken. Items are written to `<root>/tmp` under a name unique to the host, process and item
+ * and renamed into place, so readers never see partial files and concurrent writers of the same item simply
+ * replace each other's (identical) results. Each item starts with a header holding its length and content
+ * hash, which is checked on every read; items that fail the check are deleted and treated as misses.
+ *
+ * Reading an item updates its modification time, which is what eviction orders by. A shard is trimmed to
+ * 90% of its share of the maximum size at the end of a run that stored into it. Statistics of every run are
+ * appended to `<root>/stats/<hostname>`, so hosts never append to the same file.
+ *
+ * A store can be opened read-only, in which case nothing in the directory is modified.
+ */
+
+
+/**
+ * @file
+ */
+
+
+/**
+ * @file cradle_types.hpp
+ *
+ * @brief Contains utility functions for creating trivial tasks.
+ */
+
+
+
+namespace cradle {
+
+task_p listOf(const std::string& key, std::initializer_list<std::string> items) {
+    std::vector<std::string> itemVector(items);
+    return tracked(task([key, items{move(itemVector)}] (Task* self) { self->push(key, items); return ExecutionResult::SUCCESS; }));
+}
+
+task_p emptyList(const std::string& key) {
+    return tracked(task([key] (Task* self) { self->ensureList(key); return ExecutionResult::SUCCESS; }));
+}
+
+} // namespace cradle
+/**
+ * @file cradle_dir_walk.hpp
+ *
+ * @brief Lists the files under a directory using several threads.
+ *
+ * On Linux directories are read with `getdents64`, whose entries carry the type of each file, so files
+ * don't have to be stat'ed one by one. Other platforms read directories with tinydir. Directories are
+ * taken off a shared queue by a small pool of threads, which also match the paths of the files they find.
+ * The results are put in order afterwards, entries sorted by name and depth first, so the listing doesn't
+ * depend on how the work was split up.
+ *
+ * Directories named `.git`, cradle's own build directory and directories ignored by a `.gitignore` file
+ * are not searched. `.gitignore` files are read from the directories that are searched and from the
+ * directories between the working directory and the one the search starts in. Their patterns only prune
+ * directories; files are only filtered by the @ref PathFilter passed to @ref walkDirectory.
+ */
+
+
+
+// Prevent the creation of min() and max() macros on Windows which interferes with std::min() and std::max().
+#define NOMINMAX
+
+/*
+Copyright (c) 2013-2018, tinydir authors:
+- Cong Xu
+- Lautis Sun
+- Baudouin Feildel
+- Andargor <andargor@yahoo.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef TINYDIR_H
+#define TINYDIR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if ((defined _UNICODE) && !(defined UNICODE))
+#define UNICODE
+#endif
+
+#if ((defined UNICODE) && !(defined _UNICODE))
+#define _UNICODE
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+# include <tchar.h>
+# pragma warning(push)
+# pragma warning (disable : 4996)
+#else
+# include <dirent.h>
+# include <libgen.h>
+# include <sys/stat.h>
+# include <stddef.h>
+#endif
+#ifdef __MINGW32__
+# include <tchar.h>
+#endif
+
+
+/* types */
+
+/* Windows UNICODE wide character support */
+#if defined _MSC_VER || defined __MINGW32__
+# define _tinydir_char_t TCHAR
+# define TINYDIR_STRING(s) _TEXT(s)
+# define _tinydir_strlen _tcslen
+# define _tinydir_strcpy _tcscpy
+# define _tinydir_strcat _tcscat
+# define _tinydir_strcmp _tcscmp
+# define _tinydir_strrchr _tcsrchr
+# define _tinydir_strncmp _tcsncmp
+#else
+# define _tinydir_char_t char
+# define TINYDIR_STRING(s) s
+# define _tinydir_strlen strlen
+# define _tinydir_strcpy strcpy
+# define _tinydir_strcat strcat
+# define _tinydir_strcmp strcmp
+# define _tinydir_strrchr strrchr
+# define _tinydir_strncmp strncmp
+#endif
+
+#if (defined _MSC_VER || defined __MINGW32__)
+# include <windows.h>
+# define _TINYDIR_PATH_MAX MAX_PATH
+#elif defined  __linux__
+# include <limits.h>
+# ifdef PATH_MAX
+#  define _TINYDIR_PATH_MAX PATH_MAX
+# endif
+#elif defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+# include <sys/param.h>
+# if defined(BSD)
+#  include <limits.h>
+#  ifdef PATH_MAX
+#   define _TINYDIR_PATH_MAX PATH_MAX
+#  endif
+# endif
+#endif
+
+#ifndef _TINYDIR_PATH_MAX
+#define _TINYDIR_PATH_MAX 4096
+#endif
+
+#ifdef _MSC_VER
+/* extra chars for the "\\*" mask */
+# define _TINYDIR_PATH_EXTRA 2
+#else
+# define _TINYDIR_PATH_EXTRA 0
+#endif
+
+#define _TINYDIR_FILENAME_MAX 256
+
+#if (defined _MSC_VER || defined __MINGW32__)
+#define _TINYDIR_DRIVE_MAX 3
+#endif
+
+#ifdef _MSC_VER
+# define _TINYDIR_FUNC static __inline
+#elif !defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L
+# define _TINYDIR_FUNC static __inline__
+#else
+# define _TINYDIR_FUNC static inline
+#endif
+
+/* readdir_r usage; define TINYDIR_USE_READDIR_R to use it (if supported) */
+#ifdef TINYDIR_USE_READDIR_R
+
+/* readdir_r is a POSIX-only function, and may not be available under various
+ * environments/settings, e.g. MinGW. Use readdir fallback */
+#if _POSIX_C_SOURCE >= 1 || _XOPEN_SOURCE || _BSD_SOURCE || _SVID_SOURCE ||\
+	_POSIX_SOURCE
+# define _TINYDIR_HAS_READDIR_R
+#endif
+#if _POSIX_C_SOURCE >= 200112L
+# define _TINYDIR_HAS_FPATHCONF
+# include <unistd.h>
+#endif
+#if _BSD_SOURCE || _SVID_SOURCE || \
+	(_POSIX_C_SOURCE >= 200809L || _XOPEN_SOURCE >= 700)
+# define _TINYDIR_HAS_DIRFD
+# include <sys/types.h>
+#endif
+#if defined _TINYDIR_HAS_FPATHCONF && defined _TINYDIR_HAS_DIRFD &&\
+	defined _PC_NAME_MAX
+# define _TINYDIR_USE_FPATHCONF
+#endif
+#if defined __MINGW32__ || !defined _TINYDIR_HAS_READDIR_R ||\
+	!(defined _TINYDIR_USE_FPATHCONF || defined NAME_MAX)
+# define _TINYDIR_USE_READDIR
+#endif
+
+/* Use readdir by default */
+#else
+# define _TINYDIR_USE_READDIR
+#endif
+
+/* MINGW32 has two versions of dirent, ASCII and UNICODE*/
+#ifndef _MSC_VER
+#if (defined __MINGW32__) && (defined _UNICODE)
+#define _TINYDIR_DIR _WDIR
+#define _tinydir_dirent _wdirent
+#define _tinydir_opendir _wopendir
+#define _tinydir_readdir _wreaddir
+#define _tinydir_closedir _wclosedir
+#else
+#define _TINYDIR_DIR DIR
+#define _tinydir_dirent dirent
+#define _tinydir_opendir opendir
+#define _tinydir_readdir readdir
+#define _tinydir_closedir closedir
+#endif
+#endif
+
+/* Allow user to use a custom allocator by defining _TINYDIR_MALLOC and _TINYDIR_FREE. */
+#if    defined(_TINYDIR_MALLOC) &&  defined(_TINYDIR_FREE)
+#elif !defined(_TINYDIR_MALLOC) && !defined(_TINYDIR_FREE)
+#else
+#error "Either define both alloc and free or none of them!"
+#endif
+
+#if !defined(_TINYDIR_MALLOC)
+	#define _TINYDIR_MALLOC(_size) malloc(_size)
+	#define _TINYDIR_FREE(_ptr)    free(_ptr)
+#endif /* !defined(_TINYDIR_MALLOC) */
+
+typedef struct tinydir_file
+{
+	_tinydir_char_t path[_TINYDIR_PATH_MAX];
+	_tinydir_char_t name[_TINYDIR_FILENAME_MAX];
+	_tinydir_char_t *extension;
+	int is_dir;
+	int is_reg;
+
+#ifndef _MSC_VER
+#ifdef __MINGW32__
+	struct _stat _s;
+#else
+	struct stat _s;
+#endif
+#endif
+} tinydir_file;
+
+typedef struct tinydir_dir
+{
+	_tinydir_char_t path[_TINYDIR_PATH_MAX];
+	int has_next;
+	size_t n_files;
+
+	tinydir_file *_files;
+#ifdef _MSC_VER
+	HANDLE _h;
+	WIN32_FIND_DATA _f;
+#else
+	_TINYDIR_DIR *_d;
+	struct _tinydir_dirent *_e;
+#ifndef _TINYDIR_USE_READDIR
+	struct _tinydir_dirent *_ep;
+#endif
+#endif
+} tinydir_dir;
+
+
+/* declarations */
+
+_TINYDIR_FUNC
+int tinydir_open(tinydir_dir *dir, const _tinydir_char_t *path);
+_TINYDIR_FUNC
+int tinydir_open_sorted(tinydir_dir *dir, const _tinydir_char_t *path);
+_TINYDIR_FUNC
+void tinydir_close(tinydir_dir *dir);
+
+_TINYDIR_FUNC
+int tinydir_next(tinydir_dir *dir);
+_TINYDIR_FUNC
+int tinydir_readfile(const tinydir_dir *dir, tinydir_file *file);
+_TINYDIR_FUNC
+int tinydir_readfile_n(const tinydir_dir *dir, tinydir_file *file, size_t i);
+_TINYDIR_FUNC
+int tinydir_open_subdir_n(tinydir_dir *dir, size_t i);
+
+_TINYDIR_FUNC
+int tinydir_file_open(tinydir_file *file, const _tinydir_char_t *path);
+_TINYDIR_FUNC
+void _tinydir_get_ext(tinydir_file *file);
+_TINYDIR_FUNC
+int _tinydir_file_cmp(const void *a, const void *b);
+#ifndef _MSC_VER
+#ifndef _TINYDIR_USE_READDIR
+_TINYDIR_FUNC
+size_t _tinydir_dirent_buf_size(_TINYDIR_DIR *dirp);
+#endif
+#endif
+
+
+/* definitions*/
+
+_TINYDIR_FUNC
+int tinydir_open(tinydir_dir *dir, const _tinydir_char_t *path)
+{
+#ifndef _MSC_VER
+#ifndef _TINYDIR_USE_READDIR
+	int error;
+	int size;	/* using int size */
+#endif
+#else
+	_tinydir_char_t path_buf[_TINYDIR_PATH_MAX];
+#endif
+	_tinydir_char_t *pathp;
+
+	if (dir == NULL || path == NULL || _tinydir_strlen(path) == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (_tinydir_strlen(path) + _TINYDIR_PATH_EXTRA >= _TINYDIR_PATH_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	/* initialise dir */
+	dir->_files = NULL;
+#ifdef _MSC_VER
+	dir->_h = INVALID_HANDLE_VALUE;
+#else
+	dir->_d = NULL;
+#ifndef _TINYDIR_USE_READDIR
+	dir->_ep = NULL;
+#endif
+#endif
+	tinydir_close(dir);
+
+	_tinydir_strcpy(dir->path, path);
+	/* Remove trailing slashes */
+	pathp = &dir->path[_tinydir_strlen(dir->path) - 1];
+	while (pathp != dir->path && (*pathp == TINYDIR_STRING('\\') || *pathp == TINYDIR_STRING('/')))
+	{
+		*pathp = TINYDIR_STRING('\0');
+		pathp++;
+	}
+#ifdef _MSC_VER
+	_tinydir_strcpy(path_buf, dir->path);
+	_tinydir_strcat(path_buf, TINYDIR_STRING("\\*"));
+#if (defined WINAPI_FAMILY) && (WINAPI_FAMILY != WINAPI_FAMILY_DESKTOP_APP)
+	dir->_h = FindFirstFileEx(path_buf, FindExInfoStandard, &dir->_f, FindExSearchNameMatch, NULL, 0);
+#else
+	dir->_h = FindFirstFile(path_buf, &dir->_f);
+#endif
+	if (dir->_h == INVALID_HANDLE_VALUE)
+	{
+		errno = ENOENT;
+#else
+	dir->_d = _tinydir_opendir(path);
+	if (dir->_d == NULL)
+	{
+#endif
+		goto bail;
+	}
+
+	/* read first file */
+	dir->has_next = 1;
+#ifndef _MSC_VER
+#ifdef _TINYDIR_USE_READDIR
+	dir->_e = _tinydir_readdir(dir->_d);
+#else
+	/* allocate dirent buffer for readdir_r */
+	size = _tinydir_dirent_buf_size(dir->_d); /* conversion to int */
+	if (size == -1) return -1;
+	dir->_ep = (struct _tinydir_dirent*)_TINYDIR_MALLOC(size);
+	if (dir->_ep == NULL) return -1;
+
+	error = readdir_r(dir->_d, dir->_ep, &dir->_e);
+	if (error != 0) return -1;
+#endif
+	if (dir->_e == NULL)
+	{
+		dir->has_next = 0;
+	}
+#endif
+
+	return 0;
+
+bail:
+	tinydir_close(dir);
+	return -1;
+}
+
+_TINYDIR_FUNC
+int tinydir_open_sorted(tinydir_dir *dir, const _tinydir_char_t *path)
+{
+	/* Count the number of files first, to pre-allocate the files array */
+	size_t n_files = 0;
+	if (tinydir_open(dir, path) == -1)
+	{
+		return -1;
+	}
+	while (dir->has_next)
+	{
+		n_files++;
+		if (tinydir_next(dir) == -1)
+		{
+			goto bail;
+		}
+	}
+	tinydir_close(dir);
+
+	if (n_files == 0 || tinydir_open(dir, path) == -1)
+	{
+		return -1;
+	}
+
+	dir->n_files = 0;
+	dir->_files = (tinydir_file *)_TINYDIR_MALLOC(sizeof *dir->_files * n_files);
+	if (dir->_files == NULL)
+	{
+		goto bail;
+	}
+	while (dir->has_next)
+	{
+		tinydir_file *p_file;
+		dir->n_files++;
+
+		p_file = &dir->_files[dir->n_files - 1];
+		if (tinydir_readfile(dir, p_file) == -1)
+		{
+			goto bail;
+		}
+
+		if (tinydir_next(dir) == -1)
+		{
+			goto bail;
+		}
+
+		/* Just in case the number of files has changed between the first and
+		second reads, terminate without writing into unallocated memory */
+		if (dir->n_files == n_files)
+		{
+			break;
+		}
+	}
+
+	qsort(dir->_files, dir->n_files, sizeof(tinydir_file), _tinydir_file_cmp);
+
+	return 0;
+
+bail:
+	tinydir_close(dir);
+	return -1;
+}
+
+_TINYDIR_FUNC
+void tinydir_close(tinydir_dir *dir)
+{
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	memset(dir->path, 0, sizeof(dir->path));
+	dir->has_next = 0;
+	dir->n_files = 0;
+	_TINYDIR_FREE(dir->_files);
+	dir->_files = NULL;
+#ifdef _MSC_VER
+	if (dir->_h != INVALID_HANDLE_VALUE)
+	{
+		FindClose(dir->_h);
+	}
+	dir->_h = INVALID_HANDLE_VALUE;
+#else
+	if (dir->_d)
+	{
+		_tinydir_closedir(dir->_d);
+	}
+	dir->_d = NULL;
+	dir->_e = NULL;
+#ifndef _TINYDIR_USE_READDIR
+	_TINYDIR_FREE(dir->_ep);
+	dir->_ep = NULL;
+#endif
+#endif
+}
+
+_TINYDIR_FUNC
+int tinydir_next(tinydir_dir *dir)
+{
+	if (dir == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!dir->has_next)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+#ifdef _MSC_VER
+	if (FindNextFile(dir->_h, &dir->_f) == 0)
+#else
+#ifdef _TINYDIR_USE_READDIR
+	dir->_e = _tinydir_readdir(dir->_d);
+#else
+	if (dir->_ep == NULL)
+	{
+		return -1;
+	}
+	if (readdir_r(dir->_d, dir->_ep, &dir->_e) != 0)
+	{
+		return -1;
+	}
+#endif
+	if (dir->_e == NULL)
+#endif
+	{
+		dir->has_next = 0;
+#ifdef _MSC_VER
+		if (GetLastError() != ERROR_SUCCESS &&
+			GetLastError() != ERROR_NO_MORE_FILES)
+		{
+			tinydir_close(dir);
+			errno = EIO;
+			return -1;
+		}
+#endif
+	}
+
+	return 0;
+}
+
+_TINYDIR_FUNC
+int tinydir_readfile(const tinydir_dir *dir, tinydir_file *file)
+{
+	if (dir == NULL || file == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+#ifdef _MSC_VER
+	if (dir->_h == INVALID_HANDLE_VALUE)
+#else
+	if (dir->_e == NULL)
+#endif
+	{
+		errno = ENOENT;
+		return -1;
+	}
+	if (_tinydir_strlen(dir->path) +
+		_tinydir_strlen(
+#ifdef _MSC_VER
+			dir->_f.cFileName
+#else
+			dir->_e->d_name
+#endif
+		) + 1 + _TINYDIR_PATH_EXTRA >=
+		_TINYDIR_PATH_MAX)
+	{
+		/* the path for the file will be too long */
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (_tinydir_strlen(
+#ifdef _MSC_VER
+			dir->_f.cFileName
+#else
+			dir->_e->d_name
+#endif
+		) >= _TINYDIR_FILENAME_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	_tinydir_strcpy(file->path, dir->path);
+	_tinydir_strcat(file->path, TINYDIR_STRING("/"));
+	_tinydir_strcpy(file->name,
+#ifdef _MSC_VER
+		dir->_f.cFileName
+#else
+		dir->_e->d_name
+#endif
+	);
+	_tinydir_strcat(file->path, file->name);
+#ifndef _MSC_VER
+#ifdef __MINGW32__
+	if (_tstat(
+#elif (defined _BSD_SOURCE) || (defined _DEFAULT_SOURCE)	\
+	|| ((defined _XOPEN_SOURCE) && (_XOPEN_SOURCE >= 500))	\
+	|| ((defined _POSIX_C_SOURCE) && (_POSIX_C_SOURCE >= 200112L))
+	if (lstat(
+#else
+	if (stat(
+#endif
+		file->path, &file->_s) == -1)
+	{
+		return -1;
+	}
+#endif
+	_tinydir_get_ext(file);
+
+	file->is_dir =
+#ifdef _MSC_VER
+		!!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+		S_ISDIR(file->_s.st_mode);
+#endif
+	file->is_reg =
+#ifdef _MSC_VER
+		!!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_NORMAL) ||
+		(
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) &&
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_ENCRYPTED) &&
+#ifdef FILE_ATTRIBUTE_INTEGRITY_STREAM
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_INTEGRITY_STREAM) &&
+#endif
+#ifdef FILE_ATTRIBUTE_NO_SCRUB_DATA
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_NO_SCRUB_DATA) &&
+#endif
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_OFFLINE) &&
+			!(dir->_f.dwFileAttributes & FILE_ATTRIBUTE_TEMPORARY));
+#else
+		S_ISREG(file->_s.st_mode);
+#endif
+
+	return 0;
+}
+
+_TINYDIR_FUNC
+int tinydir_readfile_n(const tinydir_dir *dir, tinydir_file *file, size_t i)
+{
+	if (dir == NULL || file == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (i >= dir->n_files)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	memcpy(file, &dir->_files[i], sizeof(tinydir_file));
+	_tinydir_get_ext(file);
+
+	return 0;
+}
+
+_TINYDIR_FUNC
+int tinydir_open_subdir_n(tinydir_dir *dir, size_t i)
+{
+	_tinydir_char_t path[_TINYDIR_PATH_MAX];
+	if (dir == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (i >= dir->n_files || !dir->_files[i].is_dir)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	_tinydir_strcpy(path, dir->_files[i].path);
+	tinydir_close(dir);
+	if (tinydir_open_sorted(dir, path) == -1)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Open a single file given its path */
+_TINYDIR_FUNC
+int tinydir_file_open(tinydir_file *file, const _tinydir_char_t *path)
+{
+	tinydir_dir dir;
+	int result = 0;
+	int found = 0;
+	_tinydir_char_t dir_name_buf[_TINYDIR_PATH_MAX];
+	_tinydir_char_t file_name_buf[_TINYDIR_FILENAME_MAX];
+	_tinydir_char_t *dir_name;
+	_tinydir_char_t *base_name;
+#if (defined _MSC_VER || defined __MINGW32__)
+	_tinydir_char_t drive_buf[_TINYDIR_PATH_MAX];
+	_tinydir_char_t ext_buf[_TINYDIR_FILENAME_MAX];
+#endif
+
+	if (file == NULL || path == NULL || _tinydir_strlen(path) == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (_tinydir_strlen(path) + _TINYDIR_PATH_EXTRA >= _TINYDIR_PATH_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	/* Get the parent path */
+#if (defined _MSC_VER || defined __MINGW32__)
+#if ((defined _MSC_VER) && (_MSC_VER >= 1400))
+		errno = _tsplitpath_s(
+			path,
+			drive_buf, _TINYDIR_DRIVE_MAX,
+			dir_name_buf, _TINYDIR_FILENAME_MAX,
+			file_name_buf, _TINYDIR_FILENAME_MAX,
+			ext_buf, _TINYDIR_FILENAME_MAX);
+#else
+		_tsplitpath(
+			path,
+			drive_buf,
+			dir_name_buf,
+			file_name_buf,
+			ext_buf);
+#endif
+
+if (errno)
+{
+	return -1;
+}
+
+/* _splitpath_s not work fine with only filename and widechar support */
+#ifdef _UNICODE
+		if (drive_buf[0] == L'\xFEFE')
+			drive_buf[0] = '\0';
+		if (dir_name_buf[0] == L'\xFEFE')
+			dir_name_buf[0] = '\0';
+#endif
+
+	/* Emulate the behavior of dirname by returning "." for dir name if it's
+	empty */
+	if (drive_buf[0] == '\0' && dir_name_buf[0] == '\0')
+	{
+		_tinydir_strcpy(dir_name_buf, TINYDIR_STRING("."));
+	}
+	/* Concatenate the drive letter and dir name to form full dir name */
+	_tinydir_strcat(drive_buf, dir_name_buf);
+	dir_name = drive_buf;
+	/* Concatenate the file name and extension to form base name */
+	_tinydir_strcat(file_name_buf, ext_buf);
+	base_name = file_name_buf;
+#else
+	_tinydir_strcpy(dir_name_buf, path);
+	dir_name = dirname(dir_name_buf);
+	_tinydir_strcpy(file_name_buf, path);
+	base_name =basename(file_name_buf);
+#endif
+
+	/* Open the parent directory */
+	if (tinydir_open(&dir, dir_name) == -1)
+	{
+		return -1;
+	}
+
+	/* Read through the parent directory and look for the file */
+	while (dir.has_next)
+	{
+		if (tinydir_readfile(&dir, file) == -1)
+		{
+			result = -1;
+			goto bail;
+		}
+		if (_tinydir_strcmp(file->name, base_name) == 0)
+		{
+			/* File found */
+			found = 1;
+			break;
+		}
+		tinydir_next(&dir);
+	}
+	if (!found)
+	{
+		result = -1;
+		errno = ENOENT;
+	}
+
+bail:
+	tinydir_close(&dir);
+	return result;
+}
+
+_TINYDIR_FUNC
+void _tinydir_get_ext(tinydir_file *file)
+{
+	_tinydir_char_t *period = _tinydir_strrchr(file->name, TINYDIR_STRING('.'));
+	if (period == NULL)
+	{
+		file->extension = &(file->name[_tinydir_strlen(file->name)]);
+	}
+	else
+	{
+		file->extension = period + 1;
+	}
+}
+
+_TINYDIR_FUNC
+int _tinydir_file_cmp(const void *a, const void *b)
+{
+	const tinydir_file *fa = (const tinydir_file *)a;
+	const tinydir_file *fb = (const tinydir_file *)b;
+	if (fa->is_dir != fb->is_dir)
+	{
+		return -(fa->is_dir - fb->is_dir);
+	}
+	return _tinydir_strncmp(fa->name, fb->name, _TINYDIR_FILENAME_MAX);
+}
+
+#ifndef _MSC_VER
+#ifndef _TINYDIR_USE_READDIR
+/*
+The following authored by Ben Hutchings <ben@decadent.org.uk>
+from https://womble.decadent.org.uk/readdir_r-advisory.html
+*/
+/* Calculate the required buffer size (in bytes) for directory      *
+* entries read from the given directory handle.  Return -1 if this  *
+* this cannot be done.                                              *
+*                                                                   *
+* This code does not trust values of NAME_MAX that are less than    *
+* 255, since some systems (including at least HP-UX) incorrectly    *
+* define it to be a smaller value.                                  */
+_TINYDIR_FUNC
+size_t _tinydir_dirent_buf_size(_TINYDIR_DIR *dirp)
+{
+	long name_max;
+	size_t name_end;
+	/* parameter may be unused */
+	(void)dirp;
+
+#if defined _TINYDIR_USE_FPATHCONF
+	name_max = fpathconf(dirfd(dirp), _PC_NAME_MAX);
+	if (name_max == -1)
+#if defined(NAME_MAX)
+		name_max = (NAME_MAX > 255) ? NAME_MAX : 255;
+#else
+		return (size_t)(-1);
+#endif
+#elif defined(NAME_MAX)
+ 	name_max = (NAME_MAX > 255) ? NAME_MAX : 255;
+#else
+#error "buffer size for readdir_r cannot be determined"
+#endif
+	name_end = (size_t)offsetof(struct _tinydir_dirent, d_name) + name_max + 1;
+	return (name_end > sizeof(struct _tinydir_dirent) ?
+		name_end : sizeof(struct _tinydir_dirent));
+}
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+# if defined (_MSC_VER)
+# pragma warning(pop)
+# endif
+
+#endif
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef PLATFORM_LINUX
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace io {
+
+/**
+ * Decides which files a directory walk lists by their paths.
+ */
+class PathFilter {
+public:
+	virtual ~PathFilter() {}
+	virtual bool matches(const std::string& path) const = 0;
+};
+
+/**
+ * Matches entire paths against an `include` and an `exclude` regex, as @ref files does.
+ */
+class RegexFilter : public PathFilter {
+	std::regex include;
+	std::regex exclude;
+
+public:
+	RegexFilter(const std::regex& include, const std::regex& exclude) : include(include), exclude(exclude) {}
+
+	bool matches(const std::string& path) const override {
+		return std::regex_match(path, include) && !std::regex_match(path, exclude);
+	}
+};
+
+/**
+ * Matches the paths of files under `root`, relative to `root`, against glob patterns, as @ref glob does.
+ */
+class GlobFilter : public PathFilter {
+	std::string root;
+	Glob patterns;
+
+public:
+	GlobFilter(const std::string& root, const std::vector<std::string>& include, const std::vector<std::string>& exclude) :
+		root(root),
+		patterns(include, exclude)
+	{}
+
+	bool matches(const std::string& path) const override {
+		if (path.size() <= root.size() + 1 || path.compare(0, root.size(), root) != 0 || path[root.size()] != '/') {
+			return false;
+		}
+		return patterns.matches(path.data() + root.size() + 1, path.size() - root.size() - 1);
+	}
+};
+
+namespace detail {
+
+// The most threads used to walk one directory tree.
+static const unsigned DIRECTORY_WALK_MAX_THREADS = 8;
+
+struct DirectoryEntry {
+	std::string name;
+	bool isDirectory;
+};
+
+/**
+ * Appends the entries of the directory at `path`, except `.` and `..`, to `entries`. Symbolic links are
+ * reported as files.
+ *
+ * @return False if the directory couldn't be read.
+ */
+bool readDirectory(const std::string& path, std::vector<DirectoryEntry>& entries) {
+#ifdef PLATFORM_LINUX
+	int fd = openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	alignas(struct dirent64) char buffer[32 * 1024];
+	long size;
+	while ((size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+		for (long pos = 0; pos < size;) {
+			const struct dirent64* entry = reinterpret_cast<const struct dirent64*>(buffer + pos);
+			pos += entry->d_reclen;
+
+			const char* name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+
+			bool isDirectory = entry->d_type == DT_DIR;
+			if (entry->d_type == DT_UNKNOWN) {
+				// Some file systems don't report types.
+				struct stat s;
+				isDirectory = fstatat(fd, name, &s, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(s.st_mode);
+			}
+			entries.push_back(DirectoryEntry{name, isDirectory});
+		}
+	}
+
+	close(fd);
+	return size == 0;
+#else
+	tinydir_dir dir;
+	if (tinydir_open(&dir, path.c_str()) != 0) {
+		return false;
+	}
+
+	for (; dir.has_next; tinydir_next(&dir)) {
+		tinydir_file file;
+		if (tinydir_readfile(&dir, &file) != 0) {
+			continue;
+		}
+		if (std::strcmp(file.name, ".") == 0 || std::strcmp(file.name, "..") == 0) {
+			continue;
+		}
+		entries.push_back(DirectoryEntry{file.name, file.is_dir != 0});
+	}
+
+	tinydir_close(&dir);
+	return true;
+#endif
+}
+
+/**
+ * The patterns of a `.gitignore` file along with those of the `.gitignore` files in the directories above
+ * it, which are overridden by its own.
+ */
+class IgnoreFile {
+	struct Pattern {
+		Glob glob;
+		bool negated;
+
+		// Anchored patterns are matched against the path relative to the `.gitignore`, others against the
+		// name of the directory.
+		bool anchored;
+	};
+
+	std::vector<Pattern> patterns;
+
+	// The length of the path of the directory containing the file, including the separator after it.
+	std::size_t prefixLength;
+
+	std::shared_ptr<const IgnoreFile> parent;
+
+public:
+	IgnoreFile(const std::string& contents, std::size_t prefixLength, std::shared_ptr<const IgnoreFile> parent) :
+		prefixLength(prefixLength),
+		parent(parent)
+	{
+		std::size_t begin = 0;
+		while (begin < contents.size()) {
+			std::size_t end = contents.find('\n', begin);
+			if (end == std::string::npos) {
+				end = contents.size();
+			}
+			std::string line = contents.substr(begin, end - begin);
+			begin = end + 1;
+
+			while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+				line.pop_back();
+			}
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			bool negated = line[0] == '!';
+			if (negated || (line[0] == '\\' && (line[1] == '#' || line[1] == '!'))) {
+				line.erase(0, 1);
+			}
+			while (!line.empty() && line.back() == '/') {
+				line.pop_back();
+			}
+			bool anchored = line.find('/') != std::string::npos;
+			if (anchored && line[0] == '/') {
+				line.erase(0, 1);
+			}
+			if (!line.empty()) {
+				patterns.push_back(Pattern{Glob({line}), negated, anchored});
+			}
+		}
+	}
+
+	/**
+	 * Reads the `.gitignore` in `directory`.
+	 *
+	 * @param prefixLength The length of `directory` as it appears in the paths passed to @ref isIgnored,
+	 *                     including the separator after it.
+	 * @return `parent` if there is no `.gitignore` in `directory`.
+	 */
+	static std::shared_ptr<const IgnoreFile> read(const std::string& directory, std::size_t prefixLength, std::shared_ptr<const IgnoreFile> parent) {
+		std::ifstream in(directory.empty() ? ".gitignore" : directory + "/.gitignore", std::ios::binary);
+		if (!in) {
+			return parent;
+		}
+		std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		return std::make_shared<const IgnoreFile>(contents, prefixLength, parent);
+	}
+
+	/**
+	 * @return True if the directory at `path` is ignored. The last pattern that matches wins.
+	 */
+	bool isIgnored(const std::string& path) const {
+		bool ignored = parent != nullptr && parent->isIgnored(path);
+		if (path.size() <= prefixLength) {
+			return ignored;
+		}
+
+		const char* relative = path.c_str() + prefixLength;
+		std::size_t relativeLength = path.size() - prefixLength;
+		std::size_t slash = path.find_last_of('/');
+		const char* name = slash == std::string::npos || slash < prefixLength ? relative : path.c_str() + slash + 1;
+		std::size_t nameLength = path.c_str() + path.size() - name;
+
+		for (auto& pattern : patterns) {
+			// Only a pattern that would change the result needs to be matched.
+			if (
+				pattern.negated == ignored &&
+				(pattern.anchored ? pattern.glob.matches(relative, relativeLength) : pattern.glob.matches(name, nameLength))
+			) {
+				ignored = !pattern.negated;
+			}
+		}
+		return ignored;
+	}
+};
+
+class DirectoryWalk {
+	struct Directory {
+		std::string path;
+		std::shared_ptr<const IgnoreFile> ignore;
+
+		// Taken before the directory is read, or zeroed if it couldn't be.
+		struct stat status;
+
+		// Matching files, whose directory is null, and subdirectories by name.
+		std::vector<std::pair<std::string, std::unique_ptr<Directory>>> entries;
+
+		Directory(const std::string& path, std::shared_ptr<const IgnoreFile> ignore) :
+			path(path),
+			ignore(ignore)
+		{}
+	};
+
+	const PathFilter& filter;
+	std::string buildDir;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<Directory*> pending;
+	std::size_t active = 0;
+
+	bool isPruned(const std::string& name, const std::string& path, const IgnoreFile* ignore) const {
+		if (name == ".git") {
+			return true;
+		}
+
+		std::size_t start = 0;
+		while (path.compare(start, 2, "./") == 0) {
+			start += 2;
+		}
+		if (path.compare(start, std::string::npos, DEFAULT_BUILD_DIR) == 0 || path == buildDir) {
+			return true;
+		}
+		return ignore != nullptr && ignore->isIgnored(path);
+	}
+
+	/**
+	 * Reads `directory` and returns its subdirectories.
+	 */
+	std::vector<Directory*> visit(Directory& directory) {
+		if (stat(directory.path.c_str(), &directory.status) != 0) {
+			std::memset(&directory.status, 0, sizeof(directory.status));
+		}
+
+		std::vector<DirectoryEntry> entries;
+		readDirectory(directory.path, entries);
+
+		std::string prefix = directory.path + "/";
+		for (auto& entry : entries) {
+			if (!entry.isDirectory && entry.name == ".gitignore") {
+				directory.ignore = IgnoreFile::read(directory.path, prefix.size(), directory.ignore);
+				break;
+			}
+		}
+
+		std::vector<Directory*> subdirectories;
+		for (auto& entry : entries) {
+			std::string path = prefix + entry.name;
+			if (entry.isDirectory) {
+				if (!isPruned(entry.name, path, directory.ignore.get())) {
+					std::unique_ptr<Directory> subdirectory(new Directory(path, directory.ignore));
+					subdirectories.push_back(subdirectory.get());
+					directory.entries.emplace_back(std::move(entry.name), std::move(subdirectory));
+				}
+			} else if (filter.matches(path)) {
+				directory.entries.emplace_back(std::move(entry.name), nullptr);
+			}
+		}
+
+		std::sort(directory.entries.begin(), directory.entries.end(), [] (
+				const std::pair<std::string, std::unique_ptr<Directory>>& a,
+				const std::pair<std::string, std::unique_ptr<Directory>>& b
+		) {
+			return a.first < b.first;
+		});
+		return subdirectories;
+	}
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed.wait(lock, [this] { return !pending.empty() || active == 0; });
+			if (pending.empty()) {
+				return;
+			}
+
+			Directory* directory = pending.back();
+			pending.pop_back();
+			active++;
+			lock.unlock();
+
+			std::vector<Directory*> subdirectories = visit(*directory);
+
+			lock.lock();
+			active--;
+			pending.insert(pending.end(), subdirectories.begin(), subdirectories.end());
+			if (!subdirectories.empty() || (active == 0 && pending.empty())) {
+				changed.notify_all();
+			}
+		}
+	}
+
+	static void collect(
+			const Directory& directory,
+			std::vector<std::string>& files,
+			std::vector<std::string>* directories,
+			std::vector<struct stat>* directoryStats
+	) {
+		if (directories != nullptr) {
+			directories->push_back(directory.path);
+		}
+		if (directoryStats != nullptr) {
+			directoryStats->push_back(directory.status);
+		}
+		for (auto& entry : directory.entries) {
+			if (entry.second == nullptr) {
+				files.push_back(directory.path + "/" + entry.first);
+			} else {
+				collect(*entry.second, files, directories, directoryStats);
+			}
+		}
+	}
+
+	/**
+	 * @return The `.gitignore` files between the working directory and `root`, if `root` is below it.
+	 */
+	static std::shared_ptr<const IgnoreFile> ancestorIgnoreFiles(const std::string& root) {
+		std::size_t start = 0;
+		while (root.compare(start, 2, "./") == 0) {
+			start += 2;
+		}
+		std::size_t end = root.find_last_not_of('/');
+		if (root.empty() || root[0] == '/' || root == "." || end == std::string::npos || end < start || root.find("..") != std::string::npos) {
+			return nullptr;
+		}
+
+		std::shared_ptr<const IgnoreFile> ignore = IgnoreFile::read("", start, nullptr);
+		for (std::size_t slash = root.find('/', start); slash != std::string::npos && slash < end; slash = root.find('/', slash + 1)) {
+			ignore = IgnoreFile::read(root.substr(0, slash), slash + 1, ignore);
+		}
+		return ignore;
+	}
+
+public:
+	DirectoryWalk(const PathFilter& filter) :
+		filter(filter),
+		buildDir(platform::platform_getcwd() + "/" + DEFAULT_BUILD_DIR)
+	{}
+
+	void run(
+			const std::string& root,
+			std::vector<std::string>& files,
+			std::vector<std::string>* directories,
+			std::vector<struct stat>* directoryStats
+	) {
+		Directory top(root, ancestorIgnoreFiles(root));
+		pending.push_back(&top);
+
+		unsigned threadCount = std::max(1u, std::min(DIRECTORY_WALK_MAX_THREADS, std::thread::hardware_concurrency()));
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < threadCount; i++) {
+			threads.emplace_back([this] { work(); });
+		}
+		work();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		collect(top, files, directories, directoryStats);
+	}
+};
+
+} // namespace detail
+
+/**
+ * Appends the path of every file under `root` that `filter` matches to `files`. Paths are `root` followed by
+ * the names of the directories and the file, separated by `/`.
+ *
+ * @param directories    If not null, every directory that was searched, starting with `root`, is appended.
+ * @param directoryStats If not null, the stats of each directory in `directories`, taken before it was read,
+ *                       are appended. They are zeroed for directories that couldn't be stat'ed.
+ */
+void walkDirectory(
+		const std::string& root,
+		const PathFilter& filter,
+		std::vector<std::string>& files,
+		std::vector<std::string>* directories = nullptr,
+		std::vector<struct stat>* directoryStats = nullptr
+) {
+	detail::DirectoryWalk(filter).run(root, files, directories, directoryStats);
+}
+
+/**
+ * Appends the path of every file under `root` whose path matches `include` and doesn't match `exclude` to
+ * `files`.
+ */
+void walkDirectory(
+		const std::string& root,
+		const std::regex& include,
+		const std::regex& exclude,
+		std::vector<std::string>& files,
+		std::vector<std::string>* directories = nullptr,
+		std::vector<struct stat>* directoryStats = nullptr
+) {
+	walkDirectory(root, RegexFilter(include, exclude), files, directories, directoryStats);
+}
+
+} // namespace io
+} // namespace cradle
+/**
+ * @file
+ */
+
+
+//
+// Code modified from: https://stackoverflow.com/questions/40504281/c-how-to-check-the-last-modified-time-of-a-file
+//
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace cradle {
+namespace io {
+namespace detail {
+
+/**
+ * Memoizes the results of `stat()` for the duration of a run. Entries must be invalidated whenever cradle
+ * writes to a path so that later up-to-date checks see the new state.
+ */
+class StatCache {
+	struct Entry {
+		int error;
+		struct stat result;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+	// Bumped by every invalidation so that a stat() which raced with one is not cached.
+	uint64_t generation = 0;
+
+public:
+	/**
+	 * @return 0 if `filepath` exists (and `result` was filled in), otherwise the `errno` from `stat()`.
+	 */
+	int lookup(const std::string& filepath, struct stat& result) {
+		uint64_t startGeneration;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = entries.find(filepath);
+			if (it != entries.end()) {
+				result = it->second.result;
+				return it->second.error;
+			}
+			startGeneration = generation;
+		}
+
+		Entry entry;
+		entry.error = stat(filepath.c_str(), &entry.result) == 0 ? 0 : errno;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (generation == startGeneration) {
+			entries[filepath] = entry;
+		}
+		result = entry.result;
+		return entry.error;
+	}
+
+	void invalidate(const std::string& filepath) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(filepath);
+		generation++;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		generation++;
+	}
+};
+
+StatCache& statCache() {
+	static StatCache cache;
+	return cache;
+}
+
+} // namespace detail
+
+/**
+ * @return True if `filepath` exists. On success `result` is filled in with its stats.
+ */
+bool tryGetStat(const std::string& filepath, struct stat& result) {
+	return detail::statCache().lookup(filepath, result) == 0;
+}
+
+bool exists(const std::string& filepath) {
+	struct stat result;
+	return tryGetStat(filepath, result);
+}
+
+struct stat getStat(const std::string& filepath) {
+	struct stat result;
+	int error = detail::statCache().lookup(filepath, result);
+	if (error == 0) {
+		return result;
+	} else {
+		throw std::runtime_error("Error getting stats for " + filepath + ": " + std::strerror(error));
+	}
+}
+
+/**
+ * @return The modification time in nanoseconds (or the best resolution available on this platform).
+ */
+int64_t mtimeNanos(const struct stat& s) {
+#if defined(PLATFORM_MAC)
+	return static_cast<int64_t>(s.st_mtimespec.tv_sec) * 1000000000 + s.st_mtimespec.tv_nsec;
+#elif defined(PLATFORM_LINUX)
+	return static_cast<int64_t>(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+#else
+	return static_cast<int64_t>(s.st_mtime) * 1000000000;
+#endif
+}
+
+/**
+ * @return The current time on the clock file modification times are taken from, in the same unit as
+ *         @ref mtimeNanos. A file written after this call has an mtime at least as large as the result.
+ */
+int64_t fileClockNanos() {
+#if defined(PLATFORM_LINUX)
+	// The kernel stamps files with the coarse clock, which can lag behind CLOCK_REALTIME.
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME_COARSE, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#elif defined(PLATFORM_MAC)
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+	return static_cast<int64_t>(std::time(nullptr)) * 1000000000;
+#endif
+}
+
+/**
+ * Forget the cached stats of `filepath`. Must be called after writing to it.
+ */
+void invalidateStat(const std::string& filepath) {
+	detail::statCache().invalidate(filepath);
+}
+
+/**
+ * Forget all cached stats. Must be called after running commands that may write to unknown paths.
+ */
+void invalidateAllStats() {
+	detail::statCache().clear();
+}
+
+} // namespace io
+} // namespace cradle
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string.h>
+#include <regex>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+namespace io {
+
+static const PropertyKey FILE_LIST("FILE_LIST");
+
+// Set on the tasks returned by @ref files and @ref glob: every directory that was searched and the
+// patterns files in them had to match, so that files added later can be recognized.
+static const PropertyKey DIRECTORY_LIST("DIRECTORY_LIST");
+static const PropertyKey FILE_INCLUDE_PATTERN("FILE_INCLUDE_PATTERN");
+static const PropertyKey FILE_EXCLUDE_PATTERN("FILE_EXCLUDE_PATTERN");
+static const PropertyKey FILE_INCLUDE_GLOBS("FILE_INCLUDE_GLOBS");
+static const PropertyKey FILE_EXCLUDE_GLOBS("FILE_EXCLUDE_GLOBS");
+
+// TODO: Do something smarter to handle volume names and other things.
+std::string path_concat(std::string a, std::string b) {
+	return a + PATH_SEP + b;
+}
+
+// TODO: Do something smarter to handle volume names and other things.
+std::string path_parent(std::string p) {
+	std::size_t posA = p.find_last_of(PATH_SEP);
+	std::size_t posB = p.find_last_of('/');
+
+	std::size_t pos =
+			(posA != std::string::npos && posB != std::string::npos) ?
+				std::max(posA, posB) : // If they're both valid return the max.
+				(posA == std::string::npos ? posB : posA); // Otherwise return the valid one (note both could still be invalid.)
+
+	// If pos still invalid the path separator doesn't exist in this path.
+	if (pos == std::string::npos) {
+		if (p.empty() || p == ".") {
+			return "..";
+		}
+		return ".";
+	}
+	return p.substr(0, pos);
+}
+
+/**
+ * @brief path_filename
+ * @param p
+ * @return The last name in this path.
+ */
+std::string path_filename(std::string p) {
+	std::size_t pos = p.find_last_of(PATH_SEP);
+	if (pos == std::string::npos) {
+		return p;
+	}
+	return p.substr(pos+1);
+}
+
+/**
+ * @brief path_basename
+ * @param p
+ * @return The path with the extension removed.
+ */
+std::string path_basename(std::string p) {
+	std::size_t pos = p.find_last_of('.');
+	if (pos == std::string::npos) {
+		return p;
+	}
+	return p.substr(0, pos);
+}
+
+/**
+ * @brief path_ext
+ * @param p
+ * @return The extension of the path. (i.e. the part after and not including the last '.')
+ */
+std::string path_ext(std::string p) {
+	std::size_t pos = p.find_last_of('.');
+	if (pos == std::string::npos) {
+		return p;
+	}
+	return p.substr(pos+1);
+}
+
+/**
+ * @brief read_file  Reads the entire contents of a file.
+ * @return False if the file could not be read.
+ */
+bool read_file(const std::string& path, std::string& contents) {
+	std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!in) {
+		return false;
+	}
+
+	contents.resize(static_cast<std::size_t>(in.tellg()));
+	in.seekg(0);
+	in.read(&contents[0], contents.size());
+	return static_cast<bool>(in);
+}
+
+/**
+ * @brief write_file  Replaces the contents of a file.
+ * @return False if the file could not be written.
+ */
+bool write_file(const std::string& path, const std::string& contents) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	out.write(contents.data(), contents.size());
+	out.close();
+	invalidateStat(path);
+	return !out.fail();
+}
+
+/**
+ * @brief append_file  Adds `contents` to the end of a file, creating it if it doesn't exist.
+ * @return False if the file could not be written.
+ */
+bool append_file(const std::string& path, const std::string& contents) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::app);
+	out.write(contents.data(), contents.size());
+	out.close();
+	invalidateStat(path);
+	return !out.fail();
+}
+
+void mkdir_if_necessary(std::string d) {
+	if (!exists(d)) {
+		if (platform::platform_mkdir(d.c_str()) != 0 && errno != EEXIST) {
+			log_error(std::string() + "Error making directory " + d.c_str() + ": " + strerror(errno));
+		}
+		invalidateStat(d);
+	}
+}
+
+void mkdirs(std::string d) {
+	if (d.empty()) {
+		return;
+	}
+	if (d == std::string(1, PATH_SEP)) {
+		return;
+	}
+	if (d == "..") {
+		return;
+	}
+	if (d == ".") {
+		return;
+	}
+
+	mkdirs(path_parent(d));
+	mkdir_if_necessary(d);
+}
+
+/**
+ * Appends the files under `path` that match `include` and don't match `exclude` to `aggregator`. See
+ * @ref walkDirectory.
+ */
+void recursiveAddFilesInDir(
+		std::vector<std::string>& aggregator,
+		const std::string& path,
+		const std::regex& include,
+		const std::regex& exclude,
+		std::vector<std::string>* directories = nullptr
+) {
+	walkDirectory(path, include, exclude, aggregator, directories);
+}
+
+/**
+ * Every directory searched by @ref files or @ref glob in this run, with its stats from right before it was
+ * read. Adding or removing a file changes the timestamp of its directory, which is how the null build
+ * snapshot notices that the file lists are out of date, including when it happened during the build.
+ */
+class ListedDirectories {
+	std::mutex mutex;
+	std::vector<std::pair<std::string, struct stat>> directories;
+
+public:
+	void add(const std::vector<std::string>& listed, const std::vector<struct stat>& stats) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::size_t i = 0; i < listed.size(); i++) {
+			directories.push_back(std::make_pair(listed[i], stats[i]));
+		}
+	}
+
+	std::vector<std::pair<std::string, struct stat>> get() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return directories;
+	}
+};
+
+ListedDirectories& listedDirectories() {
+	static ListedDirectories instance;
+	return instance;
+}
+
+/**
+ * @brief files    A task to recursively find all files in a directory.
+ * @param dir      The path of the directory to search. Can be relative or absolute.
+ * @param include  A regex (using standard C++ regex library syntax) that will be run on the entire path to the file to determine if it is to be included.
+ * @param exclude  A regex (using standard C++ regex library syntax) that will be run on the entire path to the file after it has been added to the inclusion list
+ *                 to determine if it is actually to be excluded.
+ * @return
+ */
+task_p files(std::string dir, std::string include = std::string(".*"), std::string exclude = std::string("a^")) {
+	return tracked(task(
+		[=] (Task* self) {
+			std::vector<std::string> aggregator;
+			std::vector<std::string> directories;
+			std::vector<struct stat> directoryStats;
+			std::regex includeRegex(include);
+			std::regex excludeRegex(exclude);
+
+			walkDirectory(dir, includeRegex, excludeRegex, aggregator, &directories, &directoryStats);
+			self->push(FILE_LIST, aggregator);
+			self->push(DIRECTORY_LIST, directories);
+			listedDirectories().add(directories, directoryStats);
+			self->set(FILE_INCLUDE_PATTERN, include);
+			self->set(FILE_EXCLUDE_PATTERN, exclude);
+			return ExecutionResult::SUCCESS;
+		}
+	));
+}
+
+/**
+ * @brief glob     A task to recursively find the files in a directory that match glob patterns. Faster than
+ *                 @ref files since all patterns are compiled into one automaton that matches each path in a
+ *                 single pass.
+ * @param dir      The path of the directory to search. Can be relative or absolute.
+ * @param include  Glob patterns (see @ref Glob) matched against the path of each file relative to `dir`, e.g.
+ *                 `*.{cpp,cc}` for the sources directly in `dir` or `**` for every file under it.
+ *                 Files must match at least one of them.
+ * @param exclude  Glob patterns that files must not match.
+ * @return
+ */
+task_p glob(std::string dir, std::vector<std::string> include, std::vector<std::string> exclude = std::vector<std::string>()) {
+	return tracked(task(
+		[=] (Task* self) {
+			std::vector<std::string> aggregator;
+			std::vector<std::string> directories;
+			std::vector<struct stat> directoryStats;
+
+			walkDirectory(dir, GlobFilter(dir, include, exclude), aggregator, &directories, &directoryStats);
+			self->push(FILE_LIST, aggregator);
+			self->push(DIRECTORY_LIST, directories);
+			listedDirectories().add(directories, directoryStats);
+			self->push(FILE_INCLUDE_GLOBS, include);
+			self->push(FILE_EXCLUDE_GLOBS, exclude);
+			return ExecutionResult::SUCCESS;
+		}
+	));
+}
+
+/**
+ * @return The filter a task returned by @ref files or @ref glob selected its files with, or null for other
+ *         tasks.
+ */
+std::shared_ptr<const PathFilter> fileFilter(const Task& t) {
+	if (!t.hasList(DIRECTORY_LIST) || t.getList(DIRECTORY_LIST).empty()) {
+		return nullptr;
+	}
+	if (t.hasList(FILE_INCLUDE_GLOBS)) {
+		return std::make_shared<GlobFilter>(t.getList(DIRECTORY_LIST)[0], t.getList(FILE_INCLUDE_GLOBS), t.getList(FILE_EXCLUDE_GLOBS));
+	}
+	return std::make_shared<RegexFilter>(std::regex(t.get(FILE_INCLUDE_PATTERN)), std::regex(t.get(FILE_EXCLUDE_PATTERN)));
+}
+
+} // namespace io
+} // namespace cradle
+/**
+ * @file cradle_hash.hpp
+ *
+ * @brief Fast, non-cryptographic hashing of file contents.
+ *
+ * The hash follows the structure of XXH3's long-input loop: 64 byte stripes are folded into eight 64-bit
+ * lanes with 32x32->64 bit multiplies, the lanes are scrambled every 1 KiB and merged at the end. The lane
+ * updates map directly onto SSE2 instructions, which are used when available; the scalar loop produces the
+ * same results. The output is not compatible with XXH3 and must only be compared with other hashes
+ * produced here.
+ */
+
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CRADLE_HASH_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace io {
+namespace detail {
+
+static const uint64_t HASH_PRIME32_1 = 0x9E3779B1u;
+static const uint64_t HASH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+static const uint64_t HASH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+
+static const std::size_t HASH_STRIPE_LENGTH = 64;
+static const std::size_t HASH_STRIPES_PER_BLOCK = 16;
+static const std::size_t HASH_SECRET_LENGTH = HASH_STRIPE_LENGTH + 8 * HASH_STRIPES_PER_BLOCK;
+
+/**
+ * Key material mixed into every stripe. Generated with SplitMix64 from a fixed seed.
+ */
+const unsigned char* hashSecret() {
+	struct Secret {
+		unsigned char bytes[HASH_SECRET_LENGTH];
+
+		Secret() {
+			uint64_t state = 0x6372616468656Cull;
+			for (std::size_t i = 0; i < HASH_SECRET_LENGTH; i += 8) {
+				uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				z ^= z >> 31;
+				std::memcpy(bytes + i, &z, 8);
+			}
+		}
+	};
+
+	static const Secret secret;
+	return secret.bytes;
+}
+
+inline uint64_t read64(const unsigned char* p) {
+	uint64_t value;
+	std::memcpy(&value, p, 8);
+	return value;
+}
+
+inline void accumulateStripe(uint64_t* acc, const unsigned char* input, const unsigned char* secret) {
+#ifdef CRADLE_HASH_SSE2
+	__m128i* xacc = reinterpret_cast<__m128i*>(acc);
+	for (int i = 0; i < 4; i++) {
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+		__m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+		__m128i dataKey = _mm_xor_si128(data, key);
+		__m128i dataKeyHigh = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product = _mm_mul_epu32(dataKey, dataKeyHigh);
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		xacc[i] = _mm_add_epi64(product, _mm_add_epi64(xacc[i], swapped));
+	}
+#else
+	for (int i = 0; i < 8; i++) {
+		uint64_t data = read64(input + 8 * i);
+		uint64_t dataKey = data ^ read64(secret + 8 * i);
+		acc[i ^ 1] += data;
+		acc[i] += (dataKey & 0xFFFFFFFFu) * (dataKey >> 32);
+	}
+#endif
+}
+
+inline void scramble(uint64_t* acc, const unsigned char* secret) {
+	for (int i = 0; i < 8; i++) {
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= read64(secret + 8 * i);
+		acc[i] *= HASH_PRIME32_1;
+	}
+}
+
+/**
+ * @return The xor of the high and low halves of the 128-bit product of `a` and `b`.
+ */
+inline uint64_t multiplyFold(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+	return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+	uint64_t aLow = a & 0xFFFFFFFFu, aHigh = a >> 32;
+	uint64_t bLow = b & 0xFFFFFFFFu, bHigh = b >> 32;
+	uint64_t lowLow = aLow * bLow;
+	uint64_t highLow = aHigh * bLow;
+	uint64_t lowHigh = aLow * bHigh;
+	uint64_t highHigh = aHigh * bHigh;
+	uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFFu) + lowHigh;
+	uint64_t high = highHigh + (highLow >> 32) + (cross >> 32);
+	uint64_t low = (cross << 32) | (lowLow & 0xFFFFFFFFu);
+	return low ^ high;
+#endif
+}
+
+inline uint64_t avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ull;
+	h ^= h >> 32;
+	return h;
+}
+
+} // namespace detail
+
+/**
+ * @return A 64-bit hash of `length` bytes starting at `data`.
+ */
+uint64_t hashBytes(const void* data, std::size_t length) {
+	using namespace detail;
+
+	const unsigned char* input = static_cast<const unsigned char*>(data);
+	const unsigned char* secret = hashSecret();
+
+	alignas(16) uint64_t acc[8] = {
+		HASH_PRIME32_1, HASH_PRIME64_1, HASH_PRIME64_2, HASH_PRIME64_1 ^ HASH_PRIME64_2,
+		HASH_PRIME64_2 + HASH_PRIME32_1, HASH_PRIME64_1 - HASH_PRIME32_1, HASH_PRIME64_2 ^ HASH_PRIME32_1, HASH_PRIME64_1 + HASH_PRIME64_2
+	};
+
+	std::size_t stripes = length / HASH_STRIPE_LENGTH;
+	for (std::size_t s = 0; s < stripes; s++) {
+		std::size_t stripeInBlock = s % HASH_STRIPES_PER_BLOCK;
+		accumulateStripe(acc, input + s * HASH_STRIPE_LENGTH, secret + 8 * stripeInBlock);
+		if (stripeInBlock == HASH_STRIPES_PER_BLOCK - 1) {
+			scramble(acc, secret + HASH_SECRET_LENGTH - HASH_STRIPE_LENGTH);
+		}
+	}
+
+	std::size_t remaining = length - stripes * HASH_STRIPE_LENGTH;
+	if (remaining > 0) {
+		unsigned char last[HASH_STRIPE_LENGTH] = {0};
+		std::memcpy(last, input + stripes * HASH_STRIPE_LENGTH, remaining);
+		accumulateStripe(acc, last, secret + 8 * (stripes % HASH_STRIPES_PER_BLOCK));
+	}
+
+	uint64_t result = static_cast<uint64_t>(length) * HASH_PRIME64_1;
+	for (int i = 0; i < 4; i++) {
+		result += multiplyFold(acc[2 * i] ^ read64(secret + 16 * i + 11), acc[2 * i + 1] ^ read64(secret + 16 * i + 19));
+	}
+	return avalanche(result);
+}
+
+/**
+ * Hashes the contents of a file. On POSIX platforms the file is memory mapped rather than copied.
+ *
+ * @return False if the file could not be read.
+ */
+bool hashFile(const std::string& path, uint64_t& hash) {
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat s;
+	if (fstat(fd, &s) != 0) {
+		close(fd);
+		return false;
+	}
+
+	std::size_t length = static_cast<std::size_t>(s.st_size);
+	if (length == 0) {
+		close(fd);
+		hash = hashBytes(nullptr, 0);
+		return true;
+	}
+
+	void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		std::string contents;
+		if (!read_file(path, contents)) {
+			return false;
+		}
+		hash = hashBytes(contents.data(), contents.size());
+		return true;
+	}
+
+	madvise(data, length, MADV_SEQUENTIAL);
+	hash = hashBytes(data, length);
+	munmap(data, length);
+	return true;
+#else
+	std::string contents;
+	if (!read_file(path, contents)) {
+		return false;
+	}
+	hash = hashBytes(contents.data(), contents.size());
+	return true;
+#endif
+}
+
+} // namespace io
+} // namespace cradle
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cradle {
+
+static const std::string CACHE_DIR_ENV_VAR = "CRADLE_CACHE_DIR";
+static const std::string CACHE_SIZE_ENV_VAR = "CRADLE_CACHE_SIZE";
+static const uint64_t DEFAULT_CACHE_SIZE = 5ull * 1024 * 1024 * 1024;
+
+static const std::string SHARED_CACHE_DIR_ENV_VAR = "CRADLE_SHARED_CACHE_DIR";
+static const std::string SHARED_CACHE_SIZE_ENV_VAR = "CRADLE_SHARED_CACHE_SIZE";
+static const std::string SHARED_CACHE_READ_ONLY_ENV_VAR = "CRADLE_SHARED_CACHE_READ_ONLY";
+static const uint64_t DEFAULT_SHARED_CACHE_SIZE = 50ull * 1024 * 1024 * 1024;
+
+struct CacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t stores = 0;
+	uint64_t storedBytes = 0;
+	uint64_t evictions = 0;
+
+	CacheStats& operator+=(const CacheStats& other) {
+		hits += other.hits;
+		misses += other.misses;
+		stores += other.stores;
+		storedBytes += other.storedBytes;
+		evictions += other.evictions;
+		return *this;
+	}
+
+	std::string describe() const {
+		uint64_t lookups = hits + misses;
+		std::string rate = lookups == 0 ? "n/a" : std::to_string(100 * hits / lookups) + "%";
+		return
+			std::to_string(hits) + " hits, " + std::to_string(misses) + " misses (hit rate " + rate + "), " +
+			std::to_string(stores) + " stored (" + std::to_string(storedBytes / 1024) + " KiB), " +
+			std::to_string(evictions) + " evicted";
+	}
+};
+
+namespace detail {
+
+/**
+ * @return `material` reduced to a 128-bit key in hex.
+ */
+std::string cacheKey(const std::string& material) {
+	char key[33];
+	snprintf(
+		key, sizeof(key), "%016llx%016llx",
+		static_cast<unsigned long long>(io::hashBytes(material.data(), material.size())),
+		static_cast<unsigned long long>(hashString(material.data(), material.size()))
+	);
+	return key;
+}
+
+/**
+ * Parses sizes such as `500M` or `5G`.
+ *
+ * @return `defaultValue` if `s` is empty or invalid.
+ */
+uint64_t parseSize(const std::string& s, uint64_t defaultValue) {
+	char* end = nullptr;
+	double value = std::strtod(s.c_str(), &end);
+	if (s.empty() || end == s.c_str() || value < 0) {
+		return defaultValue;
+	}
+
+	switch (*end) {
+	case 'k': case 'K': value *= 1024.0; break;
+	case 'm': case 'M': value *= 1024.0 * 1024; break;
+	case 'g': case 'G': value *= 1024.0 * 1024 * 1024; break;
+	case 't': case 'T': value *= 1024.0 * 1024 * 1024 * 1024; break;
+	case '\0': break;
+	default: return defaultValue;
+	}
+	return static_cast<uint64_t>(value);
+}
+
+/**
+ * @return The directory given by `CRADLE_CACHE_DIR`, otherwise the platform's per-user cache directory.
+ */
+std::string defaultCacheDir() {
+	const char* dir = std::getenv(CACHE_DIR_ENV_VAR.c_str());
+	if (dir != nullptr && *dir != '\0') {
+		return dir;
+	}
+
+#ifdef PLATFORM_WINDOWS
+	const char* localAppData = std::getenv("LOCALAPPDATA");
+	if (localAppData != nullptr) {
+		return io::path_concat(localAppData, "cradle");
+	}
+#else
+	const char* xdgCacheHome = std::getenv("XDG_CACHE_HOME");
+	if (xdgCacheHome != nullptr && *xdgCacheHome != '\0') {
+		return io::path_concat(xdgCacheHome, "cradle");
+	}
+	const char* home = std::getenv("HOME");
+	if (home != nullptr) {
+		return io::path_concat(io::path_concat(home, ".cache"), "cradle");
+	}
+#endif
+	return io::path_concat(DEFAULT_BUILD_DIR, "cache");
+}
+
+} // namespace detail
+
+class CacheStore {
+	static constexpr const char* MAGIC = "CRADCAC";
+	static const uint32_t VERSION = 1;
+	static const std::size_t HEADER_SIZE = 8 + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+	static const int SHARDS = 16;
+
+	// Temporary files older than this are left over from processes that died while storing.
+	static const time_t STALE_TMP_SECONDS = 60 * 60;
+
+	struct Item {
+		int64_t mtime;
+		uint64_t size;
+		std::string path;
+	};
+
+	std::string root;
+	uint64_t maxSize;
+	bool readOnly;
+	std::string hostname;
+
+	std::mutex mutex;
+	CacheStats stats;
+	bool storedInShard[SHARDS] = {};
+	std::atomic<unsigned> tmpCounter;
+
+	std::string shardDir(int shard) const {
+		return io::path_concat(root, std::string(1, "0123456789abcdef"[shard]));
+	}
+
+	std::string tmpDir() const {
+		return io::path_concat(root, "tmp");
+	}
+
+	std::string statsDir() const {
+		return io::path_concat(root, "stats");
+	}
+
+	std::string pathOf(const std::string& key, const std::string& kind) const {
+		return io::path_concat(io::path_concat(io::path_concat(root, key.substr(0, 1)), key.substr(1, 2)), key.substr(3) + "." + kind);
+	}
+
+	static int shardOf(const std::string& key) {
+		char c = key[0];
+		return c >= 'a' ? c - 'a' + 10 : c - '0';
+	}
+
+	/**
+	 * @return False if `data` is not a complete item. Otherwise `payload` is set to its contents.
+	 */
+	static bool unwrap(const std::string& data, std::string& payload) {
+		if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC, 8) != 0) {
+			return false;
+		}
+
+		uint32_t version;
+		uint64_t length;
+		uint64_t hash;
+		std::memcpy(&version, data.data() + 8, sizeof(version));
+		std::memcpy(&length, data.data() + 8 + sizeof(version), sizeof(length));
+		std::memcpy(&hash, data.data() + 8 + sizeof(version) + sizeof(length), sizeof(hash));
+		if (version != VERSION || length != data.size() - HEADER_SIZE) {
+			return false;
+		}
+		if (io::hashBytes(data.data() + HEADER_SIZE, length) != hash) {
+			return false;
+		}
+
+		payload.assign(data, HEADER_SIZE, std::string::npos);
+		return true;
+	}
+
+	static std::string wrap(const std::string& payload) {
+		uint64_t length = payload.size();
+		uint64_t hash = io::hashBytes(payload.data(), payload.size());
+
+		std::string data(MAGIC, 8);
+		data.append(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+		data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		data.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+		data.append(payload);
+		return data;
+	}
+
+	/**
+	 * Adds every file under `dir` to `items`. Stats are read directly since other processes change them.
+	 */
+	static void listItems(const std::string& dir, std::vector<Item>& items) {
+		tinydir_dir d;
+		if (tinydir_open(&d, dir.c_str()) != 0) {
+			return;
+		}
+
+		while (d.has_next) {
+			tinydir_file file;
+			tinydir_readfile(&d, &file);
+			std::string name(file.name);
+
+			if (name != "." && name != "..") {
+				struct stat s;
+				if (file.is_dir) {
+					listItems(file.path, items);
+				} else if (stat(file.path, &s) == 0) {
+					items.push_back(Item{io::mtimeNanos(s), static_cast<uint64_t>(s.st_size), file.path});
+				}
+			}
+			tinydir_next(&d);
+		}
+		tinydir_close(&d);
+	}
+
+	/**
+	 * Evicts the least recently used items of `shard` until it is within 90% of its share of the maximum size.
+	 *
+	 * @return The number of items evicted.
+	 */
+	uint64_t trim(int shard) {
+		std::vector<Item> items;
+		listItems(shardDir(shard), items);
+
+		uint64_t limit = maxSize / SHARDS;
+		uint64_t total = 0;
+		for (auto& item : items) {
+			total += item.size;
+		}
+		if (total <= limit) {
+			return 0;
+		}
+
+		std::sort(items.begin(), items.end(), [] (const Item& a, const Item& b) { return a.mtime < b.mtime; });
+
+		uint64_t evicted = 0;
+		for (auto& item : items) {
+			if (total <= limit / 10 * 9) {
+				break;
+			}
+			if (std::remove(item.path.c_str()) == 0) {
+				evicted++;
+			}
+			total -= item.size;
+		}
+		return evicted;
+	}
+
+	void removeStaleTmpFiles() {
+		std::vector<Item> items;
+		listItems(tmpDir(), items);
+
+		int64_t cutoff = (static_cast<int64_t>(time(nullptr)) - STALE_TMP_SECONDS) * 1000000000;
+		for (auto& item : items) {
+			if (item.mtime < cutoff) {
+				std::remove(item.path.c_str());
+			}
+		}
+	}
+
+public:
+	CacheStore(const std::string& root, uint64_t maxSize, bool readOnly = false) :
+		root(root),
+		maxSize(maxSize),
+		readOnly(readOnly),
+		hostname(platform::platform_hostname()),
+		tmpCounter(0)
+	{}
+
+	CacheStore(const CacheStore&) = delete;
+	CacheStore& operator=(const CacheStore&) = delete;
+
+	~CacheStore() {
+		flush();
+	}
+
+	const std::string& directory() const {
+		return root;
+	}
+
+	bool isReadOnly() const {
+		return readOnly;
+	}
+
+	/**
+	 * @return False if there is no valid item for `key` and `kind`. Otherwise `payload` is set to its contents.
+	 */
+	bool get(const std::string& key, const std::string& kind, std::string& payload) {
+		std::string path = pathOf(key, kind);
+
+		std::string data;
+		if (io::read_file(path, data) && unwrap(data, payload)) {
+			if (!readOnly) {
+				platform::platform_touch(path);
+			}
+			return true;
+		}
+		if (!data.empty() && !readOnly) {
+			// Corrupt or from an incompatible version of cradle.
+			std::remove(path.c_str());
+		}
+		return false;
+	}
+
+	/**
+	 * Counts a lookup in the statistics. A lookup may read several items, so this is left to the caller.
+	 */
+	void count(bool hit) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (hit) {
+			stats.hits++;
+		} else {
+			stats.misses++;
+		}
+	}
+
+	/**
+	 * Stores `payload` as the item for `key` and `kind`, replacing any existing one. Does nothing if the
+	 * store is read-only.
+	 */
+	void put(const std::string& key, const std::string& kind, const std::string& payload) {
+		if (readOnly) {
+			return;
+		}
+
+		std::string path = pathOf(key, kind);
+		io::mkdirs(io::path_parent(path));
+		io::mkdirs(tmpDir());
+
+		std::string tmpPath = io::path_concat(
+			tmpDir(),
+			hostname + "-" + std::to_string(platform::platform_getpid()) + "-" + std::to_string(tmpCounter++) + "-" + key.substr(0, 8)
+		);
+		if (!io::write_file(tmpPath, wrap(payload)) || platform::platform_rename(tmpPath, path) != 0) {
+			log_error("Unable to store " + path + " in the cache: " + strerror(errno));
+			std::remove(tmpPath.c_str());
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.stores++;
+		stats.storedBytes += payload.size();
+		storedInShard[shardOf(key)] = true;
+	}
+
+	/**
+	 * @return The statistics of every run that has used this cache, including this one.
+	 */
+	CacheStats totalStats() {
+		CacheStats total;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			total = stats;
+		}
+
+		std::vector<Item> files;
+		listItems(statsDir(), files);
+		for (auto& file : files) {
+			std::string contents;
+			io::read_file(file.path, contents);
+			std::istringstream lines(contents);
+			CacheStats run;
+			while (lines >> run.hits >> run.misses >> run.stores >> run.storedBytes >> run.evictions) {
+				total += run;
+			}
+		}
+		return total;
+	}
+
+	/**
+	 * Evicts items from the shards stored into since the last flush and appends the statistics since then to
+	 * this host's stats file, unless the store is read-only. Called when the store is destroyed.
+	 *
+	 * @return The statistics that were appended.
+	 */
+	CacheStats flush() {
+		std::lock_guard<std::mutex> lock(mutex);
+		CacheStats flushed = stats;
+		if (readOnly || stats.hits + stats.misses + stats.stores == 0) {
+			stats = CacheStats();
+			return flushed;
+		}
+
+		bool stored = false;
+		for (int shard = 0; shard < SHARDS; shard++) {
+			if (storedInShard[shard]) {
+				stats.evictions += trim(shard);
+				storedInShard[shard] = false;
+				stored = true;
+			}
+		}
+		if (stored) {
+			removeStaleTmpFiles();
+		}
+
+		// Each line is appended with a single write so concurrent runs don't interleave.
+		std::string line =
+			std::to_string(stats.hits) + " " + std::to_string(stats.misses) + " " + std::to_string(stats.stores) + " " +
+			std::to_string(stats.storedBytes) + " " + std::to_string(stats.evictions) + "\n";
+		io::mkdirs(statsDir());
+		FILE* file = fopen(io::path_concat(statsDir(), hostname).c_str(), "ab");
+		if (file != nullptr) {
+			fwrite(line.data(), 1, line.size(), file);
+			fclose(file);
+		}
+		flushed.evictions = stats.evictions;
+		stats = CacheStats();
+		return flushed;
+	}
+};
+
+const uint32_t CacheStore::VERSION;
+const std::size_t CacheStore::HEADER_SIZE;
+const int CacheStore::SHARDS;
+const time_t CacheStore::STALE_TMP_SECONDS;
+
+} // namespace cradle
+/**
+ * @file cradle_snapshot.hpp
+ *
+ * @brief Lets a build that has nothing to do finish without configuring it.
+ *
+ * After a successful build cradle writes a snapshot of what the build depended on to @ref SNAPSHOT_FILE:
+ * every output that was found up to date or built, the inputs recorded for them in the build log along with
+ * their signatures, and every directory searched for source files. The snapshot is keyed by the cradle
+ * executable, which includes the compiled build.cpp, the working directory, the command line and the
+ * environment variables that select the toolchain.
+ *
+ * The next run with the same key only has to check those files. If none of them changed, no outputs are
+ * missing and no files were added to or removed from the searched directories, every output is up to date
+ * and cradle exits without running `configure()`.
+ *
+ * Only tasks marked with @ref Task::markTracked are known to have no effects beyond these files, which
+ * cradle does for its own C++, file listing and Conan tasks. Builds that execute any other task, e.g. a
+ * task created from a function in build.cpp or an `exec` task, don't write a snapshot.
+ * Neither do builds run with `--no-snapshot`.
+ */
+
+
+/**
+ * @file cradle_build_log.hpp
+ *
+ * @brief A persistent record of the command that produced each output and the inputs it read.
+ *
+ * The log is an append-only binary file under @ref DEFAULT_BUILD_DIR. It starts with a header (a magic
+ * string and a format version) followed by records that each start with a one byte type and a four
+ * byte payload length:
+ *
+ *  - `PATH` records hold a path. Paths are numbered in the order they appear.
+ *  - `ENTRY` records hold the id of an output path, the exact command that produced it and the id and
+ *    signature of every input. A later entry for the same output replaces earlier ones.
+ *  - `HASH` records hold the content hash of a path along with the signature it was computed for, so that
+ *    files are only rehashed when they change.
+ *
+ * Integers are written in native byte order; the version field doubles as a byte order check. Records
+ * after a truncated or unreadable one (e.g. from an interrupted write) are dropped, which only means that
+ * the affected outputs are rebuilt once.
+ */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+static const std::string BUILD_LOG_FILE = ".cradle_log";
+
+/**
+ * Identifies a version of a file. `hash` is the hash of its contents, or 0 if it wasn't computed, and is not
+ * part of the comparison.
+ */
+struct FileSignature {
+	int64_t mtime;
+	uint64_t size;
+	uint64_t inode;
+	uint64_t hash;
+
+	bool operator==(const FileSignature& other) const {
+		return mtime == other.mtime && size == other.size && inode == other.inode;
+	}
+
+	bool operator!=(const FileSignature& other) const {
+		return !(*this == other);
+	}
+};
+
+FileSignature signatureOf(const struct stat& s) {
+	FileSignature signature;
+	signature.mtime = io::mtimeNanos(s);
+	signature.size = static_cast<uint64_t>(s.st_size);
+	signature.inode = static_cast<uint64_t>(s.st_ino);
+	signature.hash = 0;
+	return signature;
+}
+
+class BuildLog {
+	static constexpr const char* MAGIC = "CRADLOG";
+	static const uint32_t VERSION = 2;
+
+	// Compact the log on load once it holds this many times more entries than are live.
+	static const std::size_t COMPACTION_RATIO = 3;
+	static const std::size_t COMPACTION_MIN_ENTRIES = 1000;
+
+	static const std::size_t NO_ENTRY = static_cast<std::size_t>(-1);
+
+	enum RecordType : uint8_t {
+		PATH = 1,
+		ENTRY = 2,
+		HASH = 3
+	};
+
+	struct Input {
+		uint32_t path;
+		FileSignature signature;
+	};
+
+	struct Entry {
+		std::string command;
+		std::vector<Input> inputs;
+	};
+
+	std::mutex mutex;
+	std::string logPath;
+	bool loaded = false;
+	FILE* file = nullptr;
+
+	// Path ids in the table match the order of the `PATH` records in the log.
+	detail::StringTable paths;
+
+	// Entries read from the log are only decoded when they are looked up. `loadedEntries` holds the offset
+	// of the payload of each path's latest entry in `contents` (or `NO_ENTRY`), indexed by path id.
+	// Entries recorded during this run are kept in `recordedEntries` and take precedence.
+	std::string contents;
+	std::vector<std::size_t> loadedEntries;
+	std::unordered_map<uint32_t, Entry> recordedEntries;
+	std::size_t entryRecords = 0;
+
+	// With content hashing, an input whose signature changed is only considered modified if its hash did.
+	// `hashes` holds the latest known hash of each path id along with the signature it belongs to.
+	bool contentHashing;
+	std::unordered_map<uint32_t, FileSignature> hashes;
+
+	// Outputs found up to date or recorded in this run.
+	std::unordered_set<uint32_t> checked;
+
+	template <typename T>
+	static void write(std::string& buffer, const T& value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static void writeString(std::string& buffer, const std::string& value) {
+		write(buffer, static_cast<uint32_t>(value.size()));
+		buffer.append(value);
+	}
+
+	static void writeSignature(std::string& buffer, const FileSignature& signature) {
+		write(buffer, signature.mtime);
+		write(buffer, signature.size);
+		write(buffer, signature.inode);
+		write(buffer, signature.hash);
+	}
+
+	template <typename T>
+	static bool read(const std::string& buffer, std::size_t& pos, std::size_t end, T& value) {
+		if (end - pos < sizeof(T)) {
+			return false;
+		}
+		std::memcpy(&value, buffer.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	static bool readString(const std::string& buffer, std::size_t& pos, std::size_t end, std::string& value) {
+		uint32_t length;
+		if (!read(buffer, pos, end, length) || end - pos < length) {
+			return false;
+		}
+		value.assign(buffer, pos, length);
+		pos += length;
+		return true;
+	}
+
+	static bool readSignature(const std::string& buffer, std::size_t& pos, std::size_t end, FileSignature& signature) {
+		return
+			read(buffer, pos, end, signature.mtime) &&
+			read(buffer, pos, end, signature.size) &&
+			read(buffer, pos, end, signature.inode) &&
+			read(buffer, pos, end, signature.hash);
+	}
+
+	static std::string header() {
+		std::string buffer(MAGIC, std::strlen(MAGIC) + 1);
+		write(buffer, VERSION);
+		return buffer;
+	}
+
+	static void appendRecord(std::string& buffer, RecordType type, const std::string& payload) {
+		write(buffer, static_cast<uint8_t>(type));
+		write(buffer, static_cast<uint32_t>(payload.size()));
+		buffer.append(payload);
+	}
+
+	static std::string entryRecord(uint32_t output, const Entry& entry) {
+		std::string payload;
+		write(payload, output);
+		writeString(payload, entry.command);
+		write(payload, static_cast<uint32_t>(entry.inputs.size()));
+		for (auto& input : entry.inputs) {
+			write(payload, input.path);
+			writeSignature(payload, input.signature);
+		}
+
+		std::string record;
+		appendRecord(record, ENTRY, payload);
+		return record;
+	}
+
+	static std::string hashRecord(uint32_t path, const FileSignature& signature) {
+		std::string payload;
+		write(payload, path);
+		writeSignature(payload, signature);
+
+		std::string record;
+		appendRecord(record, HASH, payload);
+		return record;
+	}
+
+	/**
+	 * Decodes the entry whose payload starts at `offset` in `contents`. The payload length precedes it.
+	 */
+	bool decodeLoadedEntry(std::size_t offset, Entry& entry) const {
+		uint32_t end;
+		std::memcpy(&end, contents.data() + offset - sizeof(uint32_t), sizeof(uint32_t));
+		end += offset;
+
+		std::size_t pos = offset;
+		uint32_t output;
+		uint32_t inputCount;
+		if (
+			!read(contents, pos, end, output) ||
+			!readString(contents, pos, end, entry.command) ||
+			!read(contents, pos, end, inputCount)
+		) {
+			return false;
+		}
+
+		entry.inputs.resize(inputCount);
+		for (auto& input : entry.inputs) {
+			if (
+				!read(contents, pos, end, input.path) ||
+				!readSignature(contents, pos, end, input.signature) ||
+				input.path >= paths.size()
+			) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 *
+	 * @return False if there is no valid entry for `output`.
+	 */
+	bool findEntry(uint32_t output, Entry& entry) const {
+		auto recorded = recordedEntries.find(output);
+		if (recorded != recordedEntries.end()) {
+			entry = recorded->second;
+			return true;
+		}
+
+		return loadedEntries[output] != NO_ENTRY && decodeLoadedEntry(loadedEntries[output], entry);
+	}
+
+	/**
+	 * Reads `contents` up to the first invalid record. Returns false if the log was unreadable or truncated
+	 * in which case it must be rewritten before appending to it.
+	 */
+	bool parse() {
+		std::string expectedHeader = header();
+		if (contents.compare(0, expectedHeader.size(), expectedHeader) != 0) {
+			return false;
+		}
+
+		// Most of a log is paths so this is a generous estimate.
+		paths.reserve(contents.size() / 64, contents.size());
+
+		std::size_t pos = expectedHeader.size();
+		while (pos < contents.size()) {
+			uint8_t type;
+			uint32_t length;
+			if (!read(contents, pos, contents.size(), type) || !read(contents, pos, contents.size(), length)) {
+				return false;
+			}
+			if (contents.size() - pos < length) {
+				return false;
+			}
+
+			if (type == PATH) {
+				if (paths.intern(contents.data() + pos, length) != loadedEntries.size()) {
+					// Every path is written once.
+					return false;
+				}
+				loadedEntries.push_back(NO_ENTRY);
+			} else if (type == ENTRY) {
+				uint32_t output;
+				std::size_t payload = pos;
+				if (!read(contents, payload, pos + length, output) || output >= paths.size()) {
+					return false;
+				}
+				loadedEntries[output] = pos;
+				entryRecords++;
+			} else if (type == HASH) {
+				uint32_t path;
+				FileSignature signature;
+				std::size_t payload = pos;
+				if (!read(contents, payload, pos + length, path) || !readSignature(contents, payload, pos + length, signature) || path >= paths.size()) {
+					return false;
+				}
+				hashes[path] = signature;
+			} else {
+				return false;
+			}
+			pos += length;
+		}
+		return true;
+	}
+
+	/**
+	 * Writes only the live entries to a new log and replaces the old log with it.
+	 */
+	void rewrite() {
+		std::string buffer = header();
+		for (uint32_t id = 0; id < paths.size(); id++) {
+			appendRecord(buffer, PATH, paths.get(id));
+		}
+
+		entryRecords = 0;
+		for (uint32_t id = 0; id < loadedEntries.size(); id++) {
+			Entry entry;
+			if (findEntry(id, entry)) {
+				buffer += entryRecord(id, entry);
+				entryRecords++;
+			}
+		}
+		for (auto& hash : hashes) {
+			buffer += hashRecord(hash.first, hash.second);
+		}
+
+		std::string tmpPath = logPath + ".tmp";
+		FILE* tmp = fopen(tmpPath.c_str(), "wb");
+		if (tmp == nullptr) {
+			log_error("Unable to write build log " + tmpPath + ": " + strerror(errno));
+			return;
+		}
+		fwrite(buffer.data(), 1, buffer.size(), tmp);
+		fclose(tmp);
+
+		std::remove(logPath.c_str());
+		std::rename(tmpPath.c_str(), logPath.c_str());
+		io::invalidateStat(logPath);
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	void load() {
+		if (loaded) {
+			return;
+		}
+		loaded = true;
+
+		io::mkdirs(io::path_parent(logPath));
+
+		// Whatever was parsed before an invalid record is kept.
+		bool valid = io::read_file(logPath, contents) && parse();
+
+		std::size_t liveEntries = loadedEntries.size() - std::count(loadedEntries.begin(), loadedEntries.end(), NO_ENTRY);
+		bool bloated = entryRecords > COMPACTION_MIN_ENTRIES && entryRecords > COMPACTION_RATIO * liveEntries;
+		if (!valid || bloated) {
+			rewrite();
+		}
+
+		file = fopen(logPath.c_str(), "ab");
+		if (file == nullptr) {
+			log_error("Unable to open build log " + logPath + ": " + strerror(errno));
+		}
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	uint32_t idOf(const std::string& path, std::string& records) {
+		uint32_t id = paths.intern(path);
+		if (id == loadedEntries.size()) {
+			loadedEntries.push_back(NO_ENTRY);
+			appendRecord(records, PATH, path);
+		}
+		return id;
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	void append(const std::string& records) {
+		if (file != nullptr) {
+			fwrite(records.data(), 1, records.size(), file);
+			fflush(file);
+		}
+	}
+
+	/**
+	 * @return True if `path`, whose current stats are `s`, differs from the version described by `recorded`.
+	 */
+	bool hasChanged(const std::string& path, const struct stat& s, const FileSignature& recorded) {
+		if (signatureOf(s) == recorded) {
+			return false;
+		}
+		if (!contentHashing || recorded.hash == 0) {
+			return true;
+		}
+
+		uint64_t hash = hashOf(path, s).hash;
+		return hash == 0 || hash != recorded.hash;
+	}
+
+	/**
+	 * Records that `output` was produced by `command` from inputs with the given signatures.
+	 */
+	void recordSignatures(
+		const std::string& output,
+		const std::string& command,
+		const std::vector<std::pair<std::string, FileSignature>>& signatures
+	) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		std::string records;
+		Entry entry;
+		entry.command = command;
+		for (auto& signature : signatures) {
+			Input input;
+			input.path = idOf(signature.first, records);
+			input.signature = signature.second;
+			entry.inputs.push_back(input);
+		}
+
+		uint32_t outputId = idOf(output, records);
+		records += entryRecord(outputId, entry);
+		loadedEntries[outputId] = NO_ENTRY;
+		recordedEntries[outputId] = std::move(entry);
+		entryRecords++;
+		checked.insert(outputId);
+		append(records);
+	}
+
+public:
+	BuildLog(const std::string& logPath) : logPath(logPath), contentHashing(options().has("content-hash")) {}
+
+	~BuildLog() {
+		if (file != nullptr) {
+			fclose(file);
+		}
+	}
+
+	/**
+	 * @return The signature of `path` with its content hash filled in, or a hash of 0 if it can't be read.
+	 *         Hashes are reused for as long as the file's signature stays the same.
+	 */
+	FileSignature hashOf(const std::string& path, const struct stat& s) {
+		FileSignature signature = signatureOf(s);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			uint32_t id = paths.find(path);
+			if (id != detail::StringTable::NONE) {
+				auto it = hashes.find(id);
+				if (it != hashes.end() && it->second == signature) {
+					return it->second;
+				}
+			}
+		}
+
+		if (!io::hashFile(path, signature.hash)) {
+			signature.hash = 0;
+			return signature;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::string records;
+		uint32_t id = idOf(path, records);
+		hashes[id] = signature;
+		records += hashRecord(id, signature);
+		append(records);
+		return signature;
+	}
+
+	/**
+	 * Enables or disables content hashing. It is enabled by `--content-hash` on the command line.
+	 */
+	void setContentHashing(bool enabled) {
+		contentHashing = enabled;
+	}
+
+	bool isContentHashing() const {
+		return contentHashing;
+	}
+
+	/**
+	 * @param recordedInputs Set to the inputs recorded for `output` if it is in the log.
+	 * @return True if `output` must be rebuilt: it doesn't exist, it isn't in the log, it was produced by a
+	 *         command other than `command` or one of its recorded inputs has changed or disappeared since.
+	 */
+	bool isOutOfDate(const std::string& output, const std::string& command, std::vector<std::string>& recordedInputs) {
+		if (!io::exists(output)) {
+			return true;
+		}
+
+		uint32_t id;
+		std::vector<std::pair<std::string, FileSignature>> inputs;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			id = paths.find(output);
+			Entry entry;
+			if (id == detail::StringTable::NONE || !findEntry(id, entry) || entry.command != command) {
+				return true;
+			}
+
+			for (auto& input : entry.inputs) {
+				inputs.push_back(std::make_pair(paths.get(input.path), input.signature));
+			}
+		}
+
+		recordedInputs.clear();
+		bool outOfDate = false;
+		for (auto& input : inputs) {
+			struct stat s;
+			if (!outOfDate && (!io::tryGetStat(input.first, s) || hasChanged(input.first, s, input.second))) {
+				outOfDate = true;
+			}
+			recordedInputs.push_back(input.first);
+		}
+
+		if (!outOfDate) {
+			std::lock_guard<std::mutex> lock(mutex);
+			checked.insert(id);
+		}
+		return outOfDate;
+	}
+
+	bool isOutOfDate(const std::string& output, const std::string& command) {
+		std::vector<std::string> recordedInputs;
+		return isOutOfDate(output, command, recordedInputs);
+	}
+
+	/**
+	 * @param inputs Set to the inputs recorded for `output`, without checking whether they changed.
+	 * @return False if `output` isn't in the log.
+	 */
+	bool recordedInputs(const std::string& output, std::vector<std::string>& inputs) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		uint32_t id = paths.find(output);
+		Entry entry;
+		if (id == detail::StringTable::NONE || !findEntry(id, entry)) {
+			return false;
+		}
+
+		inputs.clear();
+		for (auto& input : entry.inputs) {
+			inputs.push_back(paths.get(input.path));
+		}
+		return true;
+	}
+
+	/**
+	 * @return Every output that was found up to date or recorded in this run.
+	 */
+	std::vector<std::string> checkedOutputs() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::string> outputs;
+		for (uint32_t id : checked) {
+			outputs.push_back(paths.get(id));
+		}
+		return outputs;
+	}
+
+	/**
+	 * @param inputs Set to the inputs recorded for `output` and their signatures at the time.
+	 * @return False if `output` isn't in the log.
+	 */
+	bool recordedInputs(const std::string& output, std::vector<std::pair<std::string, FileSignature>>& inputs) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		uint32_t id = paths.find(output);
+		Entry entry;
+		if (id == detail::StringTable::NONE || !findEntry(id, entry)) {
+			return false;
+		}
+
+		inputs.clear();
+		for (auto& input : entry.inputs) {
+			inputs.push_back(std::make_pair(paths.get(input.path), input.signature));
+		}
+		return true;
+	}
+
+	/**
+	 * The content hashing counterpart of a timestamp check: `target` is out of date if it is missing, or if
+	 * one of `files` is newer than it and its contents differ from the version seen the last time `target`
+	 * was found up to date. Those versions are recorded as an entry for `target` with an empty command.
+	 *
+	 * @param skipMissing Ignore files that don't exist rather than treating `target` as out of date.
+	 */
+	bool isOlderThanInputs(const std::string& target, const std::vector<std::string>& files, bool skipMissing) {
+		struct stat targetStat;
+		if (!io::tryGetStat(target, targetStat)) {
+			return true;
+		}
+		int64_t targetTime = io::mtimeNanos(targetStat);
+
+		std::unordered_map<std::string, FileSignature> seen;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			uint32_t id = paths.find(target);
+			Entry entry;
+			if (id != detail::StringTable::NONE && findEntry(id, entry) && entry.command.empty()) {
+				for (auto& input : entry.inputs) {
+					seen[paths.get(input.path)] = input.signature;
+				}
+			}
+		}
+
+		std::vector<std::string> inputs;
+		bool changed = false;
+		for (auto& file : files) {
+			struct stat s;
+			if (!io::tryGetStat(file, s)) {
+				if (skipMissing) {
+					continue;
+				}
+				return true;
+			}
+
+			auto it = seen.find(file);
+			if (io::mtimeNanos(s) > targetTime && (it == seen.end() || hasChanged(file, s, it->second))) {
+				return true;
+			}
+			changed = changed || it == seen.end() || signatureOf(s) != it->second;
+			inputs.push_back(file);
+		}
+
+		if (changed || inputs.size() != seen.size()) {
+			record(target, "", inputs);
+		} else {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = paths.find(target);
+			if (id != detail::StringTable::NONE) {
+				checked.insert(id);
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * The state of a command's inputs just before it runs. See @ref beforeCommand.
+	 */
+	struct CommandStart {
+		int64_t time;
+		std::unordered_map<std::string, FileSignature> inputs;
+	};
+
+	/**
+	 * Must be called right before running a command whose output is then passed to @ref record.
+	 *
+	 * @param knownInputs The inputs the command is known to read, e.g. from its previous entry. Inputs only
+	 *                    discovered afterwards (e.g. from a depfile) are still checked against the time.
+	 */
+	CommandStart beforeCommand(const std::vector<std::string>& knownInputs) {
+		CommandStart start;
+		start.time = io::fileClockNanos();
+		for (auto& input : knownInputs) {
+			struct stat s;
+			if (io::tryGetStat(input, s)) {
+				start.inputs[input] = signatureOf(s);
+			}
+		}
+		return start;
+	}
+
+	/**
+	 * Records that `output` was just produced by `command` from `inputs`. Inputs that don't exist (e.g.
+	 * system libraries passed by name) are not recorded.
+	 *
+	 * Inputs modified since `start` may have been read in an older version, so they are recorded with a
+	 * signature that never matches and `output` is rebuilt on the next run. Like ninja, this only relies on
+	 * timestamps for inputs that weren't known before the command ran.
+	 */
+	void record(
+		const std::string& output,
+		const std::string& command,
+		const std::vector<std::string>& inputs,
+		const CommandStart& start
+	) {
+		std::vector<std::pair<std::string, FileSignature>> signatures;
+		for (auto& input : inputs) {
+			// The stat cache may still hold the version from before the command ran.
+			struct stat s;
+			if (stat(input.c_str(), &s) != 0) {
+				continue;
+			}
+
+			FileSignature signature = signatureOf(s);
+			auto before = start.inputs.find(input);
+			bool unchanged = before != start.inputs.end() && before->second == signature;
+			if (!unchanged && signature.mtime >= start.time) {
+				signature.mtime = -1;
+				signatures.push_back(std::make_pair(input, signature));
+			} else {
+				signatures.push_back(std::make_pair(input, contentHashing ? hashOf(input, s) : signature));
+			}
+		}
+		recordSignatures(output, command, signatures);
+	}
+
+	/**
+	 * Records `output` along with the current signatures of `inputs`, for outputs not produced by a command.
+	 */
+	void record(const std::string& output, const std::string& command, const std::vector<std::string>& inputs) {
+		std::vector<std::pair<std::string, FileSignature>> signatures;
+		for (auto& input : inputs) {
+			struct stat s;
+			if (io::tryGetStat(input, s)) {
+				signatures.push_back(std::make_pair(input, contentHashing ? hashOf(input, s) : signatureOf(s)));
+			}
+		}
+		recordSignatures(output, command, signatures);
+	}
+};
+
+const uint32_t BuildLog::VERSION;
+const std::size_t BuildLog::COMPACTION_RATIO;
+const std::size_t BuildLog::COMPACTION_MIN_ENTRIES;
+const std::size_t BuildLog::NO_ENTRY;
+
+/**
+ * @return The build log shared by every task in this run. It is loaded on first use.
+ */
+BuildLog& buildLog() {
+	static BuildLog instance(io::path_concat(DEFAULT_BUILD_DIR, BUILD_LOG_FILE));
+	return instance;
+}
+
+} // namespace cradle
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+static const std::string SNAPSHOT_FILE = ".cradle_snapshot";
+
+class Snapshot {
+	static constexpr const char* MAGIC = "CRADSNP";
+	static const uint32_t VERSION = 1;
+
+	// Files are checked in parallel once there are this many.
+	static const std::size_t PARALLEL_CHECK_MIN_FILES = 4096;
+
+	std::string path;
+	std::mutex mutex;
+	bool trackable = true;
+
+	template <typename T>
+	static void write(std::string& buffer, const T& value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static void writeString(std::string& buffer, const std::string& value) {
+		write(buffer, static_cast<uint32_t>(value.size()));
+		buffer.append(value);
+	}
+
+	template <typename T>
+	static bool read(const std::string& buffer, std::size_t& pos, T& value) {
+		if (buffer.size() - pos < sizeof(T)) {
+			return false;
+		}
+		std::memcpy(&value, buffer.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	static bool readString(const std::string& buffer, std::size_t& pos, std::string& value) {
+		uint32_t length;
+		if (!read(buffer, pos, length) || buffer.size() - pos < length) {
+			return false;
+		}
+		value.assign(buffer, pos, length);
+		pos += length;
+		return true;
+	}
+
+	static std::string header() {
+		std::string buffer(MAGIC, std::strlen(MAGIC) + 1);
+		write(buffer, VERSION);
+		return buffer;
+	}
+
+	/**
+	 * @return What the snapshot is only valid for, or an empty string if the executable can't be identified.
+	 */
+	static std::string key() {
+		if (commandLine().empty()) {
+			return "";
+		}
+
+#ifdef PLATFORM_LINUX
+		std::string executable = "/proc/self/exe";
+#else
+		std::string executable = commandLine()[0];
+#endif
+		struct stat s;
+		if (stat(executable.c_str(), &s) != 0) {
+			return "";
+		}
+
+		std::string buffer;
+		FileSignature signature = signatureOf(s);
+		write(buffer, signature.mtime);
+		write(buffer, signature.size);
+		write(buffer, signature.inode);
+		writeString(buffer, platform::platform_getcwd());
+
+		for (std::size_t i = 1; i < commandLine().size(); i++) {
+			writeString(buffer, commandLine()[i]);
+		}
+
+		// The variables that select the compiler, archiver and linker of the default toolchain.
+		for (auto& name : {"CXX", "AR", "CRADLE_LINKER"}) {
+			const char* value = std::getenv(name);
+			writeString(buffer, value == nullptr ? "" : std::string(name) + "=" + value);
+		}
+		return buffer;
+	}
+
+	static bool hasSignature(const std::string& path, const FileSignature& signature) {
+		struct stat s;
+		return stat(path.c_str(), &s) == 0 && signatureOf(s) == signature;
+	}
+
+	/**
+	 * @return True if every file in `files` still has its signature.
+	 */
+	static bool unchanged(const std::vector<std::pair<std::string, FileSignature>>& files) {
+		unsigned threadCount = files.size() < PARALLEL_CHECK_MIN_FILES ? 1 : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<char> results(threadCount, 1);
+
+		auto check = [&] (unsigned thread) {
+			for (std::size_t i = thread; i < files.size() && results[thread]; i += threadCount) {
+				if (!hasSignature(files[i].first, files[i].second)) {
+					results[thread] = 0;
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < threadCount; i++) {
+			threads.emplace_back(check, i);
+		}
+		check(0);
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		return std::find(results.begin(), results.end(), 0) == results.end();
+	}
+
+public:
+	Snapshot(const std::string& path) : path(path) {}
+
+	/**
+	 * Prevents a snapshot from being written in this run. Called when a command runs or a task executes that
+	 * may have effects beyond the outputs it declares, since it would have to run again in the next build.
+	 */
+	void disable() {
+		std::lock_guard<std::mutex> lock(mutex);
+		trackable = false;
+	}
+
+	/**
+	 * @return True if there is a snapshot for this run and nothing it depends on changed.
+	 */
+	bool isUpToDate() {
+		std::string expectedKey = key();
+		std::string contents;
+		if (expectedKey.empty() || !io::read_file(path, contents)) {
+			return false;
+		}
+
+		std::string expectedHeader = header();
+		if (contents.compare(0, expectedHeader.size(), expectedHeader) != 0) {
+			return false;
+		}
+
+		std::size_t pos = expectedHeader.size();
+		std::string snapshotKey;
+		uint32_t count;
+		if (!readString(contents, pos, snapshotKey) || snapshotKey != expectedKey || !read(contents, pos, count)) {
+			return false;
+		}
+
+		// Directories and inputs must be unchanged.
+		std::vector<std::pair<std::string, FileSignature>> files(count);
+		for (auto& file : files) {
+			if (
+				!readString(contents, pos, file.first) ||
+				!read(contents, pos, file.second.mtime) ||
+				!read(contents, pos, file.second.size) ||
+				!read(contents, pos, file.second.inode)
+			) {
+				return false;
+			}
+		}
+
+		// Outputs must exist.
+		if (!read(contents, pos, count)) {
+			return false;
+		}
+		std::vector<std::string> outputs(count);
+		for (auto& output : outputs) {
+			if (!readString(contents, pos, output)) {
+				return false;
+			}
+		}
+
+		for (auto& output : outputs) {
+			struct stat s;
+			if (stat(output.c_str(), &s) != 0) {
+				return false;
+			}
+		}
+		return unchanged(files);
+	}
+
+	/**
+	 * Writes the snapshot for the outputs and directories used in this run, unless it was disabled. Inputs
+	 * are recorded with the signatures they had when their outputs were built; if one was modified since, the
+	 * next run rebuilds it.
+	 */
+	void save() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!trackable) {
+				return;
+			}
+		}
+
+		std::string snapshotKey = key();
+		if (snapshotKey.empty()) {
+			return;
+		}
+
+		// Directories are recorded as they were listed. If one changed since, a file may have been added or
+		// removed after it was listed and the next run must list it again.
+		std::map<std::string, FileSignature> files;
+		for (auto& directory : io::listedDirectories().get()) {
+			FileSignature listed = signatureOf(directory.second);
+			auto it = files.insert(std::make_pair(directory.first, listed));
+			if ((!it.second && it.first->second != listed) || !hasSignature(directory.first, listed)) {
+				return;
+			}
+		}
+
+		std::vector<std::string> outputs = buildLog().checkedOutputs();
+		for (auto& output : outputs) {
+			std::vector<std::pair<std::string, FileSignature>> inputs;
+			if (!buildLog().recordedInputs(output, inputs)) {
+				return;
+			}
+			for (auto& input : inputs) {
+				auto it = files.insert(input);
+				if (!it.second && it.first->second != input.second) {
+					// Outputs were built from different versions of this file, so one of them is out of date.
+					return;
+				}
+			}
+		}
+
+		std::string buffer = header();
+		writeString(buffer, snapshotKey);
+		write(buffer, static_cast<uint32_t>(files.size()));
+		for (auto& file : files) {
+			writeString(buffer, file.first);
+			write(buffer, file.second.mtime);
+			write(buffer, file.second.size);
+			write(buffer, file.second.inode);
+		}
+		write(buffer, static_cast<uint32_t>(outputs.size()));
+		for (auto& output : outputs) {
+			writeString(buffer, output);
+		}
+
+		std::string tmpPath = path + ".tmp";
+		io::mkdirs(io::path_parent(path));
+		if (io::write_file(tmpPath, buffer)) {
+			std::rename(tmpPath.c_str(), path.c_str());
+			io::invalidateStat(path);
+		}
+	}
+
+	/**
+	 * Deletes the snapshot so it isn't used while the build it described changes.
+	 */
+	void remove() {
+		std::remove(path.c_str());
+		io::invalidateStat(path);
+	}
+};
+
+const uint32_t Snapshot::VERSION;
+const std::size_t Snapshot::PARALLEL_CHECK_MIN_FILES;
+
+Snapshot& snapshot() {
+	static Snapshot instance(io::path_concat(DEFAULT_BUILD_DIR, SNAPSHOT_FILE));
+	return instance;
+}
+
+/**
+ * @return True if the targets on the command line are known to be up to date, in which case the build is
+ *         skipped. Otherwise the snapshot is deleted until the build succeeds.
+ */
+bool isNullBuild() {
+	if (options().has("no-snapshot") || options().has("watch") || options().has("list")) {
+		return false;
+	}
+	if (snapshot().isUpToDate()) {
+		log("Nothing to do: every output is up to date");
+		return true;
+	}
+	snapshot().remove();
+	return false;
+}
+
+void disableSnapshot() {
+	snapshot().disable();
+}
+
+/**
+ * Writes the snapshot after a successful build.
+ */
+void finishBuild(ExecutionResult result) {
+	if (result == ExecutionResult::SUCCESS && !options().has("no-snapshot")) {
+		snapshot().save();
+	}
+}
+
+} // namespace cradle
+/**
+ * @file cradle_watch.hpp
+ *
+ * @brief Keeps cradle running after a build and rebuilds what changed sources affect (`--watch`).
+ *
+ * The configured task graph, the file lists found by @ref io::files and the stat cache stay in memory
+ * between builds. When a file changes only the tasks whose recorded inputs include it, and the tasks that
+ * depend on them, are executed again. Tasks that configured the build by adding followers are not executed
+ * again: their followers are. Adding or removing a file that @ref io::files would list changes the shape
+ * of the graph, so cradle then restarts itself to configure the build again.
+ */
+
+
+/**
+ * @file cradle_file_watcher.hpp
+ *
+ * @brief Reports changes to the files in a set of directories.
+ *
+ * Uses inotify on Linux. Directories are watched on their own rather than recursively, so each directory
+ * of interest must be added. Not supported on other platforms.
+ */
+
+
+
+#include <cerrno>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef PLATFORM_LINUX
+	#include <limits.h>
+	#include <poll.h>
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace platform {
+
+class FileWatcher {
+public:
+	struct Event {
+		enum class Kind {
+			// The file was written to or its attributes, such as its timestamp, changed.
+			MODIFIED,
+
+			// The file was created or moved into the directory.
+			CREATED,
+
+			// The file was deleted or moved out of the directory.
+			REMOVED
+		};
+
+		Kind kind;
+
+		// The directory as it was passed to @ref watch, and the name of the file in it.
+		std::string directory;
+		std::string name;
+
+		bool isDirectory;
+	};
+
+private:
+	int fd = -1;
+	std::unordered_map<int, std::string> directories;
+	std::unordered_map<std::string, int> watches;
+
+#ifdef PLATFORM_LINUX
+	/**
+	 * Reads the events that are queued without blocking.
+	 *
+	 * @return False if events were lost because the queue overflowed.
+	 */
+	bool readEvents(std::vector<Event>& events) {
+		alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+		bool complete = true;
+
+		while (true) {
+			ssize_t count = read(fd, buffer, sizeof(buffer));
+			if (count <= 0) {
+				return complete;
+			}
+
+			for (char* p = buffer; p < buffer + count; ) {
+				struct inotify_event* e = reinterpret_cast<struct inotify_event*>(p);
+				p += sizeof(struct inotify_event) + e->len;
+
+				if (e->mask & IN_Q_OVERFLOW) {
+					complete = false;
+					continue;
+				}
+
+				auto dir = directories.find(e->wd);
+				if (dir == directories.end() || e->len == 0) {
+					continue;
+				}
+
+				Event event;
+				event.directory = dir->second;
+				event.name = e->name;
+				event.isDirectory = (e->mask & IN_ISDIR) != 0;
+				if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+					event.kind = Event::Kind::CREATED;
+				} else if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					event.kind = Event::Kind::REMOVED;
+				} else {
+					event.kind = Event::Kind::MODIFIED;
+				}
+				events.push_back(event);
+			}
+		}
+	}
+#endif
+
+public:
+	FileWatcher() {
+#ifdef PLATFORM_LINUX
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher() {
+#ifdef PLATFORM_LINUX
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+
+	bool isSupported() const {
+		return fd >= 0;
+	}
+
+	bool isWatching(const std::string& directory) const {
+		return watches.find(directory) != watches.end();
+	}
+
+	/**
+	 * Starts reporting changes to the files directly in `directory`.
+	 *
+	 * @return False if the directory can't be watched, e.g. because it doesn't exist or the limit on the
+	 *         number of watches was reached.
+	 */
+	bool watch(const std::string& directory) {
+#ifdef PLATFORM_LINUX
+		if (fd < 0) {
+			return false;
+		}
+		if (isWatching(directory)) {
+			return true;
+		}
+
+		uint32_t mask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+		int wd = inotify_add_watch(fd, directory.empty() ? "." : directory.c_str(), mask | IN_ONLYDIR);
+		if (wd < 0) {
+			return false;
+		}
+		directories[wd] = directory;
+		watches[directory] = wd;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Blocks until a watched file changes, then keeps collecting changes until none have arrived for
+	 * `settleMillis` so that a file saved in several steps, or many files written at once, are reported
+	 * together.
+	 *
+	 * @param complete Set to false if events were lost, in which case anything may have changed.
+	 * @return False if waiting failed.
+	 */
+	bool wait(std::vector<Event>& events, bool& complete, int settleMillis = 50) {
+		events.clear();
+		complete = true;
+#ifdef PLATFORM_LINUX
+		int timeout = -1;
+		while (true) {
+			struct pollfd pfd = {fd, POLLIN, 0};
+			int ready = poll(&pfd, 1, timeout);
+			if (ready < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			if (ready == 0) {
+				return true;
+			}
+
+			complete = readEvents(events) && complete;
+			if (!events.empty() || !complete) {
+				timeout = settleMillis;
+			}
+		}
+#else
+		return false;
+#endif
+	}
+};
+
+} // namespace platform
+} // namespace cradle
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef PLATFORM_LINUX
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace detail {
+
+// The property tasks that write a file set to its path, e.g. `cpp::OUTPUT_FILE`. The inputs recorded for
+// that file in the build log decide which changes the task depends on.
+static const PropertyKey WATCHED_OUTPUT_PROPERTY("OUTPUT_FILE");
+
+/**
+ * Stands in for a task of the watched build during one rebuild, so that the original's dependencies and
+ * followers aren't changed. It is allocated on the heap and released from the task arena after the rebuild,
+ * so rebuilds don't accumulate tasks.
+ */
+class RebuildTask : public Task {
+	task_p original;
+	bool execute_;
+	std::mutex& succeededMutex;
+	std::unordered_set<Task*>& succeeded;
+
+public:
+	RebuildTask(
+		task_p original,
+		bool execute,
+		std::mutex& succeededMutex,
+		std::unordered_set<Task*>& succeeded
+	) :
+		Task(""),
+		original(original),
+		execute_(execute),
+		succeededMutex(succeededMutex),
+		succeeded(succeeded)
+	{
+		// executeTask checks whether the original is tracked.
+		markTracked();
+	}
+
+	ExecutionResult execute() override {
+		if (!execute_) {
+			return ExecutionResult::SUCCESS;
+		}
+		ExecutionResult result = detail::executeTask(*original);
+		if (result == ExecutionResult::SUCCESS) {
+			std::lock_guard<std::mutex> lock(succeededMutex);
+			succeeded.insert(original.get());
+		}
+		return result;
+	}
+};
+
+/**
+ * The tasks of a build and which of them a change to a file affects.
+ */
+class WatchedBuild {
+	// Whether every task was executed, i.e. every configuring task added its followers.
+	bool configured;
+
+	std::unordered_map<Task*, task_p> tasks;
+	std::unordered_map<Task*, std::vector<Task*>> dependents;
+	std::unordered_map<Task*, std::vector<Task*>> owners;
+
+	// Keyed by @ref key. Inputs hold the path as recorded so that the same stat cache entry is invalidated.
+	std::unordered_map<std::string, std::pair<std::string, std::vector<Task*>>> inputs;
+	std::unordered_set<std::string> listedFiles;
+	std::vector<std::shared_ptr<const io::PathFilter>> listings;
+	std::unordered_map<std::string, std::vector<std::size_t>> listingsByDirectory;
+	std::vector<std::string> outputDirectories;
+	std::string workingDirectory;
+
+	// Tasks that weren't executed successfully since a change affected them.
+	std::unordered_set<Task*> pending;
+
+	static std::string key(const std::string& directory, const std::string& name) {
+		return directory + '\0' + name;
+	}
+
+	void collect(const task_p& t) {
+		std::vector<task_p> stack{t};
+		while (!stack.empty()) {
+			task_p next = stack.back();
+			stack.pop_back();
+			if (!tasks.emplace(next.get(), next).second) {
+				continue;
+			}
+
+			for (auto& dep : next->dependencies()) {
+				dependents[dep.get()].push_back(next.get());
+				stack.push_back(dep);
+			}
+			for (auto& follower : next->followingTasks()) {
+				owners[follower.get()].push_back(next.get());
+				stack.push_back(follower);
+			}
+		}
+	}
+
+	/**
+	 * @return True for inputs that belong to the project rather than the system or the build's outputs.
+	 */
+	bool isWatchable(const std::string& path) const {
+		if (path.empty()) {
+			return false;
+		}
+		if (path[0] == '/' && path.compare(0, workingDirectory.size() + 1, workingDirectory + "/") != 0) {
+			return false;
+		}
+		for (auto& dir : outputDirectories) {
+			if (path.compare(0, dir.size() + 1, dir + "/") == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool isListable(const std::string& directory, const std::string& name) const {
+		auto it = listingsByDirectory.find(directory);
+		if (it == listingsByDirectory.end()) {
+			return false;
+		}
+		std::string path = io::path_concat(directory, name);
+		for (std::size_t index : it->second) {
+			if (listings[index]->matches(path)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	/**
+	 * @param roots      The tasks that were executed.
+	 * @param configured Whether they were executed successfully.
+	 */
+	WatchedBuild(const std::vector<task_p>& roots, bool configured) :
+		configured(configured),
+		workingDirectory(platform::platform_getcwd())
+	{
+		for (auto& root : roots) {
+			collect(root);
+		}
+
+		for (auto& it : tasks) {
+			Task& t = *it.second;
+			if (t.has(WATCHED_OUTPUT_PROPERTY)) {
+				std::string dir = io::path_parent(t.get(WATCHED_OUTPUT_PROPERTY));
+				if (std::find(outputDirectories.begin(), outputDirectories.end(), dir) == outputDirectories.end()) {
+					outputDirectories.push_back(dir);
+				}
+			}
+
+			std::shared_ptr<const io::PathFilter> filter = io::fileFilter(t);
+			if (filter != nullptr) {
+				listings.push_back(filter);
+				for (auto& dir : t.getList(io::DIRECTORY_LIST)) {
+					listingsByDirectory[dir].push_back(listings.size() - 1);
+				}
+				for (auto& file : t.getList(io::FILE_LIST)) {
+					listedFiles.insert(key(io::path_parent(file), io::path_filename(file)));
+				}
+			}
+		}
+	}
+
+	/**
+	 * Reads the inputs of every task from the build log, since builds may change them, and watches the
+	 * directories they and the listed files are in.
+	 */
+	void update(platform::FileWatcher& watcher) {
+		inputs.clear();
+		std::vector<std::string> recorded;
+		for (auto& it : tasks) {
+			Task& t = *it.second;
+			if (!t.has(WATCHED_OUTPUT_PROPERTY) || !t.followingTasks().empty()) {
+				continue;
+			}
+			if (!buildLog().recordedInputs(t.get(WATCHED_OUTPUT_PROPERTY), recorded)) {
+				continue;
+			}
+
+			for (auto& input : recorded) {
+				if (!isWatchable(input)) {
+					continue;
+				}
+				std::string dir = io::path_parent(input);
+				auto& entry = inputs[key(dir, io::path_filename(input))];
+				entry.first = input;
+				entry.second.push_back(&t);
+
+				if (!watcher.isWatching(dir) && !watcher.watch(dir)) {
+					log_error("Unable to watch " + dir + " for changes");
+				}
+			}
+		}
+
+		for (auto& it : listingsByDirectory) {
+			if (!watcher.isWatching(it.first) && !watcher.watch(it.first)) {
+				log_error("Unable to watch " + it.first + " for changes");
+			}
+		}
+	}
+
+	/**
+	 * @param affected Set to the tasks whose inputs changed.
+	 * @return False if files the build lists were added or removed, so the build must be configured again.
+	 */
+	bool affectedBy(const std::vector<platform::FileWatcher::Event>& events, std::vector<Task*>& affected) {
+		affected.clear();
+		std::unordered_set<std::string> seen;
+		std::unordered_set<Task*> added;
+
+		for (auto& event : events) {
+			std::string name = key(event.directory, event.name);
+			if (!seen.insert(name).second) {
+				continue;
+			}
+
+			std::string path = io::path_concat(event.directory, event.name);
+			io::invalidateStat(path);
+
+			bool listed = listedFiles.find(name) != listedFiles.end();
+			if (event.isDirectory) {
+				if (event.kind != platform::FileWatcher::Event::Kind::MODIFIED && listingsByDirectory.count(event.directory) > 0) {
+					return false;
+				}
+				continue;
+			}
+
+			auto input = inputs.find(name);
+			if (input == inputs.end()) {
+				// Files that aren't inputs yet matter if they are sources that were added, or sources that
+				// never compiled.
+				if (io::exists(path) ? (listed ? !configured : isListable(event.directory, event.name)) : listed) {
+					return false;
+				}
+				continue;
+			}
+
+			io::invalidateStat(input->second.first);
+			if (listed && !io::exists(path)) {
+				return false;
+			}
+			for (Task* t : input->second.second) {
+				if (added.insert(t).second) {
+					affected.push_back(t);
+				}
+			}
+		}
+
+		return configured || affected.empty();
+	}
+
+	/**
+	 * Executes the tasks in `affected`, the tasks that depend on them and the tasks that still hadn't
+	 * been executed successfully after earlier changes.
+	 */
+	ExecutionResult rebuild(Executor& executor, const std::vector<Task*>& affected) {
+		// Like the executor's graph each task has a "run" and a "done" node. Running a task again makes
+		// its followers run again and its dependents' dependencies done again, and a follower being done
+		// again makes its owner done again.
+		std::unordered_set<Task*> runs(pending.begin(), pending.end());
+		std::unordered_set<Task*> dones;
+		std::vector<std::pair<Task*, bool>> stack;
+		for (Task* t : pending) {
+			stack.push_back(std::make_pair(t, true));
+		}
+		for (Task* t : affected) {
+			if (runs.insert(t).second) {
+				stack.push_back(std::make_pair(t, true));
+			}
+		}
+
+		while (!stack.empty()) {
+			Task* t = stack.back().first;
+			bool run = stack.back().second;
+			stack.pop_back();
+
+			if (run) {
+				for (auto& follower : t->followingTasks()) {
+					if (runs.insert(follower.get()).second) {
+						stack.push_back(std::make_pair(follower.get(), true));
+					}
+				}
+				if (dones.insert(t).second) {
+					stack.push_back(std::make_pair(t, false));
+				}
+				continue;
+			}
+
+			for (Task* dependent : dependents[t]) {
+				if (runs.insert(dependent).second) {
+					stack.push_back(std::make_pair(dependent, true));
+				}
+			}
+			for (Task* owner : owners[t]) {
+				if (dones.insert(owner).second) {
+					stack.push_back(std::make_pair(owner, false));
+				}
+			}
+		}
+
+		// Stand-ins for the affected tasks with the same dependencies and followers among themselves.
+		// Tasks that configured the build don't execute again, their followers do.
+		std::mutex succeededMutex;
+		std::unordered_set<Task*> succeeded;
+		std::unordered_map<Task*, task_p> proxies;
+		for (Task* t : dones) {
+			task_p original = tasks[t];
+			bool execute = runs.count(t) > 0 && t->followingTasks().empty();
+			if (execute) {
+				pending.insert(t);
+			}
+
+			proxies[t] = std::make_shared<RebuildTask>(original, execute, succeededMutex, succeeded);
+		}
+
+		std::vector<task_p> roots;
+		for (auto& it : proxies) {
+			for (auto& dep : it.first->dependencies()) {
+				auto proxy = proxies.find(dep.get());
+				if (proxy != proxies.end()) {
+					it.second->dependsOn(proxy->second);
+				}
+			}
+			for (auto& follower : it.first->followingTasks()) {
+				auto proxy = proxies.find(follower.get());
+				if (proxy != proxies.end()) {
+					it.second->followedBy(proxy->second);
+				}
+			}
+			roots.push_back(it.second);
+		}
+
+		ExecutionResult result = executor.execute(roots);
+		for (Task* t : succeeded) {
+			pending.erase(t);
+		}
+
+		// Nothing refers to the proxies by id anymore, so their ids are given to the next rebuild's.
+		for (auto& it : proxies) {
+			Task::release(it.second);
+		}
+		return result;
+	}
+};
+
+/**
+ * Replaces cradle with a new instance started with the same arguments, which configures the build again.
+ * Only returns if that fails.
+ */
+void restart() {
+#ifdef PLATFORM_LINUX
+	fflush(stdout);
+	platform::jobServer().stop();
+
+	std::vector<char*> argv;
+	for (auto& arg : commandLine()) {
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+	execv("/proc/self/exe", argv.data());
+	log_error("Unable to restart cradle: " + std::string(strerror(errno)));
+#endif
+}
+
+} // namespace detail
+
+int watchAndRebuild() {
+	std::vector<task_p> roots = executor->dequeueTasks();
+	ExecutionResult result = executor->execute(roots);
+
+	platform::FileWatcher watcher;
+	if (!watcher.isSupported()) {
+		log_error("--watch is not supported on this platform");
+		return result == ExecutionResult::SUCCESS ? 0 : 1;
+	}
+
+	detail::WatchedBuild build(roots, result == ExecutionResult::SUCCESS);
+	while (true) {
+		build.update(watcher);
+		writeTrace();
+		log("Watching for changes...");
+		fflush(stdout);
+
+		std::vector<platform::FileWatcher::Event> events;
+		bool complete;
+		if (!watcher.wait(events, complete)) {
+			log_error("Unable to watch for changes: " + std::string(strerror(errno)));
+			return 1;
+		}
+
+		std::vector<Task*> affected;
+		if (!complete || !build.affectedBy(events, affected)) {
+			log("Files were added or removed, configuring the build again");
+			detail::restart();
+			return 1;
+		}
+		if (!affected.empty()) {
+			build.rebuild(*executor, affected);
+		}
+	}
+}
+
+} // namespace cradle
+/**
+ * @file
+ *
+ * The Builder concept in general is used to simplify the creation of objects that have multiple
+ * constructors or constructors of optional arguments. This file contains a number of abstractions
+ * to simplify the creation of builders for @ref cradle::Task "Task"s.
+ *
+ * To use these classes, add public fields of the appropriate type. The classes implement
+ * `operator()` so they may be called as methods (similar to typical builders) and will
+ * implicitly convert to the `ValueType` specified in the template argument. Additionaly,
+ * most of these classes will accept @ref cradle::task_p "task_p" objects as arguments and extract
+ * appropriate string values. This reduces the boilerplate necessary to create simple builders.
+ *
+ * For example:
+ * ```cpp
+ *		class MyBuilder {
+ *		public:
+ *			BuilderValue<MyBuilder, std::string> name{this}
+ *
+ *			task_p build() {
+ *				return task(name, [] { return ExecutionStatus::SUCCESS; });
+ *			}
+ *		}
+ *
+ *
+ *		int myFunctionThatUsesBuilder() {
+ *			auto b = MyBuilder()
+ *				.name("myName")
+ *				.build()
+ *		}
+ * ```
+ */
+
+
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace builder {
+
+template<typename Builder, typename ValueType>
+class Value {
+	Builder& builder;
+	ValueType value;
+	bool isSet;
+public:
+	Value() = delete;
+	Value(Builder* builder) : builder(*builder), isSet(false) {}
+	Value(Builder* builder, const ValueType& defaultValue) :
+		builder(*builder),
+		value(defaultValue),
+		isSet(true)
+	{}
+	Builder& operator()(ValueType value) {
+		this->value = value;
+		this->isSet = true;
+		return builder;
+	}
+	operator ValueType&() {
+		if (!isSet) throw new std::runtime_error("Attempting to access unset value.");
+		return value;
+	}
+};
+
+template<typename Builder, typename ValueType>
+class List {
+	Builder& builder;
+	std::vector<ValueType> value;
+	bool isSet;
+public:
+	List() = delete;
+	List(Builder* builder) : builder(*builder), isSet(false) {}
+	List(Builder* builder, std::initializer_list<ValueType> defaultValues) :
+		builder(*builder),
+		value(defaultValues),
+		isSet(true)
+	{}
+	Builder& operator()(ValueType value) {
+		this->value.push_back(value);
+		this->isSet = true;
+		return builder;
+	}
+	operator std::vector<ValueType>&() {
+		if (!isSet) throw new std::runtime_error("Attempting to access unset value.");
+		return value;
+	}
+};
+
+template<typename Builder>
+class Str : public Value<Builder, std::string> {
+public:
+	Str() = delete;
+	Str(Builder* builder) : Value<Builder, std::string>(builder) {}
+	Str(Builder* builder, const std::string& defaultValue) : Value<Builder, std::string>(builder, defaultValue) {}
+};
+
+template<typename Builder>
+class StrList : public List<Builder, std::string> {
+public:
+	StrList() = delete;
+	StrList(Builder* builder) : List<Builder, std::string>(builder) {}
+	StrList(Builder* builder, std::initializer_list<std::string> defaultValues) :
+		List<Builder, std::string>(builder, defaultValues)
+	{}
+};
+
+template <typename Builder>
+class StrFromTask {
+	Builder& builder;
+	std::string key;
+	task_p t;
+	bool isSet;
+
+public:
+	StrFromTask(Builder* builder, const std::string& key) :
+		builder(*builder),
+		key(key),
+		isSet(false)
+	{}
+
+	StrFromTask(Builder* builder, const std::string& key, task_p defaultTask) :
+		builder(*builder),
+		key(key),
+		t(defaultTask),
+		isSet(true)
+	{}
+
+	StrFromTask(Builder* builder, std::string key, std::string defaultValue) :
+		StrFromTask(
+			*builder,
+			key,
+			[key, defaultValue] (Task* self) { self->set(key, defaultValue); return ExecutionResult::SUCCESS; }
+		)
+	{}
+
+	Builder& operator() (const std::string& key, task_p newTask) {
+		std::string newTaskKey = key;
+		std::string origTaskKey = this->key;
+
+		this->t = tracked(task([newTaskKey, origTaskKey, newTask] (Task* self) {
+			self->set(origTaskKey, newTask->get(origTaskKey));
+			return ExecutionResult::SUCCESS;
+		}));
+
+		this->t->dependsOn(newTask);
+	}
+
+	operator task_p() const {
+		if (!isSet) throw new std::runtime_error("Attempting to access unset value.");
+		return t;
+	}
+};
+
+template <typename Builder>
+class StrListFromTask {
+	Builder& builder;
+	std::string key;
+	task_p t;
+	bool isSet;
+
+	// The tasks and keys that values were added from, shared with the task that collects them. Reset once the
+	// collector is shared with a copy or handed out, after which values are added to a new collector that
+	// depends on the old one.
+	mutable std::shared_ptr<std::vector<std::pair<task_p, std::string>>> sources;
+
+	static void pushValuesToList(Task& dst, const std::string& dstKey, task_p src, const std::string& srcKey) {
+		bool foundValue = false;
+		if (src->has(srcKey)) {
+			dst.push(dstKey, src->get(srcKey));
+			foundValue = true;
+		}
+		if (src->hasList(srcKey)) {
+			dst.push(dstKey, src->getList(srcKey));
+			foundValue = true;
+		}
+
+		if (!foundValue) {
+			throw std::runtime_error(
+						"Attempting to get value " + srcKey +
+						" from task " + (src->name().empty() ? "" : "with name \"" + src->name() + "\" ")  +
+						"but it is not defined."
+			);
+		}
+	}
+
+public:
+	StrListFromTask(Builder* builder, const std::string& key) :
+		builder(*builder),
+		key(key),
+		isSet(false)
+	{}
+
+	StrListFromTask(Builder* builder, const std::string& key, task_p defaultTask) :
+		builder(*builder),
+		key(key),
+		t(defaultTask),
+		isSet(true)
+	{}
+
+	StrListFromTask(const StrListFromTask& other) :
+		builder(other.builder),
+		key(other.key),
+		t(other.t),
+		isSet(other.isSet)
+	{
+		other.sources = nullptr;
+	}
+
+	Builder& operator() (std::initializer_list<std::string> values) {
+		return (*this)(key, listOf(key, values));
+	}
+
+	Builder& operator() (const std::string& value) {
+		return (*this)(key, listOf(key, {value}));
+	}
+
+	/**
+	 * Adds all the values in {@code newTask->getList(key)} if any and the single value in
+	 * {@code newTask->get(key)} if any to this parameter.
+	 * @brief operator ()
+	 * @param key
+	 * @param newTask
+	 * @return
+	 */
+	Builder& operator() (const std::string& key, task_p newTask) {
+		if (sources == nullptr) {
+			// A single task collects the values from every source, rather than one task per call.
+			sources = std::make_shared<std::vector<std::pair<task_p, std::string>>>();
+			if (isSet) {
+				sources->push_back(std::make_pair(t, this->key));
+			}
+
+			std::string origTaskKey = this->key;
+			std::shared_ptr<const std::vector<std::pair<task_p, std::string>>> collected = sources;
+			task_p collector = tracked(task([origTaskKey, collected] (Task* self) {
+				for (auto& source : *collected) {
+					StrListFromTask::pushValuesToList(*self, origTaskKey, source.first, source.second);
+				}
+				return ExecutionResult::SUCCESS;
+			}));
+			if (isSet) {
+				collector->dependsOn(t);
+			}
+			this->t = collector;
+		}
+
+		sources->push_back(std::make_pair(newTask, key));
+		this->t->dependsOn(newTask);
+		this->isSet = true;
+		return builder;
+	}
+
+	Builder& operator() (const std::string& key, std::initializer_list<task_p> tasks) {
+		for (auto newTask : tasks) {
+			(*this)(key, newTask);
+		}
+		return builder;
+	}
+
+	operator task_p() const {
+		if (!isSet) throw new std::runtime_error("Attempting to access unset value.");
+		sources = nullptr;
+		return t;
+	}
+};
+
+} // namespace builder
+} // namespace cradle
+/**
+ * @file
+ */
+
+
+
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cradle {
+
+/**
+ * Rewrites what a command wrote to standard output and error before it is printed, e.g. to drop reports
+ * that are collected instead. The result returned to the caller is left as it was.
+ */
+typedef std::function<void(std::string& output, std::string& errors)> OutputFilter;
+
+namespace detail {
+
+std::mutex& outputMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+/**
+ * Runs `args` in `workingDirectory` (or the current directory if empty) and prints its output in one piece.
+ * The command holds a jobserver slot while it runs.
+ *
+ * @param cmd The command line `args` were derived from, which is what is logged.
+ */
+platform::ProcessResult runArgs(
+	const std::string& cmd,
+	const std::vector<std::string>& args,
+	const std::string& workingDirectory,
+	const OutputFilter& filter = OutputFilter()
+) {
+	log(cmd);
+
+	platform::ProcessOptions options;
+	options.workingDirectory = workingDirectory;
+	platform::ProcessResult result;
+	{
+		platform::JobSlot slot;
+		long long begin = trace().now();
+		result = platform::runProcess(args, options);
+		if (trace().isEnabled()) {
+			trace().process(cmd, args, begin, trace().now(), result);
+		}
+	}
+
+	std::string output = result.output;
+	std::string errors = result.errors;
+	if (filter) {
+		filter(output, errors);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(outputMutex());
+		fwrite(output.data(), 1, output.size(), stdout);
+		fflush(stdout);
+		fwrite(errors.data(), 1, errors.size(), stderr);
+		fflush(stderr);
+	}
+
+	if (!result.started) {
+		log_error("Unable to run " + cmd + ": " + result.error);
+	} else if (result.signal != 0) {
+		log_error("Command terminated by signal " + std::to_string(result.signal) + ": " + cmd);
+	}
+	return result;
+}
+
+platform::ProcessResult runCommand(const std::string& cmd, const std::string& workingDirectory) {
+	return runArgs(cmd, platform::commandArgs(cmd), workingDirectory);
+}
+
+} // namespace detail
+
+/**
+ * Runs `args` without a shell and invalidates the cached stats of `outputs`, which must be every file the
+ * command may write.
+ *
+ * @param cmd    The command line that is logged for `args`.
+ * @param result Set to the exit status, output and resource usage of the command.
+ * @param filter Applied to the command's output before it is printed.
+ */
+ExecutionResult run(
+	const std::string& cmd,
+	const std::vector<std::string>& args,
+	const std::vector<std::string>& outputs,
+	platform::ProcessResult& result,
+	const OutputFilter& filter = OutputFilter()
+) {
+	result = detail::runArgs(cmd, args, "", filter);
+	for (auto& output : outputs) {
+		io::invalidateStat(output);
+	}
+	return result.succeeded() ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+}
+
+/**
+ * Runs `cmd` and invalidates the cached stats of `outputs`, which must be every file the command may write.
+ *
+ * @param result Set to the exit status, output and resource usage of the command.
+ */
+ExecutionResult run(const std::string& cmd, const std::vector<std::string>& outputs, platform::ProcessResult& result) {
+	return run(cmd, platform::commandArgs(cmd), outputs, result);
+}
+
+/**
+ * Runs `cmd` and invalidates the cached stats of `outputs`, which must be every file the command may write.
+ */
+ExecutionResult run(const std::string& cmd, const std::vector<std::string>& outputs) {
+	platform::ProcessResult result;
+	return run(cmd, outputs, result);
+}
+
+/**
+ * Runs `cmd`. Since it may write to any path all cached stats are invalidated, and no null build snapshot
+ * is written for this run.
+ */
+ExecutionResult run(const std::string& cmd) {
+	snapshot().disable();
+	auto ret = run(cmd, {});
+	io::invalidateAllStats();
+	return ret;
+}
+
+/**
+ * Runs `cmd` and collects what it writes to standard output.
+ *
+ * @return False if the command could not be started or failed.
+ */
+bool capture(const std::string& cmd, std::string& output) {
+	platform::ProcessResult result = platform::runProcess(platform::commandArgs(cmd));
+	output = result.output;
+	return result.succeeded();
+}
+
+/**
+ * Creates a task that runs `cmd` in `wd`. Since `cmd` may be a nested build (e.g. make, ninja or another
+ * cradle build) the executor will export a jobserver for it to share.
+ */
+task_p exec(std::string name, std::string wd, std::string cmd) {
+	platform::jobServer().requestServer();
+	return task(name, [wd,cmd] (Task* self) -> ExecutionResult {
+		// The working directory is only changed in the child since other tasks may be executing concurrently.
+		snapshot().disable();
+		auto result = detail::runCommand(cmd, wd);
+		io::invalidateAllStats();
+		return result.succeeded() ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+	});
+}
+
+task_p exec(std::string name, std::string cmd) {
+	platform::jobServer().requestServer();
+	return task(name, [cmd] (Task* self) -> ExecutionResult {
+		return run(cmd);
+	});
+}
+
+task_p exec(std::string cmd) {
+	platform::jobServer().requestServer();
+	return task([cmd] (Task* self) -> ExecutionResult {
+		return run(cmd);
+	});
+}
+
+} // namespace cradle
+
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+
+namespace cradle {
+namespace conan {
+
+static const PropertyKey BUILDDIRS("builddirs");
+static const PropertyKey INCLUDEDIRS("includedirs");
+static const PropertyKey LIBDIRS("libdirs");
+static const PropertyKey LIBS("libs");
+
+task_p conan_install(
+		std::string name,
+		std::string installFolder,
+		std::string pathToConanfile,
+		std::string buildOption,
+		std::vector<std::string> options,
+		std::vector<std::string> settings
+);
+
+class ConanInstallBuilder {
+public:
+	builder::Str<ConanInstallBuilder> name{this};
+	builder::Str<ConanInstallBuilder> pathToConanfile{this};
+	builder::Str<ConanInstallBuilder> installFolder{this, DEFAULT_BUILD_DIR};
+
+	/**
+	 * Set the value of `--build` passed to Conan. The default is `--build=missing`.
+	 */
+	builder::Str<ConanInstallBuilder> buildOption{this, "missing"};
+
+	/**
+	 * Set an option passed to Conan via `-o`.
+	 */
+	builder::StrList<ConanInstallBuilder> option{this, {}};
+
+	/**
+	 * Set a setting passed to Conan via `-s`.
+	 */
+	builder::StrList<ConanInstallBuilder> setting{this, {}};
+
+	task_p build() {
+		return conan_install(name, installFolder, pathToConanfile, buildOption, option, setting);
+	}
+};
+
+task_p conan_install(
+		std::string name,
+		std::string installFolder,
+		std::string pathToConanfile,
+		std::string buildOption,
+		std::vector<std::string> options,
+		std::vector<std::string> settings
+) {
+	std::string cmd = "conan install";
+
+	// Always use the text generator since we depend on its output.
+	cmd += " -g txt ";
+	cmd += " --install-folder " + installFolder;
+	cmd += " --build=" + buildOption;
+	cmd += " " + pathToConanfile;
+
+	for (auto& opt : options) {
+		if (!opt.empty()) {
+			cmd += " -o " + opt;
+		}
+	}
+	for (auto& setting : settings) {
+		if (!setting.empty()) {
+			cmd += " -s " + setting;
+		}
+	}
+
+	// `pathToConanfile` may be the conanfile or the directory containing it. The candidate that doesn't
+	// exist isn't recorded.
+	std::string filename = io::path_filename(pathToConanfile);
+	std::vector<std::string> conanfiles;
+	if (filename == "conanfile.txt" || filename == "conanfile.py") {
+		conanfiles.push_back(pathToConanfile);
+	} else {
+		conanfiles.push_back(io::path_concat(pathToConanfile, "conanfile.txt"));
+		conanfiles.push_back(io::path_concat(pathToConanfile, "conanfile.py"));
+	}
+
+	// Conan only runs again when the command or the conanfile changed, so a build that doesn't change them
+	// can be skipped by the null build snapshot.
+	return tracked(task(name, [=] (Task* self) {
+		std::string buildInfo = io::path_concat(installFolder, "conanbuildinfo.txt");
+		if (buildLog().isOutOfDate(buildInfo, cmd)) {
+			BuildLog::CommandStart started = buildLog().beforeCommand(conanfiles);
+			if (exec(cmd)->execute() == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			buildLog().record(buildInfo, cmd, conanfiles, started);
+		}
+
+		std::fstream conanbuildinfo(buildInfo);
+		std::string line;
+		std::string section = "";
+		while (std::getline(conanbuildinfo, line)) {
+			if (line.length() >= 2 && line[0] == '[' && line[line.length()-1] == ']') {
+				section = line.substr(1, line.length()-2);
+				continue;
+			} else if (line.empty()) {
+				continue;
+			}
+
+			self->push(section, line);
+		}
+
+		return ExecutionResult::SUCCESS;
+	}));
+}
+
+ConanInstallBuilder conan_install() {
+	return ConanInstallBuilder();
+}
+
+} // namespace conan
+} // namespace cradle
+/**
+ * @file cradle_cpp_cache.hpp
+ *
+ * @brief Reuses object files and static libraries built by earlier builds, in the manner of ccache's direct
+ *        mode.
+ *
+ * Before compiling, a manifest key is computed from the compiler identity, the compile command (with the
+ * output paths replaced by placeholders) and the hash of the source file. The manifest stored under that
+ * key lists, for the most recent compilations, the hash of every header the source included and the key of
+ * the resulting object. If every header of an entry still has the recorded hash the object is copied out
+ * of the cache instead of being compiled. Archives are keyed directly on the archive command and the hashes
+ * of the objects in them.
+ *
+ * There are up to two levels of cache: a local one and a shared one, e.g. on NFS, used by a fleet of
+ * machines. The local level is consulted first and results found in the shared level are copied into it.
+ * New results are stored in both levels unless the shared level is read-only.
+ */
+
+
+/**
+ * @file cradle_cpp_toolchain.hpp
+ *
+ * @brief Contains the interface and implementations of wrapper classes for executing toolchains.
+ */
+
+
+/**
+ * @file cradle_cpp_depfile.hpp
+ *
+ * @brief Parsers for the header dependency files emitted by compilers.
+ */
+
+
+
+#include <string>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+namespace detail {
+
+/**
+ * Parses a Makefile-style dependency file as written by `-MMD -MF` (GCC and Clang).
+ *
+ * @return The prerequisites of every rule in the file (i.e. the source file and the headers it includes)
+ *         in the order they appear.
+ */
+std::vector<std::string> parseMakeDepFile(const std::string& contents) {
+	std::vector<std::string> deps;
+	std::string word;
+
+	auto endWord = [&] () {
+		if (word.empty()) {
+			return;
+		}
+
+		if (word == ":") {
+			// The previous word was a target separated from its colon by whitespace.
+			if (!deps.empty()) {
+				deps.pop_back();
+			}
+		} else if (word.back() == ':') {
+			// Targets are not dependencies.
+		} else {
+			deps.push_back(word);
+		}
+		word.clear();
+	};
+
+	for (std::size_t i = 0; i < contents.size(); i++) {
+		char c = contents[i];
+
+		if (c == '\\' && i + 1 < contents.size()) {
+			char next = contents[i + 1];
+			if (next == '\n') {
+				// Line continuation.
+				endWord();
+				i++;
+				continue;
+			}
+			if (next == '\r' && i + 2 < contents.size() && contents[i + 2] == '\n') {
+				endWord();
+				i += 2;
+				continue;
+			}
+			if (next == ' ' || next == '#' || next == '\\') {
+				word += next;
+				i++;
+				continue;
+			}
+		}
+
+		if (c == '$' && i + 1 < contents.size() && contents[i + 1] == '$') {
+			word += '$';
+			i++;
+			continue;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			endWord();
+			continue;
+		}
+
+		word += c;
+	}
+	endWord();
+
+	return deps;
+}
+
+/**
+ * Parses the JSON file written by MSVC's `/sourceDependencies`.
+ *
+ * @return The source file followed by the headers it includes.
+ */
+std::vector<std::string> parseMsvcSourceDependencies(const std::string& contents) {
+	json::Value root = json::parse(contents);
+	const json::Value& data = root["Data"];
+
+	std::vector<std::string> deps;
+	if (data["Source"].isString()) {
+		deps.push_back(data["Source"].asString());
+	}
+	for (auto& include : data["Includes"].asArray()) {
+		deps.push_back(include.asString());
+	}
+	return deps;
+}
+
+} // namespace detail
+} // namespace cpp
+} // namespace cradle
+/**
+ * @file cradle_cpp_profile.hpp
+ *
+ * @brief Collects the time compilers report spending on each translation unit and sums it up over a build.
+ *
+ * Clang's `-ftime-trace` reports how long every header took to parse and every template took to
+ * instantiate. GCC's `-ftime-report` and MSVC's `/Bt+` only report the time spent in each phase of the
+ * compiler. The report lists the slowest translation units, headers, template instantiations and phases
+ * so it is clear which headers to split up or precompile.
+ */
+
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+
+static const std::string COMPILE_PROFILE_FILE = ".cradle_compile_profile.json";
+
+// The number of entries of each kind that are logged at the end of the build.
+static const std::size_t COMPILE_PROFILE_LOGGED = 10;
+
+/**
+ * Where the compiler spent its time on one translation unit. All times are in seconds.
+ */
+struct CompileProfile {
+	std::string source;
+	double seconds = 0;
+
+	// Time spent parsing each header, including the headers it includes.
+	std::map<std::string, double> headers;
+
+	// Time spent instantiating each template.
+	std::map<std::string, double> instantiations;
+
+	// Time spent in each phase or pass of the compiler.
+	std::map<std::string, double> phases;
+};
+
+namespace detail {
+
+/**
+ * Reads the trace written by Clang's `-ftime-trace` into `profile`.
+ *
+ * @return False if `contents` isn't a trace.
+ */
+bool parseClangTimeTrace(const std::string& contents, CompileProfile& profile) {
+	json::Value trace;
+	try {
+		trace = json::parse(contents);
+	} catch (const std::runtime_error&) {
+		return false;
+	}
+	if (!trace["traceEvents"].isArray()) {
+		return false;
+	}
+
+	for (auto& event : trace["traceEvents"].asArray()) {
+		const std::string& name = event["name"].asString();
+		const std::string& detail = event["args"]["detail"].asString();
+		double seconds = event["dur"].asNumber() / 1e6;
+
+		if (name == "Source") {
+			profile.headers[detail] += seconds;
+		} else if (name == "InstantiateClass" || name == "InstantiateFunction") {
+			profile.instantiations[detail] += seconds;
+		} else if (name == "Total ExecuteCompiler") {
+			profile.seconds = seconds;
+		} else if (name.compare(0, 6, "Total ") == 0) {
+			profile.phases[name.substr(6)] += seconds;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads the wall times from the table GCC prints with `-ftime-report` into `profile`, e.g.
+ *
+ *     phase parsing                      :   0.30 ( 70%)   0.13 ( 65%)   0.44 ( 68%)    32M ( 69%)
+ *
+ * @return False if `output` doesn't contain the table.
+ */
+bool parseGccTimeReport(const std::string& output, CompileProfile& profile) {
+	std::istringstream lines(output);
+	std::string line;
+	bool found = false;
+	while (std::getline(lines, line)) {
+		std::size_t colon = line.find(" : ");
+		if (colon == std::string::npos) {
+			continue;
+		}
+
+		std::size_t first = line.find_first_not_of(" |");
+		std::size_t last = line.find_last_not_of(' ', colon);
+		if (first == std::string::npos || first > last) {
+			continue;
+		}
+		std::string name = line.substr(first, last - first + 1);
+
+		// Columns are usr, sys and wall, each optionally followed by a percentage in parentheses.
+		std::istringstream columns(line.substr(colon + 3));
+		std::vector<double> times;
+		std::string column;
+		while (times.size() < 3 && columns >> column) {
+			if (column[0] == '(' || column.back() == ')' || column.back() == '%') {
+				continue;
+			}
+			char* end;
+			double value = std::strtod(column.c_str(), &end);
+			if (*end != '\0') {
+				break;
+			}
+			times.push_back(value);
+		}
+		if (times.size() < 3) {
+			continue;
+		}
+
+		found = true;
+		if (name == "TOTAL") {
+			profile.seconds = times[2];
+		} else {
+			profile.phases[name] += times[2];
+		}
+	}
+	return found;
+}
+
+/**
+ * Removes the table GCC prints with `-ftime-report`, from its `Time variable` heading to its `TOTAL` line,
+ * from `output`. Anything else the compiler printed, e.g. warnings, is kept.
+ */
+std::string stripGccTimeReport(const std::string& output) {
+	std::istringstream lines(output);
+	std::string line;
+	std::string stripped;
+	bool inReport = false;
+	while (std::getline(lines, line)) {
+		if (!inReport && line.compare(0, 13, "Time variable") == 0) {
+			inReport = true;
+			// The table is preceded by an empty line.
+			if (stripped.size() >= 2 && stripped.compare(stripped.size() - 2, 2, "\n\n") == 0) {
+				stripped.pop_back();
+			} else if (stripped == "\n") {
+				stripped.clear();
+			}
+		}
+		if (inReport) {
+			std::size_t first = line.find_first_not_of(' ');
+			if (first != std::string::npos && line.compare(first, 5, "TOTAL") == 0) {
+				inReport = false;
+			}
+			continue;
+		}
+		stripped += line;
+		if (!lines.eof()) {
+			stripped += '\n';
+		}
+	}
+	return stripped;
+}
+
+/**
+ * Reads the lines MSVC prints with `/Bt+`, e.g. `time(C:\...\c1xx.dll)=0.52s < ... > [main.cpp]`, into
+ * `profile`.
+ *
+ * @return False if `output` doesn't contain any.
+ */
+bool parseMsvcTimeReport(const std::string& output, CompileProfile& profile) {
+	static const std::vector<std::pair<std::string, std::string>> PHASES = {
+		{"c1xx.dll", "front end"},
+		{"c2.dll", "back end"}
+	};
+
+	bool found = false;
+	for (auto& phase : PHASES) {
+		std::size_t pos = output.find(phase.first + ")=");
+		if (pos == std::string::npos) {
+			continue;
+		}
+		double seconds = std::strtod(output.c_str() + pos + phase.first.size() + 2, nullptr);
+		profile.phases[phase.second] += seconds;
+		found = true;
+	}
+	return found;
+}
+
+/**
+ * Removes the lines MSVC prints with `/Bt+` from `output`.
+ */
+std::string stripMsvcTimeReport(const std::string& output) {
+	std::istringstream lines(output);
+	std::string line;
+	std::string stripped;
+	while (std::getline(lines, line)) {
+		if (line.compare(0, 5, "time(") == 0) {
+			continue;
+		}
+		stripped += line;
+		if (!lines.eof()) {
+			stripped += '\n';
+		}
+	}
+	return stripped;
+}
+
+} // namespace detail
+
+/**
+ * Sums up the profiles of the translation units compiled in this run. The report is logged and written to
+ * @ref COMPILE_PROFILE_FILE in @ref DEFAULT_BUILD_DIR when cradle exits.
+ */
+class CompileProfiler {
+	struct Total {
+		double seconds = 0;
+		std::size_t count = 0;
+	};
+
+	std::mutex mutex;
+	std::vector<std::pair<std::string, double>> units;
+	std::map<std::string, Total> headers;
+	std::map<std::string, Total> instantiations;
+	std::map<std::string, Total> phases;
+
+	static void addAll(std::map<std::string, Total>& totals, const std::map<std::string, double>& times) {
+		for (auto& time : times) {
+			Total& total = totals[time.first];
+			total.seconds += time.second;
+			total.count++;
+		}
+	}
+
+	static std::vector<std::pair<std::string, Total>> slowest(const std::map<std::string, Total>& totals) {
+		std::vector<std::pair<std::string, Total>> sorted(totals.begin(), totals.end());
+		std::stable_sort(sorted.begin(), sorted.end(), [] (const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+			return a.second.seconds > b.second.seconds;
+		});
+		return sorted;
+	}
+
+	static std::string seconds(double value) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%8.2fs", value);
+		return buffer;
+	}
+
+	static void logTotals(const std::string& title, const std::string& counted, const std::vector<std::pair<std::string, Total>>& sorted) {
+		if (sorted.empty()) {
+			return;
+		}
+		log(title);
+		for (std::size_t i = 0; i < sorted.size() && i < COMPILE_PROFILE_LOGGED; i++) {
+			log(seconds(sorted[i].second.seconds) + "  " + sorted[i].first + " (" + std::to_string(sorted[i].second.count) + " " + counted + ")");
+		}
+	}
+
+	static std::string toJson(const std::vector<std::pair<std::string, Total>>& sorted) {
+		std::string out = "[";
+		for (std::size_t i = 0; i < sorted.size(); i++) {
+			out += i == 0 ? "\n    " : ",\n    ";
+			out += "{\"name\": " + json::quote(sorted[i].first);
+			out += ", \"seconds\": " + std::to_string(sorted[i].second.seconds);
+			out += ", \"count\": " + std::to_string(sorted[i].second.count) + "}";
+		}
+		return out + (sorted.empty() ? "]" : "\n  ]");
+	}
+
+	void report() {
+		std::vector<std::pair<std::string, Total>> sortedUnits;
+		for (auto& unit : units) {
+			Total total;
+			total.seconds = unit.second;
+			total.count = 1;
+			sortedUnits.push_back(std::make_pair(unit.first, total));
+		}
+		std::stable_sort(sortedUnits.begin(), sortedUnits.end(), [] (const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+			return a.second.seconds > b.second.seconds;
+		});
+		auto sortedHeaders = slowest(headers);
+		auto sortedInstantiations = slowest(instantiations);
+		auto sortedPhases = slowest(phases);
+
+		log("Compile profile of " + std::to_string(units.size()) + " translation units:");
+		logTotals("Slowest translation units:", "compile", sortedUnits);
+		logTotals("Most expensive headers by total parse time:", "includes", sortedHeaders);
+		logTotals("Most expensive template instantiations:", "instantiations", sortedInstantiations);
+		logTotals("Time by compiler phase:", "units", sortedPhases);
+
+		std::string contents = "{\n  \"units\": " + toJson(sortedUnits);
+		contents += ",\n  \"headers\": " + toJson(sortedHeaders);
+		contents += ",\n  \"instantiations\": " + toJson(sortedInstantiations);
+		contents += ",\n  \"phases\": " + toJson(sortedPhases) + "\n}\n";
+
+		std::string file = io::path_concat(DEFAULT_BUILD_DIR, COMPILE_PROFILE_FILE);
+		if (io::write_file(file, contents)) {
+			log("Compile profile written to " + file);
+		} else {
+			log_error("Unable to write " + file);
+		}
+	}
+
+public:
+	~CompileProfiler() {
+		if (!units.empty()) {
+			report();
+		}
+	}
+
+	void add(const CompileProfile& profile) {
+		std::lock_guard<std::mutex> lock(mutex);
+		units.push_back(std::make_pair(profile.source, profile.seconds));
+		addAll(headers, profile.headers);
+		addAll(instantiations, profile.instantiations);
+		addAll(phases, profile.phases);
+	}
+};
+
+CompileProfiler& compileProfiler() {
+	static CompileProfiler instance;
+	return instance;
+}
+
+} // namespace cpp
+} // namespace cradle
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+
+class EnvToolchain;
+
+namespace detail {
+
+	static const std::string AR_ENV_VAR = "AR";
+	static const std::string CXX_ENV_VAR = "CXX";
+	static const std::string LINKER_ENV_VAR = "CRADLE_LINKER";
+
+	// Picks the fastest installed linker the compiler supports.
+	static const std::string AUTO_LINKER = "auto";
+
+	// Links with whatever the compiler driver uses by default.
+	static const std::string DRIVER_LINKER = "default";
+
+	// Commands longer than this pass their arguments through a response file. Windows limits command lines
+	// run through the shell to 8191 characters.
+#ifdef PLATFORM_WINDOWS
+	static const std::size_t RESPONSE_FILE_THRESHOLD = 8000;
+#else
+	static const std::size_t RESPONSE_FILE_THRESHOLD = 128 * 1024;
+#endif
+
+#ifdef PLATFORM_LINUX
+	static const std::string DEFAULT_AR = "ar";
+	static const std::string DEFAULT_CXX = "g++";
+#else
+	static const std::string DEFAULT_AR = "ar";
+#endif
+
+	std::string getEnvOrDefault(const std::string& envVar, const std::string& defaultValue) {
+		char* value = std::getenv(envVar.c_str());
+		if (value == NULL) {
+			return defaultValue;
+		}
+		return value;
+	}
+
+	/**
+	 * Appends ` <prefix>"<item>"` for each of `items` and a trailing space to `cmdline`. The space needed is
+	 * reserved up front so long lists, such as the objects of a large link, are appended in linear time.
+	 */
+	void appendArgs(std::string& cmdline, const std::string& prefix, const std::vector<std::string>& items) {
+		std::size_t size = cmdline.size() + 1;
+		for (auto& item : items) {
+			size += prefix.size() + item.size() + 3;
+		}
+		if (size > cmdline.capacity()) {
+			cmdline.reserve(std::max(size, 2 * cmdline.capacity()));
+		}
+
+		for (auto& item : items) {
+			cmdline += ' ';
+			cmdline += prefix;
+			cmdline += '"';
+			cmdline += item;
+			cmdline += '"';
+		}
+		cmdline += ' ';
+	}
+
+	void appendArgs(std::string& cmdline, const std::vector<std::string>& items) {
+		appendArgs(cmdline, "", items);
+	}
+
+	std::string listToArgs(const std::string& prefix, const std::vector<std::string>& items) {
+		std::string cmdline;
+		appendArgs(cmdline, prefix, items);
+		return cmdline;
+	}
+
+	std::string listToArgs(const std::vector<std::string>& items) {
+		return listToArgs("", items);
+	}
+
+	bool isInstalled(const std::string& program) {
+		if (program.find('/') != std::string::npos || program.find('\\') != std::string::npos) {
+			return io::exists(program);
+		}
+		return !platform::platform_which(program).empty();
+	}
+
+	/**
+	 * @return The archiver that goes with `compiler` and understands LTO objects, e.g. `gcc-ar-12` for
+	 *         `g++-12` or `llvm-ar` for `clang++`, if it is installed. Otherwise `ar`.
+	 */
+	std::string defaultArchiver(const std::string& compiler) {
+		static const std::vector<std::pair<std::string, std::string>> ARCHIVERS = {
+			{"clang++", "llvm-ar"},
+			{"clang", "llvm-ar"},
+			{"g++", "gcc-ar"},
+			{"gcc", "gcc-ar"},
+			{"c++", "gcc-ar"}
+		};
+
+		// Keep any directory, target prefix and version suffix, e.g. /usr/bin/x86_64-linux-gnu-g++-12.
+		std::string name = io::path_filename(compiler);
+		std::string dir = compiler.substr(0, compiler.size() - name.size());
+		for (auto& archiver : ARCHIVERS) {
+			std::size_t pos = name.find(archiver.first);
+			if (pos == std::string::npos) {
+				continue;
+			}
+
+			std::string candidate = dir + name.substr(0, pos) + archiver.second + name.substr(pos + archiver.first.size());
+			if (isInstalled(candidate)) {
+				return candidate;
+			}
+			if (isInstalled(archiver.second)) {
+				return archiver.second;
+			}
+			break;
+		}
+		return DEFAULT_AR;
+	}
+
+} // detail
+
+/**
+ * Link time optimization. `FULL` optimizes the whole program as a single module. `THIN` (ThinLTO) optimizes
+ * modules in parallel with summaries of the whole program and caches the results between links. Compilers
+ * without ThinLTO use their own parallel LTO for both.
+ */
+enum class LtoMode {
+	NONE,
+	FULL,
+	THIN
+};
+
+class Toolchain {
+protected:
+	std::vector<std::string> compileFlags;
+	std::vector<std::string> linkFlags;
+	std::vector<std::string> staticLibFlags;
+	std::size_t responseFileLength = detail::RESPONSE_FILE_THRESHOLD;
+	bool profilingCompile = false;
+
+public:
+	virtual ~Toolchain() {}
+
+	void addCompileFlags(const std::vector<std::string>& flags) {
+		compileFlags.insert(compileFlags.end(), flags.begin(), flags.end());
+	}
+
+	void addLinkFlags(const std::vector<std::string>& flags) {
+		linkFlags.insert(linkFlags.end(), flags.begin(), flags.end());
+	}
+
+	void addStaticLibFlags(const std::vector<std::string>& flags) {
+		staticLibFlags.insert(staticLibFlags.end(), flags.begin(), flags.end());
+	}
+
+	/**
+	 * Commands from this toolchain that are longer than `length` are run with their arguments in a response
+	 * file. See @ref responseFileContents.
+	 */
+	void setResponseFileThreshold(std::size_t length) {
+		responseFileLength = length;
+	}
+
+	std::size_t responseFileThreshold() const {
+		return responseFileLength;
+	}
+
+	/**
+	 * Makes `compileObjectCmd` ask the compiler to report where it spends its time, which is collected with
+	 * `readCompileProfile`. Objects are recompiled when this changes.
+	 */
+	void profileCompile(bool enabled) {
+		profilingCompile = enabled;
+	}
+
+	bool isProfilingCompile() const {
+		return profilingCompile;
+	}
+
+	/**
+	 * Moves the arguments of a command from this toolchain into a response file.
+	 *
+	 * @param args     The arguments of the command, starting with the program. Replaced by the arguments
+	 *                 that read the rest from `responseFile`.
+	 * @param contents Set to what must be written to `responseFile`.
+	 * @return False if the program doesn't read response files.
+	 */
+	virtual bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) = 0;
+
+	virtual std::string objectFileNameFromBase(const std::string& base) = 0;
+	virtual std::string staticLibNameFromBase(const std::string& base) = 0;
+	virtual std::string sharedLibNameFromBase(const std::string& base) = 0;
+
+	/**
+	 * @return The path of the file listing the headers included by the source compiled into `objectFile`.
+	 *         It is written by the command returned from `compileObjectCmd`.
+	 */
+	virtual std::string depFileNameFromObject(const std::string& objectFile) = 0;
+
+	/**
+	 * @return The source file and headers listed in the contents of a dependency file.
+	 */
+	virtual std::vector<std::string> parseDepFile(const std::string& contents) = 0;
+
+	/**
+	 * @return A description of the compiler and its version. Objects are only reused from the compile cache
+	 *         when this matches.
+	 */
+	virtual std::string compilerIdentity() = 0;
+
+	virtual std::string compileObjectCmd(
+		std::string outputFilePath,
+		std::string inputFileName,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * Adds what the compiler reported about compiling `objectFile` with profiling enabled to `profile`.
+	 *
+	 * @param result The result of the command from `compileObjectCmd`.
+	 * @return False if the compiler reported nothing.
+	 */
+	virtual bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) = 0;
+
+	/**
+	 * Removes what the compiler reports for `readCompileProfile` from the output of a command before it is
+	 * printed, so that profiled builds don't print a report for every translation unit.
+	 */
+	virtual void stripCompileProfile(std::string& output, std::string& errors) = 0;
+
+	/**
+	 * @return The path of the precompiled header built from the header `base`.
+	 */
+	virtual std::string precompiledHeaderNameFromBase(const std::string& base) = 0;
+
+	/**
+	 * Headers are precompiled from a generated file that includes them, so that the header isn't compiled as
+	 * the main file and the file can be named after the precompiled header.
+	 *
+	 * @param headerFile The absolute path of the header.
+	 * @param contents   Set to the contents of the generated file.
+	 * @return The path the file must be written to before running `compilePrecompiledHeaderCmd`.
+	 */
+	virtual std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) = 0;
+
+	/**
+	 * @return The command that precompiles `headerFile`, through the file from `precompiledHeaderSource`, into
+	 *         `outputFilePath`. Like `compileObjectCmd` it also writes the dependency file
+	 *         `depFileNameFromObject(outputFilePath)`.
+	 */
+	virtual std::string compilePrecompiledHeaderCmd(
+		std::string outputFilePath,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * @return The flags to pass to `compileObjectCmd` to include the precompiled header `precompiledHeaderFile`
+	 *         built from `headerFile` at the start of the source.
+	 */
+	virtual std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) = 0;
+
+	/**
+	 * @return An object file written by `compilePrecompiledHeaderCmd` that must be linked along with the objects
+	 *         compiled with the precompiled header, or an empty string if there is none.
+	 */
+	virtual std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) = 0;
+
+	virtual std::string linkExeCmd(
+		std::string outputFilePath,
+		std::vector<std::string> objectFiles,
+        std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	virtual std::string buildStaticLibCmd(
+		std::string outputFilePath,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * @param visibility The default visibility of symbols, e.g. `hidden` to only export symbols marked as
+	 *                   exported, or an empty string for the compiler's default.
+	 * @return The flags to compile the objects of a shared library with.
+	 */
+	virtual std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) = 0;
+
+	/**
+	 * @param soname The name the library is loaded by at runtime, if the platform has one.
+	 */
+	virtual std::string linkSharedLibCmd(
+		std::string outputFilePath,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * Describes what a shared library exports to the programs linked against it. Programs only need to be
+	 * relinked when this changes.
+	 *
+	 * @return False if the interface can't be determined.
+	 */
+	virtual bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) = 0;
+
+	/**
+	 * @return The name of the linker used by `linkExeCmd` and `linkSharedLibCmd`, for reports.
+	 */
+	virtual std::string linkerName() = 0;
+
+	/**
+	 * @return The flags to compile objects for link time optimization with.
+	 */
+	virtual std::vector<std::string> ltoCompileFlags(LtoMode mode) = 0;
+
+	/**
+	 * @param jobs     The number of modules to optimize and generate code for in parallel, or 0 for one per CPU.
+	 * @param cacheDir Where ThinLTO keeps optimized modules between links.
+	 * @return The flags to link objects compiled with `ltoCompileFlags(mode)` with.
+	 */
+	virtual std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) = 0;
+
+	/**
+	 * @param dirs Absolute paths of directories holding shared libraries.
+	 * @return The link flags to find shared libraries in `dirs` when the program runs.
+	 */
+	virtual std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) = 0;
+
+	static std::shared_ptr<Toolchain> platformDefault();
+};
+
+class GccClangCompatibleToolchain : public Toolchain {
+	std::string archiver;
+	std::string compiler;
+	std::string linker;
+
+	std::once_flag identityFlag;
+	std::string identity;
+
+	std::once_flag linkerFlag;
+	std::string selectedLinker;
+
+	/**
+	 * @return True if the compiler driver can link with `-fuse-ld=<name>`.
+	 */
+	bool supportsLinker(const std::string& name) {
+		std::string executable = name == "mold" ? "mold" : "ld." + name;
+		if (!detail::isInstalled(executable)) {
+			return false;
+		}
+		std::string version;
+		return capture(compiler + " -fuse-ld=" + name + " -Wl,--version", version);
+	}
+
+	/**
+	 * @return The linker to pass to `-fuse-ld`, or an empty string for the driver's default.
+	 */
+	std::string selectLinker() {
+		std::call_once(linkerFlag, [this] () {
+			if (linker != detail::AUTO_LINKER) {
+				selectedLinker = linker == detail::DRIVER_LINKER ? "" : linker;
+				return;
+			}
+			for (auto& candidate : {"mold", "lld", "gold"}) {
+				if (supportsLinker(candidate)) {
+					selectedLinker = candidate;
+					return;
+				}
+			}
+		});
+		return selectedLinker;
+	}
+
+	std::string useLinkerArg() {
+		std::string selected = selectLinker();
+		return selected.empty() ? "" : " -fuse-ld=" + selected;
+	}
+
+public:
+	/**
+	 * @param linker The linker to use through `-fuse-ld`, e.g. `lld`, `mold`, `gold` or `bfd`. `auto` picks
+	 *               the first of mold, lld and gold that is installed and supported by the compiler, and
+	 *               `default` leaves the choice to the compiler.
+	 */
+	GccClangCompatibleToolchain(std::string archiver, std::string compiler, std::string linker = detail::AUTO_LINKER) :
+		archiver(archiver),
+		compiler(compiler),
+		linker(linker)
+	{}
+
+	std::string linkerName() override {
+		std::string selected = selectLinker();
+		return selected.empty() ? detail::DRIVER_LINKER : selected;
+	}
+
+	bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) override {
+		// gcc-ar puts its plugin options before the arguments, so ar only finds its operation if it is
+		// given directly.
+		std::size_t keep = 1;
+		if (args[0] == archiver) {
+			auto operation = std::find(args.begin(), args.end(), "rcs");
+			keep = operation == args.end() ? args.size() : operation - args.begin() + 1;
+		}
+		if (keep >= args.size()) {
+			return false;
+		}
+
+		std::size_t size = 0;
+		for (std::size_t i = keep; i < args.size(); i++) {
+			size += 2 * args[i].size() + 3;
+		}
+
+		// GCC, clang and binutils split response files at whitespace after removing the backslash before any
+		// character, so escaping every special character works for all of them.
+		contents.clear();
+		contents.reserve(size);
+		for (std::size_t i = keep; i < args.size(); i++) {
+			if (args[i].empty()) {
+				contents += "\"\"";
+			}
+			for (char c : args[i]) {
+				if (std::strchr(" \t\n\r\f\v\\\"'", c) != nullptr) {
+					contents += '\\';
+				}
+				contents += c;
+			}
+			contents += '\n';
+		}
+
+		args.resize(keep);
+		args.push_back("@" + responseFile);
+		return true;
+	}
+
+	std::string objectFileNameFromBase(const std::string& base) override {
+		return base + ".o";
+	}
+
+	std::string staticLibNameFromBase(const std::string& base) override {
+		return "lib" + base + ".a";
+	}
+
+	std::string sharedLibNameFromBase(const std::string& base) override {
+		return "lib" + base + ".so";
+	}
+
+	std::string depFileNameFromObject(const std::string& objectFile) override {
+		return objectFile + ".d";
+	}
+
+	std::vector<std::string> parseDepFile(const std::string& contents) override {
+		return detail::parseMakeDepFile(contents);
+	}
+
+	std::string compilerIdentity() override {
+		std::call_once(identityFlag, [this] () {
+			std::string version;
+			capture(compiler + " --version", version);
+			identity = compiler + "\n" + version;
+		});
+		return identity;
+	}
+
+	std::string compileObjectCmd(
+		std::string outputFileName,
+		std::string inputFileName,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		if (profilingCompile) {
+			cmdline += isClang() ? " -ftime-trace" : " -ftime-report";
+		}
+		cmdline += " -c ";
+		cmdline += inputFileName;
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		cmdline += " -MMD -MF \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " -o " + outputFileName;
+		return cmdline;
+	}
+
+	bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) override {
+		if (!isClang()) {
+			return detail::parseGccTimeReport(result.errors, profile);
+		}
+
+		// Clang names the trace after the object, e.g. `main.cpp.json` for `main.cpp.o`.
+		std::string traceFile = objectFile.substr(0, objectFile.size() - std::string(".o").size()) + ".json";
+		std::string contents;
+		return io::read_file(traceFile, contents) && detail::parseClangTimeTrace(contents, profile);
+	}
+
+	void stripCompileProfile(std::string& output, std::string& errors) override {
+		// Clang writes its trace to a file.
+		if (profilingCompile && !isClang()) {
+			errors = detail::stripGccTimeReport(errors);
+		}
+	}
+
+	std::string precompiledHeaderNameFromBase(const std::string& base) override {
+		return base + ".gch";
+	}
+
+	std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) override {
+		contents = "#include \"" + headerFile + "\"\n";
+		return precompiledHeaderFile.substr(0, precompiledHeaderFile.size() - std::string(".gch").size());
+	}
+
+	std::string compilePrecompiledHeaderCmd(
+		std::string outputFileName,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string contents;
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " -x c++-header ";
+		cmdline += precompiledHeaderSource(outputFileName, headerFile, contents);
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		cmdline += " -MMD -MF \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " -o " + outputFileName;
+		return cmdline;
+	}
+
+	std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) override {
+		// The compiler looks for `<name>.gch` before `<name>` when including `<name>`. -Winvalid-pch reports a
+		// precompiled header that doesn't match the flags instead of silently parsing the header again.
+		std::string contents;
+		return {"-Winvalid-pch", "-include", precompiledHeaderSource(precompiledHeaderFile, headerFile, contents)};
+	}
+
+	std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) override {
+		return "";
+	}
+
+	std::string linkExeCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+        std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = compiler;
+		cmdline += useLinkerArg();
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		detail::appendArgs(cmdline, "-L", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+		detail::appendArgs(cmdline, "-l", linkLibraryNames);
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " -o " + outputFileName;
+		return cmdline;
+	}
+
+	std::string buildStaticLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = archiver;
+		detail::appendArgs(cmdline, staticLibFlags);
+		cmdline += " rcs ";
+		cmdline += outputFileName;
+		detail::appendArgs(cmdline, objectFiles);
+		return cmdline;
+	}
+
+	std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) override {
+		std::vector<std::string> flags = {"-fPIC"};
+		if (!visibility.empty()) {
+			flags.push_back("-fvisibility=" + visibility);
+			if (visibility == "hidden") {
+				flags.push_back("-fvisibility-inlines-hidden");
+			}
+		}
+		return flags;
+	}
+
+	std::string linkSharedLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = compiler;
+		cmdline += useLinkerArg();
+		cmdline += " -shared";
+		if (!soname.empty()) {
+			cmdline += " \"-Wl,-soname," + soname + "\"";
+		}
+		detail::appendArgs(cmdline, "-L", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+		detail::appendArgs(cmdline, "-l", linkLibraryNames);
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " -o " + outputFileName;
+		return cmdline;
+	}
+
+	bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) override {
+		// The name and type of every exported symbol, leaving out addresses and sizes, which change with
+		// the implementation.
+		std::string symbols;
+		if (!capture("nm --format=posix --dynamic --defined-only \"" + sharedLibFile + "\"", symbols)) {
+			return false;
+		}
+
+		std::istringstream lines(symbols);
+		std::vector<std::string> exported;
+		std::string name;
+		std::string type;
+		std::string rest;
+		while (lines >> name >> type && std::getline(lines, rest)) {
+			exported.push_back(name + " " + type);
+		}
+		std::sort(exported.begin(), exported.end());
+
+		interface.clear();
+		for (auto& symbol : exported) {
+			interface += symbol + "\n";
+		}
+		return true;
+	}
+
+	std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) override {
+		std::vector<std::string> flags;
+		for (auto& dir : dirs) {
+			flags.push_back("-Wl,-rpath," + dir);
+		}
+		return flags;
+	}
+
+	bool isClang() {
+		return compilerIdentity().find("clang") != std::string::npos;
+	}
+
+	std::vector<std::string> ltoCompileFlags(LtoMode mode) override {
+		switch (mode) {
+		case LtoMode::NONE: return {};
+		case LtoMode::FULL: return {"-flto"};
+		case LtoMode::THIN: return {isClang() ? "-flto=thin" : "-flto"};
+		}
+		return {};
+	}
+
+	std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) override {
+		if (mode == LtoMode::NONE) {
+			return {};
+		}
+		std::string jobCount = jobs > 0 ? std::to_string(jobs) : std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+
+		if (!isClang()) {
+			// GCC partitions the program and optimizes the partitions in parallel in either mode.
+			return {"-flto=" + jobCount};
+		}
+		if (mode == LtoMode::FULL) {
+			return {"-flto"};
+		}
+
+		// The driver passes the job count on in whatever form the linker expects, but the cache is only
+		// configured through linker options. lld has its own, while BFD, gold and mold load LLVM's plugin.
+		std::vector<std::string> flags = {"-flto=thin", "-flto-jobs=" + jobCount};
+		std::string cachePolicy = "prune_after=168h:cache_size_bytes=4g";
+		std::string selected = selectLinker();
+		if (selected == "lld") {
+			flags.push_back("-Wl,--thinlto-cache-dir=" + cacheDir);
+			flags.push_back("-Wl,--thinlto-cache-policy=" + cachePolicy);
+		} else if (selected.empty() && platform::os::is_mac()) {
+			flags.push_back("-Wl,-cache_path_lto," + cacheDir);
+		} else {
+			flags.push_back("-Wl,-plugin-opt,cache-dir=" + cacheDir);
+			flags.push_back("-Wl,-plugin-opt,cache-policy=" + cachePolicy);
+		}
+		return flags;
+	}
+};
+
+
+class MSVCToolchain : public Toolchain {
+	std::string archiver;
+	std::string compiler;
+    std::string linker;
+
+	std::once_flag identityFlag;
+	std::string identity;
+
+public:
+    MSVCToolchain() :
+        archiver("lib"),
+        compiler("cl"),
+        linker("link")
+	{}
+
+	std::string objectFileNameFromBase(const std::string& base) override {
+		return base + ".obj";
+	}
+
+	std::string staticLibNameFromBase(const std::string& base) override {
+		return base + ".lib";
+	}
+
+	std::string sharedLibNameFromBase(const std::string& base) override {
+		return base + ".dll";
+	}
+
+	std::string depFileNameFromObject(const std::string& objectFile) override {
+		return objectFile + ".json";
+	}
+
+	std::vector<std::string> parseDepFile(const std::string& contents) override {
+		return detail::parseMsvcSourceDependencies(contents);
+	}
+
+	std::string compilerIdentity() override {
+		std::call_once(identityFlag, [this] () {
+			// cl prints its version and target architecture to stderr when run without arguments.
+			std::string banner;
+			capture(compiler + " 2>&1", banner);
+			identity = compiler + "\n" + banner;
+		});
+		return identity;
+	}
+
+	std::string compileObjectCmd(
+		std::string outputFileName,
+		std::string inputFileName,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		if (profilingCompile) {
+			cmdline += " /Bt+";
+		}
+		cmdline += " /c ";
+		cmdline += inputFileName;
+		detail::appendArgs(cmdline, "/I", includeSearchDirs);
+		cmdline += " /sourceDependencies \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " /Fo" + outputFileName;
+		return cmdline;
+	}
+
+	bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) override {
+		return detail::parseMsvcTimeReport(result.output + result.errors, profile);
+	}
+
+	void stripCompileProfile(std::string& output, std::string& errors) override {
+		if (profilingCompile) {
+			output = detail::stripMsvcTimeReport(output);
+			errors = detail::stripMsvcTimeReport(errors);
+		}
+	}
+
+	std::string precompiledHeaderNameFromBase(const std::string& base) override {
+		return base + ".pch";
+	}
+
+	std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) override {
+		contents = "#include \"" + headerFile + "\"\n";
+		return precompiledHeaderFile + ".cpp";
+	}
+
+	std::string compilePrecompiledHeaderCmd(
+		std::string outputFileName,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string contents;
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " /c ";
+		cmdline += precompiledHeaderSource(outputFileName, headerFile, contents);
+		detail::appendArgs(cmdline, "/I", includeSearchDirs);
+		cmdline += " /Yc\"" + headerFile + "\" /Fp\"" + outputFileName + "\"";
+		cmdline += " /sourceDependencies \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " /Fo" + precompiledHeaderObject(outputFileName);
+		return cmdline;
+	}
+
+	std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) override {
+		return {"/FI" + headerFile, "/Yu" + headerFile, "/Fp" + precompiledHeaderFile};
+	}
+
+	std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) override {
+		return precompiledHeaderFile + ".obj";
+	}
+
+	std::string linkExeCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+        std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = linker;
+		detail::appendArgs(cmdline, "/LIBPATH:", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+
+		for (auto name : linkLibraryNames) {
+			cmdline += " " + staticLibNameFromBase(name);
+		}
+
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+        cmdline += " /OUT:" + outputFileName + ".exe";
+
+		return cmdline;
+	}
+
+	std::string buildStaticLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = archiver;
+		detail::appendArgs(cmdline, staticLibFlags);
+		detail::appendArgs(cmdline, flags);
+        cmdline += " ";
+        cmdline += "/OUT:" + outputFileName;
+		detail::appendArgs(cmdline, objectFiles);
+		return cmdline;
+	}
+
+	std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) override {
+		// Symbols are only exported when marked with __declspec(dllexport).
+		return {};
+	}
+
+	std::string linkSharedLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags
+	) override {
+		// Programs link against the import library, which is named like a static library.
+		std::string base = outputFileName.substr(0, outputFileName.size() - std::string(".dll").size());
+
+		std::string cmdline = linker;
+		cmdline += " /DLL";
+		detail::appendArgs(cmdline, "/LIBPATH:", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+
+		for (auto name : linkLibraryNames) {
+			cmdline += " " + staticLibNameFromBase(name);
+		}
+
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " /OUT:" + outputFileName;
+		cmdline += " /IMPLIB:" + base + ".lib";
+		return cmdline;
+	}
+
+	bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) override {
+		// The export listing includes addresses, so programs are relinked whenever the DLL is.
+		return false;
+	}
+
+	std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) override {
+		// DLLs are found next to the program or through PATH.
+		return {};
+	}
+
+	std::string linkerName() override {
+		return linker;
+	}
+
+	bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) override {
+		// cl, link and lib read every argument from the file. They are quoted as on the command line, where
+		// backslashes are literal unless they precede a quote.
+		contents.clear();
+		for (std::size_t i = 1; i < args.size(); i++) {
+			contents += '"';
+			std::size_t backslashes = 0;
+			for (char c : args[i]) {
+				if (c == '\\') {
+					backslashes++;
+				} else {
+					if (c == '"') {
+						contents.append(backslashes + 1, '\\');
+					}
+					backslashes = 0;
+				}
+				contents += c;
+			}
+			contents.append(backslashes, '\\');
+			contents += "\"\n";
+		}
+
+		args.resize(1);
+		args.push_back("@" + responseFile);
+		return true;
+	}
+
+	std::vector<std::string> ltoCompileFlags(LtoMode mode) override {
+		return mode == LtoMode::NONE ? std::vector<std::string>() : std::vector<std::string>{"/GL"};
+	}
+
+	std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) override {
+		// Incremental link time code generation is the closest thing to ThinLTO's cache. It keeps its state
+		// next to the output rather than in `cacheDir`.
+		switch (mode) {
+		case LtoMode::NONE: return {};
+		case LtoMode::FULL: return {"/LTCG"};
+		case LtoMode::THIN: return {"/LTCG:INCREMENTAL"};
+		}
+		return {};
+	}
+};
+
+std::shared_ptr<Toolchain> Toolchain::platformDefault() {
+	#ifdef PLATFORM_WINDOWS
+        return std::make_shared<MSVCToolchain>();
+	#else
+		std::string compiler = detail::getEnvOrDefault(detail::CXX_ENV_VAR, detail::DEFAULT_CXX);
+		return std::make_shared<GccClangCompatibleToolchain>(
+			detail::getEnvOrDefault(detail::AR_ENV_VAR, detail::defaultArchiver(compiler)),
+			compiler,
+			detail::getEnvOrDefault(detail::LINKER_ENV_VAR, detail::AUTO_LINKER)
+		);
+	#endif
+}
+
+} // namespace cpp
+} // namespace cradle
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+
+/**
+ * The output path used in the command that cache keys are computed from, so that keys don't depend on where
+ * the object is written.
+ */
+static const std::string CACHE_OUTPUT_PLACEHOLDER = "cradle_cache_output";
+
+class CompileCache {
+	static const std::size_t MAX_MANIFEST_ENTRIES = 16;
+
+	struct ManifestEntry {
+		std::vector<std::pair<std::string, uint64_t>> dependencies;
+		std::string objectKey;
+	};
+
+	// The local level, if enabled, comes first.
+	std::vector<std::unique_ptr<CacheStore>> levels;
+
+	static std::string getEnvOrOption(const std::string& option, const std::string& envVar) {
+		const char* value = std::getenv(envVar.c_str());
+		return options().get(option, value == nullptr ? "" : value);
+	}
+
+	/**
+	 * Manifests are text: each dependency is a line with its hash in hex and its path, and each entry ends
+	 * with a line holding `=` and the object key.
+	 */
+	static std::string encodeManifest(const std::vector<ManifestEntry>& entries) {
+		std::string contents;
+		for (auto& entry : entries) {
+			for (auto& dependency : entry.dependencies) {
+				char hash[17];
+				snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(dependency.second));
+				contents += std::string(hash) + " " + dependency.first + "\n";
+			}
+			contents += "= " + entry.objectKey + "\n";
+		}
+		return contents;
+	}
+
+	static std::vector<ManifestEntry> decodeManifest(const std::string& contents) {
+		std::vector<ManifestEntry> entries;
+		ManifestEntry entry;
+
+		std::istringstream lines(contents);
+		std::string line;
+		while (std::getline(lines, line)) {
+			if (line.compare(0, 2, "= ") == 0) {
+				entry.objectKey = line.substr(2);
+				entries.push_back(std::move(entry));
+				entry = ManifestEntry();
+			} else if (line.size() > 17 && line[16] == ' ') {
+				uint64_t hash = std::strtoull(line.substr(0, 16).c_str(), nullptr, 16);
+				entry.dependencies.push_back(std::make_pair(line.substr(17), hash));
+			}
+		}
+		return entries;
+	}
+
+	/**
+	 * @return The content hash of `path` or 0 if it can't be read. Hashes are cached in the build log.
+	 */
+	static uint64_t hashOf(const std::string& path) {
+		struct stat s;
+		if (!io::tryGetStat(path, s)) {
+			return 0;
+		}
+		return buildLog().hashOf(path, s).hash;
+	}
+
+	/**
+	 * Finds the newest entry of the manifest in `level` whose dependencies are unchanged.
+	 */
+	static bool findObject(CacheStore& level, const std::string& manifestKey, ManifestEntry& found, std::string& object) {
+		std::string manifest;
+		if (!level.get(manifestKey, "manifest", manifest)) {
+			return false;
+		}
+
+		for (auto& entry : decodeManifest(manifest)) {
+			bool matches = true;
+			for (auto& dependency : entry.dependencies) {
+				if (hashOf(dependency.first) != dependency.second) {
+					matches = false;
+					break;
+				}
+			}
+
+			if (matches && level.get(entry.objectKey, "o", object)) {
+				found = std::move(entry);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Adds `object` to `level` and makes `entry` the newest entry of its manifest.
+	 */
+	static void addObject(CacheStore& level, const std::string& manifestKey, const ManifestEntry& entry, const std::string& object) {
+		if (level.isReadOnly()) {
+			return;
+		}
+		level.put(entry.objectKey, "o", object);
+
+		// Concurrent builds may each add an entry here and only one of them is kept, which costs at most a
+		// later miss.
+		std::string manifest;
+		std::vector<ManifestEntry> entries;
+		if (level.get(manifestKey, "manifest", manifest)) {
+			entries = decodeManifest(manifest);
+		}
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (it->objectKey == entry.objectKey) {
+				entries.erase(it);
+				break;
+			}
+		}
+		entries.insert(entries.begin(), entry);
+		if (entries.size() > MAX_MANIFEST_ENTRIES) {
+			entries.resize(MAX_MANIFEST_ENTRIES);
+		}
+		level.put(manifestKey, "manifest", encodeManifest(entries));
+	}
+
+public:
+	/**
+	 * The local level is enabled by `--cache[=<dir>]` or `CRADLE_CACHE_DIR`. Without a directory it uses the
+	 * one from @ref cradle::detail::defaultCacheDir. Its size is limited by `--cache-size` or
+	 * `CRADLE_CACHE_SIZE` (e.g. `10G`) and defaults to @ref DEFAULT_CACHE_SIZE.
+	 *
+	 * The shared level is enabled by `--shared-cache=<dir>` or `CRADLE_SHARED_CACHE_DIR`. Its size is limited
+	 * by `--shared-cache-size` or `CRADLE_SHARED_CACHE_SIZE` and defaults to @ref DEFAULT_SHARED_CACHE_SIZE.
+	 * It is only read from with `--shared-cache-read-only` or if `CRADLE_SHARED_CACHE_READ_ONLY` is set.
+	 */
+	CompileCache() {
+		if (options().has("cache") || std::getenv(CACHE_DIR_ENV_VAR.c_str()) != nullptr) {
+			std::string dir = options().get("cache");
+			if (dir.empty()) {
+				dir = cradle::detail::defaultCacheDir();
+			}
+			uint64_t size = cradle::detail::parseSize(getEnvOrOption("cache-size", CACHE_SIZE_ENV_VAR), DEFAULT_CACHE_SIZE);
+			levels.emplace_back(new CacheStore(dir, size));
+		}
+
+		std::string sharedDir = getEnvOrOption("shared-cache", SHARED_CACHE_DIR_ENV_VAR);
+		if (!sharedDir.empty()) {
+			uint64_t size = cradle::detail::parseSize(getEnvOrOption("shared-cache-size", SHARED_CACHE_SIZE_ENV_VAR), DEFAULT_SHARED_CACHE_SIZE);
+			bool readOnly = options().has("shared-cache-read-only") || std::getenv(SHARED_CACHE_READ_ONLY_ENV_VAR.c_str()) != nullptr;
+			levels.emplace_back(new CacheStore(sharedDir, size, readOnly));
+		}
+	}
+
+	~CompileCache() {
+		for (auto& level : levels) {
+			CacheStats run = level->flush();
+			if (options().has("cache-stats")) {
+				log("Cache " + level->directory() + (level->isReadOnly() ? " (read-only):" : ":"));
+				log("\tThis run: " + run.describe());
+				log("\tAll runs: " + level->totalStats().describe());
+			}
+		}
+	}
+
+	bool isEnabled() const {
+		return !levels.empty();
+	}
+
+	/**
+	 * @param command The compile command generated for @ref CACHE_OUTPUT_PLACEHOLDER.
+	 * @return The key of the manifest for compiling `source` with `command`, or an empty string if `source`
+	 *         can't be read.
+	 */
+	std::string manifestKey(Toolchain& toolchain, const std::string& command, const std::string& source) {
+		uint64_t sourceHash = hashOf(source);
+		if (sourceHash == 0) {
+			return "";
+		}
+		return cradle::detail::cacheKey(toolchain.compilerIdentity() + '\0' + command + '\0' + std::to_string(sourceHash));
+	}
+
+	/**
+	 * Writes the cached object for `manifestKey` to `outputFile` if its headers are unchanged.
+	 *
+	 * @param dependencies Set to the source and headers the object was compiled from on success.
+	 * @return False on a cache miss.
+	 */
+	bool fetch(const std::string& manifestKey, const std::string& outputFile, std::vector<std::string>& dependencies) {
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			ManifestEntry entry;
+			std::string object;
+			if (!findObject(*levels[i], manifestKey, entry, object)) {
+				continue;
+			}
+
+			levels[i]->count(true);
+			for (std::size_t j = 0; j < i; j++) {
+				levels[j]->count(false);
+				addObject(*levels[j], manifestKey, entry, object);
+			}
+
+			if (!io::write_file(outputFile, object)) {
+				return false;
+			}
+			dependencies.clear();
+			for (auto& dependency : entry.dependencies) {
+				dependencies.push_back(dependency.first);
+			}
+			return true;
+		}
+
+		for (auto& level : levels) {
+			level->count(false);
+		}
+		return false;
+	}
+
+	/**
+	 * Stores the object just compiled into `outputFile` from `dependencies`.
+	 */
+	void store(const std::string& manifestKey, const std::string& outputFile, const std::vector<std::string>& dependencies) {
+		ManifestEntry entry;
+		std::string material = manifestKey;
+		for (auto& dependency : dependencies) {
+			uint64_t hash = hashOf(dependency);
+			if (hash == 0) {
+				// Can't tell later whether this dependency changed.
+				return;
+			}
+			entry.dependencies.push_back(std::make_pair(dependency, hash));
+			material += '\0' + dependency + '\0' + std::to_string(hash);
+		}
+		entry.objectKey = cradle::detail::cacheKey(material);
+
+		std::string object;
+		if (!io::read_file(outputFile, object)) {
+			return;
+		}
+		for (auto& level : levels) {
+			addObject(*level, manifestKey, entry, object);
+		}
+	}
+
+	/**
+	 * @param command The archive command generated for @ref CACHE_OUTPUT_PLACEHOLDER.
+	 * @return The key of the archive built by `command` from `objectFiles`, or an empty string if one of them
+	 *         can't be read.
+	 */
+	std::string archiveKey(const std::string& command, const std::vector<std::string>& objectFiles) {
+		std::string material = command;
+		for (auto& objectFile : objectFiles) {
+			uint64_t hash = hashOf(objectFile);
+			if (hash == 0) {
+				return "";
+			}
+			material += '\0' + std::to_string(hash);
+		}
+		return cradle::detail::cacheKey(material);
+	}
+
+	/**
+	 * Writes the cached archive for `archiveKey` to `outputFile`.
+	 *
+	 * @return False on a cache miss.
+	 */
+	bool fetchArchive(const std::string& archiveKey, const std::string& outputFile) {
+		std::string archive;
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			if (!levels[i]->get(archiveKey, "a", archive)) {
+				continue;
+			}
+
+			levels[i]->count(true);
+			for (std::size_t j = 0; j < i; j++) {
+				levels[j]->count(false);
+				levels[j]->put(archiveKey, "a", archive);
+			}
+			return io::write_file(outputFile, archive);
+		}
+
+		for (auto& level : levels) {
+			level->count(false);
+		}
+		return false;
+	}
+
+	/**
+	 * Stores the archive just built into `outputFile`.
+	 */
+	void storeArchive(const std::string& archiveKey, const std::string& outputFile) {
+		std::string archive;
+		if (!io::read_file(outputFile, archive)) {
+			return;
+		}
+		for (auto& level : levels) {
+			level->put(archiveKey, "a", archive);
+		}
+	}
+};
+
+const std::size_t CompileCache::MAX_MANIFEST_ENTRIES;
+
+/**
+ * @return The compile cache shared by every task in this run. It is configured on first use.
+ */
+CompileCache& compileCache() {
+	static CompileCache instance;
+	return instance;
+}
+
+} // namespace cpp
+} // namespace cradle
+/**
+ * @file
+ */
+
+
+
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <set>
+
+namespace cradle {
+namespace cpp {
+
+static const PropertyKey DEPENDENCY_FILES("DEPENDENCY_FILES");
+static const PropertyKey INCLUDE_DIRS("INCLUDE_DIRS");
+static const PropertyKey LIBRARY_NAME("LIBRARY_NAME");
+static const PropertyKey LIBRARY_PATH("LIBRARY_PATH");
+static const PropertyKey OUTPUT_FILE("OUTPUT_FILE");
+
+// The file in the output directory that the time and memory used by each link are appended to.
+static const std::string LINK_STATS_FILE = ".cradle_link_stats.json";
+
+namespace detail {
+
+bool strendswith(const std::string& str, const std::string& end) {
+	if (str.length() < end.length()) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < end.length(); i++) {
+		if (str.at(str.length() - end.length() + i) != end[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Uniquifies the list but maintains the order. Elements are returned in the order they first appear.
+ */
+template<typename T>
+std::vector<T> uniquify(const std::vector<T>& orig) {
+	std::set<T> seen;
+	std::vector<T> retVal;
+	for (auto& i : orig) {
+		if (seen.find(i) != seen.end()) {
+			continue;
+		}
+		retVal.push_back(i);
+		seen.insert(i);
+	}
+	return retVal;
+}
+
+std::string resolveFile(const std::string& name, const std::vector<std::string>& paths) {
+	for (auto& path : paths) {
+		std::string fileCandidate = io::path_concat(path, name);
+		if (io::exists(fileCandidate)) {
+			return fileCandidate;
+		}
+	}
+
+	return name;
+}
+
+/**
+ * @return `path`, which is relative to the working directory unless it is absolute, as an absolute path.
+ */
+std::string absolutePath(const std::string& path) {
+	bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+	return absolute ? path : io::path_concat(platform::platform_getcwd(), path);
+}
+
+/**
+ * @return The directory for files generated for the target `name`. It is distinct from the target's output,
+ *         which for executables is named `name` too.
+ */
+std::string targetDirectory(const std::string& outputDirectory, const std::string& name) {
+	return io::path_concat(outputDirectory, name + ".dir");
+}
+
+/**
+ * @return The object file `filePath` is compiled to. Sources generated in `outputDirectory`, e.g. unity
+ *         sources, have theirs next to them rather than in a copy of their directory.
+ */
+std::string objectFile(const std::string& filePath, const std::string& outputDirectory, Toolchain& toolchain) {
+	std::string prefix = io::path_concat(outputDirectory, "");
+	if (filePath.compare(0, prefix.size(), prefix) == 0) {
+		return toolchain.objectFileNameFromBase(filePath);
+	}
+	return io::path_concat(outputDirectory, toolchain.objectFileNameFromBase(filePath));
+}
+
+/**
+ * @return The path of the precompiled header built from `headerFile` for the target `rootTaskName`. Each
+ *         target has its own since it must be built with the same include directories as the target's objects.
+ */
+std::string precompiledHeaderFile(
+	const std::string& rootTaskName,
+	const std::string& headerFile,
+	const std::string& outputDirectory,
+	Toolchain& toolchain
+) {
+	return io::path_concat(targetDirectory(outputDirectory, rootTaskName), toolchain.precompiledHeaderNameFromBase(headerFile));
+}
+
+/**
+ * Runs `cmdline`, a command from `toolchain` that writes `outputFile`. Commands longer than the toolchain's
+ * response file threshold are run with their arguments in `<outputFile>.rsp`, which keeps links of many
+ * objects within the system's command line limits. Compile profiles are left out of the printed output.
+ *
+ * @param outputs Every file the command may write.
+ */
+ExecutionResult runTool(
+	Toolchain& toolchain,
+	const std::string& cmdline,
+	const std::string& outputFile,
+	const std::vector<std::string>& outputs,
+	platform::ProcessResult& result
+) {
+	OutputFilter filter = [&toolchain] (std::string& output, std::string& errors) {
+		toolchain.stripCompileProfile(output, errors);
+	};
+
+	if (cmdline.size() <= toolchain.responseFileThreshold()) {
+		return run(cmdline, platform::commandArgs(cmdline), outputs, result, filter);
+	}
+
+	bool needsShell;
+	std::vector<std::string> args = platform::splitCommandLine(cmdline, needsShell);
+	std::string responseFile = outputFile + ".rsp";
+	std::string contents;
+	if (
+		needsShell || args.empty() ||
+		!toolchain.useResponseFile(args, responseFile, contents) ||
+		!io::write_file(responseFile, contents)
+	) {
+		return run(cmdline, platform::commandArgs(cmdline), outputs, result, filter);
+	}
+
+	ExecutionResult ret = run(cmdline, args, outputs, result, filter);
+	if (ret == ExecutionResult::SUCCESS) {
+		// Kept after failures so the command can be rerun by hand.
+		std::remove(responseFile.c_str());
+		io::invalidateStat(responseFile);
+	}
+	return ret;
+}
+
+ExecutionResult runTool(
+	Toolchain& toolchain,
+	const std::string& cmdline,
+	const std::string& outputFile,
+	const std::vector<std::string>& outputs
+) {
+	platform::ProcessResult result;
+	return runTool(toolchain, cmdline, outputFile, outputs, result);
+}
+
+/**
+ * Precompiles `headerFile` for the objects of the target `rootTaskName`. It is rebuilt when the command,
+ * and so the flags, or any of the headers it includes change.
+ *
+ * @param flags The flags the target's objects are compiled with.
+ */
+task_p precompiled_header(
+	std::string rootTaskName,
+	std::string headerFile,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::vector<std::string> flags = std::vector<std::string>()
+) {
+	std::string outputFile = precompiledHeaderFile(rootTaskName, headerFile, outputDirectory, *toolchain);
+
+	auto precompile = tracked(task(rootTaskName + ':' + headerFile + ":precompile", [=] (Task* self) {
+		std::string depFile = toolchain->depFileNameFromObject(outputFile);
+		std::string cmdline = toolchain->compilePrecompiledHeaderCmd(outputFile, absolutePath(headerFile), includeSearchDirs, flags);
+
+		// The generated file is one of the precompiled header's dependencies, so it is only written when it
+		// changes, e.g. because the project moved.
+		std::string contents;
+		std::string existing;
+		std::string source = toolchain->precompiledHeaderSource(outputFile, absolutePath(headerFile), contents);
+		if (!io::read_file(source, existing) || existing != contents) {
+			io::mkdirs(io::path_parent(source));
+			if (!io::write_file(source, contents)) {
+				log_error("Unable to write " + source);
+				return ExecutionResult::FAILURE;
+			}
+		}
+
+		std::vector<std::string> dependencies;
+		if (buildLog().isOutOfDate(outputFile, cmdline, dependencies)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> knownInputs(dependencies);
+			knownInputs.push_back(headerFile);
+			BuildLog::CommandStart started = buildLog().beforeCommand(knownInputs);
+
+			std::vector<std::string> outputs = {outputFile, depFile};
+			std::string object = toolchain->precompiledHeaderObject(outputFile);
+			if (!object.empty()) {
+				outputs.push_back(object);
+			}
+			if (runTool(*toolchain, cmdline, outputFile, outputs) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+
+			if (io::read_file(depFile, contents)) {
+				dependencies = toolchain->parseDepFile(contents);
+			} else {
+				dependencies = {headerFile};
+			}
+			buildLog().record(outputFile, cmdline, dependencies, started);
+		}
+		return ExecutionResult::SUCCESS;
+	}));
+
+	precompile->set(OUTPUT_FILE, outputFile);
+	return precompile;
+}
+
+/**
+ * @param precompiledHeader The header precompiled by @ref precompiled_header for this target, or an empty
+ *                          string to compile without one.
+ * @param targetFlags       Flags every object of the target is compiled with.
+ */
+task_p object(
+	std::string rootTaskName,
+	std::string filePath,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	std::vector<std::string> targetFlags = std::vector<std::string>()
+) {
+	auto compile = tracked(task(rootTaskName + ':' + filePath + ":compile", [=] (Task* self) {
+		std::string outputFile = objectFile(filePath, outputDirectory, *toolchain);
+		std::string depFile = toolchain->depFileNameFromObject(outputFile);
+		self->set(OUTPUT_FILE, outputFile);
+
+		std::string pchFile;
+		std::vector<std::string> flags(targetFlags);
+		if (!precompiledHeader.empty()) {
+			pchFile = precompiledHeaderFile(rootTaskName, precompiledHeader, outputDirectory, *toolchain);
+			std::vector<std::string> pchFlags = toolchain->usePrecompiledHeaderFlags(pchFile, absolutePath(precompiledHeader));
+			flags.insert(flags.end(), pchFlags.begin(), pchFlags.end());
+		}
+
+		std::string cmdline = toolchain->compileObjectCmd(outputFile, filePath, includeSearchDirs, flags);
+
+		std::vector<std::string> dependencies;
+		if (buildLog().isOutOfDate(outputFile, cmdline, dependencies)) {
+
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> knownInputs(dependencies);
+			knownInputs.push_back(filePath);
+			if (!pchFile.empty()) {
+				knownInputs.push_back(pchFile);
+			}
+			BuildLog::CommandStart started = buildLog().beforeCommand(knownInputs);
+
+			std::string manifestKey;
+			if (compileCache().isEnabled()) {
+				std::string keyCmdline = toolchain->compileObjectCmd(CACHE_OUTPUT_PLACEHOLDER, filePath, includeSearchDirs, flags);
+				manifestKey = compileCache().manifestKey(*toolchain, keyCmdline, filePath);
+			}
+
+			if (!manifestKey.empty() && compileCache().fetch(manifestKey, outputFile, dependencies)) {
+				log("Restored " + outputFile + " from the cache");
+			} else {
+				platform::ProcessResult result;
+				if (runTool(*toolchain, cmdline, outputFile, {outputFile, depFile}, result) == ExecutionResult::FAILURE) {
+					return ExecutionResult::FAILURE;
+				}
+
+				if (toolchain->isProfilingCompile()) {
+					CompileProfile profile;
+					profile.source = filePath;
+					profile.seconds = result.wallSeconds;
+					toolchain->readCompileProfile(outputFile, result, profile);
+					compileProfiler().add(profile);
+				}
+
+				std::string contents;
+				if (io::read_file(depFile, contents)) {
+					dependencies = toolchain->parseDepFile(contents);
+				} else {
+					dependencies = {filePath};
+				}
+
+				if (!manifestKey.empty()) {
+					// Precompiled headers aren't reproducible, so cached objects depend on the headers the
+					// precompiled header was built from instead.
+					std::vector<std::string> cacheDependencies(dependencies);
+					if (!pchFile.empty() && io::read_file(toolchain->depFileNameFromObject(pchFile), contents)) {
+						std::vector<std::string> pchDependencies = toolchain->parseDepFile(contents);
+						cacheDependencies.insert(cacheDependencies.end(), pchDependencies.begin(), pchDependencies.end());
+					}
+					compileCache().store(manifestKey, outputFile, uniquify(cacheDependencies));
+				}
+			}
+
+			// Compilers don't list the precompiled header, but objects must be rebuilt when it is.
+			if (!pchFile.empty() && std::find(dependencies.begin(), dependencies.end(), pchFile) == dependencies.end()) {
+				dependencies.push_back(pchFile);
+			}
+			buildLog().record(outputFile, cmdline, dependencies, started);
+		}
+
+		self->push(DEPENDENCY_FILES, dependencies);
+		return ExecutionResult::SUCCESS;
+	}));
+
+	return compile;
+}
+
+/**
+ * Splits `sourceFiles` into batches of about `batchSize` files for unity builds.
+ *
+ * Files are sorted and, once a batch holds half of `batchSize` files, it ends after a file whose path hashes
+ * to a multiple of the other half, or once it holds twice `batchSize` files. Since where batches end depends
+ * on the files' own paths rather than their positions, adding or removing a file only changes the batch it
+ * is in (and rarely the next one).
+ */
+std::vector<std::vector<std::string>> unityBatches(std::vector<std::string> sourceFiles, unsigned batchSize) {
+	std::sort(sourceFiles.begin(), sourceFiles.end());
+
+	unsigned minSize = std::max(2u, batchSize / 2);
+	unsigned divisor = batchSize > minSize ? batchSize - minSize + 1 : 1;
+
+	std::vector<std::vector<std::string>> batches(1);
+	for (auto& file : sourceFiles) {
+		std::vector<std::string>& batch = batches.back();
+		batch.push_back(file);
+		bool boundary = io::hashBytes(file.data(), file.size()) % divisor == 0;
+		if ((batch.size() >= minSize && boundary) || batch.size() >= 2 * batchSize) {
+			batches.emplace_back();
+		}
+	}
+	if (batches.back().empty()) {
+		batches.pop_back();
+	}
+	return batches;
+}
+
+/**
+ * Generates unity sources that each include a batch of `sourceFiles` for the target `name`. Files in
+ * `exclude`, e.g. ones whose internal names clash with other files, and batches of one file are compiled on
+ * their own. Unity sources of earlier batches that no batch has anymore are deleted along with their objects.
+ *
+ * @return The files to compile instead of `sourceFiles`.
+ */
+std::vector<std::string> unitySources(
+	const std::string& name,
+	const std::vector<std::string>& sourceFiles,
+	unsigned batchSize,
+	const std::vector<std::string>& exclude,
+	const std::string& outputDirectory,
+	Toolchain& toolchain
+) {
+	std::string directory = targetDirectory(outputDirectory, name);
+	std::set<std::string> unityFiles;
+
+	std::set<std::string> excluded(exclude.begin(), exclude.end());
+	std::vector<std::string> sources;
+	std::vector<std::string> batched;
+	for (auto& file : sourceFiles) {
+		if (excluded.find(file) != excluded.end()) {
+			sources.push_back(file);
+		} else {
+			batched.push_back(file);
+		}
+	}
+
+	for (auto& batch : unityBatches(batched, batchSize)) {
+		if (batch.size() == 1) {
+			sources.push_back(batch.front());
+			continue;
+		}
+
+		// Named after the first file so that a batch keeps its object when other batches change.
+		char id[17];
+		snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(io::hashBytes(batch.front().data(), batch.front().size())));
+		std::string unityFile = io::path_concat(directory, "unity_" + std::string(id) + ".cpp");
+
+		std::string contents;
+		for (auto& file : batch) {
+			contents += "#include \"" + absolutePath(file) + "\"\n";
+		}
+
+		// Only written when the batch changes so that its object isn't rebuilt needlessly.
+		std::string existing;
+		if (!io::read_file(unityFile, existing) || existing != contents) {
+			io::mkdirs(io::path_parent(unityFile));
+			if (!io::write_file(unityFile, contents)) {
+				log_error("Unable to write " + unityFile + "; compiling its files separately");
+				sources.insert(sources.end(), batch.begin(), batch.end());
+				continue;
+			}
+		}
+		sources.push_back(unityFile);
+		unityFiles.insert(unityFile);
+	}
+
+	std::vector<io::detail::DirectoryEntry> entries;
+	io::detail::readDirectory(directory, entries);
+	for (auto& entry : entries) {
+		const std::string& file = entry.name;
+		bool isUnitySource = file.compare(0, 6, "unity_") == 0 && file.size() > 10 && file.compare(file.size() - 4, 4, ".cpp") == 0;
+		std::string path = io::path_concat(directory, file);
+		if (entry.isDirectory || !isUnitySource || unityFiles.count(path) > 0) {
+			continue;
+		}
+
+		std::string object = objectFile(path, outputDirectory, toolchain);
+		for (auto& stale : {path, object, toolchain.depFileNameFromObject(object)}) {
+			std::remove(stale.c_str());
+			io::invalidateStat(stale);
+		}
+	}
+	return sources;
+}
+
+/**
+ * @return The tasks compiling `sourceFiles` with `flags` for the target `name`, preceded by the task
+ *         precompiling `precompiledHeader` if it isn't empty. With a `unityBatchSize` above 1 the sources
+ *         are compiled in batches by @ref unitySources.
+ */
+std::vector<task_p> objects(
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs,
+	std::string outputDirectory,
+	std::shared_ptr<Toolchain> toolchain,
+	std::string precompiledHeader,
+	unsigned unityBatchSize,
+	std::vector<std::string> unityExclude,
+	std::vector<std::string> flags,
+	task_p& precompile
+) {
+	if (!precompiledHeader.empty()) {
+		precompile = detail::precompiled_header(name, precompiledHeader, includeSearchDirs, outputDirectory, toolchain, flags);
+	}
+
+	if (unityBatchSize > 1) {
+		sourceFiles = unitySources(name, sourceFiles, unityBatchSize, unityExclude, outputDirectory, *toolchain);
+	}
+
+	std::vector<task_p> objectFileTasks;
+	for (auto file : sourceFiles) {
+		objectFileTasks.push_back(detail::object(name, file, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, flags));
+		if (precompile) {
+			objectFileTasks.back()->dependsOn(precompile);
+		}
+	}
+	return objectFileTasks;
+}
+
+/**
+ * @return The object files written by `objectFileTasks` and `precompile`, which may be null.
+ */
+std::vector<std::string> objectFiles(const std::vector<task_p>& objectFileTasks, task_p precompile, Toolchain& toolchain) {
+	std::vector<std::string> objectFiles;
+	for (auto task : objectFileTasks) {
+		objectFiles.push_back(task->get(OUTPUT_FILE));
+	}
+	if (precompile) {
+		std::string object = toolchain.precompiledHeaderObject(precompile->get(OUTPUT_FILE));
+		if (!object.empty()) {
+			objectFiles.push_back(object);
+		}
+	}
+	return objectFiles;
+}
+
+/**
+ * @return The file describing the interface of `sharedLibFile`. It is only rewritten when the interface
+ *         changes, so programs depend on it rather than on the library.
+ */
+std::string sharedLibInterfaceFile(const std::string& sharedLibFile) {
+	return sharedLibFile + ".toc";
+}
+
+/**
+ * Finds the files that linking against `libraryNames` depends on. Like the linker, shared libraries are
+ * preferred over static ones, and they are represented by their interface file if they have one.
+ *
+ * @param runtimeDirs Set to the absolute paths of the directories holding the shared libraries.
+ */
+std::vector<std::string> libraryInputs(
+	Toolchain& toolchain,
+	const std::vector<std::string>& libraryNames,
+	const std::vector<std::string>& librarySearchPaths,
+	std::vector<std::string>& runtimeDirs
+) {
+	std::vector<std::string> inputs;
+	runtimeDirs.clear();
+	for (const auto& lib : libraryNames) {
+		std::string sharedLib = detail::resolveFile(toolchain.sharedLibNameFromBase(lib), librarySearchPaths);
+		if (io::exists(sharedLib)) {
+			std::string interfaceFile = sharedLibInterfaceFile(sharedLib);
+			inputs.push_back(io::exists(interfaceFile) ? interfaceFile : sharedLib);
+			runtimeDirs.push_back(absolutePath(io::path_parent(sharedLib)));
+		} else {
+			inputs.push_back(detail::resolveFile(toolchain.staticLibNameFromBase(lib), librarySearchPaths));
+		}
+	}
+	runtimeDirs = uniquify(runtimeDirs);
+	return inputs;
+}
+
+/**
+ * Brings the interface file of `sharedLibFile` up to date.
+ */
+void updateSharedLibInterface(Toolchain& toolchain, const std::string& sharedLibFile, const std::string& soname) {
+	std::string interfaceFile = sharedLibInterfaceFile(sharedLibFile);
+
+	std::string interface;
+	if (!toolchain.sharedLibInterface(sharedLibFile, interface)) {
+		std::remove(interfaceFile.c_str());
+		io::invalidateStat(interfaceFile);
+		return;
+	}
+
+	std::string contents = "soname " + soname + "\n" + interface;
+	std::string existing;
+	if ((!io::read_file(interfaceFile, existing) || existing != contents) && !io::write_file(interfaceFile, contents)) {
+		// Without it dependents depend on the library itself.
+		std::remove(interfaceFile.c_str());
+		io::invalidateStat(interfaceFile);
+	}
+}
+
+/**
+ * Reports how long linking `outputFile` took and how much memory the linker used, and appends them as a line
+ * of JSON to @ref LINK_STATS_FILE in `outputDirectory` for tools that track link times across builds.
+ */
+void recordLinkStats(
+	const std::string& outputDirectory,
+	const std::string& outputFile,
+	const std::string& linker,
+	const platform::ProcessResult& result
+) {
+	static std::mutex mutex;
+
+	char summary[128];
+	std::snprintf(summary, sizeof(summary), "%.2fs, peak memory %.1f MB", result.wallSeconds, result.maxResidentKb / 1024.0);
+	log("Linked " + outputFile + " with " + linker + " in " + summary);
+
+	std::string line = "{\"output\": " + json::quote(outputFile);
+	line += ", \"linker\": " + json::quote(linker);
+	line += ", \"time\": " + std::to_string(static_cast<long long>(::time(nullptr)));
+	line += ", \"wallSeconds\": " + std::to_string(result.wallSeconds);
+	line += ", \"userSeconds\": " + std::to_string(result.userSeconds);
+	line += ", \"systemSeconds\": " + std::to_string(result.systemSeconds);
+	line += ", \"maxResidentKb\": " + std::to_string(result.maxResidentKb) + "}\n";
+
+	std::lock_guard<std::mutex> lock(mutex);
+	io::append_file(io::path_concat(outputDirectory, LINK_STATS_FILE), line);
+}
+
+/**
+ * @return The flags to link a program or shared library with, given the directories of the shared libraries
+ *         it links to and its link time optimization settings.
+ */
+std::vector<std::string> linkFlags(
+	Toolchain& toolchain,
+	const std::vector<std::string>& runtimeDirs,
+	const std::string& outputDirectory,
+	LtoMode lto,
+	unsigned ltoJobs
+) {
+	std::vector<std::string> flags = toolchain.runtimeSearchPathFlags(runtimeDirs);
+
+	// Shared by every target so that modules they have in common are only optimized once.
+	std::string ltoCacheDir = io::path_concat(outputDirectory, "thinlto-cache");
+
+	std::vector<std::string> ltoFlags = toolchain.ltoLinkFlags(lto, ltoJobs, ltoCacheDir);
+	for (auto& flag : ltoFlags) {
+		if (flag.find(ltoCacheDir) != std::string::npos) {
+			io::mkdirs(ltoCacheDir);
+			break;
+		}
+	}
+	flags.insert(flags.end(), ltoFlags.begin(), ltoFlags.end());
+	return flags;
+}
+
+task_p static_lib(
+	std::string taskName,
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	std::string outputFile(io::path_concat(outputDirectory, toolchain->staticLibNameFromBase(name)));
+
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		toolchain->ltoCompileFlags(lto), precompile
+	);
+
+	auto buildArchive = tracked(task(taskName, [=] (Task* self) {
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::string cmdline = toolchain->buildStaticLibCmd(outputFile, objectFiles);
+
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			// Archivers add to existing archives so start from scratch to drop removed objects.
+			std::remove(outputFile.c_str());
+			io::invalidateStat(outputFile);
+
+			BuildLog::CommandStart started = buildLog().beforeCommand(objectFiles);
+
+			std::string archiveKey;
+			if (compileCache().isEnabled()) {
+				archiveKey = compileCache().archiveKey(toolchain->buildStaticLibCmd(CACHE_OUTPUT_PLACEHOLDER, objectFiles), objectFiles);
+			}
+
+			if (!archiveKey.empty() && compileCache().fetchArchive(archiveKey, outputFile)) {
+				log("Restored " + outputFile + " from the cache");
+			} else {
+				if (runTool(*toolchain, cmdline, outputFile, {outputFile}) == ExecutionResult::FAILURE) {
+					return ExecutionResult::FAILURE;
+				}
+				if (!archiveKey.empty()) {
+					compileCache().storeArchive(archiveKey, outputFile);
+				}
+			}
+			buildLog().record(outputFile, cmdline, objectFiles, started);
+		}
+		return ExecutionResult::SUCCESS;
+	}));
+
+	buildArchive->set(LIBRARY_NAME, name);
+	buildArchive->set(LIBRARY_PATH, io::path_parent(outputFile));
+	buildArchive->set(OUTPUT_FILE, outputFile);
+
+	for (auto t : objectFileTasks) {
+		buildArchive->dependsOn(t);
+	}
+
+	return buildArchive;
+}
+
+/**
+ * @param soname The name the library is loaded by at runtime. Defaults to the library's file name.
+ * @param visibility The default visibility of symbols, see @ref Toolchain::sharedLibCompileFlags.
+ */
+task_p shared_lib(
+	std::string taskName,
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::vector<std::string> libraryNames = std::vector<std::string>(),
+	std::vector<std::string> librarySearchPaths = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string soname = std::string(),
+	std::string visibility = std::string(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	std::string outputFile(io::path_concat(outputDirectory, toolchain->sharedLibNameFromBase(name)));
+	if (soname.empty()) {
+		soname = io::path_filename(outputFile);
+	}
+
+	std::vector<std::string> compileFlags = toolchain->sharedLibCompileFlags(visibility);
+	std::vector<std::string> ltoFlags = toolchain->ltoCompileFlags(lto);
+	compileFlags.insert(compileFlags.end(), ltoFlags.begin(), ltoFlags.end());
+
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		compileFlags, precompile
+	);
+
+	task_p link = tracked(task(taskName, [=] (Task* self) {
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::vector<std::string> runtimeDirs;
+		std::vector<std::string> libraryFiles = libraryInputs(*toolchain, libraryNames, librarySearchPaths, runtimeDirs);
+
+		std::string cmdline = toolchain->linkSharedLibCmd(
+			outputFile,
+			objectFiles,
+			libraryNames,
+			librarySearchPaths,
+			soname,
+			linkFlags(*toolchain, runtimeDirs, outputDirectory, lto, ltoJobs)
+		);
+
+		bool relinked = false;
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> inputs(objectFiles);
+			inputs.insert(inputs.end(), libraryFiles.begin(), libraryFiles.end());
+			BuildLog::CommandStart started = buildLog().beforeCommand(inputs);
+
+			platform::ProcessResult result;
+			if (runTool(*toolchain, cmdline, outputFile, {outputFile}, result) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			recordLinkStats(outputDirectory, outputFile, toolchain->linkerName(), result);
+
+			buildLog().record(outputFile, cmdline, inputs, started);
+			relinked = true;
+		}
+
+		if (relinked || !io::exists(sharedLibInterfaceFile(outputFile))) {
+			updateSharedLibInterface(*toolchain, outputFile, soname);
+		}
+		return ExecutionResult::SUCCESS;
+	}));
+
+	link->set(LIBRARY_NAME, name);
+	link->set(LIBRARY_PATH, io::path_parent(outputFile));
+	link->set(OUTPUT_FILE, outputFile);
+	link->dependsOn(objectFileTasks);
+
+	return link;
+}
+
+task_p exe(
+	std::string taskName,
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::vector<std::string> libraryNames = std::vector<std::string>(),
+	std::vector<std::string> librarySearchPaths = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	std::string outputFile(io::path_concat(outputDirectory, name));
+
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		toolchain->ltoCompileFlags(lto), precompile
+	);
+
+	task_p link = tracked(task(taskName, [=] (Task* _) {
+
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::vector<std::string> runtimeDirs;
+		std::vector<std::string> libraryFiles = libraryInputs(*toolchain, libraryNames, librarySearchPaths, runtimeDirs);
+
+		std::string cmdline = toolchain->linkExeCmd(
+			outputFile,
+			objectFiles,
+			includeSearchDirs,
+			libraryNames,
+			librarySearchPaths,
+			linkFlags(*toolchain, runtimeDirs, outputDirectory, lto, ltoJobs)
+		);
+
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> inputs(objectFiles);
+			inputs.insert(inputs.end(), libraryFiles.begin(), libraryFiles.end());
+			BuildLog::CommandStart started = buildLog().beforeCommand(inputs);
+
+			platform::ProcessResult result;
+			if (runTool(*toolchain, cmdline, outputFile, {outputFile}, result) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			recordLinkStats(outputDirectory, outputFile, toolchain->linkerName(), result);
+
+			buildLog().record(outputFile, cmdline, inputs, started);
+		}
+		return ExecutionResult::SUCCESS;
+	}));
+
+	link->set(OUTPUT_FILE, outputFile);
+	link->dependsOn(objectFileTasks);
+
+	return link;
+}
+
+} // namespace detail
+
+task_p static_lib(
+	std::string name,
+	task_p sourceFiles,
+	task_p includeSearchDirs = emptyList(INCLUDE_DIRS),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+
+	task_p configure = tracked(task(name, [=] (Task* self){
+
+		task_p buildArchive = detail::static_lib(
+			name + ":archive",
+			name,
+			sourceFiles->getList(io::FILE_LIST),
+			detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)),
+			outputDirectory,
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+
+		self->followedBy(buildArchive);
+		self->followedBy(tracked(task([=] (Task* _) {
+			self->set(LIBRARY_NAME, buildArchive->get(LIBRARY_NAME));
+			self->set(LIBRARY_PATH, buildArchive->get(LIBRARY_PATH));
+			self->set(OUTPUT_FILE, buildArchive->get(OUTPUT_FILE));
+			self->push(INCLUDE_DIRS, detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)));
+			return ExecutionResult::SUCCESS;
+		})));
+
+		return ExecutionResult::SUCCESS;
+	}));
+
+	configure->dependsOn(sourceFiles);
+	configure->dependsOn(includeSearchDirs);
+
+	return configure;
+}
+
+class StaticLibBuilder {
+public:
+	builder::Value<StaticLibBuilder, std::string> name{this};
+	builder::StrListFromTask<StaticLibBuilder> sourceFiles{this, io::FILE_LIST};
+	builder::StrListFromTask<StaticLibBuilder> includeSearchDirs{this, INCLUDE_DIRS};
+	builder::Value<StaticLibBuilder, std::string> outputDirectory{this, DEFAULT_BUILD_DIR};
+	builder::Value<StaticLibBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
+
+	// A header included by every source file, e.g. one that includes heavy third-party headers, to
+	// precompile before compiling them. Sources need not include it themselves.
+	builder::Value<StaticLibBuilder, std::string> precompiledHeader{this, ""};
+
+	// Compile the sources in batches of about this many files, each included by one generated source, to
+	// parse common headers fewer times. 0 compiles every source on its own.
+	builder::Value<StaticLibBuilder, unsigned> unityBatchSize{this, 0};
+
+	// Sources compiled on their own in unity builds, e.g. ones whose internal names clash with other files.
+	builder::StrList<StaticLibBuilder> unityExclude{this, {}};
+
+	// Compile the sources for link time optimization. Programs linking the library must use it too.
+	builder::Value<StaticLibBuilder, LtoMode> lto{this, LtoMode::NONE};
+	builder::Value<StaticLibBuilder, unsigned> ltoJobs{this, 0};
+
+    task_p build() {
+        return static_lib(
+			name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+			lto, ltoJobs
+		);
+    }
+};
+
+StaticLibBuilder static_lib() {
+	return StaticLibBuilder();
+}
+
+task_p shared_lib(
+	std::string name,
+	task_p sourceFiles,
+	task_p includeSearchDirs = emptyList(INCLUDE_DIRS),
+	task_p linkLibraries = emptyList(LIBRARY_NAME),
+	task_p linkLibraryPaths = emptyList(LIBRARY_PATH),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string soname = std::string(),
+	std::string visibility = std::string(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	task_p configure = tracked(task(name, [=] (Task* self) {
+
+		task_p link = detail::shared_lib(
+			name + ":link",
+			name,
+			sourceFiles->getList(io::FILE_LIST),
+			detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)),
+			linkLibraries->getList(LIBRARY_NAME),
+			detail::uniquify(linkLibraryPaths->getList(LIBRARY_PATH)),
+			outputDirectory,
+			toolchain,
+			soname,
+			visibility,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+
+		self->followedBy(link);
+		self->followedBy(tracked(task([=] (Task* _) {
+			self->set(LIBRARY_NAME, link->get(LIBRARY_NAME));
+			self->set(LIBRARY_PATH, link->get(LIBRARY_PATH));
+			self->set(OUTPUT_FILE, link->get(OUTPUT_FILE));
+			self->push(INCLUDE_DIRS, detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)));
+			return ExecutionResult::SUCCESS;
+		})));
+
+		return ExecutionResult::SUCCESS;
+	}));
+
+	configure->dependsOn(sourceFiles);
+	configure->dependsOn(includeSearchDirs);
+	configure->dependsOn(linkLibraries);
+	configure->dependsOn(linkLibraryPaths);
+
+	return configure;
+}
+
+class SharedLibBuilder {
+public:
+	builder::Str<SharedLibBuilder> name{this};
+	builder::StrListFromTask<SharedLibBuilder> sourceFiles{this, io::FILE_LIST};
+	builder::StrListFromTask<SharedLibBuilder> includeSearchDirs{this, INCLUDE_DIRS, emptyList(INCLUDE_DIRS)};
+	builder::StrListFromTask<SharedLibBuilder> linkLibrary{this, LIBRARY_NAME, emptyList(LIBRARY_NAME)};
+	builder::StrListFromTask<SharedLibBuilder> linklibrarySearchPath{this, LIBRARY_PATH, emptyList(LIBRARY_PATH)};
+	builder::Str<SharedLibBuilder> outputDirectory{this, DEFAULT_BUILD_DIR};
+	builder::Value<SharedLibBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
+
+	// The name the library is loaded by at runtime. Defaults to the library's file name.
+	builder::Str<SharedLibBuilder> soname{this, ""};
+
+	// The default visibility of symbols, e.g. `hidden` to only export symbols marked with
+	// `__attribute__((visibility("default")))`. Empty for the compiler's default.
+	builder::Str<SharedLibBuilder> visibility{this, ""};
+
+	// See @ref StaticLibBuilder::precompiledHeader, @ref StaticLibBuilder::unityBatchSize and
+	// @ref StaticLibBuilder::unityExclude.
+	builder::Str<SharedLibBuilder> precompiledHeader{this, ""};
+	builder::Value<SharedLibBuilder, unsigned> unityBatchSize{this, 0};
+	builder::StrList<SharedLibBuilder> unityExclude{this, {}};
+
+	// See @ref ExeBuilder::lto and @ref ExeBuilder::ltoJobs.
+	builder::Value<SharedLibBuilder, LtoMode> lto{this, LtoMode::NONE};
+	builder::Value<SharedLibBuilder, unsigned> ltoJobs{this, 0};
+
+	task_p build() {
+		return shared_lib(
+			name,
+			sourceFiles,
+			includeSearchDirs,
+			linkLibrary,
+			linklibrarySearchPath,
+			outputDirectory,
+			toolchain,
+			soname,
+			visibility,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+	}
+};
+
+SharedLibBuilder shared_lib() {
+	return SharedLibBuilder();
+}
+
+task_p exe(
+	std::string name,
+	task_p sourceFiles,
+	task_p includeSearchDirs = emptyList(INCLUDE_DIRS),
+	task_p linkLibraries = emptyList(LIBRARY_NAME),
+	task_p linkLibraryPaths = emptyList(LIBRARY_PATH),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	task_p configure = tracked(task(name, [=] (Task* self) {
+
+		task_p compile = detail::exe(
+			name + ":link",
+			name,
+			sourceFiles->getList(io::FILE_LIST),
+			detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)),
+			linkLibraries->getList(LIBRARY_NAME),
+			detail::uniquify(linkLibraryPaths->getList(LIBRARY_PATH)),
+			outputDirectory,
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+
+		self->followedBy(compile);
+
+		return ExecutionResult::SUCCESS;
+	}));
+
+	configure->dependsOn(sourceFiles);
+	configure->dependsOn(includeSearchDirs);
+	configure->dependsOn(linkLibraries);
+	configure->dependsOn(linkLibraryPaths);
+
+	return configure;
+}
+
+
+class ExeBuilder {
+public:
+	builder::Str<ExeBuilder> name{this};
+	builder::StrListFromTask<ExeBuilder> sourceFiles{this, io::FILE_LIST};
+	builder::StrListFromTask<ExeBuilder> includeSearchDirs{this, INCLUDE_DIRS, emptyList(INCLUDE_DIRS)};
+	builder::StrListFromTask<ExeBuilder> linkLibrary{this, LIBRARY_NAME, emptyList(LIBRARY_NAME)};
+	builder::StrListFromTask<ExeBuilder> linklibrarySearchPath{this, LIBRARY_PATH, emptyList(LIBRARY_PATH)};
+	builder::Str<ExeBuilder> outputDirectory{this, DEFAULT_BUILD_DIR};
+	builder::Value<ExeBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
+
+	// A header included by every source file to precompile before compiling them. See
+	// @ref StaticLibBuilder::precompiledHeader.
+	builder::Str<ExeBuilder> precompiledHeader{this, ""};
+
+	// See @ref StaticLibBuilder::unityBatchSize and @ref StaticLibBuilder::unityExclude.
+	builder::Value<ExeBuilder, unsigned> unityBatchSize{this, 0};
+	builder::StrList<ExeBuilder> unityExclude{this, {}};
+
+	// Link time optimization of the program and any static libraries built with the same mode. ThinLTO
+	// keeps optimized modules in `thinlto-cache` under the output directory between links.
+	builder::Value<ExeBuilder, LtoMode> lto{this, LtoMode::NONE};
+
+	// The number of modules optimized in parallel while linking, or 0 for one per CPU.
+	builder::Value<ExeBuilder, unsigned> ltoJobs{this, 0};
+
+	task_p build() {
+		return exe(
+			name,
+			sourceFiles,
+			includeSearchDirs,
+			linkLibrary,
+			linklibrarySearchPath,
+			outputDirectory,
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+	}
+};
+
+ExeBuilder exe() {
+	return ExeBuilder();
+}
+
+} // namespace cpp
+} // namespace cradle
+
+#include <time.h>
+#include <vector>
+
+namespace cradle {
+namespace io {
+
+/**
+ * @return True if `targetFile` is missing or older than any of `files`. With `--content-hash`, files that are
+ *         newer but whose contents didn't change are ignored (see @ref BuildLog::isOlderThanInputs).
+ */
+bool isTargetLessRecentThanFiles(const std::string& targetFile, const std::vector<std::string>& files) {
+	if (buildLog().isContentHashing()) {
+		return buildLog().isOlderThanInputs(targetFile, files, false);
+	}
+
+	struct stat targetFileStat;
+	if (!io::tryGetStat(targetFile, targetFileStat)) {
+		return true;
+	}
+
+	for (auto& sourceFile : files) {
+		struct stat sourceFileStat;
+		if (!io::tryGetStat(sourceFile, sourceFileStat)) {
+			return true;
+		}
+
+		if (difftime(targetFileStat.st_mtime, sourceFileStat.st_mtime) < 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cradle_build_log.hpp>
 #include <cradle_builder.hpp>
 #include <cradle_exec.hpp>
 #include <cradle_main.hpp>
@@ -13,10 +14,10 @@
 namespace cradle {
 namespace conan {
 
-static const std::string BUILDDIRS = "builddirs";
-static const std::string INCLUDEDIRS = "includedirs";
-static const std::string LIBDIRS = "libdirs";
-static const std::string LIBS = "libs";
+static const PropertyKey BUILDDIRS("builddirs");
+static const PropertyKey INCLUDEDIRS("includedirs");
+static const PropertyKey LIBDIRS("libdirs");
+static const PropertyKey LIBS("libs");
 
 task_p conan_install(
 		std::string name,
@@ -61,31 +62,49 @@ task_p conan_install(
 		std::vector<std::string> options,
 		std::vector<std::string> settings
 ) {
-	return task(name, [=] (Task* self) {
-		std::string cmd = "conan install";
-
-		// Always use the text generator since we depend on its output.
-		cmd += " -g txt ";
-		cmd += " --install-folder " + installFolder;
-		cmd += " --build=" + buildOption;
-		cmd += " " + pathToConanfile;
-
-		for (auto& opt : options) {
-			if (!opt.empty()) {
-				cmd += " -o " + opt;
-			}
+	std::string cmd = "conan install";
+
+	// Always use the text generator since we depend on its output.
+	cmd += " -g txt ";
+	cmd += " --install-folder " + installFolder;
+	cmd += " --build=" + buildOption;
+	cmd += " " + pathToConanfile;
+
+	for (auto& opt : options) {
+		if (!opt.empty()) {
+			cmd += " -o " + opt;
 		}
-		for (auto& setting : settings) {
-			if (!setting.empty()) {
-				cmd += " -s " + setting;
-			}
+	}
+	for (auto& setting : settings) {
+		if (!setting.empty()) {
+			cmd += " -s " + setting;
 		}
+	}
+
+	// `pathToConanfile` may be the conanfile or the directory containing it. The candidate that doesn't
+	// exist isn't recorded.
+	std::string filename = io::path_filename(pathToConanfile);
+	std::vector<std::string> conanfiles;
+	if (filename == "conanfile.txt" || filename == "conanfile.py") {
+		conanfiles.push_back(pathToConanfile);
+	} else {
+		conanfiles.push_back(io::path_concat(pathToConanfile, "conanfile.txt"));
+		conanfiles.push_back(io::path_concat(pathToConanfile, "conanfile.py"));
+	}
 
-		if (exec(cmd)->execute() == ExecutionResult::FAILURE) {
-			return ExecutionResult::FAILURE;
+	// Conan only runs again when the command or the conanfile changed, so a build that doesn't change them
+	// can be skipped by the null build snapshot.
+	return tracked(task(name, [=] (Task* self) {
+		std::string buildInfo = io::path_concat(installFolder, "conanbuildinfo.txt");
+		if (buildLog().isOutOfDate(buildInfo, cmd)) {
+			BuildLog::CommandStart started = buildLog().beforeCommand(conanfiles);
+			if (exec(cmd)->execute() == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			buildLog().record(buildInfo, cmd, conanfiles, started);
 		}
 
-		std::fstream conanbuildinfo(io::path_concat(installFolder, "conanbuildinfo.txt"));
+		std::fstream conanbuildinfo(buildInfo);
 		std::string line;
 		std::string section = "";
 		while (std::getline(conanbuildinfo, line)) {
@@ -100,7 +119,7 @@ task_p conan_install(
 		}
 
 		return ExecutionResult::SUCCESS;
-	});
+	}));
 }
 
 ConanInstallBuilder conan_install() {
@@ -4,24 +4,37 @@
 
 #pragma once
 
+#include <cradle_build_log.hpp>
 #include <cradle_builder.hpp>
 #include <cradle_exec.hpp>
 #include <cradle_main.hpp>
 #include <cradle_types.hpp>
+#include <cpp/cradle_cpp_cache.hpp>
+#include <cpp/cradle_cpp_profile.hpp>
 #include <cpp/cradle_cpp_toolchain.hpp>
 #include <io/cradle_files.hpp>
+#include <io/cradle_hash.hpp>
+#include <io/cradle_json.hpp>
 #include <io/cradle_stat.hpp>
+#include <platform/cradle_platform_util.hpp>
 
 #include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
 #include <set>
 
 namespace cradle {
 namespace cpp {
 
-static const std::string INCLUDE_DIRS = "INCLUDE_DIRS";
-static const std::string LIBRARY_NAME = "LIBRARY_NAME";
-static const std::string LIBRARY_PATH = "LIBRARY_PATH";
-static const std::string OUTPUT_FILE = "OUTPUT_FILE";
+static const PropertyKey DEPENDENCY_FILES("DEPENDENCY_FILES");
+static const PropertyKey INCLUDE_DIRS("INCLUDE_DIRS");
+static const PropertyKey LIBRARY_NAME("LIBRARY_NAME");
+static const PropertyKey LIBRARY_PATH("LIBRARY_PATH");
+static const PropertyKey OUTPUT_FILE("OUTPUT_FILE");
+
+// The file in the output directory that the time and memory used by each link are appended to.
+static const std::string LINK_STATS_FILE = ".cradle_link_stats.json";
 
 namespace detail {
 
@@ -56,129 +69,541 @@ std::vector<T> uniquify(const std::vector<T>& orig) {
 	return retVal;
 }
 
-bool isTargetLessRecentThanHeaderFiles(const struct stat& targetFileStat, const std::string& path) {
-	tinydir_dir dir;
-	tinydir_open(&dir, path.c_str());
+std::string resolveFile(const std::string& name, const std::vector<std::string>& paths) {
+	for (auto& path : paths) {
+		std::string fileCandidate = io::path_concat(path, name);
+		if (io::exists(fileCandidate)) {
+			return fileCandidate;
+		}
+	}
 
-	while (dir.has_next) {
-		tinydir_file file;
-		tinydir_readfile(&dir, &file);
+	return name;
+}
 
-		std::string filename(file.name);
-		std::string filepath(file.path);
+/**
+ * @return `path`, which is relative to the working directory unless it is absolute, as an absolute path.
+ */
+std::string absolutePath(const std::string& path) {
+	bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+	return absolute ? path : io::path_concat(platform::platform_getcwd(), path);
+}
 
-		if (filename == "." || filename == "..") {
-			tinydir_next(&dir);
-			continue;
+/**
+ * @return The directory for files generated for the target `name`. It is distinct from the target's output,
+ *         which for executables is named `name` too.
+ */
+std::string targetDirectory(const std::string& outputDirectory, const std::string& name) {
+	return io::path_concat(outputDirectory, name + ".dir");
+}
+
+/**
+ * @return The object file `filePath` is compiled to. Sources generated in `outputDirectory`, e.g. unity
+ *         sources, have theirs next to them rather than in a copy of their directory.
+ */
+std::string objectFile(const std::string& filePath, const std::string& outputDirectory, Toolchain& toolchain) {
+	std::string prefix = io::path_concat(outputDirectory, "");
+	if (filePath.compare(0, prefix.size(), prefix) == 0) {
+		return toolchain.objectFileNameFromBase(filePath);
+	}
+	return io::path_concat(outputDirectory, toolchain.objectFileNameFromBase(filePath));
+}
+
+/**
+ * @return The path of the precompiled header built from `headerFile` for the target `rootTaskName`. Each
+ *         target has its own since it must be built with the same include directories as the target's objects.
+ */
+std::string precompiledHeaderFile(
+	const std::string& rootTaskName,
+	const std::string& headerFile,
+	const std::string& outputDirectory,
+	Toolchain& toolchain
+) {
+	return io::path_concat(targetDirectory(outputDirectory, rootTaskName), toolchain.precompiledHeaderNameFromBase(headerFile));
+}
+
+/**
+ * Runs `cmdline`, a command from `toolchain` that writes `outputFile`. Commands longer than the toolchain's
+ * response file threshold are run with their arguments in `<outputFile>.rsp`, which keeps links of many
+ * objects within the system's command line limits. Compile profiles are left out of the printed output.
+ *
+ * @param outputs Every file the command may write.
+ */
+ExecutionResult runTool(
+	Toolchain& toolchain,
+	const std::string& cmdline,
+	const std::string& outputFile,
+	const std::vector<std::string>& outputs,
+	platform::ProcessResult& result
+) {
+	OutputFilter filter = [&toolchain] (std::string& output, std::string& errors) {
+		toolchain.stripCompileProfile(output, errors);
+	};
+
+	if (cmdline.size() <= toolchain.responseFileThreshold()) {
+		return run(cmdline, platform::commandArgs(cmdline), outputs, result, filter);
+	}
+
+	bool needsShell;
+	std::vector<std::string> args = platform::splitCommandLine(cmdline, needsShell);
+	std::string responseFile = outputFile + ".rsp";
+	std::string contents;
+	if (
+		needsShell || args.empty() ||
+		!toolchain.useResponseFile(args, responseFile, contents) ||
+		!io::write_file(responseFile, contents)
+	) {
+		return run(cmdline, platform::commandArgs(cmdline), outputs, result, filter);
+	}
+
+	ExecutionResult ret = run(cmdline, args, outputs, result, filter);
+	if (ret == ExecutionResult::SUCCESS) {
+		// Kept after failures so the command can be rerun by hand.
+		std::remove(responseFile.c_str());
+		io::invalidateStat(responseFile);
+	}
+	return ret;
+}
+
+ExecutionResult runTool(
+	Toolchain& toolchain,
+	const std::string& cmdline,
+	const std::string& outputFile,
+	const std::vector<std::string>& outputs
+) {
+	platform::ProcessResult result;
+	return runTool(toolchain, cmdline, outputFile, outputs, result);
+}
+
+/**
+ * Precompiles `headerFile` for the objects of the target `rootTaskName`. It is rebuilt when the command,
+ * and so the flags, or any of the headers it includes change.
+ *
+ * @param flags The flags the target's objects are compiled with.
+ */
+task_p precompiled_header(
+	std::string rootTaskName,
+	std::string headerFile,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::vector<std::string> flags = std::vector<std::string>()
+) {
+	std::string outputFile = precompiledHeaderFile(rootTaskName, headerFile, outputDirectory, *toolchain);
+
+	auto precompile = tracked(task(rootTaskName + ':' + headerFile + ":precompile", [=] (Task* self) {
+		std::string depFile = toolchain->depFileNameFromObject(outputFile);
+		std::string cmdline = toolchain->compilePrecompiledHeaderCmd(outputFile, absolutePath(headerFile), includeSearchDirs, flags);
+
+		// The generated file is one of the precompiled header's dependencies, so it is only written when it
+		// changes, e.g. because the project moved.
+		std::string contents;
+		std::string existing;
+		std::string source = toolchain->precompiledHeaderSource(outputFile, absolutePath(headerFile), contents);
+		if (!io::read_file(source, existing) || existing != contents) {
+			io::mkdirs(io::path_parent(source));
+			if (!io::write_file(source, contents)) {
+				log_error("Unable to write " + source);
+				return ExecutionResult::FAILURE;
+			}
 		}
 
-		if (file.is_dir) {
-			if (isTargetLessRecentThanHeaderFiles(targetFileStat, file.path)) {
-				tinydir_close(&dir);
-				return true;
+		std::vector<std::string> dependencies;
+		if (buildLog().isOutOfDate(outputFile, cmdline, dependencies)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> knownInputs(dependencies);
+			knownInputs.push_back(headerFile);
+			BuildLog::CommandStart started = buildLog().beforeCommand(knownInputs);
+
+			std::vector<std::string> outputs = {outputFile, depFile};
+			std::string object = toolchain->precompiledHeaderObject(outputFile);
+			if (!object.empty()) {
+				outputs.push_back(object);
+			}
+			if (runTool(*toolchain, cmdline, outputFile, outputs) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
 			}
 
-		} else if (
-			strendswith(filename, ".hpp") ||
-			strendswith(filename, ".hh") ||
-			strendswith(filename, ".h") ||
-			strendswith(filename, ".tpp")
-		) {
-			const struct stat sourceFileStat = io::getStat(file.path);
-
-			if (difftime(targetFileStat.st_mtime, sourceFileStat.st_mtime) < 0) {
-				tinydir_close(&dir);
-				return true;
+			if (io::read_file(depFile, contents)) {
+				dependencies = toolchain->parseDepFile(contents);
+			} else {
+				dependencies = {headerFile};
 			}
+			buildLog().record(outputFile, cmdline, dependencies, started);
 		}
+		return ExecutionResult::SUCCESS;
+	}));
 
-		tinydir_next(&dir);
-	}
-
-	tinydir_close(&dir);
-	return false;
+	precompile->set(OUTPUT_FILE, outputFile);
+	return precompile;
 }
 
-bool isTargetLessRecentThanFiles(const std::string& targetFile, const std::string& sourceFile, const std::vector<std::string>& includeSearchDirs) {
-	if (!io::exists(targetFile)) {
-		return true;
-	}
+/**
+ * @param precompiledHeader The header precompiled by @ref precompiled_header for this target, or an empty
+ *                          string to compile without one.
+ * @param targetFlags       Flags every object of the target is compiled with.
+ */
+task_p object(
+	std::string rootTaskName,
+	std::string filePath,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	std::vector<std::string> targetFlags = std::vector<std::string>()
+) {
+	auto compile = tracked(task(rootTaskName + ':' + filePath + ":compile", [=] (Task* self) {
+		std::string outputFile = objectFile(filePath, outputDirectory, *toolchain);
+		std::string depFile = toolchain->depFileNameFromObject(outputFile);
+		self->set(OUTPUT_FILE, outputFile);
 
-	const struct stat targetFileStat = io::getStat(targetFile);
-	const struct stat sourceFileStat = io::getStat(sourceFile);
+		std::string pchFile;
+		std::vector<std::string> flags(targetFlags);
+		if (!precompiledHeader.empty()) {
+			pchFile = precompiledHeaderFile(rootTaskName, precompiledHeader, outputDirectory, *toolchain);
+			std::vector<std::string> pchFlags = toolchain->usePrecompiledHeaderFlags(pchFile, absolutePath(precompiledHeader));
+			flags.insert(flags.end(), pchFlags.begin(), pchFlags.end());
+		}
 
-	if (difftime(targetFileStat.st_mtime, sourceFileStat.st_mtime) < 0) {
-		return true;
-	}
+		std::string cmdline = toolchain->compileObjectCmd(outputFile, filePath, includeSearchDirs, flags);
 
-	for (auto& dir : includeSearchDirs) {
-		if (isTargetLessRecentThanHeaderFiles(targetFileStat, dir)) {
-			return true;
+		std::vector<std::string> dependencies;
+		if (buildLog().isOutOfDate(outputFile, cmdline, dependencies)) {
+
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> knownInputs(dependencies);
+			knownInputs.push_back(filePath);
+			if (!pchFile.empty()) {
+				knownInputs.push_back(pchFile);
+			}
+			BuildLog::CommandStart started = buildLog().beforeCommand(knownInputs);
+
+			std::string manifestKey;
+			if (compileCache().isEnabled()) {
+				std::string keyCmdline = toolchain->compileObjectCmd(CACHE_OUTPUT_PLACEHOLDER, filePath, includeSearchDirs, flags);
+				manifestKey = compileCache().manifestKey(*toolchain, keyCmdline, filePath);
+			}
+
+			if (!manifestKey.empty() && compileCache().fetch(manifestKey, outputFile, dependencies)) {
+				log("Restored " + outputFile + " from the cache");
+			} else {
+				platform::ProcessResult result;
+				if (runTool(*toolchain, cmdline, outputFile, {outputFile, depFile}, result) == ExecutionResult::FAILURE) {
+					return ExecutionResult::FAILURE;
+				}
+
+				if (toolchain->isProfilingCompile()) {
+					CompileProfile profile;
+					profile.source = filePath;
+					profile.seconds = result.wallSeconds;
+					toolchain->readCompileProfile(outputFile, result, profile);
+					compileProfiler().add(profile);
+				}
+
+				std::string contents;
+				if (io::read_file(depFile, contents)) {
+					dependencies = toolchain->parseDepFile(contents);
+				} else {
+					dependencies = {filePath};
+				}
+
+				if (!manifestKey.empty()) {
+					// Precompiled headers aren't reproducible, so cached objects depend on the headers the
+					// precompiled header was built from instead.
+					std::vector<std::string> cacheDependencies(dependencies);
+					if (!pchFile.empty() && io::read_file(toolchain->depFileNameFromObject(pchFile), contents)) {
+						std::vector<std::string> pchDependencies = toolchain->parseDepFile(contents);
+						cacheDependencies.insert(cacheDependencies.end(), pchDependencies.begin(), pchDependencies.end());
+					}
+					compileCache().store(manifestKey, outputFile, uniquify(cacheDependencies));
+				}
+			}
+
+			// Compilers don't list the precompiled header, but objects must be rebuilt when it is.
+			if (!pchFile.empty() && std::find(dependencies.begin(), dependencies.end(), pchFile) == dependencies.end()) {
+				dependencies.push_back(pchFile);
+			}
+			buildLog().record(outputFile, cmdline, dependencies, started);
 		}
-	}
 
-	return false;
+		self->push(DEPENDENCY_FILES, dependencies);
+		return ExecutionResult::SUCCESS;
+	}));
+
+	return compile;
 }
 
-bool isTargetLessRecentThanFiles(const std::string& targetFile, const std::vector<std::string>& files) {
-	if (!io::exists(targetFile)) {
-		return true;
+/**
+ * Splits `sourceFiles` into batches of about `batchSize` files for unity builds.
+ *
+ * Files are sorted and, once a batch holds half of `batchSize` files, it ends after a file whose path hashes
+ * to a multiple of the other half, or once it holds twice `batchSize` files. Since where batches end depends
+ * on the files' own paths rather than their positions, adding or removing a file only changes the batch it
+ * is in (and rarely the next one).
+ */
+std::vector<std::vector<std::string>> unityBatches(std::vector<std::string> sourceFiles, unsigned batchSize) {
+	std::sort(sourceFiles.begin(), sourceFiles.end());
+
+	unsigned minSize = std::max(2u, batchSize / 2);
+	unsigned divisor = batchSize > minSize ? batchSize - minSize + 1 : 1;
+
+	std::vector<std::vector<std::string>> batches(1);
+	for (auto& file : sourceFiles) {
+		std::vector<std::string>& batch = batches.back();
+		batch.push_back(file);
+		bool boundary = io::hashBytes(file.data(), file.size()) % divisor == 0;
+		if ((batch.size() >= minSize && boundary) || batch.size() >= 2 * batchSize) {
+			batches.emplace_back();
+		}
 	}
+	if (batches.back().empty()) {
+		batches.pop_back();
+	}
+	return batches;
+}
 
-	const struct stat targetFileStat = io::getStat(targetFile);
+/**
+ * Generates unity sources that each include a batch of `sourceFiles` for the target `name`. Files in
+ * `exclude`, e.g. ones whose internal names clash with other files, and batches of one file are compiled on
+ * their own. Unity sources of earlier batches that no batch has anymore are deleted along with their objects.
+ *
+ * @return The files to compile instead of `sourceFiles`.
+ */
+std::vector<std::string> unitySources(
+	const std::string& name,
+	const std::vector<std::string>& sourceFiles,
+	unsigned batchSize,
+	const std::vector<std::string>& exclude,
+	const std::string& outputDirectory,
+	Toolchain& toolchain
+) {
+	std::string directory = targetDirectory(outputDirectory, name);
+	std::set<std::string> unityFiles;
+
+	std::set<std::string> excluded(exclude.begin(), exclude.end());
+	std::vector<std::string> sources;
+	std::vector<std::string> batched;
+	for (auto& file : sourceFiles) {
+		if (excluded.find(file) != excluded.end()) {
+			sources.push_back(file);
+		} else {
+			batched.push_back(file);
+		}
+	}
 
-	for (auto& sourceFile : files) {
-		// TODO: This conditional is here to prevent attempting to get stats of system libraries like pthread.
-		// There should perhaps be a better solution than skipping it.
-		if (!io::exists(sourceFile)) {
+	for (auto& batch : unityBatches(batched, batchSize)) {
+		if (batch.size() == 1) {
+			sources.push_back(batch.front());
 			continue;
 		}
 
-		const struct stat sourceFileStat = io::getStat(sourceFile);
+		// Named after the first file so that a batch keeps its object when other batches change.
+		char id[17];
+		snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(io::hashBytes(batch.front().data(), batch.front().size())));
+		std::string unityFile = io::path_concat(directory, "unity_" + std::string(id) + ".cpp");
 
-		if (difftime(targetFileStat.st_mtime, sourceFileStat.st_mtime) < 0) {
-			return true;
+		std::string contents;
+		for (auto& file : batch) {
+			contents += "#include \"" + absolutePath(file) + "\"\n";
 		}
+
+		// Only written when the batch changes so that its object isn't rebuilt needlessly.
+		std::string existing;
+		if (!io::read_file(unityFile, existing) || existing != contents) {
+			io::mkdirs(io::path_parent(unityFile));
+			if (!io::write_file(unityFile, contents)) {
+				log_error("Unable to write " + unityFile + "; compiling its files separately");
+				sources.insert(sources.end(), batch.begin(), batch.end());
+				continue;
+			}
+		}
+		sources.push_back(unityFile);
+		unityFiles.insert(unityFile);
 	}
 
-	return false;
+	std::vector<io::detail::DirectoryEntry> entries;
+	io::detail::readDirectory(directory, entries);
+	for (auto& entry : entries) {
+		const std::string& file = entry.name;
+		bool isUnitySource = file.compare(0, 6, "unity_") == 0 && file.size() > 10 && file.compare(file.size() - 4, 4, ".cpp") == 0;
+		std::string path = io::path_concat(directory, file);
+		if (entry.isDirectory || !isUnitySource || unityFiles.count(path) > 0) {
+			continue;
+		}
+
+		std::string object = objectFile(path, outputDirectory, toolchain);
+		for (auto& stale : {path, object, toolchain.depFileNameFromObject(object)}) {
+			std::remove(stale.c_str());
+			io::invalidateStat(stale);
+		}
+	}
+	return sources;
 }
 
-std::string resolveFile(const std::string& name, const std::vector<std::string>& paths) {
-	for (auto& path : paths) {
-		std::string fileCandidate = io::path_concat(path, name);
-		if (io::exists(fileCandidate)) {
-			return fileCandidate;
+/**
+ * @return The tasks compiling `sourceFiles` with `flags` for the target `name`, preceded by the task
+ *         precompiling `precompiledHeader` if it isn't empty. With a `unityBatchSize` above 1 the sources
+ *         are compiled in batches by @ref unitySources.
+ */
+std::vector<task_p> objects(
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs,
+	std::string outputDirectory,
+	std::shared_ptr<Toolchain> toolchain,
+	std::string precompiledHeader,
+	unsigned unityBatchSize,
+	std::vector<std::string> unityExclude,
+	std::vector<std::string> flags,
+	task_p& precompile
+) {
+	if (!precompiledHeader.empty()) {
+		precompile = detail::precompiled_header(name, precompiledHeader, includeSearchDirs, outputDirectory, toolchain, flags);
+	}
+
+	if (unityBatchSize > 1) {
+		sourceFiles = unitySources(name, sourceFiles, unityBatchSize, unityExclude, outputDirectory, *toolchain);
+	}
+
+	std::vector<task_p> objectFileTasks;
+	for (auto file : sourceFiles) {
+		objectFileTasks.push_back(detail::object(name, file, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, flags));
+		if (precompile) {
+			objectFileTasks.back()->dependsOn(precompile);
 		}
 	}
+	return objectFileTasks;
+}
 
-	return name;
+/**
+ * @return The object files written by `objectFileTasks` and `precompile`, which may be null.
+ */
+std::vector<std::string> objectFiles(const std::vector<task_p>& objectFileTasks, task_p precompile, Toolchain& toolchain) {
+	std::vector<std::string> objectFiles;
+	for (auto task : objectFileTasks) {
+		objectFiles.push_back(task->get(OUTPUT_FILE));
+	}
+	if (precompile) {
+		std::string object = toolchain.precompiledHeaderObject(precompile->get(OUTPUT_FILE));
+		if (!object.empty()) {
+			objectFiles.push_back(object);
+		}
+	}
+	return objectFiles;
 }
 
+/**
+ * @return The file describing the interface of `sharedLibFile`. It is only rewritten when the interface
+ *         changes, so programs depend on it rather than on the library.
+ */
+std::string sharedLibInterfaceFile(const std::string& sharedLibFile) {
+	return sharedLibFile + ".toc";
+}
 
-task_p object(
-	std::string rootTaskName,
-	std::string filePath,
-	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
-	std::string outputDirectory = DEFAULT_BUILD_DIR,
-	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault()
+/**
+ * Finds the files that linking against `libraryNames` depends on. Like the linker, shared libraries are
+ * preferred over static ones, and they are represented by their interface file if they have one.
+ *
+ * @param runtimeDirs Set to the absolute paths of the directories holding the shared libraries.
+ */
+std::vector<std::string> libraryInputs(
+	Toolchain& toolchain,
+	const std::vector<std::string>& libraryNames,
+	const std::vector<std::string>& librarySearchPaths,
+	std::vector<std::string>& runtimeDirs
 ) {
-	auto compile = task(rootTaskName + ':' + filePath + ":compile", [=] (Task* self) {
-		std::string outputFile = io::path_concat(outputDirectory, toolchain->objectFileNameFromBase(filePath));
-		self->set(OUTPUT_FILE, outputFile);
+	std::vector<std::string> inputs;
+	runtimeDirs.clear();
+	for (const auto& lib : libraryNames) {
+		std::string sharedLib = detail::resolveFile(toolchain.sharedLibNameFromBase(lib), librarySearchPaths);
+		if (io::exists(sharedLib)) {
+			std::string interfaceFile = sharedLibInterfaceFile(sharedLib);
+			inputs.push_back(io::exists(interfaceFile) ? interfaceFile : sharedLib);
+			runtimeDirs.push_back(absolutePath(io::path_parent(sharedLib)));
+		} else {
+			inputs.push_back(detail::resolveFile(toolchain.staticLibNameFromBase(lib), librarySearchPaths));
+		}
+	}
+	runtimeDirs = uniquify(runtimeDirs);
+	return inputs;
+}
 
-		if (isTargetLessRecentThanFiles(outputFile, filePath, includeSearchDirs)) {
+/**
+ * Brings the interface file of `sharedLibFile` up to date.
+ */
+void updateSharedLibInterface(Toolchain& toolchain, const std::string& sharedLibFile, const std::string& soname) {
+	std::string interfaceFile = sharedLibInterfaceFile(sharedLibFile);
+
+	std::string interface;
+	if (!toolchain.sharedLibInterface(sharedLibFile, interface)) {
+		std::remove(interfaceFile.c_str());
+		io::invalidateStat(interfaceFile);
+		return;
+	}
 
-			std::string cmdline = toolchain->compileObjectCmd(outputFile, filePath, includeSearchDirs);
-			io::mkdirs(io::path_parent(outputFile));
-			return exec(cmdline)->execute();
+	std::string contents = "soname " + soname + "\n" + interface;
+	std::string existing;
+	if ((!io::read_file(interfaceFile, existing) || existing != contents) && !io::write_file(interfaceFile, contents)) {
+		// Without it dependents depend on the library itself.
+		std::remove(interfaceFile.c_str());
+		io::invalidateStat(interfaceFile);
+	}
+}
 
-		} else {
-			return ExecutionResult::SUCCESS;
-		}
-	});
+/**
+ * Reports how long linking `outputFile` took and how much memory the linker used, and appends them as a line
+ * of JSON to @ref LINK_STATS_FILE in `outputDirectory` for tools that track link times across builds.
+ */
+void recordLinkStats(
+	const std::string& outputDirectory,
+	const std::string& outputFile,
+	const std::string& linker,
+	const platform::ProcessResult& result
+) {
+	static std::mutex mutex;
+
+	char summary[128];
+	std::snprintf(summary, sizeof(summary), "%.2fs, peak memory %.1f MB", result.wallSeconds, result.maxResidentKb / 1024.0);
+	log("Linked " + outputFile + " with " + linker + " in " + summary);
+
+	std::string line = "{\"output\": " + json::quote(outputFile);
+	line += ", \"linker\": " + json::quote(linker);
+	line += ", \"time\": " + std::to_string(static_cast<long long>(::time(nullptr)));
+	line += ", \"wallSeconds\": " + std::to_string(result.wallSeconds);
+	line += ", \"userSeconds\": " + std::to_string(result.userSeconds);
+	line += ", \"systemSeconds\": " + std::to_string(result.systemSeconds);
+	line += ", \"maxResidentKb\": " + std::to_string(result.maxResidentKb) + "}\n";
+
+	std::lock_guard<std::mutex> lock(mutex);
+	io::append_file(io::path_concat(outputDirectory, LINK_STATS_FILE), line);
+}
 
-	return compile;
+/**
+ * @return The flags to link a program or shared library with, given the directories of the shared libraries
+ *         it links to and its link time optimization settings.
+ */
+std::vector<std::string> linkFlags(
+	Toolchain& toolchain,
+	const std::vector<std::string>& runtimeDirs,
+	const std::string& outputDirectory,
+	LtoMode lto,
+	unsigned ltoJobs
+) {
+	std::vector<std::string> flags = toolchain.runtimeSearchPathFlags(runtimeDirs);
+
+	// Shared by every target so that modules they have in common are only optimized once.
+	std::string ltoCacheDir = io::path_concat(outputDirectory, "thinlto-cache");
+
+	std::vector<std::string> ltoFlags = toolchain.ltoLinkFlags(lto, ltoJobs, ltoCacheDir);
+	for (auto& flag : ltoFlags) {
+		if (flag.find(ltoCacheDir) != std::string::npos) {
+			io::mkdirs(ltoCacheDir);
+			break;
+		}
+	}
+	flags.insert(flags.end(), ltoFlags.begin(), ltoFlags.end());
+	return flags;
 }
 
 task_p static_lib(
@@ -187,29 +612,54 @@ task_p static_lib(
 	std::vector<std::string> sourceFiles,
 	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
 	std::string outputDirectory = DEFAULT_BUILD_DIR,
-	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault()
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
 ) {
 	std::string outputFile(io::path_concat(outputDirectory, toolchain->staticLibNameFromBase(name)));
 
-	std::vector<task_p> objectFileTasks;
-	for (auto file : sourceFiles) {
-		objectFileTasks.push_back(detail::object(name, file, includeSearchDirs, outputDirectory, toolchain));
-	}
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		toolchain->ltoCompileFlags(lto), precompile
+	);
 
-	auto buildArchive = task(taskName, [=] (Task* self) {
-		std::vector<std::string> objectFiles;
-		for (auto task : objectFileTasks) {
-			objectFiles.push_back(task->get(OUTPUT_FILE));
-		}
+	auto buildArchive = tracked(task(taskName, [=] (Task* self) {
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::string cmdline = toolchain->buildStaticLibCmd(outputFile, objectFiles);
 
-		if (isTargetLessRecentThanFiles(outputFile, objectFiles)) {
-			std::string cmdline = toolchain->buildStaticLibCmd(outputFile, objectFiles);
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
 			io::mkdirs(io::path_parent(outputFile));
-			return exec(cmdline)->execute();
-		} else {
-			return ExecutionResult::SUCCESS;
+
+			// Archivers add to existing archives so start from scratch to drop removed objects.
+			std::remove(outputFile.c_str());
+			io::invalidateStat(outputFile);
+
+			BuildLog::CommandStart started = buildLog().beforeCommand(objectFiles);
+
+			std::string archiveKey;
+			if (compileCache().isEnabled()) {
+				archiveKey = compileCache().archiveKey(toolchain->buildStaticLibCmd(CACHE_OUTPUT_PLACEHOLDER, objectFiles), objectFiles);
+			}
+
+			if (!archiveKey.empty() && compileCache().fetchArchive(archiveKey, outputFile)) {
+				log("Restored " + outputFile + " from the cache");
+			} else {
+				if (runTool(*toolchain, cmdline, outputFile, {outputFile}) == ExecutionResult::FAILURE) {
+					return ExecutionResult::FAILURE;
+				}
+				if (!archiveKey.empty()) {
+					compileCache().storeArchive(archiveKey, outputFile);
+				}
+			}
+			buildLog().record(outputFile, cmdline, objectFiles, started);
 		}
-	});
+		return ExecutionResult::SUCCESS;
+	}));
 
 	buildArchive->set(LIBRARY_NAME, name);
 	buildArchive->set(LIBRARY_PATH, io::path_parent(outputFile));
@@ -222,7 +672,11 @@ task_p static_lib(
 	return buildArchive;
 }
 
-task_p exe(
+/**
+ * @param soname The name the library is loaded by at runtime. Defaults to the library's file name.
+ * @param visibility The default visibility of symbols, see @ref Toolchain::sharedLibCompileFlags.
+ */
+task_p shared_lib(
 	std::string taskName,
 	std::string name,
 	std::vector<std::string> sourceFiles,
@@ -230,47 +684,135 @@ task_p exe(
 	std::vector<std::string> libraryNames = std::vector<std::string>(),
 	std::vector<std::string> librarySearchPaths = std::vector<std::string>(),
 	std::string outputDirectory = DEFAULT_BUILD_DIR,
-	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault()
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string soname = std::string(),
+	std::string visibility = std::string(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
 ) {
-	std::string outputFile(io::path_concat(outputDirectory, name));
-
-	std::vector<task_p> objectFileTasks;
-	for (auto file : sourceFiles) {
-		objectFileTasks.push_back(detail::object(name, file, includeSearchDirs, outputDirectory, toolchain));
+	std::string outputFile(io::path_concat(outputDirectory, toolchain->sharedLibNameFromBase(name)));
+	if (soname.empty()) {
+		soname = io::path_filename(outputFile);
 	}
 
-	task_p link = task(taskName, [=] (Task* _) {
+	std::vector<std::string> compileFlags = toolchain->sharedLibCompileFlags(visibility);
+	std::vector<std::string> ltoFlags = toolchain->ltoCompileFlags(lto);
+	compileFlags.insert(compileFlags.end(), ltoFlags.begin(), ltoFlags.end());
+
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		compileFlags, precompile
+	);
+
+	task_p link = tracked(task(taskName, [=] (Task* self) {
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::vector<std::string> runtimeDirs;
+		std::vector<std::string> libraryFiles = libraryInputs(*toolchain, libraryNames, librarySearchPaths, runtimeDirs);
+
+		std::string cmdline = toolchain->linkSharedLibCmd(
+			outputFile,
+			objectFiles,
+			libraryNames,
+			librarySearchPaths,
+			soname,
+			linkFlags(*toolchain, runtimeDirs, outputDirectory, lto, ltoJobs)
+		);
+
+		bool relinked = false;
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
+			io::mkdirs(io::path_parent(outputFile));
+
+			std::vector<std::string> inputs(objectFiles);
+			inputs.insert(inputs.end(), libraryFiles.begin(), libraryFiles.end());
+			BuildLog::CommandStart started = buildLog().beforeCommand(inputs);
+
+			platform::ProcessResult result;
+			if (runTool(*toolchain, cmdline, outputFile, {outputFile}, result) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			recordLinkStats(outputDirectory, outputFile, toolchain->linkerName(), result);
 
-		std::vector<std::string> objectFiles;
-		for (auto task : objectFileTasks) {
-			objectFiles.push_back(task->get(OUTPUT_FILE));
+			buildLog().record(outputFile, cmdline, inputs, started);
+			relinked = true;
 		}
 
-		std::vector<std::string> libraryFiles;
-		for (const auto& lib : libraryNames) {
-			libraryFiles.push_back(detail::resolveFile(toolchain->staticLibNameFromBase(lib), librarySearchPaths));
+		if (relinked || !io::exists(sharedLibInterfaceFile(outputFile))) {
+			updateSharedLibInterface(*toolchain, outputFile, soname);
 		}
+		return ExecutionResult::SUCCESS;
+	}));
 
-		if (
-			isTargetLessRecentThanFiles(outputFile, objectFiles) ||
-			isTargetLessRecentThanFiles(outputFile, libraryFiles)
-		) {
-			std::string cmdline = toolchain->linkExeCmd(
-				outputFile,
-				objectFiles,
-				includeSearchDirs,
-				libraryNames,
-				librarySearchPaths
-			);
+	link->set(LIBRARY_NAME, name);
+	link->set(LIBRARY_PATH, io::path_parent(outputFile));
+	link->set(OUTPUT_FILE, outputFile);
+	link->dependsOn(objectFileTasks);
+
+	return link;
+}
+
+task_p exe(
+	std::string taskName,
+	std::string name,
+	std::vector<std::string> sourceFiles,
+	std::vector<std::string> includeSearchDirs = std::vector<std::string>(),
+	std::vector<std::string> libraryNames = std::vector<std::string>(),
+	std::vector<std::string> librarySearchPaths = std::vector<std::string>(),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	std::string outputFile(io::path_concat(outputDirectory, name));
 
+	task_p precompile;
+	std::vector<task_p> objectFileTasks = objects(
+		name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+		toolchain->ltoCompileFlags(lto), precompile
+	);
+
+	task_p link = tracked(task(taskName, [=] (Task* _) {
+
+		std::vector<std::string> objectFiles = detail::objectFiles(objectFileTasks, precompile, *toolchain);
+
+		std::vector<std::string> runtimeDirs;
+		std::vector<std::string> libraryFiles = libraryInputs(*toolchain, libraryNames, librarySearchPaths, runtimeDirs);
+
+		std::string cmdline = toolchain->linkExeCmd(
+			outputFile,
+			objectFiles,
+			includeSearchDirs,
+			libraryNames,
+			librarySearchPaths,
+			linkFlags(*toolchain, runtimeDirs, outputDirectory, lto, ltoJobs)
+		);
+
+		if (buildLog().isOutOfDate(outputFile, cmdline)) {
 			io::mkdirs(io::path_parent(outputFile));
 
-			return exec(cmdline)->execute();
-		} else {
-			return ExecutionResult::SUCCESS;
+			std::vector<std::string> inputs(objectFiles);
+			inputs.insert(inputs.end(), libraryFiles.begin(), libraryFiles.end());
+			BuildLog::CommandStart started = buildLog().beforeCommand(inputs);
+
+			platform::ProcessResult result;
+			if (runTool(*toolchain, cmdline, outputFile, {outputFile}, result) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+			recordLinkStats(outputDirectory, outputFile, toolchain->linkerName(), result);
+
+			buildLog().record(outputFile, cmdline, inputs, started);
 		}
-	});
+		return ExecutionResult::SUCCESS;
+	}));
 
+	link->set(OUTPUT_FILE, outputFile);
 	link->dependsOn(objectFileTasks);
 
 	return link;
@@ -283,10 +825,15 @@ task_p static_lib(
 	task_p sourceFiles,
 	task_p includeSearchDirs = emptyList(INCLUDE_DIRS),
 	std::string outputDirectory = DEFAULT_BUILD_DIR,
-	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault()
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
 ) {
 
-	task_p configure = task(name, [=] (Task* self){
+	task_p configure = tracked(task(name, [=] (Task* self){
 
 		task_p buildArchive = detail::static_lib(
 			name + ":archive",
@@ -294,20 +841,25 @@ task_p static_lib(
 			sourceFiles->getList(io::FILE_LIST),
 			detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)),
 			outputDirectory,
-			toolchain
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
 		);
 
 		self->followedBy(buildArchive);
-		self->followedBy(task([=] (Task* _) {
+		self->followedBy(tracked(task([=] (Task* _) {
 			self->set(LIBRARY_NAME, buildArchive->get(LIBRARY_NAME));
 			self->set(LIBRARY_PATH, buildArchive->get(LIBRARY_PATH));
 			self->set(OUTPUT_FILE, buildArchive->get(OUTPUT_FILE));
 			self->push(INCLUDE_DIRS, detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)));
 			return ExecutionResult::SUCCESS;
-		}));
+		})));
 
 		return ExecutionResult::SUCCESS;
-	});
+	}));
 
 	configure->dependsOn(sourceFiles);
 	configure->dependsOn(includeSearchDirs);
@@ -323,8 +875,26 @@ public:
 	builder::Value<StaticLibBuilder, std::string> outputDirectory{this, DEFAULT_BUILD_DIR};
 	builder::Value<StaticLibBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
 
+	// A header included by every source file, e.g. one that includes heavy third-party headers, to
+	// precompile before compiling them. Sources need not include it themselves.
+	builder::Value<StaticLibBuilder, std::string> precompiledHeader{this, ""};
+
+	// Compile the sources in batches of about this many files, each included by one generated source, to
+	// parse common headers fewer times. 0 compiles every source on its own.
+	builder::Value<StaticLibBuilder, unsigned> unityBatchSize{this, 0};
+
+	// Sources compiled on their own in unity builds, e.g. ones whose internal names clash with other files.
+	builder::StrList<StaticLibBuilder> unityExclude{this, {}};
+
+	// Compile the sources for link time optimization. Programs linking the library must use it too.
+	builder::Value<StaticLibBuilder, LtoMode> lto{this, LtoMode::NONE};
+	builder::Value<StaticLibBuilder, unsigned> ltoJobs{this, 0};
+
     task_p build() {
-        return static_lib(name, sourceFiles, includeSearchDirs, outputDirectory, toolchain);
+        return static_lib(
+			name, sourceFiles, includeSearchDirs, outputDirectory, toolchain, precompiledHeader, unityBatchSize, unityExclude,
+			lto, ltoJobs
+		);
     }
 };
 
@@ -332,6 +902,113 @@ StaticLibBuilder static_lib() {
 	return StaticLibBuilder();
 }
 
+task_p shared_lib(
+	std::string name,
+	task_p sourceFiles,
+	task_p includeSearchDirs = emptyList(INCLUDE_DIRS),
+	task_p linkLibraries = emptyList(LIBRARY_NAME),
+	task_p linkLibraryPaths = emptyList(LIBRARY_PATH),
+	std::string outputDirectory = DEFAULT_BUILD_DIR,
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string soname = std::string(),
+	std::string visibility = std::string(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
+) {
+	task_p configure = tracked(task(name, [=] (Task* self) {
+
+		task_p link = detail::shared_lib(
+			name + ":link",
+			name,
+			sourceFiles->getList(io::FILE_LIST),
+			detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)),
+			linkLibraries->getList(LIBRARY_NAME),
+			detail::uniquify(linkLibraryPaths->getList(LIBRARY_PATH)),
+			outputDirectory,
+			toolchain,
+			soname,
+			visibility,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+
+		self->followedBy(link);
+		self->followedBy(tracked(task([=] (Task* _) {
+			self->set(LIBRARY_NAME, link->get(LIBRARY_NAME));
+			self->set(LIBRARY_PATH, link->get(LIBRARY_PATH));
+			self->set(OUTPUT_FILE, link->get(OUTPUT_FILE));
+			self->push(INCLUDE_DIRS, detail::uniquify(includeSearchDirs->getList(INCLUDE_DIRS)));
+			return ExecutionResult::SUCCESS;
+		})));
+
+		return ExecutionResult::SUCCESS;
+	}));
+
+	configure->dependsOn(sourceFiles);
+	configure->dependsOn(includeSearchDirs);
+	configure->dependsOn(linkLibraries);
+	configure->dependsOn(linkLibraryPaths);
+
+	return configure;
+}
+
+class SharedLibBuilder {
+public:
+	builder::Str<SharedLibBuilder> name{this};
+	builder::StrListFromTask<SharedLibBuilder> sourceFiles{this, io::FILE_LIST};
+	builder::StrListFromTask<SharedLibBuilder> includeSearchDirs{this, INCLUDE_DIRS, emptyList(INCLUDE_DIRS)};
+	builder::StrListFromTask<SharedLibBuilder> linkLibrary{this, LIBRARY_NAME, emptyList(LIBRARY_NAME)};
+	builder::StrListFromTask<SharedLibBuilder> linklibrarySearchPath{this, LIBRARY_PATH, emptyList(LIBRARY_PATH)};
+	builder::Str<SharedLibBuilder> outputDirectory{this, DEFAULT_BUILD_DIR};
+	builder::Value<SharedLibBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
+
+	// The name the library is loaded by at runtime. Defaults to the library's file name.
+	builder::Str<SharedLibBuilder> soname{this, ""};
+
+	// The default visibility of symbols, e.g. `hidden` to only export symbols marked with
+	// `__attribute__((visibility("default")))`. Empty for the compiler's default.
+	builder::Str<SharedLibBuilder> visibility{this, ""};
+
+	// See @ref StaticLibBuilder::precompiledHeader, @ref StaticLibBuilder::unityBatchSize and
+	// @ref StaticLibBuilder::unityExclude.
+	builder::Str<SharedLibBuilder> precompiledHeader{this, ""};
+	builder::Value<SharedLibBuilder, unsigned> unityBatchSize{this, 0};
+	builder::StrList<SharedLibBuilder> unityExclude{this, {}};
+
+	// See @ref ExeBuilder::lto and @ref ExeBuilder::ltoJobs.
+	builder::Value<SharedLibBuilder, LtoMode> lto{this, LtoMode::NONE};
+	builder::Value<SharedLibBuilder, unsigned> ltoJobs{this, 0};
+
+	task_p build() {
+		return shared_lib(
+			name,
+			sourceFiles,
+			includeSearchDirs,
+			linkLibrary,
+			linklibrarySearchPath,
+			outputDirectory,
+			toolchain,
+			soname,
+			visibility,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
+		);
+	}
+};
+
+SharedLibBuilder shared_lib() {
+	return SharedLibBuilder();
+}
+
 task_p exe(
 	std::string name,
 	task_p sourceFiles,
@@ -339,9 +1016,14 @@ task_p exe(
 	task_p linkLibraries = emptyList(LIBRARY_NAME),
 	task_p linkLibraryPaths = emptyList(LIBRARY_PATH),
 	std::string outputDirectory = DEFAULT_BUILD_DIR,
-	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault()
+	std::shared_ptr<Toolchain> toolchain = Toolchain::platformDefault(),
+	std::string precompiledHeader = std::string(),
+	unsigned unityBatchSize = 0,
+	std::vector<std::string> unityExclude = std::vector<std::string>(),
+	LtoMode lto = LtoMode::NONE,
+	unsigned ltoJobs = 0
 ) {
-	task_p configure = task(name, [=] (Task* self) {
+	task_p configure = tracked(task(name, [=] (Task* self) {
 
 		task_p compile = detail::exe(
 			name + ":link",
@@ -351,13 +1033,18 @@ task_p exe(
 			linkLibraries->getList(LIBRARY_NAME),
 			detail::uniquify(linkLibraryPaths->getList(LIBRARY_PATH)),
 			outputDirectory,
-			toolchain
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
 		);
 
 		self->followedBy(compile);
 
 		return ExecutionResult::SUCCESS;
-	});
+	}));
 
 	configure->dependsOn(sourceFiles);
 	configure->dependsOn(includeSearchDirs);
@@ -378,6 +1065,21 @@ public:
 	builder::Str<ExeBuilder> outputDirectory{this, DEFAULT_BUILD_DIR};
 	builder::Value<ExeBuilder, std::shared_ptr<Toolchain>> toolchain{this, Toolchain::platformDefault()};
 
+	// A header included by every source file to precompile before compiling them. See
+	// @ref StaticLibBuilder::precompiledHeader.
+	builder::Str<ExeBuilder> precompiledHeader{this, ""};
+
+	// See @ref StaticLibBuilder::unityBatchSize and @ref StaticLibBuilder::unityExclude.
+	builder::Value<ExeBuilder, unsigned> unityBatchSize{this, 0};
+	builder::StrList<ExeBuilder> unityExclude{this, {}};
+
+	// Link time optimization of the program and any static libraries built with the same mode. ThinLTO
+	// keeps optimized modules in `thinlto-cache` under the output directory between links.
+	builder::Value<ExeBuilder, LtoMode> lto{this, LtoMode::NONE};
+
+	// The number of modules optimized in parallel while linking, or 0 for one per CPU.
+	builder::Value<ExeBuilder, unsigned> ltoJobs{this, 0};
+
 	task_p build() {
 		return exe(
 			name,
@@ -386,7 +1088,12 @@ public:
 			linkLibrary,
 			linklibrarySearchPath,
 			outputDirectory,
-			toolchain
+			toolchain,
+			precompiledHeader,
+			unityBatchSize,
+			unityExclude,
+			lto,
+			ltoJobs
 		);
 	}
 };
@@ -0,0 +1,349 @@
+/**
+ * @file cradle_cpp_cache.hpp
+ *
+ * @brief Reuses object files and static libraries built by earlier builds, in the manner of ccache's direct
+ *        mode.
+ *
+ * Before compiling, a manifest key is computed from the compiler identity, the compile command (with the
+ * output paths replaced by placeholders) and the hash of the source file. The manifest stored under that
+ * key lists, for the most recent compilations, the hash of every header the source included and the key of
+ * the resulting object. If every header of an entry still has the recorded hash the object is copied out
+ * of the cache instead of being compiled. Archives are keyed directly on the archive command and the hashes
+ * of the objects in them.
+ *
+ * There are up to two levels of cache: a local one and a shared one, e.g. on NFS, used by a fleet of
+ * machines. The local level is consulted first and results found in the shared level are copied into it.
+ * New results are stored in both levels unless the shared level is read-only.
+ */
+
+#pragma once
+
+#include <cradle_build_log.hpp>
+#include <cradle_cache.hpp>
+#include <cradle_main.hpp>
+#include <cpp/cradle_cpp_toolchain.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_stat.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+
+/**
+ * The output path used in the command that cache keys are computed from, so that keys don't depend on where
+ * the object is written.
+ */
+static const std::string CACHE_OUTPUT_PLACEHOLDER = "cradle_cache_output";
+
+class CompileCache {
+	static const std::size_t MAX_MANIFEST_ENTRIES = 16;
+
+	struct ManifestEntry {
+		std::vector<std::pair<std::string, uint64_t>> dependencies;
+		std::string objectKey;
+	};
+
+	// The local level, if enabled, comes first.
+	std::vector<std::unique_ptr<CacheStore>> levels;
+
+	static std::string getEnvOrOption(const std::string& option, const std::string& envVar) {
+		const char* value = std::getenv(envVar.c_str());
+		return options().get(option, value == nullptr ? "" : value);
+	}
+
+	/**
+	 * Manifests are text: each dependency is a line with its hash in hex and its path, and each entry ends
+	 * with a line holding `=` and the object key.
+	 */
+	static std::string encodeManifest(const std::vector<ManifestEntry>& entries) {
+		std::string contents;
+		for (auto& entry : entries) {
+			for (auto& dependency : entry.dependencies) {
+				char hash[17];
+				snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(dependency.second));
+				contents += std::string(hash) + " " + dependency.first + "\n";
+			}
+			contents += "= " + entry.objectKey + "\n";
+		}
+		return contents;
+	}
+
+	static std::vector<ManifestEntry> decodeManifest(const std::string& contents) {
+		std::vector<ManifestEntry> entries;
+		ManifestEntry entry;
+
+		std::istringstream lines(contents);
+		std::string line;
+		while (std::getline(lines, line)) {
+			if (line.compare(0, 2, "= ") == 0) {
+				entry.objectKey = line.substr(2);
+				entries.push_back(std::move(entry));
+				entry = ManifestEntry();
+			} else if (line.size() > 17 && line[16] == ' ') {
+				uint64_t hash = std::strtoull(line.substr(0, 16).c_str(), nullptr, 16);
+				entry.dependencies.push_back(std::make_pair(line.substr(17), hash));
+			}
+		}
+		return entries;
+	}
+
+	/**
+	 * @return The content hash of `path` or 0 if it can't be read. Hashes are cached in the build log.
+	 */
+	static uint64_t hashOf(const std::string& path) {
+		struct stat s;
+		if (!io::tryGetStat(path, s)) {
+			return 0;
+		}
+		return buildLog().hashOf(path, s).hash;
+	}
+
+	/**
+	 * Finds the newest entry of the manifest in `level` whose dependencies are unchanged.
+	 */
+	static bool findObject(CacheStore& level, const std::string& manifestKey, ManifestEntry& found, std::string& object) {
+		std::string manifest;
+		if (!level.get(manifestKey, "manifest", manifest)) {
+			return false;
+		}
+
+		for (auto& entry : decodeManifest(manifest)) {
+			bool matches = true;
+			for (auto& dependency : entry.dependencies) {
+				if (hashOf(dependency.first) != dependency.second) {
+					matches = false;
+					break;
+				}
+			}
+
+			if (matches && level.get(entry.objectKey, "o", object)) {
+				found = std::move(entry);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Adds `object` to `level` and makes `entry` the newest entry of its manifest.
+	 */
+	static void addObject(CacheStore& level, const std::string& manifestKey, const ManifestEntry& entry, const std::string& object) {
+		if (level.isReadOnly()) {
+			return;
+		}
+		level.put(entry.objectKey, "o", object);
+
+		// Concurrent builds may each add an entry here and only one of them is kept, which costs at most a
+		// later miss.
+		std::string manifest;
+		std::vector<ManifestEntry> entries;
+		if (level.get(manifestKey, "manifest", manifest)) {
+			entries = decodeManifest(manifest);
+		}
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (it->objectKey == entry.objectKey) {
+				entries.erase(it);
+				break;
+			}
+		}
+		entries.insert(entries.begin(), entry);
+		if (entries.size() > MAX_MANIFEST_ENTRIES) {
+			entries.resize(MAX_MANIFEST_ENTRIES);
+		}
+		level.put(manifestKey, "manifest", encodeManifest(entries));
+	}
+
+public:
+	/**
+	 * The local level is enabled by `--cache[=<dir>]` or `CRADLE_CACHE_DIR`. Without a directory it uses the
+	 * one from @ref cradle::detail::defaultCacheDir. Its size is limited by `--cache-size` or
+	 * `CRADLE_CACHE_SIZE` (e.g. `10G`) and defaults to @ref DEFAULT_CACHE_SIZE.
+	 *
+	 * The shared level is enabled by `--shared-cache=<dir>` or `CRADLE_SHARED_CACHE_DIR`. Its size is limited
+	 * by `--shared-cache-size` or `CRADLE_SHARED_CACHE_SIZE` and defaults to @ref DEFAULT_SHARED_CACHE_SIZE.
+	 * It is only read from with `--shared-cache-read-only` or if `CRADLE_SHARED_CACHE_READ_ONLY` is set.
+	 */
+	CompileCache() {
+		if (options().has("cache") || std::getenv(CACHE_DIR_ENV_VAR.c_str()) != nullptr) {
+			std::string dir = options().get("cache");
+			if (dir.empty()) {
+				dir = cradle::detail::defaultCacheDir();
+			}
+			uint64_t size = cradle::detail::parseSize(getEnvOrOption("cache-size", CACHE_SIZE_ENV_VAR), DEFAULT_CACHE_SIZE);
+			levels.emplace_back(new CacheStore(dir, size));
+		}
+
+		std::string sharedDir = getEnvOrOption("shared-cache", SHARED_CACHE_DIR_ENV_VAR);
+		if (!sharedDir.empty()) {
+			uint64_t size = cradle::detail::parseSize(getEnvOrOption("shared-cache-size", SHARED_CACHE_SIZE_ENV_VAR), DEFAULT_SHARED_CACHE_SIZE);
+			bool readOnly = options().has("shared-cache-read-only") || std::getenv(SHARED_CACHE_READ_ONLY_ENV_VAR.c_str()) != nullptr;
+			levels.emplace_back(new CacheStore(sharedDir, size, readOnly));
+		}
+	}
+
+	~CompileCache() {
+		for (auto& level : levels) {
+			CacheStats run = level->flush();
+			if (options().has("cache-stats")) {
+				log("Cache " + level->directory() + (level->isReadOnly() ? " (read-only):" : ":"));
+				log("\tThis run: " + run.describe());
+				log("\tAll runs: " + level->totalStats().describe());
+			}
+		}
+	}
+
+	bool isEnabled() const {
+		return !levels.empty();
+	}
+
+	/**
+	 * @param command The compile command generated for @ref CACHE_OUTPUT_PLACEHOLDER.
+	 * @return The key of the manifest for compiling `source` with `command`, or an empty string if `source`
+	 *         can't be read.
+	 */
+	std::string manifestKey(Toolchain& toolchain, const std::string& command, const std::string& source) {
+		uint64_t sourceHash = hashOf(source);
+		if (sourceHash == 0) {
+			return "";
+		}
+		return cradle::detail::cacheKey(toolchain.compilerIdentity() + '\0' + command + '\0' + std::to_string(sourceHash));
+	}
+
+	/**
+	 * Writes the cached object for `manifestKey` to `outputFile` if its headers are unchanged.
+	 *
+	 * @param dependencies Set to the source and headers the object was compiled from on success.
+	 * @return False on a cache miss.
+	 */
+	bool fetch(const std::string& manifestKey, const std::string& outputFile, std::vector<std::string>& dependencies) {
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			ManifestEntry entry;
+			std::string object;
+			if (!findObject(*levels[i], manifestKey, entry, object)) {
+				continue;
+			}
+
+			levels[i]->count(true);
+			for (std::size_t j = 0; j < i; j++) {
+				levels[j]->count(false);
+				addObject(*levels[j], manifestKey, entry, object);
+			}
+
+			if (!io::write_file(outputFile, object)) {
+				return false;
+			}
+			dependencies.clear();
+			for (auto& dependency : entry.dependencies) {
+				dependencies.push_back(dependency.first);
+			}
+			return true;
+		}
+
+		for (auto& level : levels) {
+			level->count(false);
+		}
+		return false;
+	}
+
+	/**
+	 * Stores the object just compiled into `outputFile` from `dependencies`.
+	 */
+	void store(const std::string& manifestKey, const std::string& outputFile, const std::vector<std::string>& dependencies) {
+		ManifestEntry entry;
+		std::string material = manifestKey;
+		for (auto& dependency : dependencies) {
+			uint64_t hash = hashOf(dependency);
+			if (hash == 0) {
+				// Can't tell later whether this dependency changed.
+				return;
+			}
+			entry.dependencies.push_back(std::make_pair(dependency, hash));
+			material += '\0' + dependency + '\0' + std::to_string(hash);
+		}
+		entry.objectKey = cradle::detail::cacheKey(material);
+
+		std::string object;
+		if (!io::read_file(outputFile, object)) {
+			return;
+		}
+		for (auto& level : levels) {
+			addObject(*level, manifestKey, entry, object);
+		}
+	}
+
+	/**
+	 * @param command The archive command generated for @ref CACHE_OUTPUT_PLACEHOLDER.
+	 * @return The key of the archive built by `command` from `objectFiles`, or an empty string if one of them
+	 *         can't be read.
+	 */
+	std::string archiveKey(const std::string& command, const std::vector<std::string>& objectFiles) {
+		std::string material = command;
+		for (auto& objectFile : objectFiles) {
+			uint64_t hash = hashOf(objectFile);
+			if (hash == 0) {
+				return "";
+			}
+			material += '\0' + std::to_string(hash);
+		}
+		return cradle::detail::cacheKey(material);
+	}
+
+	/**
+	 * Writes the cached archive for `archiveKey` to `outputFile`.
+	 *
+	 * @return False on a cache miss.
+	 */
+	bool fetchArchive(const std::string& archiveKey, const std::string& outputFile) {
+		std::string archive;
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			if (!levels[i]->get(archiveKey, "a", archive)) {
+				continue;
+			}
+
+			levels[i]->count(true);
+			for (std::size_t j = 0; j < i; j++) {
+				levels[j]->count(false);
+				levels[j]->put(archiveKey, "a", archive);
+			}
+			return io::write_file(outputFile, archive);
+		}
+
+		for (auto& level : levels) {
+			level->count(false);
+		}
+		return false;
+	}
+
+	/**
+	 * Stores the archive just built into `outputFile`.
+	 */
+	void storeArchive(const std::string& archiveKey, const std::string& outputFile) {
+		std::string archive;
+		if (!io::read_file(outputFile, archive)) {
+			return;
+		}
+		for (auto& level : levels) {
+			level->put(archiveKey, "a", archive);
+		}
+	}
+};
+
+const std::size_t CompileCache::MAX_MANIFEST_ENTRIES;
+
+/**
+ * @return The compile cache shared by every task in this run. It is configured on first use.
+ */
+CompileCache& compileCache() {
+	static CompileCache instance;
+	return instance;
+}
+
+} // namespace cpp
+} // namespace cradle
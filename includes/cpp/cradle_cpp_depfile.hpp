@@ -0,0 +1,108 @@
+/**
+ * @file cradle_cpp_depfile.hpp
+ *
+ * @brief Parsers for the header dependency files emitted by compilers.
+ */
+
+#pragma once
+
+#include <io/cradle_json.hpp>
+
+#include <string>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+namespace detail {
+
+/**
+ * Parses a Makefile-style dependency file as written by `-MMD -MF` (GCC and Clang).
+ *
+ * @return The prerequisites of every rule in the file (i.e. the source file and the headers it includes)
+ *         in the order they appear.
+ */
+std::vector<std::string> parseMakeDepFile(const std::string& contents) {
+	std::vector<std::string> deps;
+	std::string word;
+
+	auto endWord = [&] () {
+		if (word.empty()) {
+			return;
+		}
+
+		if (word == ":") {
+			// The previous word was a target separated from its colon by whitespace.
+			if (!deps.empty()) {
+				deps.pop_back();
+			}
+		} else if (word.back() == ':') {
+			// Targets are not dependencies.
+		} else {
+			deps.push_back(word);
+		}
+		word.clear();
+	};
+
+	for (std::size_t i = 0; i < contents.size(); i++) {
+		char c = contents[i];
+
+		if (c == '\\' && i + 1 < contents.size()) {
+			char next = contents[i + 1];
+			if (next == '\n') {
+				// Line continuation.
+				endWord();
+				i++;
+				continue;
+			}
+			if (next == '\r' && i + 2 < contents.size() && contents[i + 2] == '\n') {
+				endWord();
+				i += 2;
+				continue;
+			}
+			if (next == ' ' || next == '#' || next == '\\') {
+				word += next;
+				i++;
+				continue;
+			}
+		}
+
+		if (c == '$' && i + 1 < contents.size() && contents[i + 1] == '$') {
+			word += '$';
+			i++;
+			continue;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			endWord();
+			continue;
+		}
+
+		word += c;
+	}
+	endWord();
+
+	return deps;
+}
+
+/**
+ * Parses the JSON file written by MSVC's `/sourceDependencies`.
+ *
+ * @return The source file followed by the headers it includes.
+ */
+std::vector<std::string> parseMsvcSourceDependencies(const std::string& contents) {
+	json::Value root = json::parse(contents);
+	const json::Value& data = root["Data"];
+
+	std::vector<std::string> deps;
+	if (data["Source"].isString()) {
+		deps.push_back(data["Source"].asString());
+	}
+	for (auto& include : data["Includes"].asArray()) {
+		deps.push_back(include.asString());
+	}
+	return deps;
+}
+
+} // namespace detail
+} // namespace cpp
+} // namespace cradle
@@ -0,0 +1,337 @@
+/**
+ * @file cradle_cpp_profile.hpp
+ *
+ * @brief Collects the time compilers report spending on each translation unit and sums it up over a build.
+ *
+ * Clang's `-ftime-trace` reports how long every header took to parse and every template took to
+ * instantiate. GCC's `-ftime-report` and MSVC's `/Bt+` only report the time spent in each phase of the
+ * compiler. The report lists the slowest translation units, headers, template instantiations and phases
+ * so it is clear which headers to split up or precompile.
+ */
+
+#pragma once
+
+#include <cradle_main.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace cpp {
+
+static const std::string COMPILE_PROFILE_FILE = ".cradle_compile_profile.json";
+
+// The number of entries of each kind that are logged at the end of the build.
+static const std::size_t COMPILE_PROFILE_LOGGED = 10;
+
+/**
+ * Where the compiler spent its time on one translation unit. All times are in seconds.
+ */
+struct CompileProfile {
+	std::string source;
+	double seconds = 0;
+
+	// Time spent parsing each header, including the headers it includes.
+	std::map<std::string, double> headers;
+
+	// Time spent instantiating each template.
+	std::map<std::string, double> instantiations;
+
+	// Time spent in each phase or pass of the compiler.
+	std::map<std::string, double> phases;
+};
+
+namespace detail {
+
+/**
+ * Reads the trace written by Clang's `-ftime-trace` into `profile`.
+ *
+ * @return False if `contents` isn't a trace.
+ */
+bool parseClangTimeTrace(const std::string& contents, CompileProfile& profile) {
+	json::Value trace;
+	try {
+		trace = json::parse(contents);
+	} catch (const std::runtime_error&) {
+		return false;
+	}
+	if (!trace["traceEvents"].isArray()) {
+		return false;
+	}
+
+	for (auto& event : trace["traceEvents"].asArray()) {
+		const std::string& name = event["name"].asString();
+		const std::string& detail = event["args"]["detail"].asString();
+		double seconds = event["dur"].asNumber() / 1e6;
+
+		if (name == "Source") {
+			profile.headers[detail] += seconds;
+		} else if (name == "InstantiateClass" || name == "InstantiateFunction") {
+			profile.instantiations[detail] += seconds;
+		} else if (name == "Total ExecuteCompiler") {
+			profile.seconds = seconds;
+		} else if (name.compare(0, 6, "Total ") == 0) {
+			profile.phases[name.substr(6)] += seconds;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads the wall times from the table GCC prints with `-ftime-report` into `profile`, e.g.
+ *
+ *     phase parsing                      :   0.30 ( 70%)   0.13 ( 65%)   0.44 ( 68%)    32M ( 69%)
+ *
+ * @return False if `output` doesn't contain the table.
+ */
+bool parseGccTimeReport(const std::string& output, CompileProfile& profile) {
+	std::istringstream lines(output);
+	std::string line;
+	bool found = false;
+	while (std::getline(lines, line)) {
+		std::size_t colon = line.find(" : ");
+		if (colon == std::string::npos) {
+			continue;
+		}
+
+		std::size_t first = line.find_first_not_of(" |");
+		std::size_t last = line.find_last_not_of(' ', colon);
+		if (first == std::string::npos || first > last) {
+			continue;
+		}
+		std::string name = line.substr(first, last - first + 1);
+
+		// Columns are usr, sys and wall, each optionally followed by a percentage in parentheses.
+		std::istringstream columns(line.substr(colon + 3));
+		std::vector<double> times;
+		std::string column;
+		while (times.size() < 3 && columns >> column) {
+			if (column[0] == '(' || column.back() == ')' || column.back() == '%') {
+				continue;
+			}
+			char* end;
+			double value = std::strtod(column.c_str(), &end);
+			if (*end != '\0') {
+				break;
+			}
+			times.push_back(value);
+		}
+		if (times.size() < 3) {
+			continue;
+		}
+
+		found = true;
+		if (name == "TOTAL") {
+			profile.seconds = times[2];
+		} else {
+			profile.phases[name] += times[2];
+		}
+	}
+	return found;
+}
+
+/**
+ * Removes the table GCC prints with `-ftime-report`, from its `Time variable` heading to its `TOTAL` line,
+ * from `output`. Anything else the compiler printed, e.g. warnings, is kept.
+ */
+std::string stripGccTimeReport(const std::string& output) {
+	std::istringstream lines(output);
+	std::string line;
+	std::string stripped;
+	bool inReport = false;
+	while (std::getline(lines, line)) {
+		if (!inReport && line.compare(0, 13, "Time variable") == 0) {
+			inReport = true;
+			// The table is preceded by an empty line.
+			if (stripped.size() >= 2 && stripped.compare(stripped.size() - 2, 2, "\n\n") == 0) {
+				stripped.pop_back();
+			} else if (stripped == "\n") {
+				stripped.clear();
+			}
+		}
+		if (inReport) {
+			std::size_t first = line.find_first_not_of(' ');
+			if (first != std::string::npos && line.compare(first, 5, "TOTAL") == 0) {
+				inReport = false;
+			}
+			continue;
+		}
+		stripped += line;
+		if (!lines.eof()) {
+			stripped += '\n';
+		}
+	}
+	return stripped;
+}
+
+/**
+ * Reads the lines MSVC prints with `/Bt+`, e.g. `time(C:\...\c1xx.dll)=0.52s < ... > [main.cpp]`, into
+ * `profile`.
+ *
+ * @return False if `output` doesn't contain any.
+ */
+bool parseMsvcTimeReport(const std::string& output, CompileProfile& profile) {
+	static const std::vector<std::pair<std::string, std::string>> PHASES = {
+		{"c1xx.dll", "front end"},
+		{"c2.dll", "back end"}
+	};
+
+	bool found = false;
+	for (auto& phase : PHASES) {
+		std::size_t pos = output.find(phase.first + ")=");
+		if (pos == std::string::npos) {
+			continue;
+		}
+		double seconds = std::strtod(output.c_str() + pos + phase.first.size() + 2, nullptr);
+		profile.phases[phase.second] += seconds;
+		found = true;
+	}
+	return found;
+}
+
+/**
+ * Removes the lines MSVC prints with `/Bt+` from `output`.
+ */
+std::string stripMsvcTimeReport(const std::string& output) {
+	std::istringstream lines(output);
+	std::string line;
+	std::string stripped;
+	while (std::getline(lines, line)) {
+		if (line.compare(0, 5, "time(") == 0) {
+			continue;
+		}
+		stripped += line;
+		if (!lines.eof()) {
+			stripped += '\n';
+		}
+	}
+	return stripped;
+}
+
+} // namespace detail
+
+/**
+ * Sums up the profiles of the translation units compiled in this run. The report is logged and written to
+ * @ref COMPILE_PROFILE_FILE in @ref DEFAULT_BUILD_DIR when cradle exits.
+ */
+class CompileProfiler {
+	struct Total {
+		double seconds = 0;
+		std::size_t count = 0;
+	};
+
+	std::mutex mutex;
+	std::vector<std::pair<std::string, double>> units;
+	std::map<std::string, Total> headers;
+	std::map<std::string, Total> instantiations;
+	std::map<std::string, Total> phases;
+
+	static void addAll(std::map<std::string, Total>& totals, const std::map<std::string, double>& times) {
+		for (auto& time : times) {
+			Total& total = totals[time.first];
+			total.seconds += time.second;
+			total.count++;
+		}
+	}
+
+	static std::vector<std::pair<std::string, Total>> slowest(const std::map<std::string, Total>& totals) {
+		std::vector<std::pair<std::string, Total>> sorted(totals.begin(), totals.end());
+		std::stable_sort(sorted.begin(), sorted.end(), [] (const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+			return a.second.seconds > b.second.seconds;
+		});
+		return sorted;
+	}
+
+	static std::string seconds(double value) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%8.2fs", value);
+		return buffer;
+	}
+
+	static void logTotals(const std::string& title, const std::string& counted, const std::vector<std::pair<std::string, Total>>& sorted) {
+		if (sorted.empty()) {
+			return;
+		}
+		log(title);
+		for (std::size_t i = 0; i < sorted.size() && i < COMPILE_PROFILE_LOGGED; i++) {
+			log(seconds(sorted[i].second.seconds) + "  " + sorted[i].first + " (" + std::to_string(sorted[i].second.count) + " " + counted + ")");
+		}
+	}
+
+	static std::string toJson(const std::vector<std::pair<std::string, Total>>& sorted) {
+		std::string out = "[";
+		for (std::size_t i = 0; i < sorted.size(); i++) {
+			out += i == 0 ? "\n    " : ",\n    ";
+			out += "{\"name\": " + json::quote(sorted[i].first);
+			out += ", \"seconds\": " + std::to_string(sorted[i].second.seconds);
+			out += ", \"count\": " + std::to_string(sorted[i].second.count) + "}";
+		}
+		return out + (sorted.empty() ? "]" : "\n  ]");
+	}
+
+	void report() {
+		std::vector<std::pair<std::string, Total>> sortedUnits;
+		for (auto& unit : units) {
+			Total total;
+			total.seconds = unit.second;
+			total.count = 1;
+			sortedUnits.push_back(std::make_pair(unit.first, total));
+		}
+		std::stable_sort(sortedUnits.begin(), sortedUnits.end(), [] (const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+			return a.second.seconds > b.second.seconds;
+		});
+		auto sortedHeaders = slowest(headers);
+		auto sortedInstantiations = slowest(instantiations);
+		auto sortedPhases = slowest(phases);
+
+		log("Compile profile of " + std::to_string(units.size()) + " translation units:");
+		logTotals("Slowest translation units:", "compile", sortedUnits);
+		logTotals("Most expensive headers by total parse time:", "includes", sortedHeaders);
+		logTotals("Most expensive template instantiations:", "instantiations", sortedInstantiations);
+		logTotals("Time by compiler phase:", "units", sortedPhases);
+
+		std::string contents = "{\n  \"units\": " + toJson(sortedUnits);
+		contents += ",\n  \"headers\": " + toJson(sortedHeaders);
+		contents += ",\n  \"instantiations\": " + toJson(sortedInstantiations);
+		contents += ",\n  \"phases\": " + toJson(sortedPhases) + "\n}\n";
+
+		std::string file = io::path_concat(DEFAULT_BUILD_DIR, COMPILE_PROFILE_FILE);
+		if (io::write_file(file, contents)) {
+			log("Compile profile written to " + file);
+		} else {
+			log_error("Unable to write " + file);
+		}
+	}
+
+public:
+	~CompileProfiler() {
+		if (!units.empty()) {
+			report();
+		}
+	}
+
+	void add(const CompileProfile& profile) {
+		std::lock_guard<std::mutex> lock(mutex);
+		units.push_back(std::make_pair(profile.source, profile.seconds));
+		addAll(headers, profile.headers);
+		addAll(instantiations, profile.instantiations);
+		addAll(phases, profile.phases);
+	}
+};
+
+CompileProfiler& compileProfiler() {
+	static CompileProfiler instance;
+	return instance;
+}
+
+} // namespace cpp
+} // namespace cradle
@@ -6,11 +6,23 @@
 
 #pragma once
 
+#include <cradle_exec.hpp>
 #include <cradle_main.hpp>
+#include <cpp/cradle_cpp_depfile.hpp>
+#include <cpp/cradle_cpp_profile.hpp>
+#include <io/cradle_files.hpp>
 #include <platform/cradle_platform.hpp>
+#include <platform/cradle_platform_util.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace cradle {
 namespace cpp {
@@ -21,10 +33,27 @@ namespace detail {
 
 	static const std::string AR_ENV_VAR = "AR";
 	static const std::string CXX_ENV_VAR = "CXX";
+	static const std::string LINKER_ENV_VAR = "CRADLE_LINKER";
+
+	// Picks the fastest installed linker the compiler supports.
+	static const std::string AUTO_LINKER = "auto";
+
+	// Links with whatever the compiler driver uses by default.
+	static const std::string DRIVER_LINKER = "default";
+
+	// Commands longer than this pass their arguments through a response file. Windows limits command lines
+	// run through the shell to 8191 characters.
+#ifdef PLATFORM_WINDOWS
+	static const std::size_t RESPONSE_FILE_THRESHOLD = 8000;
+#else
+	static const std::size_t RESPONSE_FILE_THRESHOLD = 128 * 1024;
+#endif
 
 #ifdef PLATFORM_LINUX
 	static const std::string DEFAULT_AR = "ar";
 	static const std::string DEFAULT_CXX = "g++";
+#else
+	static const std::string DEFAULT_AR = "ar";
 #endif
 
 	std::string getEnvOrDefault(const std::string& envVar, const std::string& defaultValue) {
@@ -35,25 +64,104 @@ namespace detail {
 		return value;
 	}
 
-	std::string listToArgs(const std::string& prefix, const std::vector<std::string>& items) {
-		std::string cmdline = "";
-		for (auto i : items) {
-            cmdline += " " + prefix + "\"" + i + "\"";
+	/**
+	 * Appends ` <prefix>"<item>"` for each of `items` and a trailing space to `cmdline`. The space needed is
+	 * reserved up front so long lists, such as the objects of a large link, are appended in linear time.
+	 */
+	void appendArgs(std::string& cmdline, const std::string& prefix, const std::vector<std::string>& items) {
+		std::size_t size = cmdline.size() + 1;
+		for (auto& item : items) {
+			size += prefix.size() + item.size() + 3;
+		}
+		if (size > cmdline.capacity()) {
+			cmdline.reserve(std::max(size, 2 * cmdline.capacity()));
 		}
-		return cmdline + " ";
+
+		for (auto& item : items) {
+			cmdline += ' ';
+			cmdline += prefix;
+			cmdline += '"';
+			cmdline += item;
+			cmdline += '"';
+		}
+		cmdline += ' ';
+	}
+
+	void appendArgs(std::string& cmdline, const std::vector<std::string>& items) {
+		appendArgs(cmdline, "", items);
+	}
+
+	std::string listToArgs(const std::string& prefix, const std::vector<std::string>& items) {
+		std::string cmdline;
+		appendArgs(cmdline, prefix, items);
+		return cmdline;
 	}
 
 	std::string listToArgs(const std::vector<std::string>& items) {
 		return listToArgs("", items);
 	}
 
+	bool isInstalled(const std::string& program) {
+		if (program.find('/') != std::string::npos || program.find('\\') != std::string::npos) {
+			return io::exists(program);
+		}
+		return !platform::platform_which(program).empty();
+	}
+
+	/**
+	 * @return The archiver that goes with `compiler` and understands LTO objects, e.g. `gcc-ar-12` for
+	 *         `g++-12` or `llvm-ar` for `clang++`, if it is installed. Otherwise `ar`.
+	 */
+	std::string defaultArchiver(const std::string& compiler) {
+		static const std::vector<std::pair<std::string, std::string>> ARCHIVERS = {
+			{"clang++", "llvm-ar"},
+			{"clang", "llvm-ar"},
+			{"g++", "gcc-ar"},
+			{"gcc", "gcc-ar"},
+			{"c++", "gcc-ar"}
+		};
+
+		// Keep any directory, target prefix and version suffix, e.g. /usr/bin/x86_64-linux-gnu-g++-12.
+		std::string name = io::path_filename(compiler);
+		std::string dir = compiler.substr(0, compiler.size() - name.size());
+		for (auto& archiver : ARCHIVERS) {
+			std::size_t pos = name.find(archiver.first);
+			if (pos == std::string::npos) {
+				continue;
+			}
+
+			std::string candidate = dir + name.substr(0, pos) + archiver.second + name.substr(pos + archiver.first.size());
+			if (isInstalled(candidate)) {
+				return candidate;
+			}
+			if (isInstalled(archiver.second)) {
+				return archiver.second;
+			}
+			break;
+		}
+		return DEFAULT_AR;
+	}
+
 } // detail
 
+/**
+ * Link time optimization. `FULL` optimizes the whole program as a single module. `THIN` (ThinLTO) optimizes
+ * modules in parallel with summaries of the whole program and caches the results between links. Compilers
+ * without ThinLTO use their own parallel LTO for both.
+ */
+enum class LtoMode {
+	NONE,
+	FULL,
+	THIN
+};
+
 class Toolchain {
 protected:
 	std::vector<std::string> compileFlags;
 	std::vector<std::string> linkFlags;
 	std::vector<std::string> staticLibFlags;
+	std::size_t responseFileLength = detail::RESPONSE_FILE_THRESHOLD;
+	bool profilingCompile = false;
 
 public:
 	virtual ~Toolchain() {}
@@ -70,8 +178,60 @@ public:
 		staticLibFlags.insert(staticLibFlags.end(), flags.begin(), flags.end());
 	}
 
+	/**
+	 * Commands from this toolchain that are longer than `length` are run with their arguments in a response
+	 * file. See @ref responseFileContents.
+	 */
+	void setResponseFileThreshold(std::size_t length) {
+		responseFileLength = length;
+	}
+
+	std::size_t responseFileThreshold() const {
+		return responseFileLength;
+	}
+
+	/**
+	 * Makes `compileObjectCmd` ask the compiler to report where it spends its time, which is collected with
+	 * `readCompileProfile`. Objects are recompiled when this changes.
+	 */
+	void profileCompile(bool enabled) {
+		profilingCompile = enabled;
+	}
+
+	bool isProfilingCompile() const {
+		return profilingCompile;
+	}
+
+	/**
+	 * Moves the arguments of a command from this toolchain into a response file.
+	 *
+	 * @param args     The arguments of the command, starting with the program. Replaced by the arguments
+	 *                 that read the rest from `responseFile`.
+	 * @param contents Set to what must be written to `responseFile`.
+	 * @return False if the program doesn't read response files.
+	 */
+	virtual bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) = 0;
+
 	virtual std::string objectFileNameFromBase(const std::string& base) = 0;
 	virtual std::string staticLibNameFromBase(const std::string& base) = 0;
+	virtual std::string sharedLibNameFromBase(const std::string& base) = 0;
+
+	/**
+	 * @return The path of the file listing the headers included by the source compiled into `objectFile`.
+	 *         It is written by the command returned from `compileObjectCmd`.
+	 */
+	virtual std::string depFileNameFromObject(const std::string& objectFile) = 0;
+
+	/**
+	 * @return The source file and headers listed in the contents of a dependency file.
+	 */
+	virtual std::vector<std::string> parseDepFile(const std::string& contents) = 0;
+
+	/**
+	 * @return A description of the compiler and its version. Objects are only reused from the compile cache
+	 *         when this matches.
+	 */
+	virtual std::string compilerIdentity() = 0;
 
 	virtual std::string compileObjectCmd(
 		std::string outputFilePath,
@@ -80,6 +240,70 @@ public:
 		std::vector<std::string> flags = std::vector<std::string>()
 	) = 0;
 
+	/**
+	 * Adds what the compiler reported about compiling `objectFile` with profiling enabled to `profile`.
+	 *
+	 * @param result The result of the command from `compileObjectCmd`.
+	 * @return False if the compiler reported nothing.
+	 */
+	virtual bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) = 0;
+
+	/**
+	 * Removes what the compiler reports for `readCompileProfile` from the output of a command before it is
+	 * printed, so that profiled builds don't print a report for every translation unit.
+	 */
+	virtual void stripCompileProfile(std::string& output, std::string& errors) = 0;
+
+	/**
+	 * @return The path of the precompiled header built from the header `base`.
+	 */
+	virtual std::string precompiledHeaderNameFromBase(const std::string& base) = 0;
+
+	/**
+	 * Headers are precompiled from a generated file that includes them, so that the header isn't compiled as
+	 * the main file and the file can be named after the precompiled header.
+	 *
+	 * @param headerFile The absolute path of the header.
+	 * @param contents   Set to the contents of the generated file.
+	 * @return The path the file must be written to before running `compilePrecompiledHeaderCmd`.
+	 */
+	virtual std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) = 0;
+
+	/**
+	 * @return The command that precompiles `headerFile`, through the file from `precompiledHeaderSource`, into
+	 *         `outputFilePath`. Like `compileObjectCmd` it also writes the dependency file
+	 *         `depFileNameFromObject(outputFilePath)`.
+	 */
+	virtual std::string compilePrecompiledHeaderCmd(
+		std::string outputFilePath,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * @return The flags to pass to `compileObjectCmd` to include the precompiled header `precompiledHeaderFile`
+	 *         built from `headerFile` at the start of the source.
+	 */
+	virtual std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) = 0;
+
+	/**
+	 * @return An object file written by `compilePrecompiledHeaderCmd` that must be linked along with the objects
+	 *         compiled with the precompiled header, or an empty string if there is none.
+	 */
+	virtual std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) = 0;
+
 	virtual std::string linkExeCmd(
 		std::string outputFilePath,
 		std::vector<std::string> objectFiles,
@@ -95,19 +319,162 @@ public:
 		std::vector<std::string> flags = std::vector<std::string>()
 	) = 0;
 
+	/**
+	 * @param visibility The default visibility of symbols, e.g. `hidden` to only export symbols marked as
+	 *                   exported, or an empty string for the compiler's default.
+	 * @return The flags to compile the objects of a shared library with.
+	 */
+	virtual std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) = 0;
+
+	/**
+	 * @param soname The name the library is loaded by at runtime, if the platform has one.
+	 */
+	virtual std::string linkSharedLibCmd(
+		std::string outputFilePath,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags = std::vector<std::string>()
+	) = 0;
+
+	/**
+	 * Describes what a shared library exports to the programs linked against it. Programs only need to be
+	 * relinked when this changes.
+	 *
+	 * @return False if the interface can't be determined.
+	 */
+	virtual bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) = 0;
+
+	/**
+	 * @return The name of the linker used by `linkExeCmd` and `linkSharedLibCmd`, for reports.
+	 */
+	virtual std::string linkerName() = 0;
+
+	/**
+	 * @return The flags to compile objects for link time optimization with.
+	 */
+	virtual std::vector<std::string> ltoCompileFlags(LtoMode mode) = 0;
+
+	/**
+	 * @param jobs     The number of modules to optimize and generate code for in parallel, or 0 for one per CPU.
+	 * @param cacheDir Where ThinLTO keeps optimized modules between links.
+	 * @return The flags to link objects compiled with `ltoCompileFlags(mode)` with.
+	 */
+	virtual std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) = 0;
+
+	/**
+	 * @param dirs Absolute paths of directories holding shared libraries.
+	 * @return The link flags to find shared libraries in `dirs` when the program runs.
+	 */
+	virtual std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) = 0;
+
 	static std::shared_ptr<Toolchain> platformDefault();
 };
 
 class GccClangCompatibleToolchain : public Toolchain {
 	std::string archiver;
 	std::string compiler;
+	std::string linker;
+
+	std::once_flag identityFlag;
+	std::string identity;
+
+	std::once_flag linkerFlag;
+	std::string selectedLinker;
+
+	/**
+	 * @return True if the compiler driver can link with `-fuse-ld=<name>`.
+	 */
+	bool supportsLinker(const std::string& name) {
+		std::string executable = name == "mold" ? "mold" : "ld." + name;
+		if (!detail::isInstalled(executable)) {
+			return false;
+		}
+		std::string version;
+		return capture(compiler + " -fuse-ld=" + name + " -Wl,--version", version);
+	}
+
+	/**
+	 * @return The linker to pass to `-fuse-ld`, or an empty string for the driver's default.
+	 */
+	std::string selectLinker() {
+		std::call_once(linkerFlag, [this] () {
+			if (linker != detail::AUTO_LINKER) {
+				selectedLinker = linker == detail::DRIVER_LINKER ? "" : linker;
+				return;
+			}
+			for (auto& candidate : {"mold", "lld", "gold"}) {
+				if (supportsLinker(candidate)) {
+					selectedLinker = candidate;
+					return;
+				}
+			}
+		});
+		return selectedLinker;
+	}
+
+	std::string useLinkerArg() {
+		std::string selected = selectLinker();
+		return selected.empty() ? "" : " -fuse-ld=" + selected;
+	}
 
 public:
-	GccClangCompatibleToolchain(std::string archiver, std::string compiler) :
+	/**
+	 * @param linker The linker to use through `-fuse-ld`, e.g. `lld`, `mold`, `gold` or `bfd`. `auto` picks
+	 *               the first of mold, lld and gold that is installed and supported by the compiler, and
+	 *               `default` leaves the choice to the compiler.
+	 */
+	GccClangCompatibleToolchain(std::string archiver, std::string compiler, std::string linker = detail::AUTO_LINKER) :
 		archiver(archiver),
-		compiler(compiler)
+		compiler(compiler),
+		linker(linker)
 	{}
 
+	std::string linkerName() override {
+		std::string selected = selectLinker();
+		return selected.empty() ? detail::DRIVER_LINKER : selected;
+	}
+
+	bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) override {
+		// gcc-ar puts its plugin options before the arguments, so ar only finds its operation if it is
+		// given directly.
+		std::size_t keep = 1;
+		if (args[0] == archiver) {
+			auto operation = std::find(args.begin(), args.end(), "rcs");
+			keep = operation == args.end() ? args.size() : operation - args.begin() + 1;
+		}
+		if (keep >= args.size()) {
+			return false;
+		}
+
+		std::size_t size = 0;
+		for (std::size_t i = keep; i < args.size(); i++) {
+			size += 2 * args[i].size() + 3;
+		}
+
+		// GCC, clang and binutils split response files at whitespace after removing the backslash before any
+		// character, so escaping every special character works for all of them.
+		contents.clear();
+		contents.reserve(size);
+		for (std::size_t i = keep; i < args.size(); i++) {
+			if (args[i].empty()) {
+				contents += "\"\"";
+			}
+			for (char c : args[i]) {
+				if (std::strchr(" \t\n\r\f\v\\\"'", c) != nullptr) {
+					contents += '\\';
+				}
+				contents += c;
+			}
+			contents += '\n';
+		}
+
+		args.resize(keep);
+		args.push_back("@" + responseFile);
+		return true;
+	}
+
 	std::string objectFileNameFromBase(const std::string& base) override {
 		return base + ".o";
 	}
@@ -116,6 +483,27 @@ public:
 		return "lib" + base + ".a";
 	}
 
+	std::string sharedLibNameFromBase(const std::string& base) override {
+		return "lib" + base + ".so";
+	}
+
+	std::string depFileNameFromObject(const std::string& objectFile) override {
+		return objectFile + ".d";
+	}
+
+	std::vector<std::string> parseDepFile(const std::string& contents) override {
+		return detail::parseMakeDepFile(contents);
+	}
+
+	std::string compilerIdentity() override {
+		std::call_once(identityFlag, [this] () {
+			std::string version;
+			capture(compiler + " --version", version);
+			identity = compiler + "\n" + version;
+		});
+		return identity;
+	}
+
 	std::string compileObjectCmd(
 		std::string outputFileName,
 		std::string inputFileName,
@@ -123,15 +511,86 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = compiler;
-		cmdline += detail::listToArgs(compileFlags);
-		cmdline += detail::listToArgs(flags);
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		if (profilingCompile) {
+			cmdline += isClang() ? " -ftime-trace" : " -ftime-report";
+		}
 		cmdline += " -c ";
 		cmdline += inputFileName;
-		cmdline += detail::listToArgs("-I", includeSearchDirs);
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		cmdline += " -MMD -MF \"" + depFileNameFromObject(outputFileName) + "\"";
 		cmdline += " -o " + outputFileName;
 		return cmdline;
 	}
 
+	bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) override {
+		if (!isClang()) {
+			return detail::parseGccTimeReport(result.errors, profile);
+		}
+
+		// Clang names the trace after the object, e.g. `main.cpp.json` for `main.cpp.o`.
+		std::string traceFile = objectFile.substr(0, objectFile.size() - std::string(".o").size()) + ".json";
+		std::string contents;
+		return io::read_file(traceFile, contents) && detail::parseClangTimeTrace(contents, profile);
+	}
+
+	void stripCompileProfile(std::string& output, std::string& errors) override {
+		// Clang writes its trace to a file.
+		if (profilingCompile && !isClang()) {
+			errors = detail::stripGccTimeReport(errors);
+		}
+	}
+
+	std::string precompiledHeaderNameFromBase(const std::string& base) override {
+		return base + ".gch";
+	}
+
+	std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) override {
+		contents = "#include \"" + headerFile + "\"\n";
+		return precompiledHeaderFile.substr(0, precompiledHeaderFile.size() - std::string(".gch").size());
+	}
+
+	std::string compilePrecompiledHeaderCmd(
+		std::string outputFileName,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string contents;
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " -x c++-header ";
+		cmdline += precompiledHeaderSource(outputFileName, headerFile, contents);
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		cmdline += " -MMD -MF \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " -o " + outputFileName;
+		return cmdline;
+	}
+
+	std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) override {
+		// The compiler looks for `<name>.gch` before `<name>` when including `<name>`. -Winvalid-pch reports a
+		// precompiled header that doesn't match the flags instead of silently parsing the header again.
+		std::string contents;
+		return {"-Winvalid-pch", "-include", precompiledHeaderSource(precompiledHeaderFile, headerFile, contents)};
+	}
+
+	std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) override {
+		return "";
+	}
+
 	std::string linkExeCmd(
 		std::string outputFileName,
 		std::vector<std::string> objectFiles,
@@ -141,12 +600,13 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = compiler;
-		cmdline += detail::listToArgs("-I", includeSearchDirs);
-		cmdline += detail::listToArgs("-L", librarySearchPaths);
-		cmdline += detail::listToArgs(objectFiles);
-		cmdline += detail::listToArgs("-l", linkLibraryNames);
-		cmdline += detail::listToArgs(linkFlags);
-		cmdline += detail::listToArgs(flags);
+		cmdline += useLinkerArg();
+		detail::appendArgs(cmdline, "-I", includeSearchDirs);
+		detail::appendArgs(cmdline, "-L", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+		detail::appendArgs(cmdline, "-l", linkLibraryNames);
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
 		cmdline += " -o " + outputFileName;
 		return cmdline;
 	}
@@ -157,12 +617,123 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = archiver;
-		cmdline += detail::listToArgs(staticLibFlags);
+		detail::appendArgs(cmdline, staticLibFlags);
 		cmdline += " rcs ";
 		cmdline += outputFileName;
-		cmdline += detail::listToArgs(objectFiles);
+		detail::appendArgs(cmdline, objectFiles);
+		return cmdline;
+	}
+
+	std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) override {
+		std::vector<std::string> flags = {"-fPIC"};
+		if (!visibility.empty()) {
+			flags.push_back("-fvisibility=" + visibility);
+			if (visibility == "hidden") {
+				flags.push_back("-fvisibility-inlines-hidden");
+			}
+		}
+		return flags;
+	}
+
+	std::string linkSharedLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags
+	) override {
+		std::string cmdline = compiler;
+		cmdline += useLinkerArg();
+		cmdline += " -shared";
+		if (!soname.empty()) {
+			cmdline += " \"-Wl,-soname," + soname + "\"";
+		}
+		detail::appendArgs(cmdline, "-L", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+		detail::appendArgs(cmdline, "-l", linkLibraryNames);
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " -o " + outputFileName;
 		return cmdline;
 	}
+
+	bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) override {
+		// The name and type of every exported symbol, leaving out addresses and sizes, which change with
+		// the implementation.
+		std::string symbols;
+		if (!capture("nm --format=posix --dynamic --defined-only \"" + sharedLibFile + "\"", symbols)) {
+			return false;
+		}
+
+		std::istringstream lines(symbols);
+		std::vector<std::string> exported;
+		std::string name;
+		std::string type;
+		std::string rest;
+		while (lines >> name >> type && std::getline(lines, rest)) {
+			exported.push_back(name + " " + type);
+		}
+		std::sort(exported.begin(), exported.end());
+
+		interface.clear();
+		for (auto& symbol : exported) {
+			interface += symbol + "\n";
+		}
+		return true;
+	}
+
+	std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) override {
+		std::vector<std::string> flags;
+		for (auto& dir : dirs) {
+			flags.push_back("-Wl,-rpath," + dir);
+		}
+		return flags;
+	}
+
+	bool isClang() {
+		return compilerIdentity().find("clang") != std::string::npos;
+	}
+
+	std::vector<std::string> ltoCompileFlags(LtoMode mode) override {
+		switch (mode) {
+		case LtoMode::NONE: return {};
+		case LtoMode::FULL: return {"-flto"};
+		case LtoMode::THIN: return {isClang() ? "-flto=thin" : "-flto"};
+		}
+		return {};
+	}
+
+	std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) override {
+		if (mode == LtoMode::NONE) {
+			return {};
+		}
+		std::string jobCount = jobs > 0 ? std::to_string(jobs) : std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+
+		if (!isClang()) {
+			// GCC partitions the program and optimizes the partitions in parallel in either mode.
+			return {"-flto=" + jobCount};
+		}
+		if (mode == LtoMode::FULL) {
+			return {"-flto"};
+		}
+
+		// The driver passes the job count on in whatever form the linker expects, but the cache is only
+		// configured through linker options. lld has its own, while BFD, gold and mold load LLVM's plugin.
+		std::vector<std::string> flags = {"-flto=thin", "-flto-jobs=" + jobCount};
+		std::string cachePolicy = "prune_after=168h:cache_size_bytes=4g";
+		std::string selected = selectLinker();
+		if (selected == "lld") {
+			flags.push_back("-Wl,--thinlto-cache-dir=" + cacheDir);
+			flags.push_back("-Wl,--thinlto-cache-policy=" + cachePolicy);
+		} else if (selected.empty() && platform::os::is_mac()) {
+			flags.push_back("-Wl,-cache_path_lto," + cacheDir);
+		} else {
+			flags.push_back("-Wl,-plugin-opt,cache-dir=" + cacheDir);
+			flags.push_back("-Wl,-plugin-opt,cache-policy=" + cachePolicy);
+		}
+		return flags;
+	}
 };
 
 
@@ -171,6 +742,9 @@ class MSVCToolchain : public Toolchain {
 	std::string compiler;
     std::string linker;
 
+	std::once_flag identityFlag;
+	std::string identity;
+
 public:
     MSVCToolchain() :
         archiver("lib"),
@@ -186,6 +760,28 @@ public:
 		return base + ".lib";
 	}
 
+	std::string sharedLibNameFromBase(const std::string& base) override {
+		return base + ".dll";
+	}
+
+	std::string depFileNameFromObject(const std::string& objectFile) override {
+		return objectFile + ".json";
+	}
+
+	std::vector<std::string> parseDepFile(const std::string& contents) override {
+		return detail::parseMsvcSourceDependencies(contents);
+	}
+
+	std::string compilerIdentity() override {
+		std::call_once(identityFlag, [this] () {
+			// cl prints its version and target architecture to stderr when run without arguments.
+			std::string banner;
+			capture(compiler + " 2>&1", banner);
+			identity = compiler + "\n" + banner;
+		});
+		return identity;
+	}
+
 	std::string compileObjectCmd(
 		std::string outputFileName,
 		std::string inputFileName,
@@ -193,15 +789,77 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = compiler;
-		cmdline += detail::listToArgs(compileFlags);
-		cmdline += detail::listToArgs(flags);
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		if (profilingCompile) {
+			cmdline += " /Bt+";
+		}
 		cmdline += " /c ";
 		cmdline += inputFileName;
-		cmdline += detail::listToArgs("/I", includeSearchDirs);
+		detail::appendArgs(cmdline, "/I", includeSearchDirs);
+		cmdline += " /sourceDependencies \"" + depFileNameFromObject(outputFileName) + "\"";
 		cmdline += " /Fo" + outputFileName;
 		return cmdline;
 	}
 
+	bool readCompileProfile(
+		const std::string& objectFile,
+		const platform::ProcessResult& result,
+		CompileProfile& profile
+	) override {
+		return detail::parseMsvcTimeReport(result.output + result.errors, profile);
+	}
+
+	void stripCompileProfile(std::string& output, std::string& errors) override {
+		if (profilingCompile) {
+			output = detail::stripMsvcTimeReport(output);
+			errors = detail::stripMsvcTimeReport(errors);
+		}
+	}
+
+	std::string precompiledHeaderNameFromBase(const std::string& base) override {
+		return base + ".pch";
+	}
+
+	std::string precompiledHeaderSource(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile,
+		std::string& contents
+	) override {
+		contents = "#include \"" + headerFile + "\"\n";
+		return precompiledHeaderFile + ".cpp";
+	}
+
+	std::string compilePrecompiledHeaderCmd(
+		std::string outputFileName,
+		std::string headerFile,
+		std::vector<std::string> includeSearchDirs,
+		std::vector<std::string> flags
+	) override {
+		std::string contents;
+		std::string cmdline = compiler;
+		detail::appendArgs(cmdline, compileFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " /c ";
+		cmdline += precompiledHeaderSource(outputFileName, headerFile, contents);
+		detail::appendArgs(cmdline, "/I", includeSearchDirs);
+		cmdline += " /Yc\"" + headerFile + "\" /Fp\"" + outputFileName + "\"";
+		cmdline += " /sourceDependencies \"" + depFileNameFromObject(outputFileName) + "\"";
+		cmdline += " /Fo" + precompiledHeaderObject(outputFileName);
+		return cmdline;
+	}
+
+	std::vector<std::string> usePrecompiledHeaderFlags(
+		const std::string& precompiledHeaderFile,
+		const std::string& headerFile
+	) override {
+		return {"/FI" + headerFile, "/Yu" + headerFile, "/Fp" + precompiledHeaderFile};
+	}
+
+	std::string precompiledHeaderObject(const std::string& precompiledHeaderFile) override {
+		return precompiledHeaderFile + ".obj";
+	}
+
 	std::string linkExeCmd(
 		std::string outputFileName,
 		std::vector<std::string> objectFiles,
@@ -211,15 +869,15 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = linker;
-		cmdline += detail::listToArgs("/LIBPATH:", librarySearchPaths);
-		cmdline += detail::listToArgs(objectFiles);
+		detail::appendArgs(cmdline, "/LIBPATH:", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
 
 		for (auto name : linkLibraryNames) {
 			cmdline += " " + staticLibNameFromBase(name);
 		}
 
-		cmdline += detail::listToArgs(linkFlags);
-		cmdline += detail::listToArgs(flags);
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
         cmdline += " /OUT:" + outputFileName + ".exe";
 
 		return cmdline;
@@ -231,22 +889,112 @@ public:
 		std::vector<std::string> flags
 	) override {
 		std::string cmdline = archiver;
-		cmdline += detail::listToArgs(staticLibFlags);
-		cmdline += detail::listToArgs(flags);
+		detail::appendArgs(cmdline, staticLibFlags);
+		detail::appendArgs(cmdline, flags);
         cmdline += " ";
         cmdline += "/OUT:" + outputFileName;
-		cmdline += detail::listToArgs(objectFiles);
+		detail::appendArgs(cmdline, objectFiles);
+		return cmdline;
+	}
+
+	std::vector<std::string> sharedLibCompileFlags(const std::string& visibility) override {
+		// Symbols are only exported when marked with __declspec(dllexport).
+		return {};
+	}
+
+	std::string linkSharedLibCmd(
+		std::string outputFileName,
+		std::vector<std::string> objectFiles,
+		std::vector<std::string> linkLibraryNames,
+		std::vector<std::string> librarySearchPaths,
+		std::string soname,
+		std::vector<std::string> flags
+	) override {
+		// Programs link against the import library, which is named like a static library.
+		std::string base = outputFileName.substr(0, outputFileName.size() - std::string(".dll").size());
+
+		std::string cmdline = linker;
+		cmdline += " /DLL";
+		detail::appendArgs(cmdline, "/LIBPATH:", librarySearchPaths);
+		detail::appendArgs(cmdline, objectFiles);
+
+		for (auto name : linkLibraryNames) {
+			cmdline += " " + staticLibNameFromBase(name);
+		}
+
+		detail::appendArgs(cmdline, linkFlags);
+		detail::appendArgs(cmdline, flags);
+		cmdline += " /OUT:" + outputFileName;
+		cmdline += " /IMPLIB:" + base + ".lib";
 		return cmdline;
 	}
+
+	bool sharedLibInterface(const std::string& sharedLibFile, std::string& interface) override {
+		// The export listing includes addresses, so programs are relinked whenever the DLL is.
+		return false;
+	}
+
+	std::vector<std::string> runtimeSearchPathFlags(const std::vector<std::string>& dirs) override {
+		// DLLs are found next to the program or through PATH.
+		return {};
+	}
+
+	std::string linkerName() override {
+		return linker;
+	}
+
+	bool useResponseFile(std::vector<std::string>& args, const std::string& responseFile, std::string& contents) override {
+		// cl, link and lib read every argument from the file. They are quoted as on the command line, where
+		// backslashes are literal unless they precede a quote.
+		contents.clear();
+		for (std::size_t i = 1; i < args.size(); i++) {
+			contents += '"';
+			std::size_t backslashes = 0;
+			for (char c : args[i]) {
+				if (c == '\\') {
+					backslashes++;
+				} else {
+					if (c == '"') {
+						contents.append(backslashes + 1, '\\');
+					}
+					backslashes = 0;
+				}
+				contents += c;
+			}
+			contents.append(backslashes, '\\');
+			contents += "\"\n";
+		}
+
+		args.resize(1);
+		args.push_back("@" + responseFile);
+		return true;
+	}
+
+	std::vector<std::string> ltoCompileFlags(LtoMode mode) override {
+		return mode == LtoMode::NONE ? std::vector<std::string>() : std::vector<std::string>{"/GL"};
+	}
+
+	std::vector<std::string> ltoLinkFlags(LtoMode mode, unsigned jobs, const std::string& cacheDir) override {
+		// Incremental link time code generation is the closest thing to ThinLTO's cache. It keeps its state
+		// next to the output rather than in `cacheDir`.
+		switch (mode) {
+		case LtoMode::NONE: return {};
+		case LtoMode::FULL: return {"/LTCG"};
+		case LtoMode::THIN: return {"/LTCG:INCREMENTAL"};
+		}
+		return {};
+	}
 };
 
 std::shared_ptr<Toolchain> Toolchain::platformDefault() {
 	#ifdef PLATFORM_WINDOWS
         return std::make_shared<MSVCToolchain>();
 	#else
+		std::string compiler = detail::getEnvOrDefault(detail::CXX_ENV_VAR, detail::DEFAULT_CXX);
 		return std::make_shared<GccClangCompatibleToolchain>(
-			detail::getEnvOrDefault(detail::AR_ENV_VAR, detail::DEFAULT_AR),
-			detail::getEnvOrDefault(detail::CXX_ENV_VAR, detail::DEFAULT_CXX)
+			detail::getEnvOrDefault(detail::AR_ENV_VAR, detail::defaultArchiver(compiler)),
+			compiler,
+			detail::getEnvOrDefault(detail::LINKER_ENV_VAR, detail::AUTO_LINKER)
 		);
 	#endif
 }
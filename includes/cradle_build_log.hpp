@@ -0,0 +1,737 @@
+/**
+ * @file cradle_build_log.hpp
+ *
+ * @brief A persistent record of the command that produced each output and the inputs it read.
+ *
+ * The log is an append-only binary file under @ref DEFAULT_BUILD_DIR. It starts with a header (a magic
+ * string and a format version) followed by records that each start with a one byte type and a four
+ * byte payload length:
+ *
+ *  - `PATH` records hold a path. Paths are numbered in the order they appear.
+ *  - `ENTRY` records hold the id of an output path, the exact command that produced it and the id and
+ *    signature of every input. A later entry for the same output replaces earlier ones.
+ *  - `HASH` records hold the content hash of a path along with the signature it was computed for, so that
+ *    files are only rehashed when they change.
+ *
+ * Integers are written in native byte order; the version field doubles as a byte order check. Records
+ * after a truncated or unreadable one (e.g. from an interrupted write) are dropped, which only means that
+ * the affected outputs are rebuilt once.
+ */
+
+#pragma once
+
+#include <cradle_main.hpp>
+#include <cradle_string_table.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_hash.hpp>
+#include <io/cradle_stat.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+static const std::string BUILD_LOG_FILE = ".cradle_log";
+
+/**
+ * Identifies a version of a file. `hash` is the hash of its contents, or 0 if it wasn't computed, and is not
+ * part of the comparison.
+ */
+struct FileSignature {
+	int64_t mtime;
+	uint64_t size;
+	uint64_t inode;
+	uint64_t hash;
+
+	bool operator==(const FileSignature& other) const {
+		return mtime == other.mtime && size == other.size && inode == other.inode;
+	}
+
+	bool operator!=(const FileSignature& other) const {
+		return !(*this == other);
+	}
+};
+
+FileSignature signatureOf(const struct stat& s) {
+	FileSignature signature;
+	signature.mtime = io::mtimeNanos(s);
+	signature.size = static_cast<uint64_t>(s.st_size);
+	signature.inode = static_cast<uint64_t>(s.st_ino);
+	signature.hash = 0;
+	return signature;
+}
+
+class BuildLog {
+	static constexpr const char* MAGIC = "CRADLOG";
+	static const uint32_t VERSION = 2;
+
+	// Compact the log on load once it holds this many times more entries than are live.
+	static const std::size_t COMPACTION_RATIO = 3;
+	static const std::size_t COMPACTION_MIN_ENTRIES = 1000;
+
+	static const std::size_t NO_ENTRY = static_cast<std::size_t>(-1);
+
+	enum RecordType : uint8_t {
+		PATH = 1,
+		ENTRY = 2,
+		HASH = 3
+	};
+
+	struct Input {
+		uint32_t path;
+		FileSignature signature;
+	};
+
+	struct Entry {
+		std::string command;
+		std::vector<Input> inputs;
+	};
+
+	std::mutex mutex;
+	std::string logPath;
+	bool loaded = false;
+	FILE* file = nullptr;
+
+	// Path ids in the table match the order of the `PATH` records in the log.
+	detail::StringTable paths;
+
+	// Entries read from the log are only decoded when they are looked up. `loadedEntries` holds the offset
+	// of the payload of each path's latest entry in `contents` (or `NO_ENTRY`), indexed by path id.
+	// Entries recorded during this run are kept in `recordedEntries` and take precedence.
+	std::string contents;
+	std::vector<std::size_t> loadedEntries;
+	std::unordered_map<uint32_t, Entry> recordedEntries;
+	std::size_t entryRecords = 0;
+
+	// With content hashing, an input whose signature changed is only considered modified if its hash did.
+	// `hashes` holds the latest known hash of each path id along with the signature it belongs to.
+	bool contentHashing;
+	std::unordered_map<uint32_t, FileSignature> hashes;
+
+	// Outputs found up to date or recorded in this run.
+	std::unordered_set<uint32_t> checked;
+
+	template <typename T>
+	static void write(std::string& buffer, const T& value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static void writeString(std::string& buffer, const std::string& value) {
+		write(buffer, static_cast<uint32_t>(value.size()));
+		buffer.append(value);
+	}
+
+	static void writeSignature(std::string& buffer, const FileSignature& signature) {
+		write(buffer, signature.mtime);
+		write(buffer, signature.size);
+		write(buffer, signature.inode);
+		write(buffer, signature.hash);
+	}
+
+	template <typename T>
+	static bool read(const std::string& buffer, std::size_t& pos, std::size_t end, T& value) {
+		if (end - pos < sizeof(T)) {
+			return false;
+		}
+		std::memcpy(&value, buffer.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	static bool readString(const std::string& buffer, std::size_t& pos, std::size_t end, std::string& value) {
+		uint32_t length;
+		if (!read(buffer, pos, end, length) || end - pos < length) {
+			return false;
+		}
+		value.assign(buffer, pos, length);
+		pos += length;
+		return true;
+	}
+
+	static bool readSignature(const std::string& buffer, std::size_t& pos, std::size_t end, FileSignature& signature) {
+		return
+			read(buffer, pos, end, signature.mtime) &&
+			read(buffer, pos, end, signature.size) &&
+			read(buffer, pos, end, signature.inode) &&
+			read(buffer, pos, end, signature.hash);
+	}
+
+	static std::string header() {
+		std::string buffer(MAGIC, std::strlen(MAGIC) + 1);
+		write(buffer, VERSION);
+		return buffer;
+	}
+
+	static void appendRecord(std::string& buffer, RecordType type, const std::string& payload) {
+		write(buffer, static_cast<uint8_t>(type));
+		write(buffer, static_cast<uint32_t>(payload.size()));
+		buffer.append(payload);
+	}
+
+	static std::string entryRecord(uint32_t output, const Entry& entry) {
+		std::string payload;
+		write(payload, output);
+		writeString(payload, entry.command);
+		write(payload, static_cast<uint32_t>(entry.inputs.size()));
+		for (auto& input : entry.inputs) {
+			write(payload, input.path);
+			writeSignature(payload, input.signature);
+		}
+
+		std::string record;
+		appendRecord(record, ENTRY, payload);
+		return record;
+	}
+
+	static std::string hashRecord(uint32_t path, const FileSignature& signature) {
+		std::string payload;
+		write(payload, path);
+		writeSignature(payload, signature);
+
+		std::string record;
+		appendRecord(record, HASH, payload);
+		return record;
+	}
+
+	/**
+	 * Decodes the entry whose payload starts at `offset` in `contents`. The payload length precedes it.
+	 */
+	bool decodeLoadedEntry(std::size_t offset, Entry& entry) const {
+		uint32_t end;
+		std::memcpy(&end, contents.data() + offset - sizeof(uint32_t), sizeof(uint32_t));
+		end += offset;
+
+		std::size_t pos = offset;
+		uint32_t output;
+		uint32_t inputCount;
+		if (
+			!read(contents, pos, end, output) ||
+			!readString(contents, pos, end, entry.command) ||
+			!read(contents, pos, end, inputCount)
+		) {
+			return false;
+		}
+
+		entry.inputs.resize(inputCount);
+		for (auto& input : entry.inputs) {
+			if (
+				!read(contents, pos, end, input.path) ||
+				!readSignature(contents, pos, end, input.signature) ||
+				input.path >= paths.size()
+			) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 *
+	 * @return False if there is no valid entry for `output`.
+	 */
+	bool findEntry(uint32_t output, Entry& entry) const {
+		auto recorded = recordedEntries.find(output);
+		if (recorded != recordedEntries.end()) {
+			entry = recorded->second;
+			return true;
+		}
+
+		return loadedEntries[output] != NO_ENTRY && decodeLoadedEntry(loadedEntries[output], entry);
+	}
+
+	/**
+	 * Reads `contents` up to the first invalid record. Returns false if the log was unreadable or truncated
+	 * in which case it must be rewritten before appending to it.
+	 */
+	bool parse() {
+		std::string expectedHeader = header();
+		if (contents.compare(0, expectedHeader.size(), expectedHeader) != 0) {
+			return false;
+		}
+
+		// Most of a log is paths so this is a generous estimate.
+		paths.reserve(contents.size() / 64, contents.size());
+
+		std::size_t pos = expectedHeader.size();
+		while (pos < contents.size()) {
+			uint8_t type;
+			uint32_t length;
+			if (!read(contents, pos, contents.size(), type) || !read(contents, pos, contents.size(), length)) {
+				return false;
+			}
+			if (contents.size() - pos < length) {
+				return false;
+			}
+
+			if (type == PATH) {
+				if (paths.intern(contents.data() + pos, length) != loadedEntries.size()) {
+					// Every path is written once.
+					return false;
+				}
+				loadedEntries.push_back(NO_ENTRY);
+			} else if (type == ENTRY) {
+				uint32_t output;
+				std::size_t payload = pos;
+				if (!read(contents, payload, pos + length, output) || output >= paths.size()) {
+					return false;
+				}
+				loadedEntries[output] = pos;
+				entryRecords++;
+			} else if (type == HASH) {
+				uint32_t path;
+				FileSignature signature;
+				std::size_t payload = pos;
+				if (!read(contents, payload, pos + length, path) || !readSignature(contents, payload, pos + length, signature) || path >= paths.size()) {
+					return false;
+				}
+				hashes[path] = signature;
+			} else {
+				return false;
+			}
+			pos += length;
+		}
+		return true;
+	}
+
+	/**
+	 * Writes only the live entries to a new log and replaces the old log with it.
+	 */
+	void rewrite() {
+		std::string buffer = header();
+		for (uint32_t id = 0; id < paths.size(); id++) {
+			appendRecord(buffer, PATH, paths.get(id));
+		}
+
+		entryRecords = 0;
+		for (uint32_t id = 0; id < loadedEntries.size(); id++) {
+			Entry entry;
+			if (findEntry(id, entry)) {
+				buffer += entryRecord(id, entry);
+				entryRecords++;
+			}
+		}
+		for (auto& hash : hashes) {
+			buffer += hashRecord(hash.first, hash.second);
+		}
+
+		std::string tmpPath = logPath + ".tmp";
+		FILE* tmp = fopen(tmpPath.c_str(), "wb");
+		if (tmp == nullptr) {
+			log_error("Unable to write build log " + tmpPath + ": " + strerror(errno));
+			return;
+		}
+		fwrite(buffer.data(), 1, buffer.size(), tmp);
+		fclose(tmp);
+
+		std::remove(logPath.c_str());
+		std::rename(tmpPath.c_str(), logPath.c_str());
+		io::invalidateStat(logPath);
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	void load() {
+		if (loaded) {
+			return;
+		}
+		loaded = true;
+
+		io::mkdirs(io::path_parent(logPath));
+
+		// Whatever was parsed before an invalid record is kept.
+		bool valid = io::read_file(logPath, contents) && parse();
+
+		std::size_t liveEntries = loadedEntries.size() - std::count(loadedEntries.begin(), loadedEntries.end(), NO_ENTRY);
+		bool bloated = entryRecords > COMPACTION_MIN_ENTRIES && entryRecords > COMPACTION_RATIO * liveEntries;
+		if (!valid || bloated) {
+			rewrite();
+		}
+
+		file = fopen(logPath.c_str(), "ab");
+		if (file == nullptr) {
+			log_error("Unable to open build log " + logPath + ": " + strerror(errno));
+		}
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	uint32_t idOf(const std::string& path, std::string& records) {
+		uint32_t id = paths.intern(path);
+		if (id == loadedEntries.size()) {
+			loadedEntries.push_back(NO_ENTRY);
+			appendRecord(records, PATH, path);
+		}
+		return id;
+	}
+
+	/**
+	 * Requires `mutex` to be held.
+	 */
+	void append(const std::string& records) {
+		if (file != nullptr) {
+			fwrite(records.data(), 1, records.size(), file);
+			fflush(file);
+		}
+	}
+
+	/**
+	 * @return True if `path`, whose current stats are `s`, differs from the version described by `recorded`.
+	 */
+	bool hasChanged(const std::string& path, const struct stat& s, const FileSignature& recorded) {
+		if (signatureOf(s) == recorded) {
+			return false;
+		}
+		if (!contentHashing || recorded.hash == 0) {
+			return true;
+		}
+
+		uint64_t hash = hashOf(path, s).hash;
+		return hash == 0 || hash != recorded.hash;
+	}
+
+	/**
+	 * Records that `output` was produced by `command` from inputs with the given signatures.
+	 */
+	void recordSignatures(
+		const std::string& output,
+		const std::string& command,
+		const std::vector<std::pair<std::string, FileSignature>>& signatures
+	) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		std::string records;
+		Entry entry;
+		entry.command = command;
+		for (auto& signature : signatures) {
+			Input input;
+			input.path = idOf(signature.first, records);
+			input.signature = signature.second;
+			entry.inputs.push_back(input);
+		}
+
+		uint32_t outputId = idOf(output, records);
+		records += entryRecord(outputId, entry);
+		loadedEntries[outputId] = NO_ENTRY;
+		recordedEntries[outputId] = std::move(entry);
+		entryRecords++;
+		checked.insert(outputId);
+		append(records);
+	}
+
+public:
+	BuildLog(const std::string& logPath) : logPath(logPath), contentHashing(options().has("content-hash")) {}
+
+	~BuildLog() {
+		if (file != nullptr) {
+			fclose(file);
+		}
+	}
+
+	/**
+	 * @return The signature of `path` with its content hash filled in, or a hash of 0 if it can't be read.
+	 *         Hashes are reused for as long as the file's signature stays the same.
+	 */
+	FileSignature hashOf(const std::string& path, const struct stat& s) {
+		FileSignature signature = signatureOf(s);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			uint32_t id = paths.find(path);
+			if (id != detail::StringTable::NONE) {
+				auto it = hashes.find(id);
+				if (it != hashes.end() && it->second == signature) {
+					return it->second;
+				}
+			}
+		}
+
+		if (!io::hashFile(path, signature.hash)) {
+			signature.hash = 0;
+			return signature;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::string records;
+		uint32_t id = idOf(path, records);
+		hashes[id] = signature;
+		records += hashRecord(id, signature);
+		append(records);
+		return signature;
+	}
+
+	/**
+	 * Enables or disables content hashing. It is enabled by `--content-hash` on the command line.
+	 */
+	void setContentHashing(bool enabled) {
+		contentHashing = enabled;
+	}
+
+	bool isContentHashing() const {
+		return contentHashing;
+	}
+
+	/**
+	 * @param recordedInputs Set to the inputs recorded for `output` if it is in the log.
+	 * @return True if `output` must be rebuilt: it doesn't exist, it isn't in the log, it was produced by a
+	 *         command other than `command` or one of its recorded inputs has changed or disappeared since.
+	 */
+	bool isOutOfDate(const std::string& output, const std::string& command, std::vector<std::string>& recordedInputs) {
+		if (!io::exists(output)) {
+			return true;
+		}
+
+		uint32_t id;
+		std::vector<std::pair<std::string, FileSignature>> inputs;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			id = paths.find(output);
+			Entry entry;
+			if (id == detail::StringTable::NONE || !findEntry(id, entry) || entry.command != command) {
+				return true;
+			}
+
+			for (auto& input : entry.inputs) {
+				inputs.push_back(std::make_pair(paths.get(input.path), input.signature));
+			}
+		}
+
+		recordedInputs.clear();
+		bool outOfDate = false;
+		for (auto& input : inputs) {
+			struct stat s;
+			if (!outOfDate && (!io::tryGetStat(input.first, s) || hasChanged(input.first, s, input.second))) {
+				outOfDate = true;
+			}
+			recordedInputs.push_back(input.first);
+		}
+
+		if (!outOfDate) {
+			std::lock_guard<std::mutex> lock(mutex);
+			checked.insert(id);
+		}
+		return outOfDate;
+	}
+
+	bool isOutOfDate(const std::string& output, const std::string& command) {
+		std::vector<std::string> recordedInputs;
+		return isOutOfDate(output, command, recordedInputs);
+	}
+
+	/**
+	 * @param inputs Set to the inputs recorded for `output`, without checking whether they changed.
+	 * @return False if `output` isn't in the log.
+	 */
+	bool recordedInputs(const std::string& output, std::vector<std::string>& inputs) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		uint32_t id = paths.find(output);
+		Entry entry;
+		if (id == detail::StringTable::NONE || !findEntry(id, entry)) {
+			return false;
+		}
+
+		inputs.clear();
+		for (auto& input : entry.inputs) {
+			inputs.push_back(paths.get(input.path));
+		}
+		return true;
+	}
+
+	/**
+	 * @return Every output that was found up to date or recorded in this run.
+	 */
+	std::vector<std::string> checkedOutputs() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::string> outputs;
+		for (uint32_t id : checked) {
+			outputs.push_back(paths.get(id));
+		}
+		return outputs;
+	}
+
+	/**
+	 * @param inputs Set to the inputs recorded for `output` and their signatures at the time.
+	 * @return False if `output` isn't in the log.
+	 */
+	bool recordedInputs(const std::string& output, std::vector<std::pair<std::string, FileSignature>>& inputs) {
+		std::lock_guard<std::mutex> lock(mutex);
+		load();
+
+		uint32_t id = paths.find(output);
+		Entry entry;
+		if (id == detail::StringTable::NONE || !findEntry(id, entry)) {
+			return false;
+		}
+
+		inputs.clear();
+		for (auto& input : entry.inputs) {
+			inputs.push_back(std::make_pair(paths.get(input.path), input.signature));
+		}
+		return true;
+	}
+
+	/**
+	 * The content hashing counterpart of a timestamp check: `target` is out of date if it is missing, or if
+	 * one of `files` is newer than it and its contents differ from the version seen the last time `target`
+	 * was found up to date. Those versions are recorded as an entry for `target` with an empty command.
+	 *
+	 * @param skipMissing Ignore files that don't exist rather than treating `target` as out of date.
+	 */
+	bool isOlderThanInputs(const std::string& target, const std::vector<std::string>& files, bool skipMissing) {
+		struct stat targetStat;
+		if (!io::tryGetStat(target, targetStat)) {
+			return true;
+		}
+		int64_t targetTime = io::mtimeNanos(targetStat);
+
+		std::unordered_map<std::string, FileSignature> seen;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			load();
+
+			uint32_t id = paths.find(target);
+			Entry entry;
+			if (id != detail::StringTable::NONE && findEntry(id, entry) && entry.command.empty()) {
+				for (auto& input : entry.inputs) {
+					seen[paths.get(input.path)] = input.signature;
+				}
+			}
+		}
+
+		std::vector<std::string> inputs;
+		bool changed = false;
+		for (auto& file : files) {
+			struct stat s;
+			if (!io::tryGetStat(file, s)) {
+				if (skipMissing) {
+					continue;
+				}
+				return true;
+			}
+
+			auto it = seen.find(file);
+			if (io::mtimeNanos(s) > targetTime && (it == seen.end() || hasChanged(file, s, it->second))) {
+				return true;
+			}
+			changed = changed || it == seen.end() || signatureOf(s) != it->second;
+			inputs.push_back(file);
+		}
+
+		if (changed || inputs.size() != seen.size()) {
+			record(target, "", inputs);
+		} else {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = paths.find(target);
+			if (id != detail::StringTable::NONE) {
+				checked.insert(id);
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * The state of a command's inputs just before it runs. See @ref beforeCommand.
+	 */
+	struct CommandStart {
+		int64_t time;
+		std::unordered_map<std::string, FileSignature> inputs;
+	};
+
+	/**
+	 * Must be called right before running a command whose output is then passed to @ref record.
+	 *
+	 * @param knownInputs The inputs the command is known to read, e.g. from its previous entry. Inputs only
+	 *                    discovered afterwards (e.g. from a depfile) are still checked against the time.
+	 */
+	CommandStart beforeCommand(const std::vector<std::string>& knownInputs) {
+		CommandStart start;
+		start.time = io::fileClockNanos();
+		for (auto& input : knownInputs) {
+			struct stat s;
+			if (io::tryGetStat(input, s)) {
+				start.inputs[input] = signatureOf(s);
+			}
+		}
+		return start;
+	}
+
+	/**
+	 * Records that `output` was just produced by `command` from `inputs`. Inputs that don't exist (e.g.
+	 * system libraries passed by name) are not recorded.
+	 *
+	 * Inputs modified since `start` may have been read in an older version, so they are recorded with a
+	 * signature that never matches and `output` is rebuilt on the next run. Like ninja, this only relies on
+	 * timestamps for inputs that weren't known before the command ran.
+	 */
+	void record(
+		const std::string& output,
+		const std::string& command,
+		const std::vector<std::string>& inputs,
+		const CommandStart& start
+	) {
+		std::vector<std::pair<std::string, FileSignature>> signatures;
+		for (auto& input : inputs) {
+			// The stat cache may still hold the version from before the command ran.
+			struct stat s;
+			if (stat(input.c_str(), &s) != 0) {
+				continue;
+			}
+
+			FileSignature signature = signatureOf(s);
+			auto before = start.inputs.find(input);
+			bool unchanged = before != start.inputs.end() && before->second == signature;
+			if (!unchanged && signature.mtime >= start.time) {
+				signature.mtime = -1;
+				signatures.push_back(std::make_pair(input, signature));
+			} else {
+				signatures.push_back(std::make_pair(input, contentHashing ? hashOf(input, s) : signature));
+			}
+		}
+		recordSignatures(output, command, signatures);
+	}
+
+	/**
+	 * Records `output` along with the current signatures of `inputs`, for outputs not produced by a command.
+	 */
+	void record(const std::string& output, const std::string& command, const std::vector<std::string>& inputs) {
+		std::vector<std::pair<std::string, FileSignature>> signatures;
+		for (auto& input : inputs) {
+			struct stat s;
+			if (io::tryGetStat(input, s)) {
+				signatures.push_back(std::make_pair(input, contentHashing ? hashOf(input, s) : signatureOf(s)));
+			}
+		}
+		recordSignatures(output, command, signatures);
+	}
+};
+
+const uint32_t BuildLog::VERSION;
+const std::size_t BuildLog::COMPACTION_RATIO;
+const std::size_t BuildLog::COMPACTION_MIN_ENTRIES;
+const std::size_t BuildLog::NO_ENTRY;
+
+/**
+ * @return The build log shared by every task in this run. It is loaded on first use.
+ */
+BuildLog& buildLog() {
+	static BuildLog instance(io::path_concat(DEFAULT_BUILD_DIR, BUILD_LOG_FILE));
+	return instance;
+}
+
+} // namespace cradle
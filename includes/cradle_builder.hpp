@@ -35,6 +35,10 @@
 
 #include <cradle_types.hpp>
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 namespace cradle {
 namespace builder {
 
@@ -137,10 +141,10 @@ public:
 		std::string newTaskKey = key;
 		std::string origTaskKey = this->key;
 
-		this->t = task([newTaskKey, origTaskKey, newTask] (Task* self) {
+		this->t = tracked(task([newTaskKey, origTaskKey, newTask] (Task* self) {
 			self->set(origTaskKey, newTask->get(origTaskKey));
 			return ExecutionResult::SUCCESS;
-		});
+		}));
 
 		this->t->dependsOn(newTask);
 	}
@@ -158,6 +162,11 @@ class StrListFromTask {
 	task_p t;
 	bool isSet;
 
+	// The tasks and keys that values were added from, shared with the task that collects them. Reset once the
+	// collector is shared with a copy or handed out, after which values are added to a new collector that
+	// depends on the old one.
+	mutable std::shared_ptr<std::vector<std::pair<task_p, std::string>>> sources;
+
 	static void pushValuesToList(Task& dst, const std::string& dstKey, task_p src, const std::string& srcKey) {
 		bool foundValue = false;
 		if (src->has(srcKey)) {
@@ -192,6 +201,15 @@ public:
 		isSet(true)
 	{}
 
+	StrListFromTask(const StrListFromTask& other) :
+		builder(other.builder),
+		key(other.key),
+		t(other.t),
+		isSet(other.isSet)
+	{
+		other.sources = nullptr;
+	}
+
 	Builder& operator() (std::initializer_list<std::string> values) {
 		return (*this)(key, listOf(key, values));
 	}
@@ -209,33 +227,29 @@ public:
 	 * @return
 	 */
 	Builder& operator() (const std::string& key, task_p newTask) {
-		if (!isSet) {
-
-			std::string newTaskKey = key;
-			std::string origTaskKey = this->key;
-
-			this->t = task([newTaskKey, origTaskKey, newTask] (Task* self) {
-				StrListFromTask::pushValuesToList(*self, origTaskKey, newTask, newTaskKey);
-				return ExecutionResult::SUCCESS;
-			});
-
-			this->t->dependsOn(newTask);
+		if (sources == nullptr) {
+			// A single task collects the values from every source, rather than one task per call.
+			sources = std::make_shared<std::vector<std::pair<task_p, std::string>>>();
+			if (isSet) {
+				sources->push_back(std::make_pair(t, this->key));
+			}
 
-		} else {
-
-			std::string newTaskKey = key;
 			std::string origTaskKey = this->key;
-			task_p origTask = this->t;
-
-			this->t = task([origTaskKey, newTaskKey, origTask, newTask] (Task* self) {
-				StrListFromTask::pushValuesToList(*self, origTaskKey, origTask, origTaskKey);
-				StrListFromTask::pushValuesToList(*self, origTaskKey, newTask, newTaskKey);
+			std::shared_ptr<const std::vector<std::pair<task_p, std::string>>> collected = sources;
+			task_p collector = tracked(task([origTaskKey, collected] (Task* self) {
+				for (auto& source : *collected) {
+					StrListFromTask::pushValuesToList(*self, origTaskKey, source.first, source.second);
+				}
 				return ExecutionResult::SUCCESS;
-			});
-			this->t->dependsOn(origTask);
-			this->t->dependsOn(newTask);
-
+			}));
+			if (isSet) {
+				collector->dependsOn(t);
+			}
+			this->t = collector;
 		}
+
+		sources->push_back(std::make_pair(newTask, key));
+		this->t->dependsOn(newTask);
 		this->isSet = true;
 		return builder;
 	}
@@ -249,6 +263,7 @@ public:
 
 	operator task_p() const {
 		if (!isSet) throw new std::runtime_error("Attempting to access unset value.");
+		sources = nullptr;
 		return t;
 	}
 };
@@ -0,0 +1,459 @@
+/**
+ * @file cradle_cache.hpp
+ *
+ * @brief A size-bounded, content-addressed store of build results that can be shared by concurrent cradle
+ *        processes, including processes on different machines sharing the directory over NFS.
+ *
+ * Every item is a file named by its key, a 32 character hex string, under one of 16 shards selected by the
+ * first character of the key:
+ *
+ *     <root>/<k[0]>/<k[1..2]>/<k[3..]>.<kind>
+ *
+ * No locks are taken. Items are written to `<root>/tmp` under a name unique to the host, process and item
+ * and renamed into place, so readers never see partial files and concurrent writers of the same item simply
+ * replace each other's (identical) results. Each item starts with a header holding its length and content
+ * hash, which is checked on every read; items that fail the check are deleted and treated as misses.
+ *
+ * Reading an item updates its modification time, which is what eviction orders by. A shard is trimmed to
+ * 90% of its share of the maximum size at the end of a run that stored into it. Statistics of every run are
+ * appended to `<root>/stats/<hostname>`, so hosts never append to the same file.
+ *
+ * A store can be opened read-only, in which case nothing in the directory is modified.
+ */
+
+#pragma once
+
+#include <cradle_main.hpp>
+#include <cradle_string_table.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_hash.hpp>
+#include <io/cradle_tinydir.hpp>
+#include <platform/cradle_platform_util.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cradle {
+
+static const std::string CACHE_DIR_ENV_VAR = "CRADLE_CACHE_DIR";
+static const std::string CACHE_SIZE_ENV_VAR = "CRADLE_CACHE_SIZE";
+static const uint64_t DEFAULT_CACHE_SIZE = 5ull * 1024 * 1024 * 1024;
+
+static const std::string SHARED_CACHE_DIR_ENV_VAR = "CRADLE_SHARED_CACHE_DIR";
+static const std::string SHARED_CACHE_SIZE_ENV_VAR = "CRADLE_SHARED_CACHE_SIZE";
+static const std::string SHARED_CACHE_READ_ONLY_ENV_VAR = "CRADLE_SHARED_CACHE_READ_ONLY";
+static const uint64_t DEFAULT_SHARED_CACHE_SIZE = 50ull * 1024 * 1024 * 1024;
+
+struct CacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t stores = 0;
+	uint64_t storedBytes = 0;
+	uint64_t evictions = 0;
+
+	CacheStats& operator+=(const CacheStats& other) {
+		hits += other.hits;
+		misses += other.misses;
+		stores += other.stores;
+		storedBytes += other.storedBytes;
+		evictions += other.evictions;
+		return *this;
+	}
+
+	std::string describe() const {
+		uint64_t lookups = hits + misses;
+		std::string rate = lookups == 0 ? "n/a" : std::to_string(100 * hits / lookups) + "%";
+		return
+			std::to_string(hits) + " hits, " + std::to_string(misses) + " misses (hit rate " + rate + "), " +
+			std::to_string(stores) + " stored (" + std::to_string(storedBytes / 1024) + " KiB), " +
+			std::to_string(evictions) + " evicted";
+	}
+};
+
+namespace detail {
+
+/**
+ * @return `material` reduced to a 128-bit key in hex.
+ */
+std::string cacheKey(const std::string& material) {
+	char key[33];
+	snprintf(
+		key, sizeof(key), "%016llx%016llx",
+		static_cast<unsigned long long>(io::hashBytes(material.data(), material.size())),
+		static_cast<unsigned long long>(hashString(material.data(), material.size()))
+	);
+	return key;
+}
+
+/**
+ * Parses sizes such as `500M` or `5G`.
+ *
+ * @return `defaultValue` if `s` is empty or invalid.
+ */
+uint64_t parseSize(const std::string& s, uint64_t defaultValue) {
+	char* end = nullptr;
+	double value = std::strtod(s.c_str(), &end);
+	if (s.empty() || end == s.c_str() || value < 0) {
+		return defaultValue;
+	}
+
+	switch (*end) {
+	case 'k': case 'K': value *= 1024.0; break;
+	case 'm': case 'M': value *= 1024.0 * 1024; break;
+	case 'g': case 'G': value *= 1024.0 * 1024 * 1024; break;
+	case 't': case 'T': value *= 1024.0 * 1024 * 1024 * 1024; break;
+	case '\0': break;
+	default: return defaultValue;
+	}
+	return static_cast<uint64_t>(value);
+}
+
+/**
+ * @return The directory given by `CRADLE_CACHE_DIR`, otherwise the platform's per-user cache directory.
+ */
+std::string defaultCacheDir() {
+	const char* dir = std::getenv(CACHE_DIR_ENV_VAR.c_str());
+	if (dir != nullptr && *dir != '\0') {
+		return dir;
+	}
+
+#ifdef PLATFORM_WINDOWS
+	const char* localAppData = std::getenv("LOCALAPPDATA");
+	if (localAppData != nullptr) {
+		return io::path_concat(localAppData, "cradle");
+	}
+#else
+	const char* xdgCacheHome = std::getenv("XDG_CACHE_HOME");
+	if (xdgCacheHome != nullptr && *xdgCacheHome != '\0') {
+		return io::path_concat(xdgCacheHome, "cradle");
+	}
+	const char* home = std::getenv("HOME");
+	if (home != nullptr) {
+		return io::path_concat(io::path_concat(home, ".cache"), "cradle");
+	}
+#endif
+	return io::path_concat(DEFAULT_BUILD_DIR, "cache");
+}
+
+} // namespace detail
+
+class CacheStore {
+	static constexpr const char* MAGIC = "CRADCAC";
+	static const uint32_t VERSION = 1;
+	static const std::size_t HEADER_SIZE = 8 + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+	static const int SHARDS = 16;
+
+	// Temporary files older than this are left over from processes that died while storing.
+	static const time_t STALE_TMP_SECONDS = 60 * 60;
+
+	struct Item {
+		int64_t mtime;
+		uint64_t size;
+		std::string path;
+	};
+
+	std::string root;
+	uint64_t maxSize;
+	bool readOnly;
+	std::string hostname;
+
+	std::mutex mutex;
+	CacheStats stats;
+	bool storedInShard[SHARDS] = {};
+	std::atomic<unsigned> tmpCounter;
+
+	std::string shardDir(int shard) const {
+		return io::path_concat(root, std::string(1, "0123456789abcdef"[shard]));
+	}
+
+	std::string tmpDir() const {
+		return io::path_concat(root, "tmp");
+	}
+
+	std::string statsDir() const {
+		return io::path_concat(root, "stats");
+	}
+
+	std::string pathOf(const std::string& key, const std::string& kind) const {
+		return io::path_concat(io::path_concat(io::path_concat(root, key.substr(0, 1)), key.substr(1, 2)), key.substr(3) + "." + kind);
+	}
+
+	static int shardOf(const std::string& key) {
+		char c = key[0];
+		return c >= 'a' ? c - 'a' + 10 : c - '0';
+	}
+
+	/**
+	 * @return False if `data` is not a complete item. Otherwise `payload` is set to its contents.
+	 */
+	static bool unwrap(const std::string& data, std::string& payload) {
+		if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC, 8) != 0) {
+			return false;
+		}
+
+		uint32_t version;
+		uint64_t length;
+		uint64_t hash;
+		std::memcpy(&version, data.data() + 8, sizeof(version));
+		std::memcpy(&length, data.data() + 8 + sizeof(version), sizeof(length));
+		std::memcpy(&hash, data.data() + 8 + sizeof(version) + sizeof(length), sizeof(hash));
+		if (version != VERSION || length != data.size() - HEADER_SIZE) {
+			return false;
+		}
+		if (io::hashBytes(data.data() + HEADER_SIZE, length) != hash) {
+			return false;
+		}
+
+		payload.assign(data, HEADER_SIZE, std::string::npos);
+		return true;
+	}
+
+	static std::string wrap(const std::string& payload) {
+		uint64_t length = payload.size();
+		uint64_t hash = io::hashBytes(payload.data(), payload.size());
+
+		std::string data(MAGIC, 8);
+		data.append(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+		data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		data.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+		data.append(payload);
+		return data;
+	}
+
+	/**
+	 * Adds every file under `dir` to `items`. Stats are read directly since other processes change them.
+	 */
+	static void listItems(const std::string& dir, std::vector<Item>& items) {
+		tinydir_dir d;
+		if (tinydir_open(&d, dir.c_str()) != 0) {
+			return;
+		}
+
+		while (d.has_next) {
+			tinydir_file file;
+			tinydir_readfile(&d, &file);
+			std::string name(file.name);
+
+			if (name != "." && name != "..") {
+				struct stat s;
+				if (file.is_dir) {
+					listItems(file.path, items);
+				} else if (stat(file.path, &s) == 0) {
+					items.push_back(Item{io::mtimeNanos(s), static_cast<uint64_t>(s.st_size), file.path});
+				}
+			}
+			tinydir_next(&d);
+		}
+		tinydir_close(&d);
+	}
+
+	/**
+	 * Evicts the least recently used items of `shard` until it is within 90% of its share of the maximum size.
+	 *
+	 * @return The number of items evicted.
+	 */
+	uint64_t trim(int shard) {
+		std::vector<Item> items;
+		listItems(shardDir(shard), items);
+
+		uint64_t limit = maxSize / SHARDS;
+		uint64_t total = 0;
+		for (auto& item : items) {
+			total += item.size;
+		}
+		if (total <= limit) {
+			return 0;
+		}
+
+		std::sort(items.begin(), items.end(), [] (const Item& a, const Item& b) { return a.mtime < b.mtime; });
+
+		uint64_t evicted = 0;
+		for (auto& item : items) {
+			if (total <= limit / 10 * 9) {
+				break;
+			}
+			if (std::remove(item.path.c_str()) == 0) {
+				evicted++;
+			}
+			total -= item.size;
+		}
+		return evicted;
+	}
+
+	void removeStaleTmpFiles() {
+		std::vector<Item> items;
+		listItems(tmpDir(), items);
+
+		int64_t cutoff = (static_cast<int64_t>(time(nullptr)) - STALE_TMP_SECONDS) * 1000000000;
+		for (auto& item : items) {
+			if (item.mtime < cutoff) {
+				std::remove(item.path.c_str());
+			}
+		}
+	}
+
+public:
+	CacheStore(const std::string& root, uint64_t maxSize, bool readOnly = false) :
+		root(root),
+		maxSize(maxSize),
+		readOnly(readOnly),
+		hostname(platform::platform_hostname()),
+		tmpCounter(0)
+	{}
+
+	CacheStore(const CacheStore&) = delete;
+	CacheStore& operator=(const CacheStore&) = delete;
+
+	~CacheStore() {
+		flush();
+	}
+
+	const std::string& directory() const {
+		return root;
+	}
+
+	bool isReadOnly() const {
+		return readOnly;
+	}
+
+	/**
+	 * @return False if there is no valid item for `key` and `kind`. Otherwise `payload` is set to its contents.
+	 */
+	bool get(const std::string& key, const std::string& kind, std::string& payload) {
+		std::string path = pathOf(key, kind);
+
+		std::string data;
+		if (io::read_file(path, data) && unwrap(data, payload)) {
+			if (!readOnly) {
+				platform::platform_touch(path);
+			}
+			return true;
+		}
+		if (!data.empty() && !readOnly) {
+			// Corrupt or from an incompatible version of cradle.
+			std::remove(path.c_str());
+		}
+		return false;
+	}
+
+	/**
+	 * Counts a lookup in the statistics. A lookup may read several items, so this is left to the caller.
+	 */
+	void count(bool hit) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (hit) {
+			stats.hits++;
+		} else {
+			stats.misses++;
+		}
+	}
+
+	/**
+	 * Stores `payload` as the item for `key` and `kind`, replacing any existing one. Does nothing if the
+	 * store is read-only.
+	 */
+	void put(const std::string& key, const std::string& kind, const std::string& payload) {
+		if (readOnly) {
+			return;
+		}
+
+		std::string path = pathOf(key, kind);
+		io::mkdirs(io::path_parent(path));
+		io::mkdirs(tmpDir());
+
+		std::string tmpPath = io::path_concat(
+			tmpDir(),
+			hostname + "-" + std::to_string(platform::platform_getpid()) + "-" + std::to_string(tmpCounter++) + "-" + key.substr(0, 8)
+		);
+		if (!io::write_file(tmpPath, wrap(payload)) || platform::platform_rename(tmpPath, path) != 0) {
+			log_error("Unable to store " + path + " in the cache: " + strerror(errno));
+			std::remove(tmpPath.c_str());
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.stores++;
+		stats.storedBytes += payload.size();
+		storedInShard[shardOf(key)] = true;
+	}
+
+	/**
+	 * @return The statistics of every run that has used this cache, including this one.
+	 */
+	CacheStats totalStats() {
+		CacheStats total;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			total = stats;
+		}
+
+		std::vector<Item> files;
+		listItems(statsDir(), files);
+		for (auto& file : files) {
+			std::string contents;
+			io::read_file(file.path, contents);
+			std::istringstream lines(contents);
+			CacheStats run;
+			while (lines >> run.hits >> run.misses >> run.stores >> run.storedBytes >> run.evictions) {
+				total += run;
+			}
+		}
+		return total;
+	}
+
+	/**
+	 * Evicts items from the shards stored into since the last flush and appends the statistics since then to
+	 * this host's stats file, unless the store is read-only. Called when the store is destroyed.
+	 *
+	 * @return The statistics that were appended.
+	 */
+	CacheStats flush() {
+		std::lock_guard<std::mutex> lock(mutex);
+		CacheStats flushed = stats;
+		if (readOnly || stats.hits + stats.misses + stats.stores == 0) {
+			stats = CacheStats();
+			return flushed;
+		}
+
+		bool stored = false;
+		for (int shard = 0; shard < SHARDS; shard++) {
+			if (storedInShard[shard]) {
+				stats.evictions += trim(shard);
+				storedInShard[shard] = false;
+				stored = true;
+			}
+		}
+		if (stored) {
+			removeStaleTmpFiles();
+		}
+
+		// Each line is appended with a single write so concurrent runs don't interleave.
+		std::string line =
+			std::to_string(stats.hits) + " " + std::to_string(stats.misses) + " " + std::to_string(stats.stores) + " " +
+			std::to_string(stats.storedBytes) + " " + std::to_string(stats.evictions) + "\n";
+		io::mkdirs(statsDir());
+		FILE* file = fopen(io::path_concat(statsDir(), hostname).c_str(), "ab");
+		if (file != nullptr) {
+			fwrite(line.data(), 1, line.size(), file);
+			fclose(file);
+		}
+		flushed.evictions = stats.evictions;
+		stats = CacheStats();
+		return flushed;
+	}
+};
+
+const uint32_t CacheStore::VERSION;
+const std::size_t CacheStore::HEADER_SIZE;
+const int CacheStore::SHARDS;
+const time_t CacheStore::STALE_TMP_SECONDS;
+
+} // namespace cradle
@@ -5,31 +5,175 @@
 #pragma once
 
 #include <io/cradle_files.hpp>
+#include <io/cradle_stat.hpp>
 #include <cradle_main.hpp>
+#include <cradle_snapshot.hpp>
+#include <cradle_trace.hpp>
+#include <platform/cradle_jobserver.hpp>
+#include <platform/cradle_process.hpp>
+
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace cradle {
 
+/**
+ * Rewrites what a command wrote to standard output and error before it is printed, e.g. to drop reports
+ * that are collected instead. The result returned to the caller is left as it was.
+ */
+typedef std::function<void(std::string& output, std::string& errors)> OutputFilter;
+
+namespace detail {
+
+std::mutex& outputMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+/**
+ * Runs `args` in `workingDirectory` (or the current directory if empty) and prints its output in one piece.
+ * The command holds a jobserver slot while it runs.
+ *
+ * @param cmd The command line `args` were derived from, which is what is logged.
+ */
+platform::ProcessResult runArgs(
+	const std::string& cmd,
+	const std::vector<std::string>& args,
+	const std::string& workingDirectory,
+	const OutputFilter& filter = OutputFilter()
+) {
+	log(cmd);
+
+	platform::ProcessOptions options;
+	options.workingDirectory = workingDirectory;
+	platform::ProcessResult result;
+	{
+		platform::JobSlot slot;
+		long long begin = trace().now();
+		result = platform::runProcess(args, options);
+		if (trace().isEnabled()) {
+			trace().process(cmd, args, begin, trace().now(), result);
+		}
+	}
+
+	std::string output = result.output;
+	std::string errors = result.errors;
+	if (filter) {
+		filter(output, errors);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(outputMutex());
+		fwrite(output.data(), 1, output.size(), stdout);
+		fflush(stdout);
+		fwrite(errors.data(), 1, errors.size(), stderr);
+		fflush(stderr);
+	}
+
+	if (!result.started) {
+		log_error("Unable to run " + cmd + ": " + result.error);
+	} else if (result.signal != 0) {
+		log_error("Command terminated by signal " + std::to_string(result.signal) + ": " + cmd);
+	}
+	return result;
+}
+
+platform::ProcessResult runCommand(const std::string& cmd, const std::string& workingDirectory) {
+	return runArgs(cmd, platform::commandArgs(cmd), workingDirectory);
+}
+
+} // namespace detail
+
+/**
+ * Runs `args` without a shell and invalidates the cached stats of `outputs`, which must be every file the
+ * command may write.
+ *
+ * @param cmd    The command line that is logged for `args`.
+ * @param result Set to the exit status, output and resource usage of the command.
+ * @param filter Applied to the command's output before it is printed.
+ */
+ExecutionResult run(
+	const std::string& cmd,
+	const std::vector<std::string>& args,
+	const std::vector<std::string>& outputs,
+	platform::ProcessResult& result,
+	const OutputFilter& filter = OutputFilter()
+) {
+	result = detail::runArgs(cmd, args, "", filter);
+	for (auto& output : outputs) {
+		io::invalidateStat(output);
+	}
+	return result.succeeded() ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+}
+
+/**
+ * Runs `cmd` and invalidates the cached stats of `outputs`, which must be every file the command may write.
+ *
+ * @param result Set to the exit status, output and resource usage of the command.
+ */
+ExecutionResult run(const std::string& cmd, const std::vector<std::string>& outputs, platform::ProcessResult& result) {
+	return run(cmd, platform::commandArgs(cmd), outputs, result);
+}
+
+/**
+ * Runs `cmd` and invalidates the cached stats of `outputs`, which must be every file the command may write.
+ */
+ExecutionResult run(const std::string& cmd, const std::vector<std::string>& outputs) {
+	platform::ProcessResult result;
+	return run(cmd, outputs, result);
+}
+
+/**
+ * Runs `cmd`. Since it may write to any path all cached stats are invalidated, and no null build snapshot
+ * is written for this run.
+ */
+ExecutionResult run(const std::string& cmd) {
+	snapshot().disable();
+	auto ret = run(cmd, {});
+	io::invalidateAllStats();
+	return ret;
+}
+
+/**
+ * Runs `cmd` and collects what it writes to standard output.
+ *
+ * @return False if the command could not be started or failed.
+ */
+bool capture(const std::string& cmd, std::string& output) {
+	platform::ProcessResult result = platform::runProcess(platform::commandArgs(cmd));
+	output = result.output;
+	return result.succeeded();
+}
+
+/**
+ * Creates a task that runs `cmd` in `wd`. Since `cmd` may be a nested build (e.g. make, ninja or another
+ * cradle build) the executor will export a jobserver for it to share.
+ */
 task_p exec(std::string name, std::string wd, std::string cmd) {
+	platform::jobServer().requestServer();
 	return task(name, [wd,cmd] (Task* self) -> ExecutionResult {
-		log(cmd.c_str());
-		cradle::platform::platform_chdir(wd);
-		auto ret = system(cmd.c_str()) > 0 ? ExecutionResult::FAILURE : ExecutionResult::SUCCESS;
-		cradle::platform::platform_chdir(cradle::io::path_parent(getBuildConfigFile()));
-		return ret;
+		// The working directory is only changed in the child since other tasks may be executing concurrently.
+		snapshot().disable();
+		auto result = detail::runCommand(cmd, wd);
+		io::invalidateAllStats();
+		return result.succeeded() ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
 	});
 }
 
 task_p exec(std::string name, std::string cmd) {
+	platform::jobServer().requestServer();
 	return task(name, [cmd] (Task* self) -> ExecutionResult {
-		log(cmd.c_str());
-		return system(cmd.c_str()) > 0 ? ExecutionResult::FAILURE : ExecutionResult::SUCCESS;
+		return run(cmd);
 	});
 }
 
 task_p exec(std::string cmd) {
+	platform::jobServer().requestServer();
 	return task([cmd] (Task* self) -> ExecutionResult {
-		log(cmd.c_str());
-		return system(cmd.c_str()) > 0 ? ExecutionResult::FAILURE : ExecutionResult::SUCCESS;
+		return run(cmd);
 	});
 }
 
@@ -4,13 +4,26 @@
 
 #pragma once
 
+#include <cradle_task_arena.hpp>
+#include <cradle_trace.hpp>
+#include <io/cradle_glob.hpp>
+#include <platform/cradle_jobserver.hpp>
 #include <platform/cradle_platform_util.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <exception>
+#include <forward_list>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <set>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 
@@ -25,9 +38,22 @@
 	  log("Cradle Version v0.4-alpha");       \
 	  cradle::platform::platform_chdir(cradle::io::path_parent(getBuildConfigFile())); \
 	  parseCmdLineArgs(argc, argv);           \
+	  if (isNullBuild()) {                    \
+	    writeTrace();                         \
+	    return 0;                             \
+	  }                                       \
 	  configure();                            \
-	  executor->execute();                    \
-	  return 0;                               \
+	  if (options().has("list")) {            \
+	    listTasks();                          \
+	    return 0;                             \
+	  }                                       \
+	  if (options().has("watch")) {           \
+	    return watchAndRebuild();             \
+	  }                                       \
+	  ExecutionResult result = executor->execute(); \
+	  finishBuild(result);                    \
+	  writeTrace();                           \
+	  return result == ExecutionResult::SUCCESS ? 0 : 1; \
 	}                                         \
 	void configure()
 
@@ -36,11 +62,10 @@ namespace cradle {
 static const std::string DEFAULT_BUILD_DIR = "build";
 
 class Executor;
+class ParallelExecutor;
 class SingleThreadedExecutor;
 class Task;
 
-typedef std::shared_ptr<Task> task_p;
-
 void log(const std::string& msg);
 void log_error(const std::string& msg);
 
@@ -54,57 +79,226 @@ enum class ExecutionResult {
 	FAILURE
 };
 
+/**
+ * Options given on the command line as `--name` or `--name=value`.
+ */
+class Options {
+	std::unordered_map<std::string, std::string> values;
+
+public:
+	bool has(const std::string& name) const {
+		return values.find(name) != values.end();
+	}
+
+	std::string get(const std::string& name, const std::string& defaultValue = "") const {
+		auto it = values.find(name);
+		return it == values.end() ? defaultValue : it->second;
+	}
+
+	void set(const std::string& name, const std::string& value = "") {
+		values[name] = value;
+	}
+};
+
+Options& options() {
+	static Options instance;
+	return instance;
+}
+
+/**
+ * @return The arguments cradle was started with, including the program.
+ */
+std::vector<std::string>& commandLine() {
+	static std::vector<std::string> args;
+	return args;
+}
+
+/**
+ * Builds the requested tasks and then rebuilds whatever a change to their sources affects until cradle is
+ * interrupted. Implemented in cradle_watch.hpp.
+ *
+ * @return The exit code of cradle.
+ */
+int watchAndRebuild();
+
+/**
+ * Checks the null build snapshot before the build is configured. Implemented in cradle_snapshot.hpp.
+ *
+ * @return True if every output is up to date and the build can be skipped.
+ */
+bool isNullBuild();
+
+/**
+ * Writes the null build snapshot after a successful build. Implemented in cradle_snapshot.hpp.
+ */
+void finishBuild(ExecutionResult result);
+
+/**
+ * Prevents the null build snapshot from being written in this run. Implemented in cradle_snapshot.hpp.
+ */
+void disableSnapshot();
+
+/**
+ * Writes the trace requested with `--trace`, if any.
+ */
+void writeTrace() {
+	if (!trace().write()) {
+		log_error("Unable to write the trace to " + trace().path());
+	}
+}
+
 
 class Task {
 	std::string name_;
-	std::vector<task_p> dependencies_;
-	std::vector<task_p> followingTasks_;
-	std::unordered_map<std::string, std::string> properties;
-	std::unordered_map<std::string, std::vector<std::string>> lists;
+	std::atomic<uint32_t> id_{detail::TaskArena::NONE};
+	std::vector<uint32_t> dependencies_;
+	std::vector<uint32_t> followingTasks_;
+	std::vector<std::pair<uint32_t, std::string>> properties;
+	bool tracked_ = false;
+
+	// A list rather than a vector so that references returned by getList() stay valid as lists are added.
+	std::forward_list<std::pair<uint32_t, std::vector<std::string>>> lists;
+
+	static std::vector<task_p> tasksOf(const std::vector<uint32_t>& ids) {
+		std::vector<task_p> tasks;
+		tasks.reserve(ids.size());
+		for (uint32_t id : ids) {
+			tasks.push_back(detail::taskArena().get(id));
+		}
+		return tasks;
+	}
+
+	// Properties are stored by the id of their key. Keys that no task has a property with have no id yet.
+
+	std::string* findProperty(uint32_t id) {
+		for (auto& property : properties) {
+			if (property.first == id) {
+				return &property.second;
+			}
+		}
+		return nullptr;
+	}
+
+	const std::string* findProperty(uint32_t id) const {
+		return const_cast<Task*>(this)->findProperty(id);
+	}
+
+	const std::string& get(const std::string& key, uint32_t id) const {
+		const std::string* value = findProperty(id);
+		if (value == nullptr) {
+			throw std::runtime_error("Attempting to get unknown key: " + key);
+		}
+		return *value;
+	}
+
+	void set(uint32_t id, const std::string& value) {
+		std::string* existing = findProperty(id);
+		if (existing != nullptr) {
+			*existing = value;
+			return;
+		}
+		properties.emplace_back(id, value);
+	}
+
+	std::vector<std::string>* findList(uint32_t id) {
+		for (auto& list : lists) {
+			if (list.first == id) {
+				return &list.second;
+			}
+		}
+		return nullptr;
+	}
+
+	const std::vector<std::string>* findList(uint32_t id) const {
+		return const_cast<Task*>(this)->findList(id);
+	}
+
+	const std::vector<std::string>& getList(const std::string& key, uint32_t id) const {
+		const std::vector<std::string>* values = findList(id);
+		if (values == nullptr) {
+			throw std::runtime_error("Attempting to get unknown list: " + key);
+		}
+		return *values;
+	}
+
+	std::vector<std::string>& list(uint32_t id) {
+		std::vector<std::string>* existing = findList(id);
+		if (existing != nullptr) {
+			return *existing;
+		}
+		lists.emplace_front(id, std::vector<std::string>());
+		return lists.front().second;
+	}
+
+	static uint32_t find(const std::string& key) { return detail::propertyKeys().find(key); }
+	static uint32_t intern(const std::string& key) { return detail::propertyKeys().intern(key); }
 
 public:
 	Task(std::string name) : name_(name) {}
 	virtual ~Task() {}
 
 	std::string name() const { return name_; }
+
+	/**
+	 * Declares that everything this task does is covered by the null build snapshot: it only writes outputs
+	 * recorded in the build log, lists directories with io::files or io::glob, or only sets properties.
+	 * Builds that execute any other task don't write a snapshot, since that task would have to run again.
+	 */
+	void markTracked() { tracked_ = true; }
+	bool isTracked() const { return tracked_; }
+
 	std::string addr() const {
 		std::stringstream buffer;
 		buffer << reinterpret_cast<const void*>(this);
 		return buffer.str();
 	}
 
-	void dependsOn(task_p other) { dependencies_.push_back(other); }
-	void dependsOn(std::vector<task_p>& others) { dependencies_.insert(dependencies_.end(), others.begin(), others.end()); }
-	void dependsOn(std::initializer_list<task_p> others) { dependencies_.insert(dependencies_.end(), others.begin(), others.end()); }
-	const std::vector<task_p> dependencies() const { return dependencies_; }
-	void followedBy(task_p other) { followingTasks_.push_back(other); }
-	void followedBy(std::vector<task_p>& others) { followingTasks_.insert(followingTasks_.end(), others.begin(), others.end()); }
-	void followedBy(std::initializer_list<task_p> others) { followingTasks_.insert(followingTasks_.end(), others.begin(), others.end()); }
-	const std::vector<task_p> followingTasks() const { return followingTasks_; }
+	/**
+	 * @return The id of `t` in the task arena, giving it one if it doesn't have one yet.
+	 */
+	static uint32_t idOf(const task_p& t) {
+		uint32_t id = t->id_.load(std::memory_order_acquire);
+		return id != detail::TaskArena::NONE ? id : detail::taskArena().adopt(t, t->id_);
+	}
+
+	/**
+	 * Removes `t` from the task arena so that it is freed once nothing else holds it. See
+	 * @ref detail::TaskArena::release.
+	 */
+	static void release(const task_p& t) {
+		detail::taskArena().release(t->id_);
+	}
+
+	void dependsOn(task_p other) { dependencies_.push_back(idOf(other)); }
+	void dependsOn(std::vector<task_p>& others) { for (auto& other : others) dependsOn(other); }
+	void dependsOn(std::initializer_list<task_p> others) { for (auto& other : others) dependsOn(other); }
+	const std::vector<task_p> dependencies() const { return tasksOf(dependencies_); }
+	void followedBy(task_p other) { followingTasks_.push_back(idOf(other)); }
+	void followedBy(std::vector<task_p>& others) { for (auto& other : others) followedBy(other); }
+	void followedBy(std::initializer_list<task_p> others) { for (auto& other : others) followedBy(other); }
+	const std::vector<task_p> followingTasks() const { return tasksOf(followingTasks_); }
+
+	// The ids of the tasks above in the task arena.
+	const std::vector<uint32_t>& dependencyIds() const { return dependencies_; }
+	const std::vector<uint32_t>& followerIds() const { return followingTasks_; }
 
 	//
-	// Single-valued properties.
+	// Single-valued properties. Each also takes a PropertyKey, whose id is known.
 	//
 
-	const std::string get(const std::string& key) const {
-		if (!has(key)) {
-			std::runtime_error("Attempting to get unknown key: " + key);
-		}
-		return properties.at(key);
-	}
+	const std::string get(const std::string& key) const { return get(key, find(key)); }
+	const std::string get(const PropertyKey& key) const { return get(key, key.id()); }
 
-	void set(const std::string& key, const std::string& value) {
-		properties[key] = value;
-	}
+	void set(const std::string& key, const std::string& value) { set(intern(key), value); }
+	void set(const PropertyKey& key, const std::string& value) { set(key.id(), value); }
 
-	bool has(const std::string& key) const {
-		return properties.find(key) != properties.end();
-	}
+	bool has(const std::string& key) const { return findProperty(find(key)) != nullptr; }
+	bool has(const PropertyKey& key) const { return findProperty(key.id()) != nullptr; }
 
 	std::vector<std::string> propKeys() {
 		std::vector<std::string> keys;
-		for (auto& it : properties) {
-			keys.push_back(it.first);
+		for (auto& property : properties) {
+			keys.push_back(detail::propertyKeys().name(property.first));
 		}
 		return keys;
 	}
@@ -113,39 +307,32 @@ public:
 	// Multi-valued properties.
 	//
 
-	const std::vector<std::string>& getList(const std::string& key) const {
-		if (!hasList(key)) {
-			std::runtime_error("Attempting to get unknown list: " + key);
-		}
-		return lists.at(key);
-	}
+	const std::vector<std::string>& getList(const std::string& key) const { return getList(key, find(key)); }
+	const std::vector<std::string>& getList(const PropertyKey& key) const { return getList(key, key.id()); }
 
-	void push(const std::string& key, const std::string& value) {
-		if (!hasList(key)) {
-			lists[key] = std::vector<std::string>();
-		}
-		lists[key].push_back(value);
-	}
+	void push(const std::string& key, const std::string& value) { list(intern(key)).push_back(value); }
+	void push(const PropertyKey& key, const std::string& value) { list(key.id()).push_back(value); }
 
 	void push(const std::string& key, const std::vector<std::string>& values) {
-		ensureList(key);
-		lists[key].insert(lists[key].end(), values.begin(), values.end());
+		std::vector<std::string>& target = list(intern(key));
+		target.insert(target.end(), values.begin(), values.end());
 	}
 
-	void ensureList(const std::string& key) {
-		if (!hasList(key)) {
-			lists[key] = std::vector<std::string>();
-		}
+	void push(const PropertyKey& key, const std::vector<std::string>& values) {
+		std::vector<std::string>& target = list(key.id());
+		target.insert(target.end(), values.begin(), values.end());
 	}
 
-	bool hasList(const std::string& key) const {
-		return lists.find(key) != lists.end();
-	}
+	void ensureList(const std::string& key) { list(intern(key)); }
+	void ensureList(const PropertyKey& key) { list(key.id()); }
+
+	bool hasList(const std::string& key) const { return findList(find(key)) != nullptr; }
+	bool hasList(const PropertyKey& key) const { return findList(key.id()) != nullptr; }
 
 	std::vector<std::string> listKeys() {
 		std::vector<std::string> keys;
-		for (auto& it : lists) {
-			keys.push_back(it.first);
+		for (auto& list : lists) {
+			keys.push_back(detail::propertyKeys().name(list.first));
 		}
 		return keys;
 	}
@@ -154,38 +341,528 @@ public:
 	virtual ExecutionResult execute() = 0;
 };
 
-class Executor {
-	std::unordered_map<std::string, task_p> tasks_;
-	std::queue<std::string> taskNamesToExecute_;
+/**
+ * A flat, index-based representation of the task graph that executors use to decide what may run next.
+ *
+ * Every task known to the graph has an index and two nodes: a "run" node (`2 * index`) that is ready
+ * once all of the task's dependencies are done and a "done" node (`2 * index + 1`) that is reached
+ * once the task has executed and all of its followers are done. Edges are stored as singly linked lists
+ * in flat arrays so that followers discovered while executing can be appended without rebuilding the
+ * whole graph.
+ *
+ * The graph is compiled once per run. Validation uses Kahn's algorithm over the newly added nodes and
+ * every cycle is reported (using Tarjan's algorithm on whatever Kahn's algorithm could not order)
+ * before an error is raised.
+ */
+class TaskGraph {
+	static const std::size_t NONE = static_cast<std::size_t>(-1);
+
+	// The arena ids of the tasks by index, and the reverse.
+	std::vector<uint32_t> ids_;
+	std::vector<std::size_t> indices_;
+	std::vector<std::size_t> followerCounts_;
+
+	std::vector<std::size_t> pending_;
+	std::vector<char> done_;
+	std::vector<std::size_t> head_;
+
+	std::vector<std::size_t> edgeTarget_;
+	std::vector<std::size_t> edgeNext_;
+
+	static std::size_t runNode(std::size_t task) { return 2 * task; }
+	static std::size_t doneNode(std::size_t task) { return 2 * task + 1; }
+
+	std::size_t indexOf(uint32_t id, std::vector<std::size_t>& discovered) {
+		if (id >= indices_.size()) {
+			indices_.resize(std::max<std::size_t>(id + 1, detail::taskArena().size()), NONE);
+		}
+		if (indices_[id] != NONE) {
+			return indices_[id];
+		}
+
+		std::size_t index = ids_.size();
+		indices_[id] = index;
+		ids_.push_back(id);
+		followerCounts_.push_back(0);
+		for (int i = 0; i < 2; i++) {
+			pending_.push_back(0);
+			done_.push_back(0);
+			head_.push_back(NONE);
+		}
+		discovered.push_back(index);
+		return index;
+	}
+
+	void addEdge(std::size_t from, std::size_t to) {
+		if (done_[from]) {
+			return;
+		}
+		edgeTarget_.push_back(to);
+		edgeNext_.push_back(head_[from]);
+		head_[from] = edgeTarget_.size() - 1;
+		pending_[to]++;
+	}
+
+	/**
+	 * Adds every task reachable from `roots` that isn't already in the graph. If `owner` is not `NONE`
+	 * the roots are followers that `owner` added while executing.
+	 *
+	 * @return The indices of the tasks that were added.
+	 */
+	std::vector<std::size_t> add(const std::vector<uint32_t>& roots, std::size_t owner) {
+		std::vector<std::size_t> discovered;
+		std::size_t firstNewNode = 2 * ids_.size();
+
+		std::vector<std::size_t> rootIndices;
+		for (uint32_t r : roots) {
+			rootIndices.push_back(indexOf(r, discovered));
+		}
+
+		for (std::size_t i = 0; i < discovered.size(); i++) {
+			std::size_t index = discovered[i];
+			const Task& t = *task(index);
+
+			addEdge(runNode(index), doneNode(index));
+
+			for (uint32_t dep : t.dependencyIds()) {
+				addEdge(doneNode(indexOf(dep, discovered)), runNode(index));
+			}
+
+			const std::vector<uint32_t>& followers = t.followerIds();
+			for (uint32_t f : followers) {
+				std::size_t follower = indexOf(f, discovered);
+
+				// A follower that was already in the graph has been scheduled on its own account.
+				if (runNode(follower) >= firstNewNode) {
+					addEdge(runNode(index), runNode(follower));
+				}
+				addEdge(doneNode(follower), doneNode(index));
+			}
+			followerCounts_[index] = followers.size();
+		}
+
+		if (owner != NONE) {
+			for (std::size_t follower : rootIndices) {
+				addEdge(doneNode(follower), doneNode(owner));
+			}
+		}
+
+		validate(firstNewNode, owner);
+		return discovered;
+	}
 
 	/**
-	 * Check that `toCheck` doesn't have a cyclic dependency given that we've already seen `seen`.
-	 * Assumes `toCheck` was not pushed onto `seen`.
+	 * Checks that the nodes starting at `firstNewNode` are acyclic and, if they were added as followers of
+	 * `owner`, that none of them waits on `owner`.
 	 */
-	void checkForCycles(Task* toCheck, std::vector<Task*>& seen) {
-		if (std::find(seen.begin(), seen.end(), toCheck) != seen.end()) {
+	void validate(std::size_t firstNewNode, std::size_t owner) {
+		std::size_t count = head_.size() - firstNewNode;
+
+		// Kahn's algorithm restricted to the new nodes.
+		std::vector<std::size_t> indegree(count, 0);
+		for (std::size_t n = firstNewNode; n < head_.size(); n++) {
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				if (edgeTarget_[e] >= firstNewNode) {
+					indegree[edgeTarget_[e] - firstNewNode]++;
+				}
+			}
+		}
+
+		std::vector<std::size_t> queue;
+		for (std::size_t i = 0; i < count; i++) {
+			if (indegree[i] == 0) {
+				queue.push_back(firstNewNode + i);
+			}
+		}
+
+		std::size_t ordered = 0;
+		while (!queue.empty()) {
+			std::size_t n = queue.back();
+			queue.pop_back();
+			ordered++;
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				if (edgeTarget_[e] >= firstNewNode && --indegree[edgeTarget_[e] - firstNewNode] == 0) {
+					queue.push_back(edgeTarget_[e]);
+				}
+			}
+		}
+
+		std::vector<std::vector<std::size_t>> cycles;
+		if (ordered != count) {
+			cycles = findCycles(firstNewNode, indegree);
+		}
+
+		if (owner != NONE) {
+			findCyclesThroughOwner(firstNewNode, owner, cycles);
+		}
+
+		if (cycles.empty()) {
+			return;
+		}
+
+		for (auto& cycle : cycles) {
 			log("Cycle found:");
-			for (Task* t : seen) {
-				log(std::string() + (t == toCheck ? "*" : "") + "\t" + t->name());
+			std::size_t previous = NONE;
+			for (std::size_t n : cycle) {
+				if (n / 2 != previous) {
+					log("\t" + describe(n / 2));
+				}
+				previous = n / 2;
+			}
+		}
+		throw std::runtime_error("Cycle found.");
+	}
+
+	/**
+	 * Tarjan's algorithm over the new nodes that Kahn's algorithm could not order.
+	 *
+	 * @return Every strongly connected component that forms a cycle.
+	 */
+	std::vector<std::vector<std::size_t>> findCycles(std::size_t firstNewNode, const std::vector<std::size_t>& indegree) {
+		std::size_t count = indegree.size();
+		std::vector<std::size_t> order(count, NONE);
+		std::vector<std::size_t> lowlink(count, 0);
+		std::vector<char> onStack(count, 0);
+		std::vector<std::size_t> stack;
+		std::vector<std::vector<std::size_t>> cycles;
+		std::size_t counter = 0;
+
+		// Explicit call stack of (node, next edge to visit) to avoid recursing on deep graphs.
+		std::vector<std::pair<std::size_t, std::size_t>> calls;
+
+		for (std::size_t start = 0; start < count; start++) {
+			if (indegree[start] == 0 || order[start] != NONE) {
+				continue;
+			}
+
+			calls.push_back(std::make_pair(start, head_[firstNewNode + start]));
+			order[start] = lowlink[start] = counter++;
+			stack.push_back(start);
+			onStack[start] = 1;
+
+			while (!calls.empty()) {
+				std::size_t v = calls.back().first;
+				std::size_t& e = calls.back().second;
+
+				if (e != NONE) {
+					std::size_t target = edgeTarget_[e];
+					e = edgeNext_[e];
+
+					if (target < firstNewNode || indegree[target - firstNewNode] == 0) {
+						continue;
+					}
+
+					std::size_t w = target - firstNewNode;
+					if (order[w] == NONE) {
+						order[w] = lowlink[w] = counter++;
+						stack.push_back(w);
+						onStack[w] = 1;
+						calls.push_back(std::make_pair(w, head_[target]));
+					} else if (onStack[w]) {
+						lowlink[v] = std::min(lowlink[v], order[w]);
+					}
+					continue;
+				}
+
+				calls.pop_back();
+				if (!calls.empty()) {
+					std::size_t parent = calls.back().first;
+					lowlink[parent] = std::min(lowlink[parent], lowlink[v]);
+				}
+
+				if (lowlink[v] != order[v]) {
+					continue;
+				}
+
+				std::vector<std::size_t> component;
+				std::size_t w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					onStack[w] = 0;
+					component.push_back(firstNewNode + w);
+				} while (w != v);
+
+				if (component.size() > 1) {
+					std::reverse(component.begin(), component.end());
+					cycles.push_back(component);
+				}
+			}
+		}
+
+		return cycles;
+	}
+
+	/**
+	 * Followers added at runtime make `owner` wait on them. If any of them (transitively) waits on `owner`
+	 * in turn the build can never finish.
+	 */
+	void findCyclesThroughOwner(std::size_t firstNewNode, std::size_t owner, std::vector<std::vector<std::size_t>>& cycles) {
+		std::vector<char> waitsOnOwner(firstNewNode, 0);
+		std::vector<std::size_t> queue{doneNode(owner)};
+		waitsOnOwner[doneNode(owner)] = 1;
+
+		while (!queue.empty()) {
+			std::size_t n = queue.back();
+			queue.pop_back();
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				std::size_t target = edgeTarget_[e];
+				if (target < firstNewNode && !done_[target] && !waitsOnOwner[target]) {
+					waitsOnOwner[target] = 1;
+					queue.push_back(target);
+				}
+
+				if (target >= firstNewNode) {
+					cycles.push_back(std::vector<std::size_t>{doneNode(owner), n, target, doneNode(owner)});
+				}
+			}
+		}
+	}
+
+	std::string describe(std::size_t index) const {
+		const task_p& t = task(index);
+		return t->name().empty() ? "<unnamed task " + t->addr() + ">" : t->name();
+	}
+
+	void complete(std::size_t node, std::vector<std::size_t>& ready) {
+		std::vector<std::size_t> stack{node};
+		while (!stack.empty()) {
+			std::size_t n = stack.back();
+			stack.pop_back();
+			done_[n] = 1;
+
+			for (std::size_t e = head_[n]; e != NONE; e = edgeNext_[e]) {
+				std::size_t target = edgeTarget_[e];
+				if (--pending_[target] != 0) {
+					continue;
+				}
+				if (target % 2 == 0) {
+					ready.push_back(target / 2);
+				} else {
+					stack.push_back(target);
+				}
 			}
-			log("*\t" + toCheck->name());
-			throw std::runtime_error("Cycle found.");
 		}
+	}
 
-		seen.push_back(toCheck);
+public:
+	/**
+	 * Adds the tasks reachable from `roots` to the graph.
+	 *
+	 * @return The indices of the added tasks that are ready to execute.
+	 */
+	std::vector<std::size_t> compile(const std::vector<task_p>& roots) {
+		std::vector<uint32_t> ids;
+		for (auto& root : roots) {
+			ids.push_back(Task::idOf(root));
+		}
 
-		for (task_p dep : toCheck->dependencies()) {
-			checkForCycles(dep.get(), seen);
+		std::vector<std::size_t> ready;
+		for (std::size_t index : add(ids, NONE)) {
+			if (pending_[runNode(index)] == 0) {
+				ready.push_back(index);
+			}
 		}
+		return ready;
+	}
+
+	/**
+	 * Records that the task at `index` executed successfully. Followers it added while executing are
+	 * compiled into the graph.
+	 *
+	 * @param ready Indices of tasks that became ready to execute are appended to this.
+	 */
+	void executed(std::size_t index, std::vector<std::size_t>& ready) {
+		const std::vector<uint32_t>& followers = task(index)->followerIds();
+		if (followers.size() > followerCounts_[index]) {
+			std::vector<uint32_t> added(followers.begin() + followerCounts_[index], followers.end());
+			followerCounts_[index] = followers.size();
+
+			for (std::size_t i : add(added, index)) {
+				if (pending_[runNode(i)] == 0) {
+					ready.push_back(i);
+				}
+			}
+		}
+
+		complete(runNode(index), ready);
+	}
+
+	bool isDone(const task_p& t) const {
+		uint32_t id = Task::idOf(t);
+		return id < indices_.size() && indices_[id] != NONE && done_[doneNode(indices_[id])];
+	}
 
-		seen.pop_back();
+	const task_p& task(std::size_t index) const {
+		return detail::taskArena().get(ids_[index]);
+	}
+
+	std::size_t size() const {
+		return ids_.size();
+	}
+};
+
+const std::size_t TaskGraph::NONE;
+
+namespace detail {
+
+/**
+ * Executes `t` on the calling thread and records it in the trace.
+ */
+ExecutionResult executeTask(Task& t) {
+	if (!t.isTracked()) {
+		disableSnapshot();
+	}
+
+	if (t.name().empty()) {
+		return t.execute();
+	}
+
+	log("Executing: " + t.name());
+	if (!trace().isEnabled()) {
+		return t.execute();
+	}
+
+	long long begin = trace().now();
+	ExecutionResult result;
+	try {
+		result = t.execute();
+	} catch (...) {
+		trace().task(t.name(), begin, trace().now(), "exception");
+		throw;
+	}
+	trace().task(t.name(), begin, trace().now(), result == ExecutionResult::SUCCESS ? "success" : "failure");
+	return result;
+}
+
+} // namespace detail
+
+class Executor {
+	std::unordered_map<std::string, task_p> tasks_;
+
+	// The names of the tasks in order, so tasks whose names share a prefix can be found without searching
+	// every name.
+	std::set<std::string> names_;
+
+	std::queue<std::string> taskNamesToExecute_;
+
+	// Named tasks may be created by tasks that are already executing (e.g. configure tasks) so
+	// registration must be safe to call from any worker thread.
+	std::mutex tasksMutex_;
+
+protected:
+	/**
+	 * Creates a jobserver with `jobs` slots if commands may run nested builds and there isn't one to join
+	 * already. Must be called before any worker threads are started.
+	 */
+	void startJobServer(unsigned jobs) {
+		platform::JobServer& server = platform::jobServer();
+		if (server.isActive() || !server.isServerRequested()) {
+			return;
+		}
+
+		platform::JobServer::Style style = options().get("jobserver-style") == "pipe" ?
+			platform::JobServer::Style::PIPE : platform::JobServer::Style::FIFO;
+		if (!server.serve(jobs, style)) {
+			log_error("Unable to create a jobserver; nested builds will not share job slots");
+		}
 	}
 
 public:
 	virtual ~Executor() {}
-	virtual ExecutionResult execute() = 0;
 
+	/**
+	 * Executes `roots` and everything they depend on. May be called again with other tasks once it
+	 * returns, in which case tasks are executed again even if they were executed before.
+	 */
+	virtual ExecutionResult execute(const std::vector<task_p>& roots) = 0;
+
+	/**
+	 * Executes the tasks queued with @ref queue.
+	 */
+	ExecutionResult execute() {
+		return execute(dequeueTasks());
+	}
+
+	/**
+	 * Empties the queue of task names to execute.
+	 *
+	 * @return The tasks with the queued names.
+	 */
+	std::vector<task_p> dequeueTasks() {
+		std::vector<task_p> roots;
+		while (!taskNamesToExecute().empty()) {
+			auto name = taskNamesToExecute().front();
+			taskNamesToExecute().pop();
+
+			if (isPattern(name)) {
+				std::size_t matched = roots.size();
+				forEachTask(name, [&roots] (const task_p& t) { roots.push_back(t); });
+				if (roots.size() == matched) {
+					throw std::runtime_error("No tasks match: " + name);
+				}
+				continue;
+			}
+
+			task_p t = find(name);
+			if (t == nullptr) {
+				throw std::runtime_error("Unknown task: " + name);
+			}
+			roots.push_back(t);
+		}
+		return roots;
+	}
+
+	/**
+	 * @return True if `name` is a glob pattern selecting tasks rather than the name of a task.
+	 */
+	static bool isPattern(const std::string& name) {
+		return name.find_first_of("*?[{") != std::string::npos;
+	}
+
+	/**
+	 * @return The task with the given name or null if there is none.
+	 */
+	task_p find(const std::string& name) {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		auto it = tasks_.find(name);
+		return it == tasks_.end() ? nullptr : it->second;
+	}
+
+	/**
+	 * Calls `f` with every task that has a name, in order of their names. `f` must not add tasks.
+	 */
+	template <typename F>
+	void forEachTask(F f) {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		for (auto& name : names_) {
+			f(tasks_.find(name)->second);
+		}
+	}
+
+	/**
+	 * Calls `f` with every task whose name matches the glob pattern `pattern` (see cradle_glob.hpp), e.g.
+	 * `lib*`, in order of their names. Only the names starting with the characters before the first
+	 * wildcard are matched against the pattern. `f` must not add tasks.
+	 */
+	template <typename F>
+	void forEachTask(const std::string& pattern, F f) {
+		std::string prefix = pattern.substr(0, pattern.find_first_of("*?[{\\"));
+		io::Glob glob({pattern});
+
+		std::lock_guard<std::mutex> lock(tasksMutex_);
+		for (auto it = names_.lower_bound(prefix); it != names_.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+			if (glob.matches(*it)) {
+				f(tasks_.find(*it)->second);
+			}
+		}
+	}
+
+	/**
+	 * @return A copy of every task with a name. Prefer @ref find or @ref forEachTask, which don't copy them.
+	 */
 	std::unordered_map<std::string, task_p> tasks() {
+		std::lock_guard<std::mutex> lock(tasksMutex_);
 		return tasks_;
 	}
 
@@ -198,109 +875,320 @@ public:
 			return;
 		}
 
+		std::lock_guard<std::mutex> lock(tasksMutex_);
 		if (tasks_.find(t->name()) != tasks_.end()) {
 			throw std::runtime_error("Duplicate tasks with name: " + t->name());
 		}
 		tasks_[t->name()] = t;
+		names_.insert(t->name());
 	}
 
 	void queue(std::string name) {
 		taskNamesToExecute_.push(name);
 	}
 
+	/**
+	 * Check that none of the registered tasks are part of a cycle. Every cycle found is logged.
+	 */
 	void checkForCycles() {
-		for (auto& t : tasks()) {
-			auto seen = std::vector<Task*>();
-			checkForCycles(t.second.get(), seen);
-		}
+		std::vector<task_p> all;
+		forEachTask([&all] (const task_p& t) { all.push_back(t); });
+		TaskGraph().compile(all);
 	}
 };
 
 class SingleThreadedExecutor : public Executor {
+	TaskGraph graph;
 
-	std::unordered_map<task_p, ExecutionResult> results;
+public:
+	using Executor::execute;
 
-	bool wasExecuted(task_p task) const {
-		return results.find(task) != results.end();
-	}
+	ExecutionResult execute(const std::vector<task_p>& roots) override {
+		graph = TaskGraph();
+		std::vector<std::size_t> ready = graph.compile(roots);
+		startJobServer(1);
 
-	ExecutionResult getResult(task_p task) const {
-		return results.at(task);
+		while (!ready.empty()) {
+			std::size_t index = ready.back();
+			ready.pop_back();
+
+			task_p t = graph.task(index);
+			if (detail::executeTask(*t) == ExecutionResult::FAILURE) {
+				return ExecutionResult::FAILURE;
+			}
+
+			graph.executed(index, ready);
+		}
+		return ExecutionResult::SUCCESS;
 	}
+};
 
-	ExecutionResult setResult(task_p task, ExecutionResult result) {
-		results[task] = result;
-		return result;
+/**
+ * Executes tasks on a pool of worker threads.
+ *
+ * A task becomes ready once all of its dependencies are done and it is done once it has executed and
+ * all of its followers (including followers added while it was executing) are done. Ready tasks are
+ * pushed onto the deque of the worker that made them ready. Workers take work from the back of their
+ * own deque and steal from the front of the other workers' deques when they run out.
+ */
+class ParallelExecutor : public Executor {
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::size_t> ready;
+	};
+
+	unsigned threadCount_;
+
+	// Guards the graph and the failure state below.
+	std::mutex graphMutex;
+	TaskGraph graph;
+	bool failed = false;
+	std::exception_ptr error;
+	std::condition_variable progress;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// The number of tasks in the workers' deques. It changes together with a deque, while holding that
+	// worker's mutex, so idle workers only wake up when there is a task to take. Locked after a worker's
+	// mutex.
+	std::mutex idleMutex;
+	std::condition_variable idle;
+	std::size_t available = 0;
+	bool stopping = false;
+
+	void fail(std::exception_ptr e) {
+		std::lock_guard<std::mutex> lock(graphMutex);
+		failed = true;
+		if (e && !error) {
+			error = e;
+		}
+		progress.notify_all();
 	}
 
-	ExecutionResult execute(task_p t) {
-		checkForCycles();
+	void push(std::size_t workerIndex, const std::vector<std::size_t>& ready) {
+		if (ready.empty()) {
+			return;
+		}
+
+		{
+			Worker& w = *workers[workerIndex];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			w.ready.insert(w.ready.end(), ready.begin(), ready.end());
 
-		// Don't repeat a task twice.
-		if (wasExecuted(t)) {
-			return results[t];
+			std::lock_guard<std::mutex> idleLock(idleMutex);
+			available += ready.size();
 		}
+		idle.notify_all();
+	}
 
-		// Recursively execute dependencies.
-		for (auto dep : t->dependencies()) {
-			if (execute(dep) == ExecutionResult::FAILURE) {
-				return setResult(t, ExecutionResult::FAILURE);
+	bool pop(std::size_t workerIndex, std::size_t& index) {
+		for (std::size_t i = 0; i < workers.size(); i++) {
+			std::size_t victim = (workerIndex + i) % workers.size();
+			Worker& w = *workers[victim];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (w.ready.empty()) {
+				continue;
 			}
-		}
 
-		// Execute task.
+			// Take the most recently readied task from our own deque and the oldest from anyone else's.
+			if (victim == workerIndex) {
+				index = w.ready.back();
+				w.ready.pop_back();
+			} else {
+				index = w.ready.front();
+				w.ready.pop_front();
+			}
 
-		if (!t->name().empty()) {
-			log("Executing: " + t->name());
+			std::lock_guard<std::mutex> idleLock(idleMutex);
+			available--;
+			return true;
 		}
+		return false;
+	}
 
-		auto result = t->execute();
+	void work(std::size_t workerIndex) {
+		while (true) {
+			std::size_t index;
+			if (!pop(workerIndex, index)) {
+				std::unique_lock<std::mutex> lock(idleMutex);
+				idle.wait(lock, [this] { return stopping || available > 0; });
+				if (stopping) {
+					return;
+				}
+				continue;
+			}
 
-		if (result == ExecutionResult::FAILURE) {
-			return ExecutionResult::FAILURE;
-		}
+			task_p t;
+			{
+				std::lock_guard<std::mutex> lock(graphMutex);
+				if (failed) {
+					continue;
+				}
+				t = graph.task(index);
+			}
 
-		// Recursively execute followers.
-		for (auto f : t->followingTasks()) {
-			if (execute(f) == ExecutionResult::FAILURE) {
-				return setResult(t, ExecutionResult::FAILURE);
+			std::vector<std::size_t> ready;
+			try {
+				if (detail::executeTask(*t) == ExecutionResult::FAILURE) {
+					fail(nullptr);
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(graphMutex);
+				graph.executed(index, ready);
+				progress.notify_all();
+			} catch (...) {
+				fail(std::current_exception());
+				continue;
 			}
+
+			push(workerIndex, ready);
 		}
+	}
 
-		return setResult(t, ExecutionResult::SUCCESS);
+	bool isDone(const std::vector<task_p>& roots) const {
+		for (auto& t : roots) {
+			if (!graph.isDone(t)) {
+				return false;
+			}
+		}
+		return true;
 	}
 
 public:
-	ExecutionResult execute() override {
-		while (!taskNamesToExecute().empty()) {
-			auto name = taskNamesToExecute().front();
-			taskNamesToExecute().pop();
+	ParallelExecutor(unsigned threadCount = std::thread::hardware_concurrency()) :
+		threadCount_(std::max(1u, threadCount))
+	{}
 
-			bool executed = false;
-			for (auto& t : tasks()) {
-				if (t.first == name) {
-					auto result = execute(t.second);
-					executed = true;
+	unsigned threadCount() const {
+		return threadCount_;
+	}
 
-					if (result == ExecutionResult::FAILURE) {
-						return ExecutionResult::FAILURE;
-					}
-				}
-			}
+	void setThreadCount(unsigned threadCount) {
+		threadCount_ = std::max(1u, threadCount);
+	}
 
-			if (!executed) {
-				throw std::runtime_error("Unknown task: " + name);
-			}
+	using Executor::execute;
+
+	ExecutionResult execute(const std::vector<task_p>& roots) override {
+		graph = TaskGraph();
+		failed = false;
+		error = nullptr;
+		std::vector<std::size_t> ready = graph.compile(roots);
+		startJobServer(threadCount_);
+
+		workers.clear();
+		for (unsigned i = 0; i < threadCount_; i++) {
+			workers.push_back(std::make_unique<Worker>());
 		}
-		return ExecutionResult::SUCCESS;
+		stopping = false;
+		available = 0;
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < threadCount_; i++) {
+			threads.emplace_back([this, i] { work(i); });
+		}
+
+		push(0, ready);
+
+		{
+			std::unique_lock<std::mutex> lock(graphMutex);
+			progress.wait(lock, [&] { return failed || isDone(roots); });
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			stopping = true;
+		}
+		idle.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return failed ? ExecutionResult::FAILURE : ExecutionResult::SUCCESS;
 	}
 };
 
-static std::unique_ptr<Executor> executor = std::make_unique<SingleThreadedExecutor>();
+static std::unique_ptr<Executor> executor = std::make_unique<ParallelExecutor>();
 
+/**
+ * Parses the command line. Arguments are the names of tasks to execute, or glob patterns such as `'lib*'`
+ * selecting every task whose name matches, except for:
+ *
+ *  - `-j N` (or `-jN`): The number of worker threads used by the @ref ParallelExecutor.
+ *    Defaults to the `-j` value of a parent make, otherwise the number of online CPUs.
+ *  - `--name` or `--name=value`: Stored in @ref options(). Recognized options:
+ *     - `--content-hash`: Decide whether inputs changed by their contents rather than their timestamps.
+ *     - `--jobserver-style=fifo|pipe`: How the jobserver shared with nested builds is exported. Use `pipe`
+ *       when nesting versions of make older than 4.4.
+ *     - `--list[=pattern]`: Print the names of the tasks, or of those matching the glob pattern, after
+ *       configuring the build instead of building.
+ *     - `--no-snapshot`: Always configure and check the whole build, rather than skipping it when the
+ *       null build snapshot shows that nothing changed. See cradle_snapshot.hpp.
+ *     - `--trace[=file]`: Record when each task and command ran and write it to `file` (@ref
+ *       DEFAULT_TRACE_FILE by default) in the Chrome trace event format.
+ *     - `--watch`: Keep running after the build and rebuild the tasks as their sources change. See
+ *       @ref watchAndRebuild.
+ */
 void parseCmdLineArgs(int argc, char** argv) {
+	commandLine().assign(argv, argv + argc);
+
+	// Take job slots from the jobserver of a parent make or cradle, if there is one.
+	const char* makeflags = std::getenv("MAKEFLAGS");
+	if (makeflags != nullptr && platform::jobServer().connect(makeflags)) {
+		ParallelExecutor* parallel = dynamic_cast<ParallelExecutor*>(executor.get());
+		if (parallel && platform::jobServer().parentJobCount() > 0) {
+			parallel->setThreadCount(platform::jobServer().parentJobCount());
+		}
+	}
+
 	for (int i = 1; i < argc; ++i) {
-		executor->queue(std::string(argv[i]));
+		std::string arg(argv[i]);
+
+		if (arg.compare(0, 2, "-j") == 0) {
+			std::string jobs = arg.substr(2);
+			if (jobs.empty() && i + 1 < argc) {
+				jobs = argv[++i];
+			}
+
+			ParallelExecutor* parallel = dynamic_cast<ParallelExecutor*>(executor.get());
+			if (parallel) {
+				parallel->setThreadCount(static_cast<unsigned>(std::stoul(jobs)));
+			}
+			continue;
+		}
+
+		if (arg.compare(0, 2, "--") == 0) {
+			std::size_t equals = arg.find('=');
+			if (equals == std::string::npos) {
+				options().set(arg.substr(2));
+			} else {
+				options().set(arg.substr(2, equals - 2), arg.substr(equals + 1));
+			}
+			continue;
+		}
+
+		executor->queue(arg);
+	}
+
+	if (options().has("trace")) {
+		trace().enable(options().get("trace").empty() ? DEFAULT_TRACE_FILE : options().get("trace"));
+	}
+}
+
+/**
+ * Prints the names of the tasks selected with `--list`.
+ */
+void listTasks() {
+	auto print = [] (const task_p& t) { log(t->name()); };
+	std::string pattern = options().get("list");
+	if (pattern.empty()) {
+		executor->forEachTask(print);
+	} else {
+		executor->forEachTask(pattern, print);
 	}
 }
 
@@ -327,7 +1215,8 @@ public:
  */
 template <typename F>
 task_p task(std::string name, F&& f) {
-	task_p t = std::make_shared<FunctionTask<F>>(name, std::move(f));
+	task_p t = detail::taskArena().create<FunctionTask<F>>(name, std::move(f));
+	Task::idOf(t);
 	executor->add(t);
 	return t;
 }
@@ -344,9 +1233,18 @@ task_p task(std::string name, F&& f) {
  */
 template <typename F>
 task_p task(F f) {
-	return std::make_shared<FunctionTask<F>>("", std::move(f));
+	task_p t = detail::taskArena().create<FunctionTask<F>>("", std::move(f));
+	Task::idOf(t);
+	return t;
 }
 
+/**
+ * Marks `t` as tracked by the null build snapshot (see @ref Task::markTracked) and returns it.
+ */
+task_p tracked(task_p t) {
+	t->markTracked();
+	return t;
+}
 
 void log(const std::string& msg) {
 	printf("%s\n", msg.c_str());
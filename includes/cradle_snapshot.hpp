@@ -0,0 +1,339 @@
+/**
+ * @file cradle_snapshot.hpp
+ *
+ * @brief Lets a build that has nothing to do finish without configuring it.
+ *
+ * After a successful build cradle writes a snapshot of what the build depended on to @ref SNAPSHOT_FILE:
+ * every output that was found up to date or built, the inputs recorded for them in the build log along with
+ * their signatures, and every directory searched for source files. The snapshot is keyed by the cradle
+ * executable, which includes the compiled build.cpp, the working directory, the command line and the
+ * environment variables that select the toolchain.
+ *
+ * The next run with the same key only has to check those files. If none of them changed, no outputs are
+ * missing and no files were added to or removed from the searched directories, every output is up to date
+ * and cradle exits without running `configure()`.
+ *
+ * Only tasks marked with @ref Task::markTracked are known to have no effects beyond these files, which
+ * cradle does for its own C++, file listing and Conan tasks. Builds that execute any other task, e.g. a
+ * task created from a function in build.cpp or an `exec` task, don't write a snapshot.
+ * Neither do builds run with `--no-snapshot`.
+ */
+
+#pragma once
+
+#include <cradle_build_log.hpp>
+#include <cradle_main.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_stat.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+static const std::string SNAPSHOT_FILE = ".cradle_snapshot";
+
+class Snapshot {
+	static constexpr const char* MAGIC = "CRADSNP";
+	static const uint32_t VERSION = 1;
+
+	// Files are checked in parallel once there are this many.
+	static const std::size_t PARALLEL_CHECK_MIN_FILES = 4096;
+
+	std::string path;
+	std::mutex mutex;
+	bool trackable = true;
+
+	template <typename T>
+	static void write(std::string& buffer, const T& value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static void writeString(std::string& buffer, const std::string& value) {
+		write(buffer, static_cast<uint32_t>(value.size()));
+		buffer.append(value);
+	}
+
+	template <typename T>
+	static bool read(const std::string& buffer, std::size_t& pos, T& value) {
+		if (buffer.size() - pos < sizeof(T)) {
+			return false;
+		}
+		std::memcpy(&value, buffer.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	static bool readString(const std::string& buffer, std::size_t& pos, std::string& value) {
+		uint32_t length;
+		if (!read(buffer, pos, length) || buffer.size() - pos < length) {
+			return false;
+		}
+		value.assign(buffer, pos, length);
+		pos += length;
+		return true;
+	}
+
+	static std::string header() {
+		std::string buffer(MAGIC, std::strlen(MAGIC) + 1);
+		write(buffer, VERSION);
+		return buffer;
+	}
+
+	/**
+	 * @return What the snapshot is only valid for, or an empty string if the executable can't be identified.
+	 */
+	static std::string key() {
+		if (commandLine().empty()) {
+			return "";
+		}
+
+#ifdef PLATFORM_LINUX
+		std::string executable = "/proc/self/exe";
+#else
+		std::string executable = commandLine()[0];
+#endif
+		struct stat s;
+		if (stat(executable.c_str(), &s) != 0) {
+			return "";
+		}
+
+		std::string buffer;
+		FileSignature signature = signatureOf(s);
+		write(buffer, signature.mtime);
+		write(buffer, signature.size);
+		write(buffer, signature.inode);
+		writeString(buffer, platform::platform_getcwd());
+
+		for (std::size_t i = 1; i < commandLine().size(); i++) {
+			writeString(buffer, commandLine()[i]);
+		}
+
+		// The variables that select the compiler, archiver and linker of the default toolchain.
+		for (auto& name : {"CXX", "AR", "CRADLE_LINKER"}) {
+			const char* value = std::getenv(name);
+			writeString(buffer, value == nullptr ? "" : std::string(name) + "=" + value);
+		}
+		return buffer;
+	}
+
+	static bool hasSignature(const std::string& path, const FileSignature& signature) {
+		struct stat s;
+		return stat(path.c_str(), &s) == 0 && signatureOf(s) == signature;
+	}
+
+	/**
+	 * @return True if every file in `files` still has its signature.
+	 */
+	static bool unchanged(const std::vector<std::pair<std::string, FileSignature>>& files) {
+		unsigned threadCount = files.size() < PARALLEL_CHECK_MIN_FILES ? 1 : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<char> results(threadCount, 1);
+
+		auto check = [&] (unsigned thread) {
+			for (std::size_t i = thread; i < files.size() && results[thread]; i += threadCount) {
+				if (!hasSignature(files[i].first, files[i].second)) {
+					results[thread] = 0;
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < threadCount; i++) {
+			threads.emplace_back(check, i);
+		}
+		check(0);
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		return std::find(results.begin(), results.end(), 0) == results.end();
+	}
+
+public:
+	Snapshot(const std::string& path) : path(path) {}
+
+	/**
+	 * Prevents a snapshot from being written in this run. Called when a command runs or a task executes that
+	 * may have effects beyond the outputs it declares, since it would have to run again in the next build.
+	 */
+	void disable() {
+		std::lock_guard<std::mutex> lock(mutex);
+		trackable = false;
+	}
+
+	/**
+	 * @return True if there is a snapshot for this run and nothing it depends on changed.
+	 */
+	bool isUpToDate() {
+		std::string expectedKey = key();
+		std::string contents;
+		if (expectedKey.empty() || !io::read_file(path, contents)) {
+			return false;
+		}
+
+		std::string expectedHeader = header();
+		if (contents.compare(0, expectedHeader.size(), expectedHeader) != 0) {
+			return false;
+		}
+
+		std::size_t pos = expectedHeader.size();
+		std::string snapshotKey;
+		uint32_t count;
+		if (!readString(contents, pos, snapshotKey) || snapshotKey != expectedKey || !read(contents, pos, count)) {
+			return false;
+		}
+
+		// Directories and inputs must be unchanged.
+		std::vector<std::pair<std::string, FileSignature>> files(count);
+		for (auto& file : files) {
+			if (
+				!readString(contents, pos, file.first) ||
+				!read(contents, pos, file.second.mtime) ||
+				!read(contents, pos, file.second.size) ||
+				!read(contents, pos, file.second.inode)
+			) {
+				return false;
+			}
+		}
+
+		// Outputs must exist.
+		if (!read(contents, pos, count)) {
+			return false;
+		}
+		std::vector<std::string> outputs(count);
+		for (auto& output : outputs) {
+			if (!readString(contents, pos, output)) {
+				return false;
+			}
+		}
+
+		for (auto& output : outputs) {
+			struct stat s;
+			if (stat(output.c_str(), &s) != 0) {
+				return false;
+			}
+		}
+		return unchanged(files);
+	}
+
+	/**
+	 * Writes the snapshot for the outputs and directories used in this run, unless it was disabled. Inputs
+	 * are recorded with the signatures they had when their outputs were built; if one was modified since, the
+	 * next run rebuilds it.
+	 */
+	void save() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!trackable) {
+				return;
+			}
+		}
+
+		std::string snapshotKey = key();
+		if (snapshotKey.empty()) {
+			return;
+		}
+
+		// Directories are recorded as they were listed. If one changed since, a file may have been added or
+		// removed after it was listed and the next run must list it again.
+		std::map<std::string, FileSignature> files;
+		for (auto& directory : io::listedDirectories().get()) {
+			FileSignature listed = signatureOf(directory.second);
+			auto it = files.insert(std::make_pair(directory.first, listed));
+			if ((!it.second && it.first->second != listed) || !hasSignature(directory.first, listed)) {
+				return;
+			}
+		}
+
+		std::vector<std::string> outputs = buildLog().checkedOutputs();
+		for (auto& output : outputs) {
+			std::vector<std::pair<std::string, FileSignature>> inputs;
+			if (!buildLog().recordedInputs(output, inputs)) {
+				return;
+			}
+			for (auto& input : inputs) {
+				auto it = files.insert(input);
+				if (!it.second && it.first->second != input.second) {
+					// Outputs were built from different versions of this file, so one of them is out of date.
+					return;
+				}
+			}
+		}
+
+		std::string buffer = header();
+		writeString(buffer, snapshotKey);
+		write(buffer, static_cast<uint32_t>(files.size()));
+		for (auto& file : files) {
+			writeString(buffer, file.first);
+			write(buffer, file.second.mtime);
+			write(buffer, file.second.size);
+			write(buffer, file.second.inode);
+		}
+		write(buffer, static_cast<uint32_t>(outputs.size()));
+		for (auto& output : outputs) {
+			writeString(buffer, output);
+		}
+
+		std::string tmpPath = path + ".tmp";
+		io::mkdirs(io::path_parent(path));
+		if (io::write_file(tmpPath, buffer)) {
+			std::rename(tmpPath.c_str(), path.c_str());
+			io::invalidateStat(path);
+		}
+	}
+
+	/**
+	 * Deletes the snapshot so it isn't used while the build it described changes.
+	 */
+	void remove() {
+		std::remove(path.c_str());
+		io::invalidateStat(path);
+	}
+};
+
+const uint32_t Snapshot::VERSION;
+const std::size_t Snapshot::PARALLEL_CHECK_MIN_FILES;
+
+Snapshot& snapshot() {
+	static Snapshot instance(io::path_concat(DEFAULT_BUILD_DIR, SNAPSHOT_FILE));
+	return instance;
+}
+
+/**
+ * @return True if the targets on the command line are known to be up to date, in which case the build is
+ *         skipped. Otherwise the snapshot is deleted until the build succeeds.
+ */
+bool isNullBuild() {
+	if (options().has("no-snapshot") || options().has("watch") || options().has("list")) {
+		return false;
+	}
+	if (snapshot().isUpToDate()) {
+		log("Nothing to do: every output is up to date");
+		return true;
+	}
+	snapshot().remove();
+	return false;
+}
+
+void disableSnapshot() {
+	snapshot().disable();
+}
+
+/**
+ * Writes the snapshot after a successful build.
+ */
+void finishBuild(ExecutionResult result) {
+	if (result == ExecutionResult::SUCCESS && !options().has("no-snapshot")) {
+		snapshot().save();
+	}
+}
+
+} // namespace cradle
@@ -0,0 +1,145 @@
+/**
+ * @file cradle_string_table.hpp
+ *
+ * @brief A compact table for interning strings such as paths.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace detail {
+
+/**
+ * 64-bit FNV-1a.
+ */
+uint64_t hashString(const char* data, std::size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * Interns strings, giving each distinct string a dense id in the order it was first added.
+ *
+ * The strings are stored back to back in a single buffer and found through an open addressing hash table
+ * of ids, so interning many strings costs only a handful of allocations.
+ */
+class StringTable {
+	std::string data_;
+	std::vector<std::pair<std::size_t, uint32_t>> spans_;
+	std::vector<uint64_t> hashes_;
+
+	// Holds `id + 1` for occupied slots and 0 for empty ones. The size is always a power of two.
+	std::vector<uint32_t> slots_;
+
+	bool equals(uint32_t id, const char* s, std::size_t length) const {
+		return spans_[id].second == length && std::memcmp(data_.data() + spans_[id].first, s, length) == 0;
+	}
+
+	/**
+	 * @return The slot holding `s` or the empty slot where it would be inserted.
+	 */
+	std::size_t slotOf(uint64_t hash, const char* s, std::size_t length) const {
+		std::size_t mask = slots_.size() - 1;
+		std::size_t slot = static_cast<std::size_t>(hash) & mask;
+		while (slots_[slot] != 0) {
+			uint32_t id = slots_[slot] - 1;
+			if (hashes_[id] == hash && equals(id, s, length)) {
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	void rehash(std::size_t slotCount) {
+		slots_.assign(slotCount, 0);
+		std::size_t mask = slotCount - 1;
+		for (uint32_t id = 0; id < spans_.size(); id++) {
+			std::size_t slot = static_cast<std::size_t>(hashes_[id]) & mask;
+			while (slots_[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			slots_[slot] = id + 1;
+		}
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	StringTable() : slots_(16, 0) {}
+
+	/**
+	 * Prepare for a total of `count` strings taking up `bytes` bytes.
+	 */
+	void reserve(std::size_t count, std::size_t bytes) {
+		data_.reserve(bytes);
+		spans_.reserve(count);
+		hashes_.reserve(count);
+
+		std::size_t slotCount = slots_.size();
+		while (slotCount < 2 * count) {
+			slotCount *= 2;
+		}
+		if (slotCount != slots_.size()) {
+			rehash(slotCount);
+		}
+	}
+
+	/**
+	 * @return The id of `s`, adding it to the table if necessary.
+	 */
+	uint32_t intern(const char* s, std::size_t length) {
+		uint64_t hash = hashString(s, length);
+		std::size_t slot = slotOf(hash, s, length);
+		if (slots_[slot] != 0) {
+			return slots_[slot] - 1;
+		}
+
+		uint32_t id = static_cast<uint32_t>(spans_.size());
+		spans_.push_back(std::make_pair(data_.size(), static_cast<uint32_t>(length)));
+		hashes_.push_back(hash);
+		data_.append(s, length);
+		slots_[slot] = id + 1;
+
+		// Keep the table at most half full.
+		if (2 * spans_.size() > slots_.size()) {
+			rehash(2 * slots_.size());
+		}
+		return id;
+	}
+
+	uint32_t intern(const std::string& s) {
+		return intern(s.data(), s.size());
+	}
+
+	/**
+	 * @return The id of `s` or `NONE` if it was never interned.
+	 */
+	uint32_t find(const std::string& s) const {
+		std::size_t slot = slotOf(hashString(s.data(), s.size()), s.data(), s.size());
+		return slots_[slot] == 0 ? NONE : slots_[slot] - 1;
+	}
+
+	std::string get(uint32_t id) const {
+		return data_.substr(spans_[id].first, spans_[id].second);
+	}
+
+	std::size_t size() const {
+		return spans_.size();
+	}
+};
+
+const uint32_t StringTable::NONE;
+
+} // namespace detail
+} // namespace cradle
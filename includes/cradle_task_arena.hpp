@@ -0,0 +1,354 @@
+/**
+ * @file cradle_task_arena.hpp
+ *
+ * @brief Storage for the tasks of a build.
+ *
+ * Large builds create hundreds of thousands of small tasks. Tasks created with @ref task are allocated,
+ * along with the reference count of their @ref task_p, from large blocks rather than with one heap
+ * allocation each. Every task in the graph has a dense id, so edges between tasks are stored as arrays of
+ * ids and the executors index flat arrays with them instead of hashing pointers. The keys of task
+ * properties are interned to ids as well.
+ *
+ * The arena owns every task with an id until cradle exits or the task is released. Tasks released from the
+ * arena give their ids to tasks adopted later, which keeps the ids dense for tasks that only live for one
+ * execution, e.g. the stand-ins watch mode creates for each rebuild. Such tasks should be allocated on the
+ * heap rather than in the arena, since memory in the arena is only reclaimed when cradle exits.
+ */
+
+#pragma once
+
+#include <cradle_string_table.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+
+class Task;
+typedef std::shared_ptr<Task> task_p;
+
+namespace detail {
+
+/**
+ * Hands out memory from large blocks. Memory is only released when the arena is destroyed.
+ */
+class Arena {
+	static const std::size_t BLOCK_SIZE = 256 * 1024;
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* next = nullptr;
+	std::size_t remaining = 0;
+
+	static std::size_t paddingFor(const char* p, std::size_t alignment) {
+		return (alignment - reinterpret_cast<std::uintptr_t>(p) % alignment) % alignment;
+	}
+
+public:
+	void* allocate(std::size_t size, std::size_t alignment) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::size_t padding = paddingFor(next, alignment);
+		if (next == nullptr || padding + size > remaining) {
+			std::size_t blockSize = std::max(BLOCK_SIZE, size + alignment);
+			blocks.emplace_back(new char[blockSize]);
+			next = blocks.back().get();
+			remaining = blockSize;
+			padding = paddingFor(next, alignment);
+		}
+
+		char* result = next + padding;
+		next += padding + size;
+		remaining -= padding + size;
+		return result;
+	}
+};
+
+const std::size_t Arena::BLOCK_SIZE;
+
+/**
+ * Allocates from an @ref Arena. Deallocating does nothing.
+ */
+template <typename T>
+class ArenaAllocator {
+	template <typename U>
+	friend class ArenaAllocator;
+
+	Arena* arena;
+
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(std::size_t n) {
+		return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, std::size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {
+		return arena == other.arena;
+	}
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const {
+		return arena != other.arena;
+	}
+};
+
+/**
+ * Allocates tasks and maps ids to them.
+ *
+ * Tasks are stored in chunks that never move, so a task can be looked up by id while other threads add
+ * tasks, e.g. from configuring tasks that create their followers.
+ */
+class TaskArena {
+	static const std::size_t CHUNK_BITS = 12;
+	static const std::size_t CHUNK_SIZE = std::size_t(1) << CHUNK_BITS;
+	static const std::size_t MAX_CHUNKS = 4096;
+
+	Arena memory;
+
+	std::mutex mutex;
+	std::atomic<std::size_t> size_{0};
+	std::unique_ptr<std::atomic<task_p*>[]> chunks;
+
+	// Ids of released tasks, which are given to tasks adopted later.
+	std::vector<uint32_t> freeIds;
+
+	task_p& slot(std::size_t index) const {
+		return chunks[index >> CHUNK_BITS].load(std::memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	TaskArena() : chunks(new std::atomic<task_p*>[MAX_CHUNKS]) {
+		for (std::size_t i = 0; i < MAX_CHUNKS; i++) {
+			chunks[i].store(nullptr);
+		}
+	}
+
+	/**
+	 * Creates a task of type `T` in the arena. It doesn't have an id until it is adopted.
+	 */
+	template <typename T, typename... Args>
+	std::shared_ptr<T> create(Args&&... args) {
+		return std::allocate_shared<T>(ArenaAllocator<T>(memory), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Gives `t` an id, storing it in `id`, unless `id` already holds one. The arena keeps `t` alive from then
+	 * on.
+	 *
+	 * @return The id of `t`.
+	 */
+	uint32_t adopt(const task_p& t, std::atomic<uint32_t>& id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (id.load(std::memory_order_relaxed) != NONE) {
+			return id.load(std::memory_order_relaxed);
+		}
+
+		if (!freeIds.empty()) {
+			uint32_t reused = freeIds.back();
+			freeIds.pop_back();
+			slot(reused) = t;
+			id.store(reused, std::memory_order_release);
+			return reused;
+		}
+
+		std::size_t index = size_.load(std::memory_order_relaxed);
+		std::size_t chunk = index >> CHUNK_BITS;
+		if (chunk >= MAX_CHUNKS) {
+			throw std::runtime_error("Too many tasks.");
+		}
+		if (chunks[chunk].load(std::memory_order_relaxed) == nullptr) {
+			chunks[chunk].store(new task_p[CHUNK_SIZE], std::memory_order_release);
+		}
+		chunks[chunk].load(std::memory_order_relaxed)[index & (CHUNK_SIZE - 1)] = t;
+
+		size_.store(index + 1, std::memory_order_release);
+		id.store(static_cast<uint32_t>(index), std::memory_order_release);
+		return static_cast<uint32_t>(index);
+	}
+
+	/**
+	 * Drops the arena's reference to the task whose id is in `id`, if any, and resets `id`. The id is given to
+	 * the next task adopted. Must not be called while tasks execute or while any task or graph still refers
+	 * to the released task by its id.
+	 */
+	void release(std::atomic<uint32_t>& id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		uint32_t released = id.load(std::memory_order_relaxed);
+		if (released == NONE) {
+			return;
+		}
+
+		slot(released).reset();
+		freeIds.push_back(released);
+		id.store(NONE, std::memory_order_release);
+	}
+
+	const task_p& get(uint32_t id) const {
+		return slot(id);
+	}
+
+	/**
+	 * @return One more than the largest id given to a task, including released ones.
+	 */
+	std::size_t size() const {
+		return size_.load(std::memory_order_acquire);
+	}
+};
+
+const std::size_t TaskArena::CHUNK_BITS;
+const std::size_t TaskArena::CHUNK_SIZE;
+const std::size_t TaskArena::MAX_CHUNKS;
+const uint32_t TaskArena::NONE;
+
+/**
+ * The arena is never destroyed, since tasks may be referenced by other objects with static storage
+ * duration until the very end of the program.
+ */
+TaskArena& taskArena() {
+	static TaskArena* instance = new TaskArena();
+	return *instance;
+}
+
+/**
+ * Interns the keys of task properties.
+ *
+ * Every executing task reads properties, so looking up a key doesn't take a lock: keys are only ever
+ * added, and readers probe an index that is replaced rather than modified when it grows. Adding a key is
+ * serialized by a mutex.
+ */
+class PropertyKeys {
+	struct Key {
+		uint64_t hash;
+		uint32_t id;
+		std::string name;
+	};
+
+	// Open addressing over the keys, at most half full. The size is always a power of two.
+	struct Index {
+		std::size_t mask;
+		std::unique_ptr<std::atomic<const Key*>[]> slots;
+
+		explicit Index(std::size_t slotCount) : mask(slotCount - 1), slots(new std::atomic<const Key*>[slotCount]) {
+			for (std::size_t i = 0; i < slotCount; i++) {
+				slots[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		 * @return The key with `name` or the empty slot where it would be inserted.
+		 */
+		std::atomic<const Key*>& slotOf(uint64_t hash, const std::string& name) const {
+			std::size_t slot = static_cast<std::size_t>(hash) & mask;
+			while (true) {
+				const Key* key = slots[slot].load(std::memory_order_acquire);
+				if (key == nullptr || (key->hash == hash && key->name == name)) {
+					return slots[slot];
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	};
+
+	std::mutex mutex;
+
+	// Never moves its elements, so the index may point into it.
+	std::deque<Key> keys;
+
+	// Indexes that were replaced are kept, since readers may still be probing them.
+	std::vector<std::unique_ptr<Index>> indexes;
+	std::atomic<const Index*> index;
+
+	void grow() {
+		indexes.emplace_back(new Index(2 * (index.load(std::memory_order_relaxed)->mask + 1)));
+		for (auto& key : keys) {
+			indexes.back()->slotOf(key.hash, key.name).store(&key, std::memory_order_relaxed);
+		}
+		index.store(indexes.back().get(), std::memory_order_release);
+	}
+
+public:
+	static const uint32_t NONE = static_cast<uint32_t>(-1);
+
+	PropertyKeys() {
+		indexes.emplace_back(new Index(64));
+		index.store(indexes.back().get(), std::memory_order_release);
+	}
+
+	uint32_t intern(const std::string& name) {
+		uint32_t id = find(name);
+		if (id != NONE) {
+			return id;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		uint64_t hash = hashString(name.data(), name.size());
+		if (2 * (keys.size() + 1) > index.load(std::memory_order_relaxed)->mask + 1) {
+			grow();
+		}
+
+		std::atomic<const Key*>& slot = index.load(std::memory_order_relaxed)->slotOf(hash, name);
+		if (slot.load(std::memory_order_relaxed) != nullptr) {
+			return slot.load(std::memory_order_relaxed)->id;
+		}
+		keys.push_back(Key{hash, static_cast<uint32_t>(keys.size()), name});
+		slot.store(&keys.back(), std::memory_order_release);
+		return keys.back().id;
+	}
+
+	/**
+	 * @return The id of `name` or `NONE` if no task has a property with this key.
+	 */
+	uint32_t find(const std::string& name) const {
+		uint64_t hash = hashString(name.data(), name.size());
+		const Key* key = index.load(std::memory_order_acquire)->slotOf(hash, name).load(std::memory_order_acquire);
+		return key == nullptr ? NONE : key->id;
+	}
+
+	std::string name(uint32_t id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return keys[id].name;
+	}
+};
+
+const uint32_t PropertyKeys::NONE;
+
+PropertyKeys& propertyKeys() {
+	static PropertyKeys instance;
+	return instance;
+}
+
+} // namespace detail
+
+/**
+ * The key of a task property, interned once when it is created so that tasks look it up by id instead of
+ * hashing it. Used for the keys cradle defines; it is a string wherever one is expected.
+ */
+class PropertyKey : public std::string {
+	uint32_t id_;
+
+public:
+	explicit PropertyKey(const char* name) : std::string(name), id_(detail::propertyKeys().intern(*this)) {}
+
+	uint32_t id() const { return id_; }
+};
+
+} // namespace cradle
@@ -27,6 +27,10 @@ class TaskBuilder {
 	task_p _first;
 	std::string _name;
 	std::vector<detail::SubsequentTask> followers;
+	bool _tracked = false;
+
+	// Whether `_first` runs a function given to first().
+	bool _firstIsFunction = false;
 
 	static void copyNonconflictingKeys(Task* dst, Task* src) {
 		for (auto& k : src->propKeys()) {
@@ -43,7 +47,7 @@ class TaskBuilder {
 
 public:
 	TaskBuilder() :
-		_first(task([] (Task *) { return ExecutionResult::SUCCESS; }))
+		_first(tracked(task([] (Task *) { return ExecutionResult::SUCCESS; })))
 	{}
 
 	TaskBuilder& name(std::string _name) {
@@ -53,11 +57,22 @@ public:
 
 	TaskBuilder& first(std::function<ExecutionResult(Task*)> f) {
 		_first = task(std::move(f));
+		_firstIsFunction = true;
 		return *this;
 	}
 
 	TaskBuilder& first(task_p t) {
 		_first = t;
+		_firstIsFunction = false;
+		return *this;
+	}
+
+	/**
+	 * Marks the tasks running the given functions with @ref Task::markTracked, for functions that only set
+	 * properties, so that executing them doesn't prevent a null build snapshot.
+	 */
+	TaskBuilder& markTracked() {
+		_tracked = true;
 		return *this;
 	}
 
@@ -88,6 +103,9 @@ public:
 
 	task_p build() {
 		task_p current = _first;
+		if (_tracked && _firstIsFunction) {
+			_first->markTracked();
+		}
 		std::vector<detail::SubsequentTask> subsequentTasks = followers;
 
 		for (auto nextFunction : subsequentTasks) {
@@ -98,13 +116,16 @@ public:
 				return result;
 			});
 			current->dependsOn(prev);
+			if (_tracked) {
+				current->markTracked();
+			}
 		}
 
-		// Create final task with name.
-		task_p retVal = task(_name, [current] (Task* self) {
+		// Create final task with name. Only the tasks running the given functions are untracked, unless marked.
+		task_p retVal = tracked(task(_name, [current] (Task* self) {
 			TaskBuilder::copyNonconflictingKeys(self, current.get());
 			return ExecutionResult::SUCCESS;
-		});
+		}));
 		retVal->dependsOn(current);
 
 		return retVal;
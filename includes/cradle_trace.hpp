@@ -0,0 +1,160 @@
+/**
+ * @file cradle_trace.hpp
+ *
+ * @brief Records when each task and command ran in the Chrome trace event format.
+ *
+ * The file written by @ref Trace::write can be loaded in Perfetto (ui.perfetto.dev) or `chrome://tracing`.
+ * Every thread that executes tasks gets its own lane. Tasks are drawn as slices on their lane and the
+ * commands they run as slices nested inside them, with the command line, exit status and resource usage
+ * of the command as arguments.
+ */
+
+#pragma once
+
+#include <io/cradle_json.hpp>
+#include <platform/cradle_process.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cradle {
+
+static const std::string DEFAULT_TRACE_FILE = "build.json";
+
+class Trace {
+	typedef std::chrono::steady_clock Clock;
+
+	std::mutex mutex_;
+	bool enabled_ = false;
+	std::string path_;
+	Clock::time_point start_;
+
+	std::vector<std::string> events_;
+	std::unordered_map<std::thread::id, int> lanes_;
+
+	// Must be called with the mutex held.
+	int lane() {
+		auto it = lanes_.find(std::this_thread::get_id());
+		if (it != lanes_.end()) {
+			return it->second;
+		}
+
+		int lane = static_cast<int>(lanes_.size());
+		lanes_[std::this_thread::get_id()] = lane;
+		events_.push_back(
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(lane) +
+			",\"args\":{\"name\":\"lane " + std::to_string(lane) + "\"}}"
+		);
+		return lane;
+	}
+
+	void add(const std::string& name, const std::string& category, long long begin, long long end, const std::string& args) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		events_.push_back(
+			"{\"name\":" + json::quote(name) +
+			",\"cat\":\"" + category + "\"" +
+			",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(lane()) +
+			",\"ts\":" + std::to_string(begin) +
+			",\"dur\":" + std::to_string(end - begin) +
+			",\"args\":{" + args + "}}"
+		);
+	}
+
+public:
+	/**
+	 * Starts recording. Events are kept in memory until @ref write is called.
+	 */
+	void enable(const std::string& path) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!enabled_) {
+			start_ = Clock::now();
+		}
+		enabled_ = true;
+		path_ = path;
+	}
+
+	bool isEnabled() const {
+		return enabled_;
+	}
+
+	/**
+	 * @return Microseconds since recording started.
+	 */
+	long long now() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count();
+	}
+
+	/**
+	 * Records that the task `name` executed on the calling thread from `begin` to `end`.
+	 *
+	 * @param result "success", "failure" or "exception".
+	 */
+	void task(const std::string& name, long long begin, long long end, const std::string& result) {
+		add(name, "task", begin, end, "\"result\":" + json::quote(result));
+	}
+
+	/**
+	 * Records that the calling thread ran `cmd` from `begin` to `end`.
+	 */
+	void process(const std::string& cmd, const std::vector<std::string>& args, long long begin, long long end, const platform::ProcessResult& result) {
+		std::string name = args.empty() ? cmd : args[0];
+		std::size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos) {
+			name = name.substr(slash + 1);
+		}
+
+		add(name, "process", begin, end,
+			"\"command\":" + json::quote(cmd) +
+			",\"started\":" + (result.started ? "true" : "false") +
+			",\"exitCode\":" + std::to_string(result.exitCode) +
+			",\"signal\":" + std::to_string(result.signal) +
+			",\"userSeconds\":" + std::to_string(result.userSeconds) +
+			",\"systemSeconds\":" + std::to_string(result.systemSeconds) +
+			",\"maxResidentKb\":" + std::to_string(result.maxResidentKb)
+		);
+	}
+
+	/**
+	 * Writes every event recorded so far, replacing the file from an earlier call.
+	 *
+	 * @return False if the file couldn't be written.
+	 */
+	bool write() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!enabled_) {
+			return true;
+		}
+
+		FILE* file = fopen(path_.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+
+		std::string contents = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		contents += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"cradle\"}}";
+		for (auto& event : events_) {
+			contents += ",\n";
+			contents += event;
+		}
+		contents += "\n]}\n";
+
+		bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+		return fclose(file) == 0 && written;
+	}
+
+	const std::string& path() const {
+		return path_;
+	}
+};
+
+Trace& trace() {
+	static Trace instance;
+	return instance;
+}
+
+} // namespace cradle
@@ -0,0 +1,438 @@
+/**
+ * @file cradle_watch.hpp
+ *
+ * @brief Keeps cradle running after a build and rebuilds what changed sources affect (`--watch`).
+ *
+ * The configured task graph, the file lists found by @ref io::files and the stat cache stay in memory
+ * between builds. When a file changes only the tasks whose recorded inputs include it, and the tasks that
+ * depend on them, are executed again. Tasks that configured the build by adding followers are not executed
+ * again: their followers are. Adding or removing a file that @ref io::files would list changes the shape
+ * of the graph, so cradle then restarts itself to configure the build again.
+ */
+
+#pragma once
+
+#include <cradle_build_log.hpp>
+#include <cradle_main.hpp>
+#include <io/cradle_files.hpp>
+#include <io/cradle_stat.hpp>
+#include <platform/cradle_file_watcher.hpp>
+#include <platform/cradle_jobserver.hpp>
+#include <platform/cradle_platform_util.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef PLATFORM_LINUX
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace detail {
+
+// The property tasks that write a file set to its path, e.g. `cpp::OUTPUT_FILE`. The inputs recorded for
+// that file in the build log decide which changes the task depends on.
+static const PropertyKey WATCHED_OUTPUT_PROPERTY("OUTPUT_FILE");
+
+/**
+ * Stands in for a task of the watched build during one rebuild, so that the original's dependencies and
+ * followers aren't changed. It is allocated on the heap and released from the task arena after the rebuild,
+ * so rebuilds don't accumulate tasks.
+ */
+class RebuildTask : public Task {
+	task_p original;
+	bool execute_;
+	std::mutex& succeededMutex;
+	std::unordered_set<Task*>& succeeded;
+
+public:
+	RebuildTask(
+		task_p original,
+		bool execute,
+		std::mutex& succeededMutex,
+		std::unordered_set<Task*>& succeeded
+	) :
+		Task(""),
+		original(original),
+		execute_(execute),
+		succeededMutex(succeededMutex),
+		succeeded(succeeded)
+	{
+		// executeTask checks whether the original is tracked.
+		markTracked();
+	}
+
+	ExecutionResult execute() override {
+		if (!execute_) {
+			return ExecutionResult::SUCCESS;
+		}
+		ExecutionResult result = detail::executeTask(*original);
+		if (result == ExecutionResult::SUCCESS) {
+			std::lock_guard<std::mutex> lock(succeededMutex);
+			succeeded.insert(original.get());
+		}
+		return result;
+	}
+};
+
+/**
+ * The tasks of a build and which of them a change to a file affects.
+ */
+class WatchedBuild {
+	// Whether every task was executed, i.e. every configuring task added its followers.
+	bool configured;
+
+	std::unordered_map<Task*, task_p> tasks;
+	std::unordered_map<Task*, std::vector<Task*>> dependents;
+	std::unordered_map<Task*, std::vector<Task*>> owners;
+
+	// Keyed by @ref key. Inputs hold the path as recorded so that the same stat cache entry is invalidated.
+	std::unordered_map<std::string, std::pair<std::string, std::vector<Task*>>> inputs;
+	std::unordered_set<std::string> listedFiles;
+	std::vector<std::shared_ptr<const io::PathFilter>> listings;
+	std::unordered_map<std::string, std::vector<std::size_t>> listingsByDirectory;
+	std::vector<std::string> outputDirectories;
+	std::string workingDirectory;
+
+	// Tasks that weren't executed successfully since a change affected them.
+	std::unordered_set<Task*> pending;
+
+	static std::string key(const std::string& directory, const std::string& name) {
+		return directory + '\0' + name;
+	}
+
+	void collect(const task_p& t) {
+		std::vector<task_p> stack{t};
+		while (!stack.empty()) {
+			task_p next = stack.back();
+			stack.pop_back();
+			if (!tasks.emplace(next.get(), next).second) {
+				continue;
+			}
+
+			for (auto& dep : next->dependencies()) {
+				dependents[dep.get()].push_back(next.get());
+				stack.push_back(dep);
+			}
+			for (auto& follower : next->followingTasks()) {
+				owners[follower.get()].push_back(next.get());
+				stack.push_back(follower);
+			}
+		}
+	}
+
+	/**
+	 * @return True for inputs that belong to the project rather than the system or the build's outputs.
+	 */
+	bool isWatchable(const std::string& path) const {
+		if (path.empty()) {
+			return false;
+		}
+		if (path[0] == '/' && path.compare(0, workingDirectory.size() + 1, workingDirectory + "/") != 0) {
+			return false;
+		}
+		for (auto& dir : outputDirectories) {
+			if (path.compare(0, dir.size() + 1, dir + "/") == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool isListable(const std::string& directory, const std::string& name) const {
+		auto it = listingsByDirectory.find(directory);
+		if (it == listingsByDirectory.end()) {
+			return false;
+		}
+		std::string path = io::path_concat(directory, name);
+		for (std::size_t index : it->second) {
+			if (listings[index]->matches(path)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	/**
+	 * @param roots      The tasks that were executed.
+	 * @param configured Whether they were executed successfully.
+	 */
+	WatchedBuild(const std::vector<task_p>& roots, bool configured) :
+		configured(configured),
+		workingDirectory(platform::platform_getcwd())
+	{
+		for (auto& root : roots) {
+			collect(root);
+		}
+
+		for (auto& it : tasks) {
+			Task& t = *it.second;
+			if (t.has(WATCHED_OUTPUT_PROPERTY)) {
+				std::string dir = io::path_parent(t.get(WATCHED_OUTPUT_PROPERTY));
+				if (std::find(outputDirectories.begin(), outputDirectories.end(), dir) == outputDirectories.end()) {
+					outputDirectories.push_back(dir);
+				}
+			}
+
+			std::shared_ptr<const io::PathFilter> filter = io::fileFilter(t);
+			if (filter != nullptr) {
+				listings.push_back(filter);
+				for (auto& dir : t.getList(io::DIRECTORY_LIST)) {
+					listingsByDirectory[dir].push_back(listings.size() - 1);
+				}
+				for (auto& file : t.getList(io::FILE_LIST)) {
+					listedFiles.insert(key(io::path_parent(file), io::path_filename(file)));
+				}
+			}
+		}
+	}
+
+	/**
+	 * Reads the inputs of every task from the build log, since builds may change them, and watches the
+	 * directories they and the listed files are in.
+	 */
+	void update(platform::FileWatcher& watcher) {
+		inputs.clear();
+		std::vector<std::string> recorded;
+		for (auto& it : tasks) {
+			Task& t = *it.second;
+			if (!t.has(WATCHED_OUTPUT_PROPERTY) || !t.followingTasks().empty()) {
+				continue;
+			}
+			if (!buildLog().recordedInputs(t.get(WATCHED_OUTPUT_PROPERTY), recorded)) {
+				continue;
+			}
+
+			for (auto& input : recorded) {
+				if (!isWatchable(input)) {
+					continue;
+				}
+				std::string dir = io::path_parent(input);
+				auto& entry = inputs[key(dir, io::path_filename(input))];
+				entry.first = input;
+				entry.second.push_back(&t);
+
+				if (!watcher.isWatching(dir) && !watcher.watch(dir)) {
+					log_error("Unable to watch " + dir + " for changes");
+				}
+			}
+		}
+
+		for (auto& it : listingsByDirectory) {
+			if (!watcher.isWatching(it.first) && !watcher.watch(it.first)) {
+				log_error("Unable to watch " + it.first + " for changes");
+			}
+		}
+	}
+
+	/**
+	 * @param affected Set to the tasks whose inputs changed.
+	 * @return False if files the build lists were added or removed, so the build must be configured again.
+	 */
+	bool affectedBy(const std::vector<platform::FileWatcher::Event>& events, std::vector<Task*>& affected) {
+		affected.clear();
+		std::unordered_set<std::string> seen;
+		std::unordered_set<Task*> added;
+
+		for (auto& event : events) {
+			std::string name = key(event.directory, event.name);
+			if (!seen.insert(name).second) {
+				continue;
+			}
+
+			std::string path = io::path_concat(event.directory, event.name);
+			io::invalidateStat(path);
+
+			bool listed = listedFiles.find(name) != listedFiles.end();
+			if (event.isDirectory) {
+				if (event.kind != platform::FileWatcher::Event::Kind::MODIFIED && listingsByDirectory.count(event.directory) > 0) {
+					return false;
+				}
+				continue;
+			}
+
+			auto input = inputs.find(name);
+			if (input == inputs.end()) {
+				// Files that aren't inputs yet matter if they are sources that were added, or sources that
+				// never compiled.
+				if (io::exists(path) ? (listed ? !configured : isListable(event.directory, event.name)) : listed) {
+					return false;
+				}
+				continue;
+			}
+
+			io::invalidateStat(input->second.first);
+			if (listed && !io::exists(path)) {
+				return false;
+			}
+			for (Task* t : input->second.second) {
+				if (added.insert(t).second) {
+					affected.push_back(t);
+				}
+			}
+		}
+
+		return configured || affected.empty();
+	}
+
+	/**
+	 * Executes the tasks in `affected`, the tasks that depend on them and the tasks that still hadn't
+	 * been executed successfully after earlier changes.
+	 */
+	ExecutionResult rebuild(Executor& executor, const std::vector<Task*>& affected) {
+		// Like the executor's graph each task has a "run" and a "done" node. Running a task again makes
+		// its followers run again and its dependents' dependencies done again, and a follower being done
+		// again makes its owner done again.
+		std::unordered_set<Task*> runs(pending.begin(), pending.end());
+		std::unordered_set<Task*> dones;
+		std::vector<std::pair<Task*, bool>> stack;
+		for (Task* t : pending) {
+			stack.push_back(std::make_pair(t, true));
+		}
+		for (Task* t : affected) {
+			if (runs.insert(t).second) {
+				stack.push_back(std::make_pair(t, true));
+			}
+		}
+
+		while (!stack.empty()) {
+			Task* t = stack.back().first;
+			bool run = stack.back().second;
+			stack.pop_back();
+
+			if (run) {
+				for (auto& follower : t->followingTasks()) {
+					if (runs.insert(follower.get()).second) {
+						stack.push_back(std::make_pair(follower.get(), true));
+					}
+				}
+				if (dones.insert(t).second) {
+					stack.push_back(std::make_pair(t, false));
+				}
+				continue;
+			}
+
+			for (Task* dependent : dependents[t]) {
+				if (runs.insert(dependent).second) {
+					stack.push_back(std::make_pair(dependent, true));
+				}
+			}
+			for (Task* owner : owners[t]) {
+				if (dones.insert(owner).second) {
+					stack.push_back(std::make_pair(owner, false));
+				}
+			}
+		}
+
+		// Stand-ins for the affected tasks with the same dependencies and followers among themselves.
+		// Tasks that configured the build don't execute again, their followers do.
+		std::mutex succeededMutex;
+		std::unordered_set<Task*> succeeded;
+		std::unordered_map<Task*, task_p> proxies;
+		for (Task* t : dones) {
+			task_p original = tasks[t];
+			bool execute = runs.count(t) > 0 && t->followingTasks().empty();
+			if (execute) {
+				pending.insert(t);
+			}
+
+			proxies[t] = std::make_shared<RebuildTask>(original, execute, succeededMutex, succeeded);
+		}
+
+		std::vector<task_p> roots;
+		for (auto& it : proxies) {
+			for (auto& dep : it.first->dependencies()) {
+				auto proxy = proxies.find(dep.get());
+				if (proxy != proxies.end()) {
+					it.second->dependsOn(proxy->second);
+				}
+			}
+			for (auto& follower : it.first->followingTasks()) {
+				auto proxy = proxies.find(follower.get());
+				if (proxy != proxies.end()) {
+					it.second->followedBy(proxy->second);
+				}
+			}
+			roots.push_back(it.second);
+		}
+
+		ExecutionResult result = executor.execute(roots);
+		for (Task* t : succeeded) {
+			pending.erase(t);
+		}
+
+		// Nothing refers to the proxies by id anymore, so their ids are given to the next rebuild's.
+		for (auto& it : proxies) {
+			Task::release(it.second);
+		}
+		return result;
+	}
+};
+
+/**
+ * Replaces cradle with a new instance started with the same arguments, which configures the build again.
+ * Only returns if that fails.
+ */
+void restart() {
+#ifdef PLATFORM_LINUX
+	fflush(stdout);
+	platform::jobServer().stop();
+
+	std::vector<char*> argv;
+	for (auto& arg : commandLine()) {
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+	execv("/proc/self/exe", argv.data());
+	log_error("Unable to restart cradle: " + std::string(strerror(errno)));
+#endif
+}
+
+} // namespace detail
+
+int watchAndRebuild() {
+	std::vector<task_p> roots = executor->dequeueTasks();
+	ExecutionResult result = executor->execute(roots);
+
+	platform::FileWatcher watcher;
+	if (!watcher.isSupported()) {
+		log_error("--watch is not supported on this platform");
+		return result == ExecutionResult::SUCCESS ? 0 : 1;
+	}
+
+	detail::WatchedBuild build(roots, result == ExecutionResult::SUCCESS);
+	while (true) {
+		build.update(watcher);
+		writeTrace();
+		log("Watching for changes...");
+		fflush(stdout);
+
+		std::vector<platform::FileWatcher::Event> events;
+		bool complete;
+		if (!watcher.wait(events, complete)) {
+			log_error("Unable to watch for changes: " + std::string(strerror(errno)));
+			return 1;
+		}
+
+		std::vector<Task*> affected;
+		if (!complete || !build.affectedBy(events, affected)) {
+			log("Files were added or removed, configuring the build again");
+			detail::restart();
+			return 1;
+		}
+		if (!affected.empty()) {
+			build.rebuild(*executor, affected);
+		}
+	}
+}
+
+} // namespace cradle
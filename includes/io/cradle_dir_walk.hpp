@@ -0,0 +1,480 @@
+/**
+ * @file cradle_dir_walk.hpp
+ *
+ * @brief Lists the files under a directory using several threads.
+ *
+ * On Linux directories are read with `getdents64`, whose entries carry the type of each file, so files
+ * don't have to be stat'ed one by one. Other platforms read directories with tinydir. Directories are
+ * taken off a shared queue by a small pool of threads, which also match the paths of the files they find.
+ * The results are put in order afterwards, entries sorted by name and depth first, so the listing doesn't
+ * depend on how the work was split up.
+ *
+ * Directories named `.git`, cradle's own build directory and directories ignored by a `.gitignore` file
+ * are not searched. `.gitignore` files are read from the directories that are searched and from the
+ * directories between the working directory and the one the search starts in. Their patterns only prune
+ * directories; files are only filtered by the @ref PathFilter passed to @ref walkDirectory.
+ */
+
+#pragma once
+
+#include <cradle_main.hpp>
+#include <io/cradle_glob.hpp>
+#include <io/cradle_tinydir.hpp>
+#include <platform/cradle_platform.hpp>
+#include <platform/cradle_platform_util.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef PLATFORM_LINUX
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace io {
+
+/**
+ * Decides which files a directory walk lists by their paths.
+ */
+class PathFilter {
+public:
+	virtual ~PathFilter() {}
+	virtual bool matches(const std::string& path) const = 0;
+};
+
+/**
+ * Matches entire paths against an `include` and an `exclude` regex, as @ref files does.
+ */
+class RegexFilter : public PathFilter {
+	std::regex include;
+	std::regex exclude;
+
+public:
+	RegexFilter(const std::regex& include, const std::regex& exclude) : include(include), exclude(exclude) {}
+
+	bool matches(const std::string& path) const override {
+		return std::regex_match(path, include) && !std::regex_match(path, exclude);
+	}
+};
+
+/**
+ * Matches the paths of files under `root`, relative to `root`, against glob patterns, as @ref glob does.
+ */
+class GlobFilter : public PathFilter {
+	std::string root;
+	Glob patterns;
+
+public:
+	GlobFilter(const std::string& root, const std::vector<std::string>& include, const std::vector<std::string>& exclude) :
+		root(root),
+		patterns(include, exclude)
+	{}
+
+	bool matches(const std::string& path) const override {
+		if (path.size() <= root.size() + 1 || path.compare(0, root.size(), root) != 0 || path[root.size()] != '/') {
+			return false;
+		}
+		return patterns.matches(path.data() + root.size() + 1, path.size() - root.size() - 1);
+	}
+};
+
+namespace detail {
+
+// The most threads used to walk one directory tree.
+static const unsigned DIRECTORY_WALK_MAX_THREADS = 8;
+
+struct DirectoryEntry {
+	std::string name;
+	bool isDirectory;
+};
+
+/**
+ * Appends the entries of the directory at `path`, except `.` and `..`, to `entries`. Symbolic links are
+ * reported as files.
+ *
+ * @return False if the directory couldn't be read.
+ */
+bool readDirectory(const std::string& path, std::vector<DirectoryEntry>& entries) {
+#ifdef PLATFORM_LINUX
+	int fd = openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	alignas(struct dirent64) char buffer[32 * 1024];
+	long size;
+	while ((size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+		for (long pos = 0; pos < size;) {
+			const struct dirent64* entry = reinterpret_cast<const struct dirent64*>(buffer + pos);
+			pos += entry->d_reclen;
+
+			const char* name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+
+			bool isDirectory = entry->d_type == DT_DIR;
+			if (entry->d_type == DT_UNKNOWN) {
+				// Some file systems don't report types.
+				struct stat s;
+				isDirectory = fstatat(fd, name, &s, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(s.st_mode);
+			}
+			entries.push_back(DirectoryEntry{name, isDirectory});
+		}
+	}
+
+	close(fd);
+	return size == 0;
+#else
+	tinydir_dir dir;
+	if (tinydir_open(&dir, path.c_str()) != 0) {
+		return false;
+	}
+
+	for (; dir.has_next; tinydir_next(&dir)) {
+		tinydir_file file;
+		if (tinydir_readfile(&dir, &file) != 0) {
+			continue;
+		}
+		if (std::strcmp(file.name, ".") == 0 || std::strcmp(file.name, "..") == 0) {
+			continue;
+		}
+		entries.push_back(DirectoryEntry{file.name, file.is_dir != 0});
+	}
+
+	tinydir_close(&dir);
+	return true;
+#endif
+}
+
+/**
+ * The patterns of a `.gitignore` file along with those of the `.gitignore` files in the directories above
+ * it, which are overridden by its own.
+ */
+class IgnoreFile {
+	struct Pattern {
+		Glob glob;
+		bool negated;
+
+		// Anchored patterns are matched against the path relative to the `.gitignore`, others against the
+		// name of the directory.
+		bool anchored;
+	};
+
+	std::vector<Pattern> patterns;
+
+	// The length of the path of the directory containing the file, including the separator after it.
+	std::size_t prefixLength;
+
+	std::shared_ptr<const IgnoreFile> parent;
+
+public:
+	IgnoreFile(const std::string& contents, std::size_t prefixLength, std::shared_ptr<const IgnoreFile> parent) :
+		prefixLength(prefixLength),
+		parent(parent)
+	{
+		std::size_t begin = 0;
+		while (begin < contents.size()) {
+			std::size_t end = contents.find('\n', begin);
+			if (end == std::string::npos) {
+				end = contents.size();
+			}
+			std::string line = contents.substr(begin, end - begin);
+			begin = end + 1;
+
+			while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+				line.pop_back();
+			}
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			bool negated = line[0] == '!';
+			if (negated || (line[0] == '\\' && (line[1] == '#' || line[1] == '!'))) {
+				line.erase(0, 1);
+			}
+			while (!line.empty() && line.back() == '/') {
+				line.pop_back();
+			}
+			bool anchored = line.find('/') != std::string::npos;
+			if (anchored && line[0] == '/') {
+				line.erase(0, 1);
+			}
+			if (!line.empty()) {
+				patterns.push_back(Pattern{Glob({line}), negated, anchored});
+			}
+		}
+	}
+
+	/**
+	 * Reads the `.gitignore` in `directory`.
+	 *
+	 * @param prefixLength The length of `directory` as it appears in the paths passed to @ref isIgnored,
+	 *                     including the separator after it.
+	 * @return `parent` if there is no `.gitignore` in `directory`.
+	 */
+	static std::shared_ptr<const IgnoreFile> read(const std::string& directory, std::size_t prefixLength, std::shared_ptr<const IgnoreFile> parent) {
+		std::ifstream in(directory.empty() ? ".gitignore" : directory + "/.gitignore", std::ios::binary);
+		if (!in) {
+			return parent;
+		}
+		std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		return std::make_shared<const IgnoreFile>(contents, prefixLength, parent);
+	}
+
+	/**
+	 * @return True if the directory at `path` is ignored. The last pattern that matches wins.
+	 */
+	bool isIgnored(const std::string& path) const {
+		bool ignored = parent != nullptr && parent->isIgnored(path);
+		if (path.size() <= prefixLength) {
+			return ignored;
+		}
+
+		const char* relative = path.c_str() + prefixLength;
+		std::size_t relativeLength = path.size() - prefixLength;
+		std::size_t slash = path.find_last_of('/');
+		const char* name = slash == std::string::npos || slash < prefixLength ? relative : path.c_str() + slash + 1;
+		std::size_t nameLength = path.c_str() + path.size() - name;
+
+		for (auto& pattern : patterns) {
+			// Only a pattern that would change the result needs to be matched.
+			if (
+				pattern.negated == ignored &&
+				(pattern.anchored ? pattern.glob.matches(relative, relativeLength) : pattern.glob.matches(name, nameLength))
+			) {
+				ignored = !pattern.negated;
+			}
+		}
+		return ignored;
+	}
+};
+
+class DirectoryWalk {
+	struct Directory {
+		std::string path;
+		std::shared_ptr<const IgnoreFile> ignore;
+
+		// Taken before the directory is read, or zeroed if it couldn't be.
+		struct stat status;
+
+		// Matching files, whose directory is null, and subdirectories by name.
+		std::vector<std::pair<std::string, std::unique_ptr<Directory>>> entries;
+
+		Directory(const std::string& path, std::shared_ptr<const IgnoreFile> ignore) :
+			path(path),
+			ignore(ignore)
+		{}
+	};
+
+	const PathFilter& filter;
+	std::string buildDir;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<Directory*> pending;
+	std::size_t active = 0;
+
+	bool isPruned(const std::string& name, const std::string& path, const IgnoreFile* ignore) const {
+		if (name == ".git") {
+			return true;
+		}
+
+		std::size_t start = 0;
+		while (path.compare(start, 2, "./") == 0) {
+			start += 2;
+		}
+		if (path.compare(start, std::string::npos, DEFAULT_BUILD_DIR) == 0 || path == buildDir) {
+			return true;
+		}
+		return ignore != nullptr && ignore->isIgnored(path);
+	}
+
+	/**
+	 * Reads `directory` and returns its subdirectories.
+	 */
+	std::vector<Directory*> visit(Directory& directory) {
+		if (stat(directory.path.c_str(), &directory.status) != 0) {
+			std::memset(&directory.status, 0, sizeof(directory.status));
+		}
+
+		std::vector<DirectoryEntry> entries;
+		readDirectory(directory.path, entries);
+
+		std::string prefix = directory.path + "/";
+		for (auto& entry : entries) {
+			if (!entry.isDirectory && entry.name == ".gitignore") {
+				directory.ignore = IgnoreFile::read(directory.path, prefix.size(), directory.ignore);
+				break;
+			}
+		}
+
+		std::vector<Directory*> subdirectories;
+		for (auto& entry : entries) {
+			std::string path = prefix + entry.name;
+			if (entry.isDirectory) {
+				if (!isPruned(entry.name, path, directory.ignore.get())) {
+					std::unique_ptr<Directory> subdirectory(new Directory(path, directory.ignore));
+					subdirectories.push_back(subdirectory.get());
+					directory.entries.emplace_back(std::move(entry.name), std::move(subdirectory));
+				}
+			} else if (filter.matches(path)) {
+				directory.entries.emplace_back(std::move(entry.name), nullptr);
+			}
+		}
+
+		std::sort(directory.entries.begin(), directory.entries.end(), [] (
+				const std::pair<std::string, std::unique_ptr<Directory>>& a,
+				const std::pair<std::string, std::unique_ptr<Directory>>& b
+		) {
+			return a.first < b.first;
+		});
+		return subdirectories;
+	}
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed.wait(lock, [this] { return !pending.empty() || active == 0; });
+			if (pending.empty()) {
+				return;
+			}
+
+			Directory* directory = pending.back();
+			pending.pop_back();
+			active++;
+			lock.unlock();
+
+			std::vector<Directory*> subdirectories = visit(*directory);
+
+			lock.lock();
+			active--;
+			pending.insert(pending.end(), subdirectories.begin(), subdirectories.end());
+			if (!subdirectories.empty() || (active == 0 && pending.empty())) {
+				changed.notify_all();
+			}
+		}
+	}
+
+	static void collect(
+			const Directory& directory,
+			std::vector<std::string>& files,
+			std::vector<std::string>* directories,
+			std::vector<struct stat>* directoryStats
+	) {
+		if (directories != nullptr) {
+			directories->push_back(directory.path);
+		}
+		if (directoryStats != nullptr) {
+			directoryStats->push_back(directory.status);
+		}
+		for (auto& entry : directory.entries) {
+			if (entry.second == nullptr) {
+				files.push_back(directory.path + "/" + entry.first);
+			} else {
+				collect(*entry.second, files, directories, directoryStats);
+			}
+		}
+	}
+
+	/**
+	 * @return The `.gitignore` files between the working directory and `root`, if `root` is below it.
+	 */
+	static std::shared_ptr<const IgnoreFile> ancestorIgnoreFiles(const std::string& root) {
+		std::size_t start = 0;
+		while (root.compare(start, 2, "./") == 0) {
+			start += 2;
+		}
+		std::size_t end = root.find_last_not_of('/');
+		if (root.empty() || root[0] == '/' || root == "." || end == std::string::npos || end < start || root.find("..") != std::string::npos) {
+			return nullptr;
+		}
+
+		std::shared_ptr<const IgnoreFile> ignore = IgnoreFile::read("", start, nullptr);
+		for (std::size_t slash = root.find('/', start); slash != std::string::npos && slash < end; slash = root.find('/', slash + 1)) {
+			ignore = IgnoreFile::read(root.substr(0, slash), slash + 1, ignore);
+		}
+		return ignore;
+	}
+
+public:
+	DirectoryWalk(const PathFilter& filter) :
+		filter(filter),
+		buildDir(platform::platform_getcwd() + "/" + DEFAULT_BUILD_DIR)
+	{}
+
+	void run(
+			const std::string& root,
+			std::vector<std::string>& files,
+			std::vector<std::string>* directories,
+			std::vector<struct stat>* directoryStats
+	) {
+		Directory top(root, ancestorIgnoreFiles(root));
+		pending.push_back(&top);
+
+		unsigned threadCount = std::max(1u, std::min(DIRECTORY_WALK_MAX_THREADS, std::thread::hardware_concurrency()));
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < threadCount; i++) {
+			threads.emplace_back([this] { work(); });
+		}
+		work();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		collect(top, files, directories, directoryStats);
+	}
+};
+
+} // namespace detail
+
+/**
+ * Appends the path of every file under `root` that `filter` matches to `files`. Paths are `root` followed by
+ * the names of the directories and the file, separated by `/`.
+ *
+ * @param directories    If not null, every directory that was searched, starting with `root`, is appended.
+ * @param directoryStats If not null, the stats of each directory in `directories`, taken before it was read,
+ *                       are appended. They are zeroed for directories that couldn't be stat'ed.
+ */
+void walkDirectory(
+		const std::string& root,
+		const PathFilter& filter,
+		std::vector<std::string>& files,
+		std::vector<std::string>* directories = nullptr,
+		std::vector<struct stat>* directoryStats = nullptr
+) {
+	detail::DirectoryWalk(filter).run(root, files, directories, directoryStats);
+}
+
+/**
+ * Appends the path of every file under `root` whose path matches `include` and doesn't match `exclude` to
+ * `files`.
+ */
+void walkDirectory(
+		const std::string& root,
+		const std::regex& include,
+		const std::regex& exclude,
+		std::vector<std::string>& files,
+		std::vector<std::string>* directories = nullptr,
+		std::vector<struct stat>* directoryStats = nullptr
+) {
+	walkDirectory(root, RegexFilter(include, exclude), files, directories, directoryStats);
+}
+
+} // namespace io
+} // namespace cradle
@@ -6,19 +6,35 @@
 
 #include <cradle_main.hpp>
 #include <cradle_types.hpp>
+#include <io/cradle_dir_walk.hpp>
+#include <io/cradle_stat.hpp>
 #include <io/cradle_tinydir.hpp>
 #include <platform/cradle_platform.hpp>
 #include <platform/cradle_platform_util.hpp>
 
 #include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string.h>
 #include <regex>
+#include <utility>
+#include <vector>
 
 namespace cradle {
 
 namespace io {
 
-static const std::string FILE_LIST = "FILE_LIST";
+static const PropertyKey FILE_LIST("FILE_LIST");
+
+// Set on the tasks returned by @ref files and @ref glob: every directory that was searched and the
+// patterns files in them had to match, so that files added later can be recognized.
+static const PropertyKey DIRECTORY_LIST("DIRECTORY_LIST");
+static const PropertyKey FILE_INCLUDE_PATTERN("FILE_INCLUDE_PATTERN");
+static const PropertyKey FILE_EXCLUDE_PATTERN("FILE_EXCLUDE_PATTERN");
+static const PropertyKey FILE_INCLUDE_GLOBS("FILE_INCLUDE_GLOBS");
+static const PropertyKey FILE_EXCLUDE_GLOBS("FILE_EXCLUDE_GLOBS");
 
 // TODO: Do something smarter to handle volume names and other things.
 std::string path_concat(std::string a, std::string b) {
@@ -84,17 +100,59 @@ std::string path_ext(std::string p) {
 	return p.substr(pos+1);
 }
 
+/**
+ * @brief read_file  Reads the entire contents of a file.
+ * @return False if the file could not be read.
+ */
+bool read_file(const std::string& path, std::string& contents) {
+	std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!in) {
+		return false;
+	}
+
+	contents.resize(static_cast<std::size_t>(in.tellg()));
+	in.seekg(0);
+	in.read(&contents[0], contents.size());
+	return static_cast<bool>(in);
+}
+
+/**
+ * @brief write_file  Replaces the contents of a file.
+ * @return False if the file could not be written.
+ */
+bool write_file(const std::string& path, const std::string& contents) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	out.write(contents.data(), contents.size());
+	out.close();
+	invalidateStat(path);
+	return !out.fail();
+}
+
+/**
+ * @brief append_file  Adds `contents` to the end of a file, creating it if it doesn't exist.
+ * @return False if the file could not be written.
+ */
+bool append_file(const std::string& path, const std::string& contents) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::app);
+	out.write(contents.data(), contents.size());
+	out.close();
+	invalidateStat(path);
+	return !out.fail();
+}
+
 void mkdir_if_necessary(std::string d) {
-	tinydir_dir dir;
-	if (tinydir_open(&dir, d.c_str()) != 0) {
-		tinydir_close(&dir);
+	if (!exists(d)) {
 		if (platform::platform_mkdir(d.c_str()) != 0 && errno != EEXIST) {
 			log_error(std::string() + "Error making directory " + d.c_str() + ": " + strerror(errno));
 		}
+		invalidateStat(d);
 	}
 }
 
 void mkdirs(std::string d) {
+	if (d.empty()) {
+		return;
+	}
 	if (d == std::string(1, PATH_SEP)) {
 		return;
 	}
@@ -109,46 +167,46 @@ void mkdirs(std::string d) {
 	mkdir_if_necessary(d);
 }
 
+/**
+ * Appends the files under `path` that match `include` and don't match `exclude` to `aggregator`. See
+ * @ref walkDirectory.
+ */
 void recursiveAddFilesInDir(
 		std::vector<std::string>& aggregator,
 		const std::string& path,
 		const std::regex& include,
-		const std::regex& exclude
+		const std::regex& exclude,
+		std::vector<std::string>* directories = nullptr
 ) {
-	tinydir_dir dir;
-	tinydir_open(&dir, path.c_str());
-
-	while (dir.has_next) {
-		tinydir_file file;
-		tinydir_readfile(&dir, &file);
-
-		std::string filename(file.name);
-		std::string filepath(file.path);
-
-		if (filename == "." || filename == "..") {
-			tinydir_next(&dir);
-			continue;
-		}
-
-		if (file.is_dir) {
-			recursiveAddFilesInDir(aggregator, file.path, include, exclude);
+	walkDirectory(path, include, exclude, aggregator, directories);
+}
 
-		} else {
-			std::smatch includeMatch;
-			std::smatch excludeMatch;
+/**
+ * Every directory searched by @ref files or @ref glob in this run, with its stats from right before it was
+ * read. Adding or removing a file changes the timestamp of its directory, which is how the null build
+ * snapshot notices that the file lists are out of date, including when it happened during the build.
+ */
+class ListedDirectories {
+	std::mutex mutex;
+	std::vector<std::pair<std::string, struct stat>> directories;
 
-			if (
-				std::regex_match(filepath, includeMatch, include) &&
-				!std::regex_match(filepath, excludeMatch, exclude)
-			) {
-				aggregator.push_back(filepath);
-			}
+public:
+	void add(const std::vector<std::string>& listed, const std::vector<struct stat>& stats) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::size_t i = 0; i < listed.size(); i++) {
+			directories.push_back(std::make_pair(listed[i], stats[i]));
 		}
+	}
 
-		tinydir_next(&dir);
+	std::vector<std::pair<std::string, struct stat>> get() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return directories;
 	}
+};
 
-	tinydir_close(&dir);
+ListedDirectories& listedDirectories() {
+	static ListedDirectories instance;
+	return instance;
 }
 
 /**
@@ -160,17 +218,66 @@ void recursiveAddFilesInDir(
  * @return
  */
 task_p files(std::string dir, std::string include = std::string(".*"), std::string exclude = std::string("a^")) {
-	return task(
+	return tracked(task(
 		[=] (Task* self) {
 			std::vector<std::string> aggregator;
+			std::vector<std::string> directories;
+			std::vector<struct stat> directoryStats;
 			std::regex includeRegex(include);
 			std::regex excludeRegex(exclude);
 
-			recursiveAddFilesInDir(aggregator, dir, includeRegex, excludeRegex);
+			walkDirectory(dir, includeRegex, excludeRegex, aggregator, &directories, &directoryStats);
 			self->push(FILE_LIST, aggregator);
+			self->push(DIRECTORY_LIST, directories);
+			listedDirectories().add(directories, directoryStats);
+			self->set(FILE_INCLUDE_PATTERN, include);
+			self->set(FILE_EXCLUDE_PATTERN, exclude);
 			return ExecutionResult::SUCCESS;
 		}
-	);
+	));
+}
+
+/**
+ * @brief glob     A task to recursively find the files in a directory that match glob patterns. Faster than
+ *                 @ref files since all patterns are compiled into one automaton that matches each path in a
+ *                 single pass.
+ * @param dir      The path of the directory to search. Can be relative or absolute.
+ * @param include  Glob patterns (see @ref Glob) matched against the path of each file relative to `dir`, e.g.
+ *                 `*.{cpp,cc}` for the sources directly in `dir` or `**` for every file under it.
+ *                 Files must match at least one of them.
+ * @param exclude  Glob patterns that files must not match.
+ * @return
+ */
+task_p glob(std::string dir, std::vector<std::string> include, std::vector<std::string> exclude = std::vector<std::string>()) {
+	return tracked(task(
+		[=] (Task* self) {
+			std::vector<std::string> aggregator;
+			std::vector<std::string> directories;
+			std::vector<struct stat> directoryStats;
+
+			walkDirectory(dir, GlobFilter(dir, include, exclude), aggregator, &directories, &directoryStats);
+			self->push(FILE_LIST, aggregator);
+			self->push(DIRECTORY_LIST, directories);
+			listedDirectories().add(directories, directoryStats);
+			self->push(FILE_INCLUDE_GLOBS, include);
+			self->push(FILE_EXCLUDE_GLOBS, exclude);
+			return ExecutionResult::SUCCESS;
+		}
+	));
+}
+
+/**
+ * @return The filter a task returned by @ref files or @ref glob selected its files with, or null for other
+ *         tasks.
+ */
+std::shared_ptr<const PathFilter> fileFilter(const Task& t) {
+	if (!t.hasList(DIRECTORY_LIST) || t.getList(DIRECTORY_LIST).empty()) {
+		return nullptr;
+	}
+	if (t.hasList(FILE_INCLUDE_GLOBS)) {
+		return std::make_shared<GlobFilter>(t.getList(DIRECTORY_LIST)[0], t.getList(FILE_INCLUDE_GLOBS), t.getList(FILE_EXCLUDE_GLOBS));
+	}
+	return std::make_shared<RegexFilter>(std::regex(t.get(FILE_INCLUDE_PATTERN)), std::regex(t.get(FILE_EXCLUDE_PATTERN)));
 }
 
 } // namespace io
@@ -0,0 +1,380 @@
+/**
+ * @file cradle_glob.hpp
+ *
+ * @brief Matches paths against sets of glob patterns.
+ *
+ * Patterns support `*` and `?`, which don't match `/`, character classes such as `[a-z]` or `[!0-9]`,
+ * brace sets such as `{cpp,cc}` and `**`, which as a whole path segment matches any number of
+ * directories, so a pattern ending in a `**` segment matches every file below it. A `\` makes the next
+ * character literal.
+ *
+ * All patterns of a @ref Glob are compiled together into one deterministic automaton, so a path is
+ * matched against every pattern in a single pass over its characters.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cradle {
+namespace io {
+
+namespace detail {
+
+/**
+ * Appends every pattern `pattern` stands for, e.g. `a.cpp` and `a.hpp` for `a.{cpp,hpp}`, to `expanded`.
+ * Braces without a comma are kept as they are.
+ */
+void expandBraces(const std::string& pattern, std::vector<std::string>& expanded) {
+	for (std::size_t open = 0; open < pattern.size(); open++) {
+		if (pattern[open] == '\\') {
+			open++;
+			continue;
+		}
+		if (pattern[open] != '{') {
+			continue;
+		}
+
+		// Find the matching brace and the commas between them that aren't in nested braces.
+		std::vector<std::size_t> separators{open};
+		int depth = 0;
+		std::size_t close = open + 1;
+		for (; close < pattern.size(); close++) {
+			char c = pattern[close];
+			if (c == '\\') {
+				close++;
+			} else if (c == '{') {
+				depth++;
+			} else if (c == '}' && depth > 0) {
+				depth--;
+			} else if (c == '}') {
+				break;
+			} else if (c == ',' && depth == 0) {
+				separators.push_back(close);
+			}
+		}
+		if (close >= pattern.size() || separators.size() == 1) {
+			continue;
+		}
+		separators.push_back(close);
+
+		std::string prefix = pattern.substr(0, open);
+		std::string suffix = pattern.substr(close + 1);
+		for (std::size_t i = 0; i + 1 < separators.size(); i++) {
+			std::string alternative = pattern.substr(separators[i] + 1, separators[i + 1] - separators[i] - 1);
+			expandBraces(prefix + alternative + suffix, expanded);
+		}
+		return;
+	}
+	expanded.push_back(pattern);
+}
+
+} // namespace detail
+
+class Glob {
+	enum Accepts : uint8_t {
+		INCLUDED = 1,
+		EXCLUDED = 2
+	};
+
+	/**
+	 * A state of the nondeterministic automaton. A state has at most one pattern element's worth of
+	 * transitions: characters in `step` lead to `next`, characters in `stay` lead back to the state and
+	 * `epsilon` is reached without consuming a character.
+	 */
+	struct State {
+		std::bitset<256> step;
+		int next = -1;
+		std::bitset<256> stay;
+		int epsilon = -1;
+		uint8_t accepts = 0;
+	};
+
+	// The deterministic automaton gives up beyond this many states and paths are matched by simulating the
+	// nondeterministic one instead.
+	static const std::size_t MAX_DFA_STATES = 1024;
+
+	// The deterministic state that no path can leave, and the one matching starts in.
+	static const int DEAD = 0;
+	static const int START = 1;
+
+	std::vector<State> states;
+	std::vector<int> starts;
+
+	// Characters that every state treats the same way share a class.
+	uint8_t classOf[256];
+	std::size_t classCount = 0;
+
+	bool deterministic = false;
+	std::vector<int> transitions;
+	std::vector<uint8_t> accepting;
+
+	int addState() {
+		states.emplace_back();
+		return static_cast<int>(states.size()) - 1;
+	}
+
+	static std::bitset<256> notSlash() {
+		std::bitset<256> bytes;
+		bytes.set();
+		bytes.reset('/');
+		return bytes;
+	}
+
+	/**
+	 * Parses the character class at `pattern[begin]` into `bytes`.
+	 *
+	 * @return The position after the class, or `begin` if it isn't a class.
+	 */
+	static std::size_t parseClass(const std::string& pattern, std::size_t begin, std::bitset<256>& bytes) {
+		std::size_t i = begin + 1;
+		bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+		if (negated) {
+			i++;
+		}
+
+		std::size_t first = i;
+		for (; i < pattern.size() && (pattern[i] != ']' || i == first); i++) {
+			unsigned char low = pattern[i];
+			if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+				for (unsigned c = low; c <= static_cast<unsigned char>(pattern[i + 2]); c++) {
+					bytes.set(c);
+				}
+				i += 2;
+			} else {
+				bytes.set(low);
+			}
+		}
+		if (i >= pattern.size()) {
+			return begin;
+		}
+
+		if (negated) {
+			bytes.flip();
+		}
+		bytes &= notSlash();
+		return i + 1;
+	}
+
+	/**
+	 * Adds the states matching `pattern`, which must not contain braces.
+	 */
+	void addPattern(const std::string& pattern, uint8_t accepts) {
+		int current = addState();
+		starts.push_back(current);
+
+		std::size_t i = 0;
+		while (i < pattern.size()) {
+			char c = pattern[i];
+			bool segmentStart = i == 0 || pattern[i - 1] == '/';
+			bool segmentEnd = i + 2 == pattern.size() || (i + 2 < pattern.size() && pattern[i + 2] == '/');
+
+			if (c == '*' && i + 1 < pattern.size() && pattern[i + 1] == '*' && segmentStart && segmentEnd) {
+				if (i + 2 == pattern.size()) {
+					// A trailing `**` matches everything.
+					int next = addState();
+					states[current].stay.set();
+					states[current].epsilon = next;
+					current = next;
+					i += 2;
+				} else {
+					// `**/` matches any number of directories, including none.
+					int inside = addState();
+					int next = addState();
+					states[current].step = notSlash();
+					states[current].next = inside;
+					states[current].epsilon = next;
+					states[inside].stay = notSlash();
+					states[inside].step.set('/');
+					states[inside].next = current;
+					current = next;
+					i += 3;
+				}
+				continue;
+			}
+
+			if (c == '*') {
+				int next = addState();
+				states[current].stay = notSlash();
+				states[current].epsilon = next;
+				current = next;
+				while (i < pattern.size() && pattern[i] == '*') {
+					i++;
+				}
+				continue;
+			}
+
+			std::bitset<256> bytes;
+			std::size_t end = c == '[' ? parseClass(pattern, i, bytes) : i;
+			if (c == '?') {
+				bytes = notSlash();
+				i++;
+			} else if (end != i) {
+				i = end;
+			} else {
+				if (c == '\\' && i + 1 < pattern.size()) {
+					i++;
+				}
+				bytes.reset();
+				bytes.set(static_cast<unsigned char>(pattern[i]));
+				i++;
+			}
+
+			int next = addState();
+			states[current].step = bytes;
+			states[current].next = next;
+			current = next;
+		}
+		states[current].accepts |= accepts;
+	}
+
+	/**
+	 * Adds every state reachable from `set` without consuming a character to it and sorts it.
+	 */
+	void closure(std::vector<int>& set) const {
+		std::vector<char> seen(states.size(), 0);
+		for (int s : set) {
+			seen[s] = 1;
+		}
+		for (std::size_t i = 0; i < set.size(); i++) {
+			int epsilon = states[set[i]].epsilon;
+			if (epsilon >= 0 && !seen[epsilon]) {
+				seen[epsilon] = 1;
+				set.push_back(epsilon);
+			}
+		}
+		std::sort(set.begin(), set.end());
+	}
+
+	void advance(const std::vector<int>& set, unsigned char c, std::vector<int>& next) const {
+		std::vector<char> seen(states.size(), 0);
+		next.clear();
+		for (int s : set) {
+			if (states[s].step[c] && !seen[states[s].next]) {
+				seen[states[s].next] = 1;
+				next.push_back(states[s].next);
+			}
+			if (states[s].stay[c] && !seen[s]) {
+				seen[s] = 1;
+				next.push_back(s);
+			}
+		}
+		closure(next);
+	}
+
+	uint8_t acceptsOf(const std::vector<int>& set) const {
+		uint8_t accepts = 0;
+		for (int s : set) {
+			accepts |= states[s].accepts;
+		}
+		return accepts;
+	}
+
+	void computeClasses() {
+		std::map<std::vector<bool>, uint8_t> classes;
+		for (unsigned c = 0; c < 256; c++) {
+			std::vector<bool> signature;
+			signature.reserve(states.size() * 2);
+			for (auto& state : states) {
+				signature.push_back(state.step[c]);
+				signature.push_back(state.stay[c]);
+			}
+			auto it = classes.insert(std::make_pair(signature, static_cast<uint8_t>(classes.size()))).first;
+			classOf[c] = it->second;
+		}
+		classCount = classes.size();
+	}
+
+	/**
+	 * Builds the deterministic automaton by subset construction, unless it has too many states.
+	 */
+	void determinize() {
+		std::vector<unsigned char> representatives(classCount);
+		for (unsigned c = 256; c-- > 0;) {
+			representatives[classOf[c]] = static_cast<unsigned char>(c);
+		}
+
+		std::vector<int> start = starts;
+		closure(start);
+		std::vector<std::vector<int>> sets{std::vector<int>(), start};
+		std::map<std::vector<int>, int> ids{{sets[0], DEAD}, {sets[1], START}};
+
+		std::vector<int> next;
+		for (std::size_t i = 0; i < sets.size(); i++) {
+			for (std::size_t c = 0; c < classCount; c++) {
+				advance(sets[i], representatives[c], next);
+				auto it = ids.find(next);
+				if (it == ids.end()) {
+					if (sets.size() == MAX_DFA_STATES) {
+						transitions.clear();
+						return;
+					}
+					it = ids.insert(std::make_pair(next, static_cast<int>(sets.size()))).first;
+					sets.push_back(next);
+				}
+				transitions.push_back(it->second);
+			}
+		}
+
+		for (auto& set : sets) {
+			accepting.push_back(acceptsOf(set));
+		}
+		deterministic = true;
+	}
+
+public:
+	/**
+	 * @param include Paths must match one of these patterns.
+	 * @param exclude Paths must not match any of these patterns.
+	 */
+	Glob(const std::vector<std::string>& include, const std::vector<std::string>& exclude = std::vector<std::string>()) {
+		for (auto& patterns : {std::make_pair(&include, INCLUDED), std::make_pair(&exclude, EXCLUDED)}) {
+			for (auto& pattern : *patterns.first) {
+				std::vector<std::string> expanded;
+				detail::expandBraces(pattern, expanded);
+				for (auto& alternative : expanded) {
+					addPattern(alternative, patterns.second);
+				}
+			}
+		}
+		computeClasses();
+		determinize();
+	}
+
+	bool matches(const char* path, std::size_t length) const {
+		if (deterministic) {
+			int state = START;
+			for (std::size_t i = 0; i < length && state != DEAD; i++) {
+				state = transitions[state * classCount + classOf[static_cast<unsigned char>(path[i])]];
+			}
+			return accepting[state] == INCLUDED;
+		}
+
+		std::vector<int> set = starts;
+		std::vector<int> next;
+		closure(set);
+		for (std::size_t i = 0; i < length && !set.empty(); i++) {
+			advance(set, static_cast<unsigned char>(path[i]), next);
+			set.swap(next);
+		}
+		return acceptsOf(set) == INCLUDED;
+	}
+
+	bool matches(const std::string& path) const {
+		return matches(path.data(), path.size());
+	}
+};
+
+const std::size_t Glob::MAX_DFA_STATES;
+const int Glob::DEAD;
+const int Glob::START;
+
+} // namespace io
+} // namespace cradle
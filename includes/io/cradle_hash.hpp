@@ -0,0 +1,222 @@
+/**
+ * @file cradle_hash.hpp
+ *
+ * @brief Fast, non-cryptographic hashing of file contents.
+ *
+ * The hash follows the structure of XXH3's long-input loop: 64 byte stripes are folded into eight 64-bit
+ * lanes with 32x32->64 bit multiplies, the lanes are scrambled every 1 KiB and merged at the end. The lane
+ * updates map directly onto SSE2 instructions, which are used when available; the scalar loop produces the
+ * same results. The output is not compatible with XXH3 and must only be compared with other hashes
+ * produced here.
+ */
+
+#pragma once
+
+#include <io/cradle_files.hpp>
+#include <platform/cradle_platform.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CRADLE_HASH_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace io {
+namespace detail {
+
+static const uint64_t HASH_PRIME32_1 = 0x9E3779B1u;
+static const uint64_t HASH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+static const uint64_t HASH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+
+static const std::size_t HASH_STRIPE_LENGTH = 64;
+static const std::size_t HASH_STRIPES_PER_BLOCK = 16;
+static const std::size_t HASH_SECRET_LENGTH = HASH_STRIPE_LENGTH + 8 * HASH_STRIPES_PER_BLOCK;
+
+/**
+ * Key material mixed into every stripe. Generated with SplitMix64 from a fixed seed.
+ */
+const unsigned char* hashSecret() {
+	struct Secret {
+		unsigned char bytes[HASH_SECRET_LENGTH];
+
+		Secret() {
+			uint64_t state = 0x6372616468656Cull;
+			for (std::size_t i = 0; i < HASH_SECRET_LENGTH; i += 8) {
+				uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				z ^= z >> 31;
+				std::memcpy(bytes + i, &z, 8);
+			}
+		}
+	};
+
+	static const Secret secret;
+	return secret.bytes;
+}
+
+inline uint64_t read64(const unsigned char* p) {
+	uint64_t value;
+	std::memcpy(&value, p, 8);
+	return value;
+}
+
+inline void accumulateStripe(uint64_t* acc, const unsigned char* input, const unsigned char* secret) {
+#ifdef CRADLE_HASH_SSE2
+	__m128i* xacc = reinterpret_cast<__m128i*>(acc);
+	for (int i = 0; i < 4; i++) {
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+		__m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+		__m128i dataKey = _mm_xor_si128(data, key);
+		__m128i dataKeyHigh = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product = _mm_mul_epu32(dataKey, dataKeyHigh);
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		xacc[i] = _mm_add_epi64(product, _mm_add_epi64(xacc[i], swapped));
+	}
+#else
+	for (int i = 0; i < 8; i++) {
+		uint64_t data = read64(input + 8 * i);
+		uint64_t dataKey = data ^ read64(secret + 8 * i);
+		acc[i ^ 1] += data;
+		acc[i] += (dataKey & 0xFFFFFFFFu) * (dataKey >> 32);
+	}
+#endif
+}
+
+inline void scramble(uint64_t* acc, const unsigned char* secret) {
+	for (int i = 0; i < 8; i++) {
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= read64(secret + 8 * i);
+		acc[i] *= HASH_PRIME32_1;
+	}
+}
+
+/**
+ * @return The xor of the high and low halves of the 128-bit product of `a` and `b`.
+ */
+inline uint64_t multiplyFold(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+	return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+	uint64_t aLow = a & 0xFFFFFFFFu, aHigh = a >> 32;
+	uint64_t bLow = b & 0xFFFFFFFFu, bHigh = b >> 32;
+	uint64_t lowLow = aLow * bLow;
+	uint64_t highLow = aHigh * bLow;
+	uint64_t lowHigh = aLow * bHigh;
+	uint64_t highHigh = aHigh * bHigh;
+	uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFFu) + lowHigh;
+	uint64_t high = highHigh + (highLow >> 32) + (cross >> 32);
+	uint64_t low = (cross << 32) | (lowLow & 0xFFFFFFFFu);
+	return low ^ high;
+#endif
+}
+
+inline uint64_t avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ull;
+	h ^= h >> 32;
+	return h;
+}
+
+} // namespace detail
+
+/**
+ * @return A 64-bit hash of `length` bytes starting at `data`.
+ */
+uint64_t hashBytes(const void* data, std::size_t length) {
+	using namespace detail;
+
+	const unsigned char* input = static_cast<const unsigned char*>(data);
+	const unsigned char* secret = hashSecret();
+
+	alignas(16) uint64_t acc[8] = {
+		HASH_PRIME32_1, HASH_PRIME64_1, HASH_PRIME64_2, HASH_PRIME64_1 ^ HASH_PRIME64_2,
+		HASH_PRIME64_2 + HASH_PRIME32_1, HASH_PRIME64_1 - HASH_PRIME32_1, HASH_PRIME64_2 ^ HASH_PRIME32_1, HASH_PRIME64_1 + HASH_PRIME64_2
+	};
+
+	std::size_t stripes = length / HASH_STRIPE_LENGTH;
+	for (std::size_t s = 0; s < stripes; s++) {
+		std::size_t stripeInBlock = s % HASH_STRIPES_PER_BLOCK;
+		accumulateStripe(acc, input + s * HASH_STRIPE_LENGTH, secret + 8 * stripeInBlock);
+		if (stripeInBlock == HASH_STRIPES_PER_BLOCK - 1) {
+			scramble(acc, secret + HASH_SECRET_LENGTH - HASH_STRIPE_LENGTH);
+		}
+	}
+
+	std::size_t remaining = length - stripes * HASH_STRIPE_LENGTH;
+	if (remaining > 0) {
+		unsigned char last[HASH_STRIPE_LENGTH] = {0};
+		std::memcpy(last, input + stripes * HASH_STRIPE_LENGTH, remaining);
+		accumulateStripe(acc, last, secret + 8 * (stripes % HASH_STRIPES_PER_BLOCK));
+	}
+
+	uint64_t result = static_cast<uint64_t>(length) * HASH_PRIME64_1;
+	for (int i = 0; i < 4; i++) {
+		result += multiplyFold(acc[2 * i] ^ read64(secret + 16 * i + 11), acc[2 * i + 1] ^ read64(secret + 16 * i + 19));
+	}
+	return avalanche(result);
+}
+
+/**
+ * Hashes the contents of a file. On POSIX platforms the file is memory mapped rather than copied.
+ *
+ * @return False if the file could not be read.
+ */
+bool hashFile(const std::string& path, uint64_t& hash) {
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat s;
+	if (fstat(fd, &s) != 0) {
+		close(fd);
+		return false;
+	}
+
+	std::size_t length = static_cast<std::size_t>(s.st_size);
+	if (length == 0) {
+		close(fd);
+		hash = hashBytes(nullptr, 0);
+		return true;
+	}
+
+	void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		std::string contents;
+		if (!read_file(path, contents)) {
+			return false;
+		}
+		hash = hashBytes(contents.data(), contents.size());
+		return true;
+	}
+
+	madvise(data, length, MADV_SEQUENTIAL);
+	hash = hashBytes(data, length);
+	munmap(data, length);
+	return true;
+#else
+	std::string contents;
+	if (!read_file(path, contents)) {
+		return false;
+	}
+	hash = hashBytes(contents.data(), contents.size());
+	return true;
+#endif
+}
+
+} // namespace io
+} // namespace cradle
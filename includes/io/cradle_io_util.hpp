@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cradle_build_log.hpp>
 #include <io/cradle_stat.hpp>
 #include <time.h>
 #include <vector>
@@ -7,20 +8,26 @@
 namespace cradle {
 namespace io {
 
+/**
+ * @return True if `targetFile` is missing or older than any of `files`. With `--content-hash`, files that are
+ *         newer but whose contents didn't change are ignored (see @ref BuildLog::isOlderThanInputs).
+ */
 bool isTargetLessRecentThanFiles(const std::string& targetFile, const std::vector<std::string>& files) {
-	if (!io::exists(targetFile)) {
-		return true;
+	if (buildLog().isContentHashing()) {
+		return buildLog().isOlderThanInputs(targetFile, files, false);
 	}
 
-	const struct stat targetFileStat = io::getStat(targetFile);
+	struct stat targetFileStat;
+	if (!io::tryGetStat(targetFile, targetFileStat)) {
+		return true;
+	}
 
 	for (auto& sourceFile : files) {
-		if (!io::exists(sourceFile)) {
+		struct stat sourceFileStat;
+		if (!io::tryGetStat(sourceFile, sourceFileStat)) {
 			return true;
 		}
 
-		const struct stat sourceFileStat = io::getStat(sourceFile);
-
 		if (difftime(targetFileStat.st_mtime, sourceFileStat.st_mtime) < 0) {
 			return true;
 		}
@@ -0,0 +1,301 @@
+/**
+ * @file cradle_json.hpp
+ *
+ * @brief A minimal JSON reader and writing helpers for the files produced and consumed by tools.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cradle {
+namespace json {
+
+class Value {
+public:
+	enum class Type {
+		NUL,
+		BOOLEAN,
+		NUMBER,
+		STRING,
+		ARRAY,
+		OBJECT
+	};
+
+private:
+	Type type_;
+	bool boolean_;
+	double number_;
+	std::string string_;
+	std::vector<Value> array_;
+	std::map<std::string, Value> object_;
+
+	static const Value& null() {
+		static const Value value;
+		return value;
+	}
+
+public:
+	Value() : type_(Type::NUL), boolean_(false), number_(0) {}
+	explicit Value(bool b) : type_(Type::BOOLEAN), boolean_(b), number_(0) {}
+	explicit Value(double n) : type_(Type::NUMBER), boolean_(false), number_(n) {}
+	explicit Value(std::string s) : type_(Type::STRING), boolean_(false), number_(0), string_(std::move(s)) {}
+	explicit Value(std::vector<Value> a) : type_(Type::ARRAY), boolean_(false), number_(0), array_(std::move(a)) {}
+	explicit Value(std::map<std::string, Value> o) : type_(Type::OBJECT), boolean_(false), number_(0), object_(std::move(o)) {}
+
+	Type type() const { return type_; }
+	bool isNull() const { return type_ == Type::NUL; }
+	bool isString() const { return type_ == Type::STRING; }
+	bool isNumber() const { return type_ == Type::NUMBER; }
+	bool isArray() const { return type_ == Type::ARRAY; }
+	bool isObject() const { return type_ == Type::OBJECT; }
+
+	bool asBool() const { return boolean_; }
+	double asNumber() const { return number_; }
+	const std::string& asString() const { return string_; }
+	const std::vector<Value>& asArray() const { return array_; }
+	const std::map<std::string, Value>& asObject() const { return object_; }
+
+	bool has(const std::string& key) const {
+		return object_.find(key) != object_.end();
+	}
+
+	/**
+	 * @return The member with the given key or a null value if this isn't an object with that key.
+	 */
+	const Value& operator[](const std::string& key) const {
+		auto it = object_.find(key);
+		return it == object_.end() ? null() : it->second;
+	}
+};
+
+namespace detail {
+
+class Parser {
+	const std::string& text;
+	std::size_t pos;
+
+	[[noreturn]] void error(const std::string& msg) {
+		throw std::runtime_error("Error parsing JSON at offset " + std::to_string(pos) + ": " + msg);
+	}
+
+	void skipWhitespace() {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+			pos++;
+		}
+	}
+
+	bool consume(const char* literal) {
+		std::size_t length = std::char_traits<char>::length(literal);
+		if (text.compare(pos, length, literal) == 0) {
+			pos += length;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char c) {
+		skipWhitespace();
+		if (pos >= text.size() || text[pos] != c) {
+			error(std::string("Expected '") + c + "'");
+		}
+		pos++;
+	}
+
+	static void appendUtf8(std::string& out, unsigned long codepoint) {
+		if (codepoint < 0x80) {
+			out += static_cast<char>(codepoint);
+		} else if (codepoint < 0x800) {
+			out += static_cast<char>(0xC0 | (codepoint >> 6));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		} else if (codepoint < 0x10000) {
+			out += static_cast<char>(0xE0 | (codepoint >> 12));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		} else {
+			out += static_cast<char>(0xF0 | (codepoint >> 18));
+			out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codepoint & 0x3F));
+		}
+	}
+
+	unsigned long parseHex4() {
+		if (pos + 4 > text.size()) {
+			error("Truncated unicode escape");
+		}
+		unsigned long value = std::strtoul(text.substr(pos, 4).c_str(), nullptr, 16);
+		pos += 4;
+		return value;
+	}
+
+	std::string parseString() {
+		expect('"');
+		std::string out;
+		while (true) {
+			if (pos >= text.size()) {
+				error("Unterminated string");
+			}
+
+			char c = text[pos++];
+			if (c == '"') {
+				return out;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+
+			if (pos >= text.size()) {
+				error("Unterminated escape");
+			}
+			switch (text[pos++]) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				unsigned long codepoint = parseHex4();
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u")) {
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (parseHex4() - 0xDC00);
+				}
+				appendUtf8(out, codepoint);
+				break;
+			}
+			default:
+				error("Invalid escape");
+			}
+		}
+	}
+
+	Value parseNumber() {
+		const char* begin = text.c_str() + pos;
+		char* end = nullptr;
+		double value = std::strtod(begin, &end);
+		if (end == begin) {
+			error("Invalid number");
+		}
+		pos += end - begin;
+		return Value(value);
+	}
+
+public:
+	Parser(const std::string& text) : text(text), pos(0) {}
+
+	Value parseValue() {
+		skipWhitespace();
+		if (pos >= text.size()) {
+			error("Unexpected end of input");
+		}
+
+		switch (text[pos]) {
+		case '{': {
+			pos++;
+			std::map<std::string, Value> members;
+			skipWhitespace();
+			if (pos < text.size() && text[pos] == '}') {
+				pos++;
+				return Value(std::move(members));
+			}
+			while (true) {
+				skipWhitespace();
+				std::string key = parseString();
+				expect(':');
+				members[key] = parseValue();
+				skipWhitespace();
+				if (pos < text.size() && text[pos] == ',') {
+					pos++;
+					continue;
+				}
+				expect('}');
+				return Value(std::move(members));
+			}
+		}
+		case '[': {
+			pos++;
+			std::vector<Value> elements;
+			skipWhitespace();
+			if (pos < text.size() && text[pos] == ']') {
+				pos++;
+				return Value(std::move(elements));
+			}
+			while (true) {
+				elements.push_back(parseValue());
+				skipWhitespace();
+				if (pos < text.size() && text[pos] == ',') {
+					pos++;
+					continue;
+				}
+				expect(']');
+				return Value(std::move(elements));
+			}
+		}
+		case '"':
+			return Value(parseString());
+		default:
+			if (consume("true")) return Value(true);
+			if (consume("false")) return Value(false);
+			if (consume("null")) return Value();
+			return parseNumber();
+		}
+	}
+
+	Value parseDocument() {
+		Value value = parseValue();
+		skipWhitespace();
+		if (pos != text.size()) {
+			error("Trailing characters");
+		}
+		return value;
+	}
+};
+
+} // namespace detail
+
+/**
+ * @throws std::runtime_error if `text` is not a valid JSON document.
+ */
+Value parse(const std::string& text) {
+	return detail::Parser(text).parseDocument();
+}
+
+/**
+ * @return `s` as a quoted JSON string.
+ */
+std::string quote(const std::string& s) {
+	static const char* hex = "0123456789abcdef";
+
+	std::string out;
+	out.reserve(s.size() + 2);
+	out += '"';
+	for (char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				out += "\\u00";
+				out += hex[(c >> 4) & 0xF];
+				out += hex[c & 0xF];
+			} else {
+				out += c;
+			}
+		}
+	}
+	out += '"';
+	return out;
+}
+
+} // namespace json
+} // namespace cradle
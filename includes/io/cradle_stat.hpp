@@ -10,28 +10,151 @@
 
 #include <platform/cradle_platform.hpp>
 #include <platform/cradle_platform_util.hpp>
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
+#include <ctime>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 namespace cradle {
 namespace io {
+namespace detail {
+
+/**
+ * Memoizes the results of `stat()` for the duration of a run. Entries must be invalidated whenever cradle
+ * writes to a path so that later up-to-date checks see the new state.
+ */
+class StatCache {
+	struct Entry {
+		int error;
+		struct stat result;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+	// Bumped by every invalidation so that a stat() which raced with one is not cached.
+	uint64_t generation = 0;
+
+public:
+	/**
+	 * @return 0 if `filepath` exists (and `result` was filled in), otherwise the `errno` from `stat()`.
+	 */
+	int lookup(const std::string& filepath, struct stat& result) {
+		uint64_t startGeneration;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = entries.find(filepath);
+			if (it != entries.end()) {
+				result = it->second.result;
+				return it->second.error;
+			}
+			startGeneration = generation;
+		}
+
+		Entry entry;
+		entry.error = stat(filepath.c_str(), &entry.result) == 0 ? 0 : errno;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (generation == startGeneration) {
+			entries[filepath] = entry;
+		}
+		result = entry.result;
+		return entry.error;
+	}
+
+	void invalidate(const std::string& filepath) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(filepath);
+		generation++;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		generation++;
+	}
+};
+
+StatCache& statCache() {
+	static StatCache cache;
+	return cache;
+}
+
+} // namespace detail
+
+/**
+ * @return True if `filepath` exists. On success `result` is filled in with its stats.
+ */
+bool tryGetStat(const std::string& filepath, struct stat& result) {
+	return detail::statCache().lookup(filepath, result) == 0;
+}
 
 bool exists(const std::string& filepath) {
 	struct stat result;
-	return stat(filepath.c_str(), &result) == 0;
+	return tryGetStat(filepath, result);
 }
 
 struct stat getStat(const std::string& filepath) {
 	struct stat result;
-	if (stat(filepath.c_str(), &result) == 0) {
+	int error = detail::statCache().lookup(filepath, result);
+	if (error == 0) {
 		return result;
 	} else {
-		throw std::runtime_error("Error getting stats for " + filepath + ": " + std::strerror(errno));
+		throw std::runtime_error("Error getting stats for " + filepath + ": " + std::strerror(error));
 	}
 }
 
+/**
+ * @return The modification time in nanoseconds (or the best resolution available on this platform).
+ */
+int64_t mtimeNanos(const struct stat& s) {
+#if defined(PLATFORM_MAC)
+	return static_cast<int64_t>(s.st_mtimespec.tv_sec) * 1000000000 + s.st_mtimespec.tv_nsec;
+#elif defined(PLATFORM_LINUX)
+	return static_cast<int64_t>(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+#else
+	return static_cast<int64_t>(s.st_mtime) * 1000000000;
+#endif
+}
+
+/**
+ * @return The current time on the clock file modification times are taken from, in the same unit as
+ *         @ref mtimeNanos. A file written after this call has an mtime at least as large as the result.
+ */
+int64_t fileClockNanos() {
+#if defined(PLATFORM_LINUX)
+	// The kernel stamps files with the coarse clock, which can lag behind CLOCK_REALTIME.
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME_COARSE, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#elif defined(PLATFORM_MAC)
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+	return static_cast<int64_t>(std::time(nullptr)) * 1000000000;
+#endif
+}
+
+/**
+ * Forget the cached stats of `filepath`. Must be called after writing to it.
+ */
+void invalidateStat(const std::string& filepath) {
+	detail::statCache().invalidate(filepath);
+}
+
+/**
+ * Forget all cached stats. Must be called after running commands that may write to unknown paths.
+ */
+void invalidateAllStats() {
+	detail::statCache().clear();
+}
+
 } // namespace io
 } // namespace cradle
@@ -0,0 +1,196 @@
+/**
+ * @file cradle_file_watcher.hpp
+ *
+ * @brief Reports changes to the files in a set of directories.
+ *
+ * Uses inotify on Linux. Directories are watched on their own rather than recursively, so each directory
+ * of interest must be added. Not supported on other platforms.
+ */
+
+#pragma once
+
+#include <platform/cradle_platform.hpp>
+
+#include <cerrno>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef PLATFORM_LINUX
+	#include <limits.h>
+	#include <poll.h>
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace platform {
+
+class FileWatcher {
+public:
+	struct Event {
+		enum class Kind {
+			// The file was written to or its attributes, such as its timestamp, changed.
+			MODIFIED,
+
+			// The file was created or moved into the directory.
+			CREATED,
+
+			// The file was deleted or moved out of the directory.
+			REMOVED
+		};
+
+		Kind kind;
+
+		// The directory as it was passed to @ref watch, and the name of the file in it.
+		std::string directory;
+		std::string name;
+
+		bool isDirectory;
+	};
+
+private:
+	int fd = -1;
+	std::unordered_map<int, std::string> directories;
+	std::unordered_map<std::string, int> watches;
+
+#ifdef PLATFORM_LINUX
+	/**
+	 * Reads the events that are queued without blocking.
+	 *
+	 * @return False if events were lost because the queue overflowed.
+	 */
+	bool readEvents(std::vector<Event>& events) {
+		alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+		bool complete = true;
+
+		while (true) {
+			ssize_t count = read(fd, buffer, sizeof(buffer));
+			if (count <= 0) {
+				return complete;
+			}
+
+			for (char* p = buffer; p < buffer + count; ) {
+				struct inotify_event* e = reinterpret_cast<struct inotify_event*>(p);
+				p += sizeof(struct inotify_event) + e->len;
+
+				if (e->mask & IN_Q_OVERFLOW) {
+					complete = false;
+					continue;
+				}
+
+				auto dir = directories.find(e->wd);
+				if (dir == directories.end() || e->len == 0) {
+					continue;
+				}
+
+				Event event;
+				event.directory = dir->second;
+				event.name = e->name;
+				event.isDirectory = (e->mask & IN_ISDIR) != 0;
+				if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+					event.kind = Event::Kind::CREATED;
+				} else if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					event.kind = Event::Kind::REMOVED;
+				} else {
+					event.kind = Event::Kind::MODIFIED;
+				}
+				events.push_back(event);
+			}
+		}
+	}
+#endif
+
+public:
+	FileWatcher() {
+#ifdef PLATFORM_LINUX
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher() {
+#ifdef PLATFORM_LINUX
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+
+	bool isSupported() const {
+		return fd >= 0;
+	}
+
+	bool isWatching(const std::string& directory) const {
+		return watches.find(directory) != watches.end();
+	}
+
+	/**
+	 * Starts reporting changes to the files directly in `directory`.
+	 *
+	 * @return False if the directory can't be watched, e.g. because it doesn't exist or the limit on the
+	 *         number of watches was reached.
+	 */
+	bool watch(const std::string& directory) {
+#ifdef PLATFORM_LINUX
+		if (fd < 0) {
+			return false;
+		}
+		if (isWatching(directory)) {
+			return true;
+		}
+
+		uint32_t mask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+		int wd = inotify_add_watch(fd, directory.empty() ? "." : directory.c_str(), mask | IN_ONLYDIR);
+		if (wd < 0) {
+			return false;
+		}
+		directories[wd] = directory;
+		watches[directory] = wd;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Blocks until a watched file changes, then keeps collecting changes until none have arrived for
+	 * `settleMillis` so that a file saved in several steps, or many files written at once, are reported
+	 * together.
+	 *
+	 * @param complete Set to false if events were lost, in which case anything may have changed.
+	 * @return False if waiting failed.
+	 */
+	bool wait(std::vector<Event>& events, bool& complete, int settleMillis = 50) {
+		events.clear();
+		complete = true;
+#ifdef PLATFORM_LINUX
+		int timeout = -1;
+		while (true) {
+			struct pollfd pfd = {fd, POLLIN, 0};
+			int ready = poll(&pfd, 1, timeout);
+			if (ready < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			if (ready == 0) {
+				return true;
+			}
+
+			complete = readEvents(events) && complete;
+			if (!events.empty() || !complete) {
+				timeout = settleMillis;
+			}
+		}
+#else
+		return false;
+#endif
+	}
+};
+
+} // namespace platform
+} // namespace cradle
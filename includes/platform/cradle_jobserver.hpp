@@ -0,0 +1,373 @@
+/**
+ * @file cradle_jobserver.hpp
+ *
+ * @brief Shares a pool of job slots with GNU make and other processes that implement its jobserver protocol.
+ *
+ * A jobserver is a pipe or named fifo holding one byte per job slot beyond the first. A process that wants
+ * to run a job reads a byte and writes it back once the job is done. Every process also owns one implicit
+ * slot which needs no byte.
+ *
+ * If `MAKEFLAGS` names a jobserver (`--jobserver-auth=R,W` for pipes, `--jobserver-auth=fifo:PATH` for
+ * fifos, or the older `--jobserver-fds=R,W`) cradle takes a slot for each process it runs. Otherwise, if
+ * the build launches commands through `exec` that may themselves be builds, cradle creates a jobserver with
+ * one slot per worker and exports it in `MAKEFLAGS` so nested cradle, make and ninja processes share its
+ * slots.
+ *
+ * Not supported on Windows, where make uses a named semaphore instead.
+ */
+
+#pragma once
+
+#include <platform/cradle_platform.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifndef PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace cradle {
+namespace platform {
+
+class JobServer {
+public:
+	enum class Style {
+		FIFO,
+		PIPE
+	};
+
+	/**
+	 * A slot taken with @ref acquire.
+	 */
+	struct Token {
+		enum class Kind {
+			NONE,
+			IMPLICIT,
+			BYTE
+		};
+
+		Kind kind;
+		char byte;
+	};
+
+private:
+	// Both are -1 if there is no jobserver.
+	int readFd = -1;
+	int writeFd = -1;
+
+	// The pipe exported to child processes by @ref serve with `Style::PIPE`.
+	int inheritedFds[2] = {-1, -1};
+
+	// Written to when the implicit slot is released to wake threads waiting for a slot.
+	int wakeFds[2] = {-1, -1};
+
+	std::mutex mutex;
+	bool implicitFree = true;
+	bool serverRequested = false;
+	unsigned parentJobs = 0;
+
+	// The fifo and the directory holding it if this process created the jobserver.
+	std::string fifoPath;
+	std::string fifoDir;
+
+	// `MAKEFLAGS` before @ref serve exported the jobserver, if it did.
+	bool served = false;
+	bool hadMakeflags = false;
+	std::string inheritedMakeflags;
+
+#ifndef PLATFORM_WINDOWS
+	static std::string findFlag(const std::string& makeflags, const std::string& flag) {
+		std::size_t pos = makeflags.rfind(flag);
+		if (pos == std::string::npos) {
+			return "";
+		}
+		pos += flag.size();
+		return makeflags.substr(pos, makeflags.find(' ', pos) - pos);
+	}
+
+	/**
+	 * Opens our own non-blocking description of the pipe that `fd` refers to so that setting `O_NONBLOCK`
+	 * doesn't affect the other processes using it.
+	 */
+	static int reopen(int fd, int flags) {
+		if (fcntl(fd, F_GETFD) < 0) {
+			// Make didn't pass the descriptors on, e.g. because the command wasn't marked with `+`.
+			return -1;
+		}
+		std::string path = "/proc/self/fd/" + std::to_string(fd);
+		int reopened = open(path.c_str(), flags | O_NONBLOCK | O_CLOEXEC);
+		return reopened >= 0 ? reopened : -1;
+	}
+
+	bool startWaking() {
+		return pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) == 0;
+	}
+#endif
+
+public:
+	JobServer() {}
+	JobServer(const JobServer&) = delete;
+	JobServer& operator=(const JobServer&) = delete;
+
+	~JobServer() {
+		stop();
+	}
+
+	/**
+	 * Leaves the jobserver. If this process created it, it is removed and `MAKEFLAGS` is restored, e.g.
+	 * before cradle replaces itself with a new process.
+	 */
+	void stop() {
+#ifndef PLATFORM_WINDOWS
+		for (int* fd : {&readFd, &writeFd, &wakeFds[0], &wakeFds[1], &inheritedFds[0], &inheritedFds[1]}) {
+			if (*fd >= 0) {
+				close(*fd);
+				*fd = -1;
+			}
+		}
+		if (!fifoPath.empty()) {
+			unlink(fifoPath.c_str());
+			rmdir(fifoDir.c_str());
+			fifoPath.clear();
+		}
+		if (served) {
+			if (hadMakeflags) {
+				setenv("MAKEFLAGS", inheritedMakeflags.c_str(), 1);
+			} else {
+				unsetenv("MAKEFLAGS");
+			}
+			served = false;
+		}
+#endif
+	}
+
+	bool isActive() const {
+		return readFd >= 0;
+	}
+
+	/**
+	 * @return The `-j` value of the parent make, or 0 if it wasn't given.
+	 */
+	unsigned parentJobCount() const {
+		return parentJobs;
+	}
+
+	/**
+	 * Asks for a jobserver to be created by @ref serve because commands may run nested builds.
+	 */
+	void requestServer() {
+		std::lock_guard<std::mutex> lock(mutex);
+		serverRequested = true;
+	}
+
+	bool isServerRequested() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return serverRequested;
+	}
+
+	/**
+	 * Joins the jobserver described by `makeflags`, the value of `MAKEFLAGS`.
+	 *
+	 * @return False if it doesn't describe one or it can't be opened.
+	 */
+	bool connect(const std::string& makeflags) {
+#ifdef PLATFORM_WINDOWS
+		return false;
+#else
+		std::string jobs = findFlag(makeflags, " -j");
+		if (jobs.empty() && makeflags.compare(0, 2, "-j") == 0) {
+			jobs = findFlag(" " + makeflags, " -j");
+		}
+		parentJobs = static_cast<unsigned>(std::strtoul(jobs.c_str(), nullptr, 10));
+
+		std::string auth = findFlag(makeflags, "--jobserver-auth=");
+		if (auth.empty()) {
+			auth = findFlag(makeflags, "--jobserver-fds=");
+		}
+		if (auth.empty()) {
+			return false;
+		}
+
+		if (auth.compare(0, 5, "fifo:") == 0) {
+			readFd = open(auth.substr(5).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+			writeFd = readFd >= 0 ? fcntl(readFd, F_DUPFD_CLOEXEC, 0) : -1;
+		} else {
+			std::size_t comma = auth.find(',');
+			if (comma == std::string::npos) {
+				return false;
+			}
+			int parentRead = std::atoi(auth.substr(0, comma).c_str());
+			int parentWrite = std::atoi(auth.substr(comma + 1).c_str());
+			readFd = reopen(parentRead, O_RDONLY);
+			writeFd = readFd >= 0 && fcntl(parentWrite, F_GETFD) >= 0 ? parentWrite : -1;
+		}
+
+		if (readFd < 0 || writeFd < 0 || !startWaking()) {
+			if (readFd >= 0) {
+				close(readFd);
+			}
+			readFd = writeFd = -1;
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	/**
+	 * Creates a jobserver with `jobs` slots and exports it to child processes through `MAKEFLAGS`. Must be
+	 * called before any threads are started since it changes the environment.
+	 *
+	 * @param style `Style::FIFO` is understood by make 4.4 and later and by ninja. `Style::PIPE` is also
+	 *              understood by older versions of make but leaves the pipe open in every child process.
+	 * @return False if the jobserver couldn't be created.
+	 */
+	bool serve(unsigned jobs, Style style = Style::FIFO) {
+#ifdef PLATFORM_WINDOWS
+		return false;
+#else
+		std::string auth;
+		if (style == Style::FIFO) {
+			const char* tmp = std::getenv("TMPDIR");
+			std::string pattern = std::string(tmp != nullptr && *tmp != '\0' ? tmp : "/tmp") + "/cradle-jobserver-XXXXXX";
+			if (mkdtemp(&pattern[0]) == nullptr) {
+				return false;
+			}
+			fifoDir = pattern;
+			fifoPath = fifoDir + "/fifo";
+
+			if (mkfifo(fifoPath.c_str(), 0600) != 0) {
+				rmdir(fifoDir.c_str());
+				fifoPath.clear();
+				return false;
+			}
+
+			readFd = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+			writeFd = readFd >= 0 ? fcntl(readFd, F_DUPFD_CLOEXEC, 0) : -1;
+			auth = "fifo:" + fifoPath;
+		} else {
+			// Children inherit these descriptors, so they are not close-on-exec.
+			if (pipe(inheritedFds) != 0) {
+				return false;
+			}
+			readFd = reopen(inheritedFds[0], O_RDONLY);
+			writeFd = fcntl(inheritedFds[1], F_DUPFD_CLOEXEC, 0);
+			auth = std::to_string(inheritedFds[0]) + "," + std::to_string(inheritedFds[1]);
+		}
+
+		std::string tokens(jobs > 1 ? jobs - 1 : 0, '+');
+		if (
+			readFd < 0 || writeFd < 0 || !startWaking() ||
+			(!tokens.empty() && write(writeFd, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+		) {
+			// Run without a jobserver rather than with one nobody else can use.
+			if (readFd >= 0) {
+				close(readFd);
+			}
+			readFd = -1;
+			return false;
+		}
+
+		const char* inherited = std::getenv("MAKEFLAGS");
+		hadMakeflags = inherited != nullptr;
+		inheritedMakeflags = hadMakeflags ? inherited : "";
+		served = true;
+
+		std::string makeflags = hadMakeflags ? inheritedMakeflags + " " : "";
+		makeflags += "-j" + std::to_string(jobs) + " --jobserver-auth=" + auth;
+		setenv("MAKEFLAGS", makeflags.c_str(), 1);
+		return true;
+#endif
+	}
+
+	/**
+	 * Blocks until a job slot is available. Returns immediately if there is no jobserver.
+	 */
+	Token acquire() {
+		Token token = {Token::Kind::NONE, 0};
+#ifndef PLATFORM_WINDOWS
+		if (!isActive()) {
+			return token;
+		}
+
+		while (true) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (implicitFree) {
+					implicitFree = false;
+					token.kind = Token::Kind::IMPLICIT;
+					return token;
+				}
+			}
+
+			ssize_t count = read(readFd, &token.byte, 1);
+			if (count == 1) {
+				token.kind = Token::Kind::BYTE;
+				return token;
+			}
+			if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+				// The jobserver is gone so don't limit jobs at all.
+				return token;
+			}
+
+			struct pollfd fds[2] = {{readFd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+			if (poll(fds, 2, -1) > 0 && fds[1].revents != 0) {
+				char drain[16];
+				while (read(wakeFds[0], drain, sizeof(drain)) > 0) {}
+			}
+		}
+#else
+		return token;
+#endif
+	}
+
+	void release(const Token& token) {
+#ifndef PLATFORM_WINDOWS
+		if (token.kind == Token::Kind::BYTE) {
+			while (write(writeFd, &token.byte, 1) < 0 && errno == EINTR) {}
+		} else if (token.kind == Token::Kind::IMPLICIT) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				implicitFree = true;
+			}
+			char wake = 0;
+			if (write(wakeFds[1], &wake, 1) < 0) {
+				// The pipe is full so waiters will wake anyway.
+			}
+		}
+#endif
+	}
+};
+
+/**
+ * @return The jobserver shared by every task in this run.
+ */
+JobServer& jobServer() {
+	static JobServer instance;
+	return instance;
+}
+
+/**
+ * Holds a job slot for as long as it exists.
+ */
+class JobSlot {
+	JobServer::Token token;
+
+public:
+	JobSlot() : token(jobServer().acquire()) {}
+	JobSlot(const JobSlot&) = delete;
+	JobSlot& operator=(const JobSlot&) = delete;
+
+	~JobSlot() {
+		jobServer().release(token);
+	}
+};
+
+} // namespace platform
+} // namespace cradle
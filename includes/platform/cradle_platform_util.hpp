@@ -2,17 +2,24 @@
 
 #include <platform/cradle_platform.hpp>
 
+#include <cstdlib>
 #include <memory>
 #include <string>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <cstdio>
+
 #ifdef PLATFORM_LINUX
 	#include <unistd.h>
+	#include <utime.h>
 #endif
 
 #ifdef PLATFORM_WINDOWS
 	#include <direct.h>
+	#include <process.h>
+	#include <sys/utime.h>
+	#include <windows.h>
 	#define stat _stat
 #endif
 
@@ -27,6 +34,39 @@ int platform_mkdir(const char * const str) {
 	return _mkdir(str);
 }
 
+/**
+ * Atomically replaces `to` with `from`.
+ *
+ * @return 0 on success.
+ */
+int platform_rename(const std::string& from, const std::string& to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
+
+int platform_getpid() {
+	return _getpid();
+}
+
+std::string platform_hostname() {
+	char name[MAX_COMPUTERNAME_LENGTH + 1];
+	DWORD size = sizeof(name);
+	return GetComputerNameA(name, &size) ? std::string(name, size) : std::string("localhost");
+}
+
+/**
+ * Sets the access and modification times of `path` to now.
+ *
+ * @return 0 on success.
+ */
+int platform_touch(const std::string& path) {
+	return _utime(path.c_str(), nullptr);
+}
+
+std::string platform_getcwd() {
+	char dir[MAX_PATH];
+	return _getcwd(dir, sizeof(dir)) != nullptr ? std::string(dir) : std::string(".");
+}
+
 #else
 
 #define PATH_SEP ('/')
@@ -35,11 +75,83 @@ int platform_mkdir(const char * const str) {
 	return mkdir(str, 0744);
 }
 
+/**
+ * Atomically replaces `to` with `from`.
+ *
+ * @return 0 on success.
+ */
+int platform_rename(const std::string& from, const std::string& to) {
+	return std::rename(from.c_str(), to.c_str());
+}
+
+int platform_getpid() {
+	return static_cast<int>(getpid());
+}
+
+std::string platform_hostname() {
+	char name[256] = {};
+	return gethostname(name, sizeof(name) - 1) == 0 ? std::string(name) : std::string("localhost");
+}
+
+/**
+ * Sets the access and modification times of `path` to now.
+ *
+ * @return 0 on success.
+ */
+int platform_touch(const std::string& path) {
+	return utime(path.c_str(), nullptr);
+}
+
+std::string platform_getcwd() {
+	char dir[4096];
+	return getcwd(dir, sizeof(dir)) != nullptr ? std::string(dir) : std::string(".");
+}
+
 #endif
 
 int platform_chdir(const std::string& str) {
 	return chdir(str.c_str());
 }
 
+/**
+ * @return The path of the executable `program` found in the directories listed in `PATH`, or an empty string
+ *         if it isn't installed.
+ */
+std::string platform_which(const std::string& program) {
+	const char* path = std::getenv("PATH");
+	if (path == nullptr) {
+		return "";
+	}
+
+#ifdef PLATFORM_WINDOWS
+	const char separator = ';';
+	std::string name = program.size() > 4 && program.compare(program.size() - 4, 4, ".exe") == 0 ? program : program + ".exe";
+#else
+	const char separator = ':';
+	const std::string& name = program;
+#endif
+
+	std::string dirs(path);
+	std::size_t start = 0;
+	while (start <= dirs.size()) {
+		std::size_t end = dirs.find(separator, start);
+		if (end == std::string::npos) {
+			end = dirs.size();
+		}
+
+		std::string candidate = (end > start ? dirs.substr(start, end - start) : std::string(".")) + PATH_SEP + name;
+		struct stat s;
+		bool found = stat(candidate.c_str(), &s) == 0 && (s.st_mode & S_IFMT) == S_IFREG;
+#ifndef PLATFORM_WINDOWS
+		found = found && access(candidate.c_str(), X_OK) == 0;
+#endif
+		if (found) {
+			return candidate;
+		}
+		start = end + 1;
+	}
+	return "";
+}
+
 }
 }
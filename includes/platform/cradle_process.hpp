@@ -0,0 +1,374 @@
+/**
+ * @file cradle_process.hpp
+ *
+ * @brief Runs child processes without going through `system()`.
+ *
+ * On POSIX platforms processes are started with `posix_spawnp`, which avoids copying the page tables of a
+ * large cradle process and doesn't need a shell for simple commands. The working directory is changed in
+ * the child only, so processes with different working directories can run concurrently. Output is
+ * collected through pipes so that the output of concurrent processes isn't interleaved, and the exit
+ * status and resource usage are reported with `wait4`.
+ *
+ * On Windows commands are run through `_popen`, which uses the shell.
+ */
+
+#pragma once
+
+#include <platform/cradle_platform.hpp>
+
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <spawn.h>
+	#include <sys/resource.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+
+	extern char** environ;
+
+	// posix_spawn_file_actions_addchdir_np was added in glibc 2.29.
+	#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+		#define CRADLE_SPAWN_ADDCHDIR
+	#endif
+#endif
+
+namespace cradle {
+namespace platform {
+
+struct ProcessOptions {
+	// The directory the process runs in. Empty to use the current directory.
+	std::string workingDirectory;
+
+	// Collect standard output and error into the result instead of passing them through.
+	bool captureOutput = true;
+};
+
+struct ProcessResult {
+	// False if the process couldn't be started, in which case `error` says why.
+	bool started = false;
+	std::string error;
+
+	int exitCode = -1;
+
+	// The signal that terminated the process or 0.
+	int signal = 0;
+
+	std::string output;
+	std::string errors;
+
+	double wallSeconds = 0;
+	double userSeconds = 0;
+	double systemSeconds = 0;
+
+	// Peak resident set size in kilobytes. Not available on Windows.
+	long maxResidentKb = 0;
+
+	bool succeeded() const {
+		return started && signal == 0 && exitCode == 0;
+	}
+};
+
+/**
+ * Splits a command line into arguments like a POSIX shell does for simple commands: unquoted whitespace
+ * separates arguments, and single quotes, double quotes and backslashes are removed after grouping and
+ * escaping.
+ *
+ * @param needsShell Set to true if the command uses other shell features, such as pipes, redirection,
+ *                   variables or globs, and must be run by a shell.
+ */
+std::vector<std::string> splitCommandLine(const std::string& cmd, bool& needsShell) {
+	static const char* SHELL_CHARACTERS = "|&;<>()$`*?[]~{}#\n";
+
+	std::vector<std::string> args;
+	std::string word;
+	bool inWord = false;
+	needsShell = false;
+
+	for (std::size_t i = 0; i < cmd.size(); i++) {
+		char c = cmd[i];
+
+		if (c == ' ' || c == '\t') {
+			if (inWord) {
+				args.push_back(word);
+				word.clear();
+				inWord = false;
+			}
+			continue;
+		}
+
+		inWord = true;
+		if (c == '\'') {
+			std::size_t end = cmd.find('\'', i + 1);
+			if (end == std::string::npos) {
+				needsShell = true;
+				end = cmd.size();
+			}
+			word.append(cmd, i + 1, end - i - 1);
+			i = end;
+		} else if (c == '"') {
+			for (i++; i < cmd.size() && cmd[i] != '"'; i++) {
+				if (cmd[i] == '\\' && i + 1 < cmd.size() && std::strchr("\"\\$`", cmd[i + 1]) != nullptr) {
+					word += cmd[++i];
+				} else {
+					if (cmd[i] == '$' || cmd[i] == '`') {
+						needsShell = true;
+					}
+					word += cmd[i];
+				}
+			}
+			if (i == cmd.size()) {
+				needsShell = true;
+			}
+		} else if (c == '\\' && i + 1 < cmd.size()) {
+			word += cmd[++i];
+		} else {
+			if (std::strchr(SHELL_CHARACTERS, c) != nullptr) {
+				needsShell = true;
+			}
+			word += c;
+		}
+	}
+	if (inWord) {
+		args.push_back(word);
+	}
+
+	// Variable assignments before the command.
+	if (!args.empty() && args[0].find('=') != std::string::npos) {
+		needsShell = true;
+	}
+	return args;
+}
+
+/**
+ * @return The arguments to run `cmd` with, using the shell only if it is needed.
+ */
+std::vector<std::string> commandArgs(const std::string& cmd) {
+#ifdef PLATFORM_WINDOWS
+	return {cmd};
+#else
+	bool needsShell;
+	std::vector<std::string> args = splitCommandLine(cmd, needsShell);
+	if (needsShell) {
+		return {"/bin/sh", "-c", cmd};
+	}
+	return args;
+#endif
+}
+
+#ifdef PLATFORM_WINDOWS
+
+ProcessResult runProcess(const std::vector<std::string>& args, const ProcessOptions& options = ProcessOptions()) {
+	ProcessResult result;
+	auto start = std::chrono::steady_clock::now();
+
+	std::string cmd;
+	for (auto& arg : args) {
+		if (!cmd.empty()) {
+			cmd += " ";
+		}
+		cmd += args.size() > 1 && arg.find(' ') != std::string::npos ? "\"" + arg + "\"" : arg;
+	}
+	if (!options.workingDirectory.empty()) {
+		cmd = "cd /d \"" + options.workingDirectory + "\" && " + cmd;
+	}
+
+	if (!options.captureOutput) {
+		result.started = true;
+		result.exitCode = system(cmd.c_str());
+	} else {
+		FILE* pipe = _popen((cmd + " 2>&1").c_str(), "r");
+		if (pipe == nullptr) {
+			result.error = strerror(errno);
+			return result;
+		}
+
+		char buffer[4096];
+		std::size_t count;
+		while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+			result.output.append(buffer, count);
+		}
+		result.started = true;
+		result.exitCode = _pclose(pipe);
+	}
+
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+#else
+
+namespace detail {
+
+/**
+ * Reads from `outFd` and `errFd` until both are closed. Both are read concurrently so that a process
+ * blocked writing to one pipe can't deadlock with cradle waiting on the other.
+ */
+void readPipes(int outFd, int errFd, std::string& output, std::string& errors) {
+	struct pollfd fds[2] = {{outFd, POLLIN, 0}, {errFd, POLLIN, 0}};
+	std::string* buffers[2] = {&output, &errors};
+
+	int open = 2;
+	char buffer[16384];
+	while (open > 0) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].fd < 0 || fds[i].revents == 0) {
+				continue;
+			}
+
+			ssize_t count = read(fds[i].fd, buffer, sizeof(buffer));
+			if (count > 0) {
+				buffers[i]->append(buffer, static_cast<std::size_t>(count));
+			} else if (count == 0 || errno != EINTR) {
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				open--;
+			}
+		}
+	}
+
+	for (auto& fd : fds) {
+		if (fd.fd >= 0) {
+			close(fd.fd);
+		}
+	}
+}
+
+/**
+ * Starts `argv` with its standard output and error redirected to `outFd` and `errFd` if they are not -1.
+ *
+ * @return 0 or the `errno` value describing why the process couldn't be started.
+ */
+int spawn(pid_t& pid, std::vector<char*>& argv, const std::string& workingDirectory, int outFd, int errFd) {
+#if defined(CRADLE_SPAWN_ADDCHDIR)
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (outFd >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, errFd, STDERR_FILENO);
+	}
+	if (!workingDirectory.empty()) {
+		posix_spawn_file_actions_addchdir_np(&actions, workingDirectory.c_str());
+	}
+
+	int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	return error;
+#else
+	// Without a way to change the child's directory through posix_spawn, fork and change it by hand.
+	pid = fork();
+	if (pid < 0) {
+		return errno;
+	}
+	if (pid == 0) {
+		if (outFd >= 0) {
+			dup2(outFd, STDOUT_FILENO);
+			dup2(errFd, STDERR_FILENO);
+		}
+		if (!workingDirectory.empty() && chdir(workingDirectory.c_str()) != 0) {
+			_exit(127);
+		}
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	return 0;
+#endif
+}
+
+} // namespace detail
+
+/**
+ * Runs `args[0]`, searched for in `PATH`, with the arguments `args` and waits for it to finish.
+ */
+ProcessResult runProcess(const std::vector<std::string>& args, const ProcessOptions& options = ProcessOptions()) {
+	ProcessResult result;
+	if (args.empty()) {
+		result.error = "Empty command";
+		return result;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<char*> argv;
+	argv.reserve(args.size() + 1);
+	for (auto& arg : args) {
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	// The pipes are close-on-exec so that processes spawned concurrently by other threads don't inherit
+	// them and keep them open.
+	int outPipe[2] = {-1, -1};
+	int errPipe[2] = {-1, -1};
+	if (options.captureOutput) {
+		if (pipe2(outPipe, O_CLOEXEC) != 0) {
+			result.error = strerror(errno);
+			return result;
+		}
+		if (pipe2(errPipe, O_CLOEXEC) != 0) {
+			result.error = strerror(errno);
+			close(outPipe[0]);
+			close(outPipe[1]);
+			return result;
+		}
+	}
+
+	pid_t pid;
+	int error = detail::spawn(pid, argv, options.workingDirectory, outPipe[1], errPipe[1]);
+	if (options.captureOutput) {
+		close(outPipe[1]);
+		close(errPipe[1]);
+	}
+	if (error != 0) {
+		result.error = strerror(error);
+		if (options.captureOutput) {
+			close(outPipe[0]);
+			close(errPipe[0]);
+		}
+		return result;
+	}
+	result.started = true;
+
+	if (options.captureOutput) {
+		detail::readPipes(outPipe[0], errPipe[0], result.output, result.errors);
+	}
+
+	int status = 0;
+	struct rusage usage;
+	std::memset(&usage, 0, sizeof(usage));
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			result.error = strerror(errno);
+			return result;
+		}
+	}
+
+	if (WIFEXITED(status)) {
+		result.exitCode = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		result.signal = WTERMSIG(status);
+	}
+
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	result.systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	result.maxResidentKb = usage.ru_maxrss;
+	return result;
+}
+
+#endif
+
+} // namespace platform
+} // namespace cradle
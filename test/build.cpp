@@ -2,9 +2,37 @@
 
 using namespace cradle;
 
+struct ListBuilder {
+	builder::StrListFromTask<ListBuilder> items{this, "items"};
+};
+
+bool hasItems(task_p t, std::vector<std::string> expected) {
+	if (t->getList("items") == expected) {
+		return true;
+	}
+	log_error("Unexpected items in " + t->addr());
+	return false;
+}
+
+bool hasFiles(task_p t, std::vector<std::string> expected) {
+	std::vector<std::string> found = t->getList(io::FILE_LIST);
+	std::sort(found.begin(), found.end());
+	if (found == expected) {
+		return true;
+	}
+
+	std::string listed;
+	for (auto& file : found) {
+		listed += " " + file;
+	}
+	log_error("Unexpected files listed by " + t->addr() + ":" + listed);
+	return false;
+}
+
 build_config {
 	auto chain = task()
 			.name("chain")
+			.markTracked()
 			.first([] (Task *self) {
 				self->set("greeting", "Hello, World!");
 				return ExecutionResult::SUCCESS;
@@ -15,6 +43,43 @@ build_config {
 			})
 			.build();
 
+	// Values added to a copy of a builder, or after its value was used, must not change what was built.
+	ListBuilder base;
+	base.items("base");
+	ListBuilder a = base;
+	a.items("a");
+	task_p builtA = a.items;
+	a.items("after");
+	ListBuilder b = base;
+	b.items("b");
+	task_p builtB = b.items;
+	task_p builtBase = base.items;
+
+	auto builderCopy = tracked(task("builder_copy", [=] (Task*) {
+		bool ok =
+			hasItems(builtA, {"base", "a"}) &&
+			hasItems(builtB, {"base", "b"}) &&
+			hasItems(builtBase, {"base"});
+		return ok ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+	}));
+	builderCopy->dependsOn({builtA, builtB, builtBase});
+
+	// Brace sets, `**`, character classes and exclude patterns.
+	task_p braces = io::glob("lib", {"*.{cpp,hpp}"});
+	task_p recursive = io::glob(".", {"**/*.cpp"}, {"build/**", "shared/**"});
+	task_p negated = io::glob("lib", {"*.[!h]pp"});
+	task_p excluded = io::glob("lib", {"**"}, {"*.hpp"});
+
+	auto globs = tracked(task("globs", [=] (Task*) {
+		bool ok =
+			hasFiles(braces, {"lib/Hello.cpp", "lib/Hello.hpp"}) &&
+			hasFiles(recursive, {"./build.cpp", "./lib/Hello.cpp", "./main/main.cpp"}) &&
+			hasFiles(negated, {"lib/Hello.cpp"}) &&
+			hasFiles(excluded, {"lib/Hello.cpp"});
+		return ok ? ExecutionResult::SUCCESS : ExecutionResult::FAILURE;
+	}));
+	globs->dependsOn({braces, recursive, negated, excluded});
+
 	auto conan = conan::conan_install()
 			.name("conan")
 			.pathToConanfile(".")
@@ -39,4 +104,34 @@ build_config {
 			.build();
 
 	exe->dependsOn(chain);
+	exe->dependsOn(builderCopy);
+	exe->dependsOn(globs);
+
+	// Programs depend on the interface file of the shared libraries they link against. DLLs don't have one.
+	if (!platform::os::is_windows()) {
+		auto shared = cpp::shared_lib()
+				.name("greeting")
+				.sourceFiles(io::FILE_LIST, io::glob("shared", {"*.cpp"}, {"main.cpp"}))
+				.includeSearchDirs({"."})
+				.build();
+
+		auto sharedExe = cpp::exe()
+				.name("shared_exec")
+				.sourceFiles(io::FILE_LIST, io::glob("shared", {"main.cpp"}))
+				.includeSearchDirs({"."})
+				.linkLibrary(cpp::LIBRARY_NAME, shared)
+				.linklibrarySearchPath(cpp::LIBRARY_PATH, shared)
+				.build();
+
+		auto sharedInterface = tracked(task("shared_interface", [=] (Task*) {
+			std::string contents;
+			if (!io::read_file(shared->get(cpp::OUTPUT_FILE) + ".toc", contents) || contents.find("greeting") == std::string::npos) {
+				log_error("No interface file listing greeting() for " + shared->get(cpp::OUTPUT_FILE));
+				return ExecutionResult::FAILURE;
+			}
+			return ExecutionResult::SUCCESS;
+		}));
+		sharedInterface->dependsOn(sharedExe);
+		exe->dependsOn(sharedInterface);
+	}
 }
@@ -0,0 +1,6 @@
+#include "Greeting.hpp"
+
+const char* greeting()
+{
+	return "Hello from a shared library!";
+}
@@ -0,0 +1,6 @@
+#ifndef GREETING_HPP
+#define GREETING_HPP
+
+const char* greeting();
+
+#endif // GREETING_HPP
@@ -0,0 +1,8 @@
+#include "shared/Greeting.hpp"
+
+#include <stdio.h>
+
+int main(int argc, char* argv[]) {
+	printf("%s\n", greeting());
+	return 0;
+}